@@ -0,0 +1,28 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* BakedSymbols.h
+* GENERATED by tools/bake_symbols.py from the .bin files in symtab/ - do not edit
+*/
+
+#ifndef _BAKEDSYMBOLS_H_
+#define _BAKEDSYMBOLS_H_
+
+#include <Arduino.h>
+
+struct BakedSymbolTable   //symbol table of one firmware version, stored in flash
+{
+	uint32_t firmware;
+	const byte *dump;        //raw symbol table dump
+	uint16_t len;            //length of the dump
+	uint16_t count;          //number of symbols
+	const uint16_t *offset;  //key -> position of the name in the dump
+	const uint16_t *sorted;  //keys in ascending strcmp() order of their names
+};
+
+const BakedSymbolTable baked_symtabs[] =
+{
+	{ 0x00000000, nullptr, 0, 0, nullptr, nullptr }  //end marker
+};
+
+#endif
@@ -8,8 +8,10 @@
 
 #include <Arduino.h>
 #include "Globals.h"
+#include "BakedSymbols.h"  //generated by tools/bake_symbols.py
 #include <stddef.h>
 #include <string.h>
+#include <algorithm>
 
 //Normal TRACE/DEBUG
 #define TRACE_THR30IIPEDAL(x) x
@@ -19,47 +21,225 @@
 //#define TRACE_V_THR30IIPEDAL(x)	x
 #define TRACE_V_THR30IIPEDAL(x)
 
-void Constants::set_all(const byte* buf)
+bool Constants::set_all(byte* buf, size_t len)
 {
-  uint32_t vals = *((uint32_t*) buf);       //how many values are in the symbol table
-  uint32_t len =  *((uint32_t*) (buf+4));   //how many bytes build the symbol table
+  int heapBefore = freeMemory();
+  uint32_t t0 = micros();
+
+  bool ok = glo.adopt(buf, len);  //buffer belongs to the symbol table from now on
+  generation++;
 
-  TRACE_THR30IIPEDAL(Serial.printf("%d symbols found.\n\r",vals);
-                      Serial.printf("%d file length.\n\r",len);
+  uint32_t t1 = micros();
+
+  TRACE_THR30IIPEDAL(Serial.printf("%d symbols found.\n\r",glo.size());
+                     Serial.printf("%d file length.\n\r",(int)len);
+                     Serial.printf("Symbol table: %d bytes heap (%d bytes free memory used), built in %lu us\n\r",
+                                    (int)glo.heapUsage(), heapBefore - freeMemory(), t1 - t0);
                     )
-  int symStart = (int)(12 * vals + 8);   //Where is the start of the symbol names?    
-  
-  TRACE_THR30IIPEDAL(Serial.printf("Start of symbols: %d\n\r"+symStart);)
-  
-  // print out for analysis only
-  // char tmp[60];
-
-  // for(uint16_t i =0; i < len; i++ )
-  // {
-  //     if(i %16==0)
-  //     {
-  //         sprintf(tmp,"\r\n%04X : ",i);
-  //     }
-  //     Serial.print(tmp);
-  //     sprintf(tmp,"%02X ",buf[i]);
-  //     Serial.print(tmp);
-  // }
-
-  Serial.println();
-  glo.clear();
-
-  char *beg= (char*) (buf+symStart);
-  char *p=beg;
-  
-  for(uint16_t keynr=0; keynr< vals; keynr++ )
+
+  // measure average lookup time (for analysis only, verbose trace: it delays every load of the table)
+  TRACE_V_THR30IIPEDAL(
+    if(ok && glo.size() > 0)
+    {
+      volatile uint16_t k = 0;
+      uint32_t tl = micros();
+      for(uint16_t i = 0; i < glo.size(); i++)
+      {
+        k = glo.lookup(glo.name(i));
+      }
+      tl = micros() - tl;
+      (void) k;
+      Serial.printf("Symbol lookup: %lu ns average over %d names\n\r", (tl * 1000UL) / glo.size(), glo.size());
+    }
+  )
+
+  return ok;
+};
+
+bool Constants::set_baked(uint32_t firmware)
+{
+  for(const BakedSymbolTable *b = baked_symtabs; b->dump != nullptr; b++)
   {
-      glo.emplace(String(p), keynr);
-      TRACE_V_THR30IIPEDAL(Serial.printf("%s : %d\n\r",p, keynr);)
-      while( *(p++)!='\0');
+    if(b->firmware == firmware)
+    {
+      bool ok = glo.attach(b->dump, b->len, b->count, b->offset, b->sorted);
+      generation++;
+      TRACE_THR30IIPEDAL(Serial.printf("Baked symbol table for firmware %08lx: %d symbols %s.\n\r",
+                                        (unsigned long) firmware, glo.size(), ok ? "in use" : "rejected");)
+      return ok;
+    }
   }
-};
+  return false;
+}
+
+bool SymbolTable::adopt(byte* buf, size_t len)
+{
+  clear();
+
+  if(buf == nullptr || len < 8)
+  {
+    delete[] buf;
+    return false;
+  }
+
+  uint32_t vals = *((uint32_t*) buf);       //how many values are in the symbol table
+  uint32_t symStart = 12 * vals + 8;        //Where is the start of the symbol names?
+
+  TRACE_V_THR30IIPEDAL(Serial.printf("Start of symbols: %d\n\r",symStart);)
+
+  if(vals > 0xFFFE || symStart >= len || len > 0xFFFF)  //offsets are stored as 16 bit
+  {
+    TRACE_THR30IIPEDAL(Serial.println(F("Symbol table dump has unexpected size!"));)
+    delete[] buf;
+    return false;
+  }
+
+  uint16_t *offset = new uint16_t[vals];
+  uint16_t *sorted = new uint16_t[vals];
+
+  if(offset == nullptr || sorted == nullptr)
+  {
+    Serial.println("\n\rAllocation Error for symbol table index!");
+    delete[] buf;
+    delete[] offset;
+    delete[] sorted;
+    return false;
+  }
+
+  _buf = buf;
+  _len = len;
+  _offset = offset;
+  _sorted = sorted;
+  _owned = true;
+  buf[len - 1] = '\0';  //make sure, the last name can not run over the end of the buffer
+
+  size_t p = symStart;
+
+  for(uint16_t keynr = 0; keynr < vals; keynr++ )
+  {
+      if(p >= len)  //less names than announced
+      {
+          break;
+      }
+      offset[keynr] = (uint16_t) p;
+      sorted[keynr] = keynr;
+      _count++;
+      TRACE_V_THR30IIPEDAL(Serial.printf("%s : %d\n\r",(const char*)(_buf + p), keynr);)
+      while( p < len && _buf[p++] != '\0');
+  }
+
+  //stable sort keeps the lowest key first for duplicate names (as std::map::emplace did)
+  std::stable_sort(sorted, sorted + _count, [this](uint16_t a, uint16_t b)
+  {
+      return strcmp((const char*)(_buf + _offset[a]), (const char*)(_buf + _offset[b])) < 0;
+  });
+
+  return true;
+}
+
+bool SymbolTable::attach(const byte* buf, size_t len, uint16_t count, const uint16_t* offset, const uint16_t* sorted)
+{
+  clear();
+
+  //the generator guarantees the layout, check only what protects against reading out of the buffer
+  if(buf == nullptr || offset == nullptr || sorted == nullptr || len < 8 || buf[len - 1] != '\0')
+  {
+    return false;
+  }
+
+  _buf = buf;
+  _len = len;
+  _count = count;
+  _offset = offset;
+  _sorted = sorted;
+  _owned = false;
+  return true;
+}
+
+void SymbolTable::clear()
+{
+  if(_owned)
+  {
+    delete[] _buf;
+    delete[] _offset;
+    delete[] _sorted;
+  }
+  _owned = false;
+  _buf = nullptr;
+  _offset = nullptr;
+  _sorted = nullptr;
+  _len = 0;
+  _count = 0;
+}
+
+uint16_t SymbolTable::lookup(const char* name) const
+{
+  if(name == nullptr)
+  {
+    return SYMBOL_NOT_FOUND;
+  }
+
+  int lo = 0;
+  int hi = (int) _count - 1;
+
+  while(lo <= hi)   //binary search over the sorted index
+  {
+      int mid = (lo + hi) / 2;
+      int c = strcmp((const char*)(_buf + _offset[_sorted[mid]]), name);
+      if(c < 0)
+      {
+          lo = mid + 1;
+      }
+      else if(c > 0)
+      {
+          hi = mid - 1;
+      }
+      else
+      {
+          //step back to the first of equal names (lowest key)
+          while(mid > 0 && strcmp((const char*)(_buf + _offset[_sorted[mid - 1]]), name) == 0)
+          {
+              mid--;
+          }
+          return _sorted[mid];
+      }
+  }
+  return SYMBOL_NOT_FOUND;
+}
+
+const char* SymbolTable::name(uint16_t key) const
+{
+  if(key >= _count)
+  {
+    return nullptr;
+  }
+  return (const char*)(_buf + _offset[key]);
+}
+
+size_t SymbolTable::heapUsage() const
+{
+  if(!_owned)
+  {
+    return 0;
+  }
+  return _len + 2 * sizeof(uint16_t) * _count;
+}
+
+uint32_t SymbolTable::checksum() const
+{
+  uint32_t h = 2166136261UL;  //FNV-1a offset basis
+  for(size_t i = 0; i < _len; i++)
+  {
+    h ^= _buf[i];
+    h *= 16777619UL;          //FNV prime
+  }
+  return h;
+}
 
 //Get count of free memory (for development only)
+#if !defined(ARDUINO)
+int freeMemory() { return 0; }  //host tests: no heap bounds
+#else
 #ifdef __arm__
 // should use uinstd.h to define sbrk but Due causes a conflict
 extern "C" char* sbrk(int incr);
@@ -76,4 +256,5 @@ int freeMemory() {
 #else  // __arm__
   return __brkval ? &top - __brkval : &top - __malloc_heap_start;
 #endif  // __arm__
-}
\ No newline at end of file
+}
+#endif  // ARDUINO
\ No newline at end of file
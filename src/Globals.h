@@ -11,12 +11,50 @@
 
 #include <map>
 
+#define SYMBOL_NOT_FOUND 0xFFFF   //returned by SymbolTable::lookup() for unknown names
+
+//Compact symbol table (string pool)
+//The symbol names stay inside the contiguous dump buffer received from THR30II.
+//Only an offset array (key -> name) and an index array (keys sorted by name) are built once.
+//Lookups are a binary search with strcmp over the sorted index and never insert anything.
+class SymbolTable
+{
+   public:
+     SymbolTable():_buf(nullptr),_len(0),_count(0),_offset(nullptr),_sorted(nullptr),_owned(false){};
+     ~SymbolTable(){ clear(); };
+     SymbolTable(const SymbolTable &other) = delete;            //owns the dump buffer, so no copies
+     SymbolTable & operator=(const SymbolTable &other) = delete;
+
+     bool adopt(byte* buf, size_t len);          //takes ownership of a symbol table dump buffer (allocated with new[])
+     bool attach(const byte* buf, size_t len, uint16_t count, const uint16_t* offset, const uint16_t* sorted);  //uses prebuilt tables in flash (not owned)
+     void clear();                                //frees buffer and index arrays (if owned)
+     uint16_t lookup(const char* name) const;     //key for this name or SYMBOL_NOT_FOUND
+     uint16_t operator[](const char* name) const { return lookup(name); };
+     const char* name(uint16_t key) const;        //name for this key or nullptr
+     uint16_t size() const { return _count; };
+     size_t heapUsage() const;                    //bytes allocated for buffer and index arrays (0 for baked tables)
+     bool isBaked() const { return _buf != nullptr && !_owned; };  //table is used from flash
+     const byte* data() const { return _buf; };   //the raw dump (e.g. for storing it on SD)
+     size_t length() const { return _len; };
+     uint32_t checksum() const;                   //FNV-1a over the raw dump
+
+   private:
+     const byte* _buf;          //the dump (count, length, 12 bytes per symbol, then the '\0'-terminated names)
+     size_t _len;               //length of the dump
+     uint16_t _count;           //number of symbols
+     const uint16_t* _offset;   //_offset[key]: position of the symbol name inside _buf
+     const uint16_t* _sorted;   //keys in ascending strcmp() order of their names
+     bool _owned;               //buffer and arrays are on the heap (dump) and not in flash (baked)
+};
+
 class Constants   //Class for holding all the global keys (received from THR30II by request)
 {
    public:
-     static std::map<String, uint16_t> glo;
+     static SymbolTable glo;
+     static uint16_t generation;   //incremented, whenever a new symbol table is set (everything built from keys gets invalid)
 
-     static void set_all(const byte* buf);
+     static bool set_all(byte* buf, size_t len);  //takes ownership of "buf"
+     static bool set_baked(uint32_t firmware);     //use the table baked into flash for this firmware (if there is one)
 };
 
 //Function for making data SysEx-compatible (0x00...0x7f) by packing MSB of a pack of 7 Bytes in an eighth byte ("bitbucket")
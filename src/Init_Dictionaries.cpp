@@ -4,446 +4,419 @@
 
 /* Init_Dictionaries.cpp
 *  last modified 09/2021
-*  Author: Martin Zwerschke 
+*  Author: Martin Zwerschke
 */
 
 #include <Arduino.h>
 #undef max
 #undef min
-#include <map>
+#include <array>
+#include <algorithm>
+#include <string.h>
 #include "THR30II.h"
 #include "Globals.h"
 
-std::map<String, uint16_t> Constants::glo ;
+//Normal TRACE/DEBUG
+#define TRACE_THR30IIPEDAL(x) x
+//#define TRACE_THR30IIPEDAL(x)
 
-std::map<THR30II_CAB, String> THR30II_CAB_NAMES
+//Verbose TRACE/DEBUG
+//#define TRACE_V_THR30IIPEDAL(x)	x
+#define TRACE_V_THR30IIPEDAL(x)
+
+SymbolTable Constants::glo ;  //symbol names and keys received from THR30II
+uint16_t Constants::generation = 0;
+
+//The constant names (in flash, indexed by the enums)
+const char THR30II_CAB_NAMES[Bypass + 1][16] PROGMEM
+{
+	"British 4x12",     //British_4x12
+	"American 4x12",    //American_4x12
+	"Brown 4x12",       //Brown_4x12
+	"Vintage 4x12",     //Vintage_4x12
+	"Fuel 4x12",        //Fuel_4x12
+	"Juicy 4x12",       //Juicy_4x12
+	"Mods 4x12",        //Mods_4x12
+	"American 2x12",    //American_2x12
+	"British 2x12",     //British_2x12
+	"British Blues",    //British_Blues
+	"Boutique 2x12",    //Boutique_2x12
+	"Yamaha 2x12",      //Yamaha_2x12
+	"California 1x12",  //California_1x12
+	"American 1x12",    //American_1x12
+	"American 4x10",    //American_4x10
+	"Boutique 1x12",    //Boutique_1x12
+	"Bypass"            //Bypass
+};
+
+const char THR30II_AMP_NAMES[FLAT + 1][8] PROGMEM
+{
+	"Clean", "Crunch", "Lead", "Hi Gain", "Special", "Bass", "Aco", "Flat"
+};
+
+const char THR30II_COL_NAMES[MODERN + 1][9] PROGMEM
+{
+	"Classic", "Boutique", "Modern"
+};
+
+//Symbol names (in flash) of the keys, that Init_Dictionaries() resolves from the symbol table
+typedef char sym_name[24];
+
+struct key_name_def        //=> key_name
 {
-	{THR30II_CAB::British_4x12 , "British 4x12"},
-	{THR30II_CAB::American_4x12 , "American 4x12"},
-	{THR30II_CAB::Brown_4x12 , "Brown 4x12"},
-	{THR30II_CAB::Vintage_4x12 , "Vintage 4x12"},
-	{THR30II_CAB::Fuel_4x12 , "Fuel 4x12"},
-	{THR30II_CAB::Juicy_4x12 , "Juicy 4x12"},
-	{THR30II_CAB::Mods_4x12 , "Mods 4x12"},
-	{THR30II_CAB::American_2x12 , "American 2x12"},
-	{THR30II_CAB::British_2x12 , "British 2x12"},
-	{THR30II_CAB::British_Blues , "British Blues"},
-	{THR30II_CAB::Boutique_2x12 , "Boutique 2x12"},
-	{THR30II_CAB::Yamaha_2x12 , "Yamaha 2x12"},
-	{THR30II_CAB::California_1x12 , "California 1x12"},
-	{THR30II_CAB::American_1x12 , "American 1x12"},
-	{THR30II_CAB::American_4x10 , "American 4x10"},
-	{THR30II_CAB::Boutique_1x12 , "Boutique 1x12"},
-	{THR30II_CAB::Bypass , "Bypass"}
+	sym_name sym;
+	char name[14];
 };
 
-std::map<col_amp, uint16_t> THR30IIAmpKeys;
+/* Old Firmware 1.30.0c
+AMP-Sim Modern  Boutique  Classic
+CLEAN:	  32(B2)  36(B6)  4a(4A)
+CRUNCH:   23(A3)  71(71)  08(88)
+LEAD:     3b(BB)  28(A8)  19(99)
+HIGAIN:   0b(8B)  2f(AF)  7f(7F)
+SPECIAL:  1c(9C)  04(84)  78(78)
+BASS      38(B8)  2b(AB)  37(B7)
+ACOUSTIC: 17(97)  18(98)  13(93)
+FLAT:	  35(B5)  34(B4)  0f(8F)*/
+static const sym_name AMP_SYMS[MODERN + 1][FLAT + 1] PROGMEM
+{
+	{ "THR10C_Deluxe", "THR10C_DC30", "THR10_Lead", "THR10_Modern",                              //CLASSIC
+	  "THR10X_Brown1", "THR10_Bass_Eden_Marcus", "THR10_Aco_Condenser1", "THR10_Flat" },
+	{ "THR10C_BJunior2", "THR10C_Mini", "THR30_Blondie", "THR30_FLead",                         //BOUTIQUE
+	  "THR10X_South", "THR10_Bass_Mesa", "THR10_Aco_Tube1", "THR10_Flat_B" },
+	{ "THR30_Carmen", "THR30_SR101", "THR10_Brit", "THR10X_Brown2",                             //MODERN
+	  "THR30_Stealth", "THR30_JKBass2", "THR10_Aco_Dynamic1", "THR10_Flat_V" }
+};
 
-std::map<THR30II_AMP, String> THR30II_AMP_NAMES
+static const key_name_def UNITS_DEFS[GATE + 1] PROGMEM
 {
-	{THR30II_AMP::CLEAN , "Clean"},
-    {THR30II_AMP::CRUNCH , "Crunch"},
-    {THR30II_AMP::LEAD , "Lead"},
-    {THR30II_AMP::HI_GAIN , "Hi Gain"},
-    {THR30II_AMP::SPECIAL , "Special"},
-    {THR30II_AMP::BASS , "Bass"},
-    {THR30II_AMP::ACO , "Aco"},
-    {THR30II_AMP::FLAT , "Flat"}
+	{ "FX1", "Compressor" }, { "Amp", "Control" }, { "FX2", "Effect" },
+	{ "FX3", "Echo" }, { "FX4", "Reverb" }, { "GuitarProc", "Gate" }
 };
 
-std::map<THR30II_COL, String> THR30II_COL_NAMES
+static const key_name_def EFF_TYPES_DEFS[CHORUS + 1] PROGMEM
 {
-	{THR30II_COL::CLASSIC , "Classic"},
-    {THR30II_COL::BOUTIQUE , "Boutique"},
-    {THR30II_COL::MODERN , "Modern"},
+	{ "Phaser", "Phaser" }, { "BiasTremolo", "Tremolo" }, { "L6Flanger", "Flanger" }, { "StereoSquareChorus", "Chorus" }
 };
 
-std::map<THR30II_UNITS, uint16_t> THR30II_UNIT_ON_OFF_COMMANDS;
-
-//CAB-Simulation is Sub-Unit of GATE 
-uint16_t THR30II_CAB_COMMAND;// = 0x0105;       //SpkSimType
-uint16_t THR30II_CAB_COMMAND_DUMP;// = 0x0124;  //SpkSimTypeState
-
-//Mapping the MIDI-dump keys to the corresponding single command MIDI keys
-std::map<THR30II_CTRL_SET, uint16_t> THR30II_CTRL_VALS;
-std::map<uint16_t, uint16_t> controlMap;
-std::map<THR30II_GATE, uint16_t> THR30II_GATE_VALS;
-std::map<uint16_t, uint16_t> gateMap;
-
-std::map<THR30II_UNITS, key_name> THR30II_UNITS_VALS;
-std::map<uint16_t, uint16_t> effectMap;
-std::map<THR30II_EFF_TYPES, key_name> THR30II_EFF_TYPES_VALS;
-std::map<THR30II_EFF_SET_PHAS, unit_info> THR30II_INFO_PHAS;
-std::map<THR30II_EFF_SET_TREM, unit_info> THR30II_INFO_TREM;
-std::map<THR30II_EFF_SET_FLAN, unit_info> THR30II_INFO_FLAN;
-std::map<THR30II_EFF_SET_CHOR, unit_info> THR30II_INFO_CHOR;
-std::map<THR30II_EFF_TYPES, std::map<String, unit_info>> THR30II_INFO_EFFECT;
-std::map<uint16_t, uint16_t> reverbMap;
-std::map<THR30II_REV_TYPES, key_name> THR30II_REV_TYPES_VALS;
-std::map<THR30II_REV_SET_SPRI, unit_info> THR30II_INFO_SPRI;
-std::map<THR30II_REV_SET_PLAT, unit_info> THR30II_INFO_PLAT;
-std::map<THR30II_REV_SET_HALL, unit_info> THR30II_INFO_HALL;
-std::map<THR30II_REV_SET_ROOM, unit_info> THR30II_INFO_ROOM;
-std::map<THR30II_REV_TYPES, std::map<String, unit_info>> THR30II_INFO_REVERB;
-
-std::map<uint16_t, uint16_t> echoMap;
-std::map<THR30II_ECHO_TYPES, key_name> THR30II_ECHO_TYPES_VALS;
-std::map<THR30II_ECHO_SET_TAPE, unit_info> THR30II_INFO_TAPE;
-std::map<THR30II_ECHO_SET_DIGI, unit_info> THR30II_INFO_DIGI;
-std::map<THR30II_ECHO_TYPES, std::map<String, unit_info>> THR30II_INFO_ECHO;
-
-std::map<uint16_t, uint16_t> compressorMap;
-std::map<uint16_t, uint16_t> unitOnMap;
-std::map<THR30II_COMP, uint16_t> THR30II_COMP_VALS;
+static const key_name_def REV_TYPES_DEFS[ROOM + 1] PROGMEM
+{
+	{ "StandardSpring", "Spring" }, { "LargePlate1", "Plate" }, { "ReallyLargeHall", "Hall" }, { "SmallRoom1", "Room" }
+};
+
+static const key_name_def ECHO_TYPES_DEFS[DIGITAL_DELAY + 1] PROGMEM
+{
+	{ "TapeEcho", "Tape Echo" }, { "L6DigitalDelay", "Digital Delay" }
+};
+
+const char * const THR30II_JSON_GROUPS[GATE + 1] = { "THRGroupFX1Compressor", "THRGroupAmp", "THRGroupFX2Effect",
+                                                     "THRGroupFX3EffectEcho", "THRGroupFX4EffectReverb", "THRGroupGate" };
+
+//The parameter registry (in the order of enum THR30II_PARAM)
+//(unit, type, index, command unit, dump key, command key, fix key, encoding, lower limit, upper limit, .thrl6p key, label)
+const param_def THR30II_PARAMS[P_COUNT] PROGMEM
+{
+	{ COMPRESSOR, -1, CO_SUSTAIN, COMPRESSOR, "SustainState", "Sustain", 0, ENC_LINEAR, 0, 100, "Sustain", "Sustain" },       //P_CO_SUSTAIN
+	{ COMPRESSOR, -1, CO_LEVEL, COMPRESSOR, "LevelState", "Level", 0, ENC_LINEAR, 0, 100, "Level", "Level" },                 //P_CO_LEVEL
+	{ COMPRESSOR, -1, CO_MIX, GATE, "FX1MixState", "FX1Mix", 0, ENC_LINEAR, 0, 100, "", "Mix" },                              //P_CO_MIX (not in patch files)
+
+	{ CONTROL, -1, CTRL_GAIN, CONTROL, "DriveState", "Drive", 0, ENC_LINEAR, 0, 100, "Drive", "Gain" },                       //P_CTRL_GAIN
+	{ CONTROL, -1, CTRL_MASTER, CONTROL, "MasterState", "Master", 0, ENC_LINEAR, 0, 100, "Master", "Master" },                //P_CTRL_MASTER
+	{ CONTROL, -1, CTRL_BASS, CONTROL, "BassState", "Bass", 0, ENC_LINEAR, 0, 100, "Bass", "Bass" },                          //P_CTRL_BASS
+	{ CONTROL, -1, CTRL_MID, CONTROL, "MidState", "Mid", 0, ENC_LINEAR, 0, 100, "Mid", "Mid" },                               //P_CTRL_MID
+	{ CONTROL, -1, CTRL_TREBLE, CONTROL, "TrebleState", "Treble", 0, ENC_LINEAR, 0, 100, "Treble", "Treble" },                //P_CTRL_TREBLE
+
+	{ GATE, -1, GA_THRESHOLD, GATE, "ThreshState", "Thresh", 0, ENC_THRESHOLD, 0, 100, "Thresh", "Threshold" },               //P_GA_THRESHOLD
+	{ GATE, -1, GA_DECAY, GATE, "DecayState", "Decay", 0, ENC_LINEAR, 0, 100, "Decay", "Decay" },                             //P_GA_DECAY
+
+	{ GATE, -1, 0, GATE, "SpkSimTypeState", "SpkSimType", 0, ENC_ENUM, British_4x12, Bypass, "", "Cabinet" },                 //P_CAB (own group in patch files)
+
+	{ COMPRESSOR, -1, COMPRESSOR, GATE, "FX1EnableState", "FX1Enable", 0, ENC_BOOL, 0, 1, "@enabled", "Compressor" },         //P_ON_COMPRESSOR
+	{ EFFECT, -1, EFFECT, GATE, "FX2EnableState", "FX2Enable", 0, ENC_BOOL, 0, 1, "@enabled", "Effect" },                     //P_ON_EFFECT
+	{ ECHO, -1, ECHO, GATE, "FX3EnableState", "FX3Enable", 0, ENC_BOOL, 0, 1, "@enabled", "Echo" },                           //P_ON_ECHO
+	{ REVERB, -1, REVERB, GATE, "FX4EnableState", "FX4Enable", 0, ENC_BOOL, 0, 1, "@enabled", "Reverb" },                     //P_ON_REVERB
+	{ GATE, -1, GATE, GATE, "GateEnableState", "GateEnable", 0, ENC_BOOL, 0, 1, "@enabled", "Gate" },                         //P_ON_GATE
+
+	{ EFFECT, PHASER, PH_SPEED, EFFECT, "FreqState", "Speed", 0, ENC_LINEAR, 0, 100, "Speed", "Speed" },                      //P_PH_SPEED
+	{ EFFECT, PHASER, PH_FEEDBACK, EFFECT, "FeedbackState", "Feedback", 0, ENC_LINEAR, 0, 100, "Feedback", "Feedback" },      //P_PH_FEEDBACK
+	{ EFFECT, PHASER, PH_MIX, GATE, "FX2MixState", "FX2Mix", 0, ENC_LINEAR, 0, 100, "@wetDry", "Mix" },                       //P_PH_MIX
+
+	{ EFFECT, TREMOLO, TR_SPEED, EFFECT, "SpeedState", "Speed", 0, ENC_LINEAR, 0, 100, "Speed", "Speed" },                    //P_TR_SPEED
+	{ EFFECT, TREMOLO, TR_DEPTH, EFFECT, "DepthState", "Depth", 0, ENC_LINEAR, 0, 100, "Depth", "Depth" },                    //P_TR_DEPTH
+	{ EFFECT, TREMOLO, TR_MIX, GATE, "FX2MixState", "FX2Mix", 0, ENC_LINEAR, 0, 100, "@wetDry", "Mix" },                      //P_TR_MIX
+
+	{ EFFECT, FLANGER, FL_DEPTH, EFFECT, "DepthState", "", 0x00E0, ENC_LINEAR, 0, 100, "Depth", "Depth" },                    //P_FL_DEPTH
+	{ EFFECT, FLANGER, FL_SPEED, EFFECT, "FreqState", "", 0x00E4, ENC_LINEAR, 0, 100, "Freq", "Speed" },                      //P_FL_SPEED
+	{ EFFECT, FLANGER, FL_MIX, GATE, "FX2MixState", "FX2Mix", 0, ENC_LINEAR, 0, 100, "@wetDry", "Mix" },                      //P_FL_MIX
+
+	{ EFFECT, CHORUS, CH_FEEDBACK, EFFECT, "FeedbackState", "Feedback", 0, ENC_LINEAR, 0, 100, "Feedback", "Feedback" },      //P_CH_FEEDBACK
+	{ EFFECT, CHORUS, CH_DEPTH, EFFECT, "DepthState", "Depth", 0, ENC_LINEAR, 0, 100, "Depth", "Depth" },                     //P_CH_DEPTH
+	{ EFFECT, CHORUS, CH_SPEED, EFFECT, "FreqState", "Freq", 0, ENC_LINEAR, 0, 100, "Freq", "Speed" },                        //P_CH_SPEED
+	{ EFFECT, CHORUS, CH_PREDELAY, EFFECT, "PreState", "Pre", 0, ENC_LINEAR, 0, 100, "Pre", "Pre-Delay" },                    //P_CH_PREDELAY
+	{ EFFECT, CHORUS, CH_MIX, GATE, "FX2MixState", "FX2Mix", 0, ENC_LINEAR, 0, 100, "@wetDry", "Mix" },                       //P_CH_MIX
+	{ EFFECT, CHORUS, CH_SYNCSELECT, EFFECT, "SyncSelectState", "SyncSelect", 0, ENC_LINEAR, 0, 100, "", "SyncSelect" },      //P_CH_SYNCSELECT (not in THR-Remote)
+
+	{ REVERB, SPRING, SP_REVERB, REVERB, "TimeState", "Time", 0, ENC_LINEAR, 0, 100, "Time", "Reverb" },                      //P_SP_REVERB
+	{ REVERB, SPRING, SP_TONE, REVERB, "ToneState", "Tone", 0, ENC_LINEAR, 0, 100, "Tone", "Tone" },                          //P_SP_TONE
+	{ REVERB, SPRING, SP_MIX, GATE, "FX4WetSendState", "FX4WetSend", 0, ENC_LINEAR, 0, 100, "@wetDry", "Mix" },               //P_SP_MIX
+
+	{ REVERB, PLATE, PL_DECAY, REVERB, "DecayState", "Decay", 0, ENC_LINEAR, 0, 100, "Decay", "Decay" },                      //P_PL_DECAY
+	{ REVERB, PLATE, PL_TONE, REVERB, "ToneState", "Tone", 0, ENC_LINEAR, 0, 100, "Tone", "Tone" },                           //P_PL_TONE
+	{ REVERB, PLATE, PL_PREDELAY, REVERB, "PreDelayState", "PreDelay", 0, ENC_LINEAR, 0, 100, "PreDelay", "Pre-Delay" },      //P_PL_PREDELAY
+	{ REVERB, PLATE, PL_MIX, GATE, "FX4WetSendState", "FX4WetSend", 0, ENC_LINEAR, 0, 100, "@wetDry", "Mix" },                //P_PL_MIX
+
+	{ REVERB, HALL, HA_DECAY, REVERB, "DecayState", "Decay", 0, ENC_LINEAR, 0, 100, "Decay", "Decay" },                       //P_HA_DECAY
+	{ REVERB, HALL, HA_TONE, REVERB, "ToneState", "Tone", 0, ENC_LINEAR, 0, 100, "Tone", "Tone" },                            //P_HA_TONE
+	{ REVERB, HALL, HA_PREDELAY, REVERB, "PreDelayState", "PreDelay", 0, ENC_LINEAR, 0, 100, "PreDelay", "Pre-Delay" },       //P_HA_PREDELAY
+	{ REVERB, HALL, HA_MIX, GATE, "FX4WetSendState", "FX4WetSend", 0, ENC_LINEAR, 0, 100, "@wetDry", "Mix" },                 //P_HA_MIX
+
+	{ REVERB, ROOM, RO_DECAY, REVERB, "DecayState", "Decay", 0, ENC_LINEAR, 0, 100, "Decay", "Decay" },                       //P_RO_DECAY
+	{ REVERB, ROOM, RO_TONE, REVERB, "ToneState", "Tone", 0, ENC_LINEAR, 0, 100, "Tone", "Tone" },                            //P_RO_TONE
+	{ REVERB, ROOM, RO_PREDELAY, REVERB, "PreDelayState", "PreDelay", 0, ENC_LINEAR, 0, 100, "PreDelay", "Pre-Delay" },       //P_RO_PREDELAY
+	{ REVERB, ROOM, RO_MIX, GATE, "FX4WetSendState", "FX4WetSend", 0, ENC_LINEAR, 0, 100, "@wetDry", "Mix" },                 //P_RO_MIX
+
+	{ ECHO, TAPE_ECHO, TA_BASS, ECHO, "BassState", "Bass", 0, ENC_LINEAR, 0, 100, "Bass", "Bass" },                           //P_TA_BASS
+	{ ECHO, TAPE_ECHO, TA_TREBLE, ECHO, "TrebleState", "Treble", 0, ENC_LINEAR, 0, 100, "Treble", "Treble" },                 //P_TA_TREBLE
+	{ ECHO, TAPE_ECHO, TA_FEEDBACK, ECHO, "FeedbackState", "Feedback", 0, ENC_LINEAR, 0, 100, "Feedback", "Feedback" },       //P_TA_FEEDBACK
+	{ ECHO, TAPE_ECHO, TA_TIME, ECHO, "TimeState", "Time", 0, ENC_LINEAR, 0, 100, "Time", "Time" },                           //P_TA_TIME
+	{ ECHO, TAPE_ECHO, TA_MIX, GATE, "FX3MixState", "FX3Mix", 0, ENC_LINEAR, 0, 100, "@wetDry", "Mix" },                      //P_TA_MIX
+	{ ECHO, TAPE_ECHO, TA_SYNCSELECT, ECHO, "SyncSelectState", "SyncSelect", 0, ENC_LINEAR, 0, 100, "", "SyncSelect" },       //P_TA_SYNCSELECT (not in THR-Remote)
+
+	{ ECHO, DIGITAL_DELAY, DD_BASS, ECHO, "BassState", "Bass", 0, ENC_LINEAR, 0, 100, "Bass", "Bass" },                       //P_DD_BASS
+	{ ECHO, DIGITAL_DELAY, DD_TREBLE, ECHO, "TrebleState", "Treble", 0, ENC_LINEAR, 0, 100, "Treble", "Treble" },             //P_DD_TREBLE
+	{ ECHO, DIGITAL_DELAY, DD_FEEDBACK, ECHO, "FeedbackState", "Feedback", 0, ENC_LINEAR, 0, 100, "Feedback", "Feedback" },   //P_DD_FEEDBACK
+	{ ECHO, DIGITAL_DELAY, DD_TIME, ECHO, "TimeState", "Time", 0, ENC_LINEAR, 0, 100, "Time", "Time" },                       //P_DD_TIME
+	{ ECHO, DIGITAL_DELAY, DD_MIX, GATE, "FX3MixState", "FX3Mix", 0, ENC_LINEAR, 0, 100, "@wetDry", "Mix" },                  //P_DD_MIX
+	{ ECHO, DIGITAL_DELAY, DD_SYNCSELECT, ECHO, "SyncSelectState", "SyncSelect", 0, ENC_LINEAR, 0, 100, "", "SyncSelect" }    //P_DD_SYNCSELECT (not in THR-Remote)
+};
+
+//The resolved keys (in RAM)
+std::array<std::array<uint16_t, FLAT + 1>, MODERN + 1> THR30IIAmpKeys;
+
+std::array<key_name, GATE + 1> THR30II_UNITS_VALS;
+std::array<key_name, CHORUS + 1> THR30II_EFF_TYPES_VALS;
+std::array<key_name, ROOM + 1> THR30II_REV_TYPES_VALS;
+std::array<key_name, DIGITAL_DELAY + 1> THR30II_ECHO_TYPES_VALS;
+
+std::array<param_keys, P_COUNT> THR30II_PARAM_KEYS;
+
+//Reverse index of the registry: first parameter for each key (indexed by the key, sized like the symbol table),
+//and for each parameter the next one with the same key (P_NONE ends the chain)
+static uint8_t *param_by_dk = nullptr;
+static uint8_t *param_by_ck = nullptr;
+static uint16_t param_index_len = 0;
+static std::array<uint8_t, P_COUNT> next_by_dk;
+static std::array<uint8_t, P_COUNT> next_by_ck;
 
 byte * dump=nullptr;   //dynamic Array because of big size
 size_t dump_len=0;  //length of the dynamic array for the dump
 
-void THR30II_Settings::Init_Dictionaries()
+//Helpers for resolving the symbol names of a definition table into the RAM array
+//(the array sizes are checked at compile time)
+
+static uint16_t resolve(const SymbolTable &glob, const char *sym)
 {
-    std::map<String,uint16_t> & glob = Constants::glo ;
+	return sym[0] == '\0' ? SYMBOL_NOT_FOUND : glob[sym];
+}
 
-    THR30IIAmpKeys =
-    {
-        /* Old Firmware 1.30.0c
-        AMP-Sim Modern  Boutique  Classic
-        CLEAN:	  32(B2)  36(B6)  4a(4A)
-        CRUNCH:   23(A3)  71(71)  08(88)
-        LEAD:     3b(BB)  28(A8)  19(99)
-        HIGAIN:   0b(8B)  2f(AF)  7f(7F)
-        SPECIAL:  1c(9C)  04(84)  78(78)
-        BASS      38(B8)  2b(AB)  37(B7)
-        ACOUSTIC: 17(97)  18(98)  13(93)
-        FLAT:	  35(B5)  34(B4)  0f(8F)*/
-
-        {{CLASSIC, CLEAN}, glob["THR10C_Deluxe"]}, // = 0x4A,
-        {{CLASSIC, CRUNCH}, glob["THR10C_DC30"]}, // = 0x88,
-        {{CLASSIC, LEAD}, glob["THR10_Lead"]}, // = 0x99,
-        {{CLASSIC, HI_GAIN}, glob["THR10_Modern"]}, // = 0x7F,
-        {{CLASSIC, SPECIAL}, glob["THR10X_Brown1"]}, // = 0x78,
-        {{CLASSIC, BASS}, glob["THR10_Bass_Eden_Marcus"]}, // = 0xB7,
-        {{CLASSIC, ACO}, glob["THR10_Aco_Condenser1"]}, // = 0x93,
-        {{CLASSIC, FLAT}, glob["THR10_Flat"]}, // = 0x8F,
-
-        {{BOUTIQUE, CLEAN}, glob["THR10C_BJunior2"]}, //= 0xB6,
-        {{BOUTIQUE, CRUNCH}, glob["THR10C_Mini"]}, // = 0x71,
-        {{BOUTIQUE, LEAD}, glob["THR30_Blondie"]}, // = 0xA8,
-        {{BOUTIQUE, HI_GAIN}, glob["THR30_FLead"]}, // = 0xAF,
-        {{BOUTIQUE, SPECIAL}, glob["THR10X_South"]}, // = 0x84,
-        {{BOUTIQUE, BASS}, glob["THR10_Bass_Mesa"]}, // = 0xAB,
-        {{BOUTIQUE, ACO}, glob["THR10_Aco_Tube1"]}, // = 0x98,
-        {{BOUTIQUE, FLAT}, glob["THR10_Flat_B"]}, // = 0xB4,
-
-        {{MODERN, CLEAN}, glob["THR30_Carmen"]},// = 0xB2,
-        {{MODERN, CRUNCH}, glob["THR30_SR101"]}, //= 0xA3,
-        {{MODERN, LEAD}, glob["THR10_Brit"]}, //= 0xBB,
-        {{MODERN, HI_GAIN}, glob["THR10X_Brown2"]}, //= 0x8B,
-        {{MODERN, SPECIAL}, glob["THR30_Stealth"]}, // = 0x9C,
-        {{MODERN, BASS}, glob["THR30_JKBass2"]}, //= 0xB2,
-        {{MODERN, ACO}, glob["THR10_Aco_Dynamic1"]}, // = 0x97,
-        {{MODERN, FLAT}, glob["THR10_Flat_V"]}, // = 0xB5,
-    };
-
-    THR30II_UNITS_VALS=
-    {
-        {COMPRESSOR, {glob["FX1"] , "Compressor"}},
-        {CONTROL, {glob["Amp"], "Control"}}, 
-        {EFFECT, {glob["FX2"], "Effect"}},
-        {ECHO, {glob["FX3"], "Echo"}},  
-        {REVERB, {glob["FX4"], "Reverb"}},
-        {GATE, {glob["GuitarProc"], "Gate"}}
-    };
-
-    THR30II_UNIT_ON_OFF_COMMANDS=
-    {
-        {COMPRESSOR,glob["FX1Enable"]}, 
-        {EFFECT, glob["FX2Enable"]},
-        {ECHO, glob["FX3Enable"]},
-        {REVERB, glob["FX4Enable"]},
-        {GATE, glob["GateEnable"]} 
-    };
-   
-    unitOnMap=
-    {
-        {glob["FX1EnableState"], glob["FX1Enable"]},  //FX1=Compressor
-        {glob["FX2EnableState"], glob["FX2Enable"]},  //FX2=Effect
-        {glob["FX3EnableState"], glob["FX3Enable"]},  //FX3=Echo
-        {glob["FX4EnableState"], glob["FX4Enable"]},  //FX4=Reverb 
-        {glob["GateEnableState"], glob["GateEnable"]}  //GateEnableState=>GateEnable
-    };
-
-    //CAB-Simulation is Sub-Unit of GATE 
-    THR30II_CAB_COMMAND = glob["SpkSimType"]; //SpkSimType
-    THR30II_CAB_COMMAND_DUMP = glob["SpkSimTypeState"]; //SpkSimTypeState
-
-    THR30II_EFF_TYPES_VALS=
-    {
-        {PHASER, {glob["Phaser"], "Phaser"}},  
-        {TREMOLO, {glob["BiasTremolo"], "Tremolo"}},
-        {FLANGER, {glob["L6Flanger"], "Flanger"}},
-        {CHORUS, {glob["StereoSquareChorus"], "Chorus"}} 
-    };
+template <size_t N>
+static void resolve(const SymbolTable &glob, std::array<uint16_t, N> &keys, const sym_name (&defs)[N])
+{
+	for(size_t i = 0; i < N; i++)
+	{
+		keys[i] = resolve(glob, defs[i]);
+	}
+}
 
-    effectMap=
-    {
-        {glob["FeedbackState"],glob["Feedback"]},//Effect.FeedBackState=>Effect.FeedBack
-        {glob["SpeedState"],glob["Speed"]},//Effect.Speed=>Effect.Speed
-        {glob["DepthState"],glob["Depth"]},//Effect.DepthState =>Effect.Depth
-        {glob["SyncSelectState"],glob["SyncSelect"]}, //SyncSelectState=>SyncSelect  (Not in THR_Remote)
-        {glob["FreqState"],glob["Freq"]},//Effect.FreqState => Effect.Freq 
-        {glob["PreState"], glob["Pre"]},//Effect.PreDelayState=>Effect.Pre
-        {glob["FX2MixState"],glob["FX2Mix"]}   //FX2.MixState=> FX2.Mix
-    };
-
-    THR30II_INFO_PHAS=
-    {
-        {PH_SPEED , {glob["FX2"], glob["Speed"], "Speed", 0, 100}},
-        {PH_FEEDBACK, {glob["FX2"], glob["Feedback"], "Feedback", 0, 100}},
-        {PH_MIX, {glob["GuitarProc"], glob["FX2Mix"], "Mix", 0, 100}}
-    };
+template <size_t N>
+static void resolve(const SymbolTable &glob, std::array<key_name, N> &keys, const key_name_def (&defs)[N])
+{
+	for(size_t i = 0; i < N; i++)
+	{
+		keys[i] = { resolve(glob, defs[i].sym), defs[i].name };
+	}
+}
 
-    THR30II_INFO_TREM=
-    {
-        {TR_SPEED ,{glob["FX2"], glob["Speed"], "Speed", 0, 100}}, 
-        {TR_DEPTH ,{glob["FX2"], glob["Depth"], "Depth", 0, 100}}, 
-        {TR_MIX   ,{glob["GuitarProc"], glob["FX2Mix"], "Mix", 0, 100}}
-    };
+//Resolves the keys of the parameter registry and builds the reverse index (needs THR30II_UNITS_VALS resolved before)
+static void resolve_params(const SymbolTable &glob)
+{
+	delete[] param_by_dk;
+	delete[] param_by_ck;
+	param_index_len = glob.size();
+	param_by_dk = new uint8_t[param_index_len];
+	param_by_ck = new uint8_t[param_index_len];
+
+	if(param_by_dk == nullptr || param_by_ck == nullptr)
+	{
+		Serial.println("\n\rAllocation Error for parameter index!");
+		delete[] param_by_dk;
+		delete[] param_by_ck;
+		param_by_dk = param_by_ck = nullptr;
+		param_index_len = 0;
+	}
+	else
+	{
+		memset(param_by_dk, P_NONE, param_index_len);
+		memset(param_by_ck, P_NONE, param_index_len);
+	}
+
+	for(int p = P_COUNT - 1; p >= 0; p--)  //backwards, so the chains are in ascending order
+	{
+		const param_def &d = THR30II_PARAMS[p];
+		param_keys &k = THR30II_PARAM_KEYS[p];
+		k = { THR30II_UNITS_VALS[d.cmdunit].key, resolve(glob, d.dk), d.ck[0] == '\0' ? d.fix : glob[d.ck] };
+
+		next_by_dk[p] = P_NONE;
+		next_by_ck[p] = P_NONE;
+		if(k.dk < param_index_len)
+		{
+			next_by_dk[p] = param_by_dk[k.dk];
+			param_by_dk[k.dk] = (uint8_t) p;
+		}
+		if(k.ck < param_index_len)
+		{
+			next_by_ck[p] = param_by_ck[k.ck];
+			param_by_ck[k.ck] = (uint8_t) p;
+		}
+		TRACE_V_THR30IIPEDAL(Serial.printf("Param %d: uk %04x dk %04x ck %04x %s\n\r", p, k.uk, k.dk, k.ck, d.label);)
+	}
+}
 
-    THR30II_INFO_FLAN=
-    {
-        {FL_DEPTH ,{glob["FX2"], 0x00E0, "Depth", 0, 100}},
-        {FL_SPEED ,{glob["FX2"], 0x00E4, "Speed", 0, 100}},
-        {FL_MIX   ,{glob["GuitarProc"], glob["FX2Mix"], "Mix", 0, 100}}
-    };
+THR30II_PARAM ParamByKey(uint16_t key, bool dump)
+{
+	const uint8_t *index = dump ? param_by_dk : param_by_ck;
+	return (index == nullptr || key >= param_index_len) ? P_NONE : (THR30II_PARAM) index[key];
+}
 
-    THR30II_INFO_CHOR=
-    {
-        {CH_SYNCSELECT,{glob["FX2"], glob["SyncSelect"], "SyncSelect", 0, 100}},
-        {CH_FEEDBACK,{glob["FX2"], glob["Feedback"], "Feedback", 0, 100}}, 
-        {CH_DEPTH,{glob["FX2"], glob["Depth"], "Depth", 0, 100}}, 
-        {CH_SPEED,{glob["FX2"], glob["Freq"], "Speed", 0, 100}}, 
-        {CH_PREDELAY,{glob["FX2"], glob["Pre"], "PreDelay", 0, 100}},
-        {CH_MIX,{glob["GuitarProc"], glob["FX2Mix"], "Mix", 0, 100}}
-    };
-
-    THR30II_INFO_EFFECT=
-    {
-        { PHASER ,{
-            {"SPEED", THR30II_INFO_PHAS[PH_SPEED]},
-            {"FEEDBACK" , THR30II_INFO_PHAS[PH_FEEDBACK]},
-            {"MIX", THR30II_INFO_PHAS[PH_MIX]} }
-        },
-        { TREMOLO ,{
-            {"SPEED", THR30II_INFO_TREM[TR_SPEED]},
-            {"DEPTH", THR30II_INFO_TREM[TR_DEPTH]},
-            {"MIX", THR30II_INFO_TREM[TR_MIX]} }
-        },
-        { FLANGER ,{
-            {"DEPTH", THR30II_INFO_FLAN[FL_DEPTH]},
-            {"SPEED", THR30II_INFO_FLAN[FL_SPEED]},
-            {"MIX",   THR30II_INFO_FLAN[FL_MIX]} }
-        },
-        { CHORUS ,{
-            {"FEEDBACK" , THR30II_INFO_CHOR[CH_FEEDBACK]},
-            {"DEPTH" , THR30II_INFO_CHOR[CH_DEPTH]},
-            {"SPEED" , THR30II_INFO_CHOR[CH_SPEED]},
-            {"PREDELAY" , THR30II_INFO_CHOR[CH_PREDELAY]},
-            {"MIX" , THR30II_INFO_CHOR[CH_MIX]} }
-        }
-    };
-
-    THR30II_REV_TYPES_VALS=
-    {
-        {SPRING, {glob["StandardSpring"], "Spring"}},
-        {PLATE , {glob["LargePlate1"], "Plate"}},
-        {HALL  , {glob["ReallyLargeHall"],"Hall"}},
-        {ROOM  , {glob["SmallRoom1"],"Room"}} 
-    };
+THR30II_PARAM NextParamByKey(THR30II_PARAM p, bool dump)
+{
+	if(p >= P_COUNT)
+	{
+		return P_NONE;
+	}
+	return (THR30II_PARAM) (dump ? next_by_dk[p] : next_by_ck[p]);
+}
 
-    reverbMap=
-    {
-        {glob["TimeState"], glob["Time"]},  //Reverb.TimeState=>Reverb.Reverb (Time),
-        {glob["ToneState"], glob["Tone"]},  //Reverb.ToneState =>Reverb.Tone,
-        {glob["DecayState"], glob["Decay"]},  //Reverb.DecayState => Reverb.Decay,
-        {glob["PreDelayState"], glob["PreDelay"]},  //Reverb.PreDelayState=>Reverb.PreDelay,
-        {glob["FX4WetSendState"], glob["FX4WetSend"]}  //Reverb.MixState=>Reverb.Mix 
-    };
-
-    THR30II_INFO_SPRI=
-    {
-        {SP_REVERB , {glob["FX4"], glob["Time"], "Reverb", 0, 100}},
-        {SP_TONE   , {glob["FX4"], glob["Tone"], "Tone", 0, 100}},  
-        {SP_MIX    , {glob["GuitarProc"], glob["FX4WetSend"], "Mix", 0, 100}}
-    };
+//Raw protocol values (IEEE float bits) of the display values 0..100, precomputed
+//Positive floats are ordered like their bit patterns, so a display value is found by binary search without float math
+static const uint32_t LINEAR_LUT[101] PROGMEM   //k / 100
+{
+	0x00000000, 0x3C23D70A, 0x3CA3D70A, 0x3CF5C28F, 0x3D23D70A, 0x3D4CCCCD, 0x3D75C28F, 0x3D8F5C29,
+	0x3DA3D70A, 0x3DB851EC, 0x3DCCCCCD, 0x3DE147AE, 0x3DF5C28F, 0x3E051EB8, 0x3E0F5C29, 0x3E19999A,
+	0x3E23D70A, 0x3E2E147B, 0x3E3851EC, 0x3E428F5C, 0x3E4CCCCD, 0x3E570A3D, 0x3E6147AE, 0x3E6B851F,
+	0x3E75C28F, 0x3E800000, 0x3E851EB8, 0x3E8A3D71, 0x3E8F5C29, 0x3E947AE1, 0x3E99999A, 0x3E9EB852,
+	0x3EA3D70A, 0x3EA8F5C3, 0x3EAE147B, 0x3EB33333, 0x3EB851EC, 0x3EBD70A4, 0x3EC28F5C, 0x3EC7AE14,
+	0x3ECCCCCD, 0x3ED1EB85, 0x3ED70A3D, 0x3EDC28F6, 0x3EE147AE, 0x3EE66666, 0x3EEB851F, 0x3EF0A3D7,
+	0x3EF5C28F, 0x3EFAE148, 0x3F000000, 0x3F028F5C, 0x3F051EB8, 0x3F07AE14, 0x3F0A3D71, 0x3F0CCCCD,
+	0x3F0F5C29, 0x3F11EB85, 0x3F147AE1, 0x3F170A3D, 0x3F19999A, 0x3F1C28F6, 0x3F1EB852, 0x3F2147AE,
+	0x3F23D70A, 0x3F266666, 0x3F28F5C3, 0x3F2B851F, 0x3F2E147B, 0x3F30A3D7, 0x3F333333, 0x3F35C28F,
+	0x3F3851EC, 0x3F3AE148, 0x3F3D70A4, 0x3F400000, 0x3F428F5C, 0x3F451EB8, 0x3F47AE14, 0x3F4A3D71,
+	0x3F4CCCCD, 0x3F4F5C29, 0x3F51EB85, 0x3F547AE1, 0x3F570A3D, 0x3F59999A, 0x3F5C28F6, 0x3F5EB852,
+	0x3F6147AE, 0x3F63D70A, 0x3F666666, 0x3F68F5C3, 0x3F6B851F, 0x3F6E147B, 0x3F70A3D7, 0x3F733333,
+	0x3F75C28F, 0x3F7851EC, 0x3F7AE148, 0x3F7D70A4, 0x3F800000
+};
 
-    THR30II_INFO_PLAT=
-    {
-        {PL_DECAY, {glob["FX4"], glob["Decay"], "Decay", 0, 100}},       
-        {PL_TONE, {glob["FX4"], glob["Tone"], "Tone", 0, 100}},     
-        {PL_PREDELAY, {glob["FX4"], glob["PreDelay"], "Pre-Delay", 0, 100}},
-        {PL_MIX, {glob["GuitarProc"], glob["FX4WetSend"], "Mix", 0, 100}}
-    };
+static const uint32_t THRESHOLD_LUT[101] PROGMEM   //k * 0.96 (magnitude of the threshold in dB for display value 100 - k)
+{
+	0x00000000, 0x3F75C28F, 0x3FF5C28F, 0x403851EC, 0x4075C28F, 0x4099999A, 0x40B851EC, 0x40D70A3D,
+	0x40F5C28F, 0x410A3D71, 0x4119999A, 0x4128F5C3, 0x413851EC, 0x4147AE14, 0x41570A3D, 0x41666666,
+	0x4175C28F, 0x41828F5C, 0x418A3D71, 0x4191EB85, 0x4199999A, 0x41A147AE, 0x41A8F5C3, 0x41B0A3D7,
+	0x41B851EC, 0x41C00000, 0x41C7AE14, 0x41CF5C29, 0x41D70A3D, 0x41DEB852, 0x41E66666, 0x41EE147B,
+	0x41F5C28F, 0x41FD70A4, 0x42028F5C, 0x42066666, 0x420A3D71, 0x420E147B, 0x4211EB85, 0x4215C28F,
+	0x4219999A, 0x421D70A4, 0x422147AE, 0x42251EB8, 0x4228F5C3, 0x422CCCCD, 0x4230A3D7, 0x42347AE1,
+	0x423851EC, 0x423C28F6, 0x42400000, 0x4243D70A, 0x4247AE14, 0x424B851F, 0x424F5C29, 0x42533333,
+	0x42570A3D, 0x425AE148, 0x425EB852, 0x42628F5C, 0x42666666, 0x426A3D71, 0x426E147B, 0x4271EB85,
+	0x4275C28F, 0x4279999A, 0x427D70A4, 0x4280A3D7, 0x42828F5C, 0x42847AE1, 0x42866666, 0x428851EC,
+	0x428A3D71, 0x428C28F6, 0x428E147B, 0x42900000, 0x4291EB85, 0x4293D70A, 0x4295C28F, 0x4297AE14,
+	0x4299999A, 0x429B851F, 0x429D70A4, 0x429F5C29, 0x42A147AE, 0x42A33333, 0x42A51EB8, 0x42A70A3D,
+	0x42A8F5C3, 0x42AAE148, 0x42ACCCCD, 0x42AEB852, 0x42B0A3D7, 0x42B28F5C, 0x42B47AE1, 0x42B66666,
+	0x42B851EC, 0x42BA3D71, 0x42BC28F6, 0x42BE147B, 0x42C00000
+};
 
-    THR30II_INFO_HALL=
-    {
-        {HA_DECAY     , {glob["FX4"], glob["Decay"], "Decay", 0, 100}},  
-        {HA_TONE      , {glob["FX4"], glob["Tone"], "Tone", 0, 100}},   
-        {HA_PREDELAY  , {glob["FX4"], glob["PreDelay"], "Pre-Delay", 0, 100}},
-        {HA_MIX       , {glob["GuitarProc"], glob["FX4WetSend"], "Mix", 0, 100}}
-    };
+uint8_t ParamRawToDisplay(THR30II_ENC enc, uint32_t raw)
+{
+	switch(enc)
+	{
+		case ENC_LINEAR:
+			if(raw & 0x80000000u)  //negative
+			{
+				return 0;
+			}
+			return (uint8_t) (std::upper_bound(LINEAR_LUT, LINEAR_LUT + 101, raw) - LINEAR_LUT - 1);  //floor(100 * value)
+		case ENC_THRESHOLD:
+		{
+			if(!(raw & 0x80000000u))  //0dB (or above)
+			{
+				return 100;
+			}
+			size_t k = std::lower_bound(THRESHOLD_LUT, THRESHOLD_LUT + 101, raw & 0x7FFFFFFFu) - THRESHOLD_LUT;
+			return k > 100 ? 0 : (uint8_t) (100 - k);  //floor(100 + 100 / 96 * dB)
+		}
+		default:
+			return raw > 0xFF ? 0xFF : (uint8_t) raw;  //enum, bool
+	}
+}
 
-    THR30II_INFO_ROOM =
-    {
-        {RO_DECAY    , {glob["FX4"], glob["Decay"], "Decay", 0, 100}},  
-        {RO_TONE     , {glob["FX4"], glob["Tone"], "Tone", 0, 100}},  
-        {RO_PREDELAY , {glob["FX4"], glob["PreDelay"], "Pre-Delay", 0, 100}}, 
-        {RO_MIX      , {glob["GuitarProc"], glob["FX4WetSend"], "Mix", 0, 100}}
-    };
+uint32_t ParamDisplayToRaw(THR30II_ENC enc, uint8_t val)
+{
+	switch(enc)
+	{
+		case ENC_LINEAR:
+			return LINEAR_LUT[val > 100 ? 100 : val];
+		case ENC_THRESHOLD:
+			return val >= 100 ? 0x00000000u : 0x80000000u | THRESHOLD_LUT[100 - val];
+		default:
+			return val;  //enum, bool
+	}
+}
 
-    THR30II_INFO_REVERB =
-    {
-        { SPRING , { 
-        
-            {"REVERB", THR30II_INFO_SPRI[SP_REVERB]},
-            {"TONE", THR30II_INFO_SPRI[SP_TONE]},
-            {"MIX", THR30II_INFO_SPRI[SP_MIX]}  }
-        }
-        ,
-        { PLATE , { 
-        
-            {"DECAY", THR30II_INFO_PLAT[PL_DECAY]},
-            {"TONE", THR30II_INFO_PLAT[PL_TONE]},
-            {"PREDELAY", THR30II_INFO_PLAT[PL_PREDELAY]},
-            {"MIX", THR30II_INFO_PLAT[PL_MIX]}   }
-        },
-        { HALL , {
-        
-            {"DECAY", THR30II_INFO_HALL[HA_DECAY]},
-            {"TONE", THR30II_INFO_HALL[HA_TONE]},
-            {"PREDELAY", THR30II_INFO_HALL[HA_PREDELAY]},
-            {"MIX", THR30II_INFO_HALL[HA_MIX]}  }
-        },
-        { ROOM  , {
-        
-            {"DECAY", THR30II_INFO_ROOM[RO_DECAY]},
-            {"TONE", THR30II_INFO_ROOM[RO_TONE]},
-            {"PREDELAY", THR30II_INFO_ROOM[RO_PREDELAY]},
-            {"MIX", THR30II_INFO_ROOM[RO_MIX]}  }
-        }
-    };
-
-    THR30II_GATE_VALS=
-    {
-        {GA_THRESHOLD, glob["Thresh"]}, 
-        {GA_DECAY, glob["Decay"]} 
-    };
+bool AmpAsset_ToColAmp(const char *asset, col_amp &ca)  //by the asset name used in patch files (works without symbol table)
+{
+	if(asset == nullptr)
+	{
+		return false;
+	}
+	for(uint8_t c = CLASSIC; c <= MODERN; c++)
+	{
+		for(uint8_t a = CLEAN; a <= FLAT; a++)
+		{
+			if(strcmp(AMP_SYMS[c][a], asset) == 0)
+			{
+				ca = col_amp((THR30II_COL) c, (THR30II_AMP) a);
+				return true;
+			}
+		}
+	}
+	return false;
+}
 
-    gateMap=
-    {
-        {glob["DecayState"], glob["Decay"]}, 
-        {glob["ThreshState"], glob["Thresh"]} 
-    };
+const char *ColAmp_ToAmpAsset(THR30II_COL c, THR30II_AMP a)  //the asset name for patch files (nullptr, if out of range)
+{
+	return (c <= MODERN && a <= FLAT) ? AMP_SYMS[c][a] : nullptr;
+}
 
-    THR30II_CTRL_VALS=
-    {
-        {CTRL_GAIN   , glob["Drive"]},
-        {CTRL_MASTER , glob["Master"]},
-        {CTRL_BASS   , glob["Bass"]},
-        {CTRL_MID    , glob["Mid"]},
-        {CTRL_TREBLE , glob["Treble"]}
-    };
-
-    controlMap = 
-    {
-        {glob["MasterState"],  glob["Master"]},
-        {glob["BassState"],  glob["Bass"]},
-        {glob["MidState"],  glob["Mid"]},
-        {glob["TrebleState"],  glob["Treble"]},
-        {glob["DriveState"],  glob["Drive"]}    //Drive=Gain
-    };
-    
-    THR30II_ECHO_TYPES_VALS =
-    {
-        {TAPE_ECHO, {glob["TapeEcho"], "Tape Echo"}},
-        {DIGITAL_DELAY, {glob["L6DigitalDelay"],"Digital Delay"}}
-    };
+void THR30II_Settings::Init_Dictionaries()
+{
+    const SymbolTable & glob = Constants::glo ;
 
-    echoMap=   //Map patch keys to MIDI keys
-    {
-        {glob["BassState"], glob["Bass"]}, 
-        {glob["TrebleState"], glob["Treble"]},  
-        {glob["FeedbackState"], glob["Feedback"]}, 
-        {glob["SyncSelectState"], glob["SyncSelect"]}, //SyncSelectState=>SyncSelect  (Not in THR_Remote) 
-        {glob["TimeState"], glob["Time"]}, 
-        {glob["FX3MixState"], glob["FX3Mix"]} 
-    };
-    
-    THR30II_INFO_TAPE= //Information about settings for echo type "Tape Echo":  (unit key,  settings key, name, lower limit, upper limit)
-    {
-        {TA_BASS, {glob["FX3"], glob["Bass"], "Bass", 0, 100}},
-        {TA_TREBLE, {glob["FX3"], glob["Treble"], "Treble", 0, 100}},
-        {TA_FEEDBACK, {glob["FX3"], glob["Feedback"], "Feedback", 0, 100}},
-        {TA_MIX, {glob["GuitarProc"], glob["FX3Mix"], "Mix", 0, 100}}, 
-        {TA_TIME, {glob["FX3"], glob["Time"], "Time", 0, 100}},
-        {TA_SYNCSELECT, {glob["FX3"], glob["SyncSelect"], "SyncSelect", 0, 100}}
-    };
-
-    THR30II_INFO_DIGI= //Information about settings for echo type "Digital Delay":  (unit key,  settings key, name, lower limit, upper limit)
-    {
-        {DD_BASS, {glob["FX3"], glob["Bass"], "Bass", 0, 100}},
-        {DD_TREBLE, {glob["FX3"], glob["Treble"], "Treble", 0, 100}},
-        {DD_FEEDBACK, {glob["FX3"], glob["Feedback"], "Feedback", 0, 100}},
-        {DD_MIX, {glob["GuitarProc"], glob["FX3Mix"], "Mix", 0, 100}},
-        {DD_TIME, {glob["FX3"], glob["Time"], "Time", 0, 100}},
-        {DD_SYNCSELECT, {glob["FX3"], glob["SyncSelect"], "SyncSelect", 0, 100}}
-    };
-
-    THR30II_INFO_ECHO=  //Information about settings depending on echo type:  (unit key,  settings key, name, lower limit, upper limit)
-    {
-        {TAPE_ECHO, {
-            {
-                {"BASS", THR30II_INFO_TAPE[TA_BASS]},
-                {"TREBLE", THR30II_INFO_TAPE[TA_TREBLE]},
-                {"FEEDBACK", THR30II_INFO_TAPE[TA_FEEDBACK]},
-                {"TIME", THR30II_INFO_TAPE[TA_TIME]},
-                {"MIX", THR30II_INFO_TAPE[TA_MIX]} }
-            }
-        }
-        ,
-        {DIGITAL_DELAY, {
-            {
-                {"BASS", THR30II_INFO_DIGI[DD_BASS]},
-                {"TREBLE", THR30II_INFO_DIGI[DD_TREBLE]},
-                {"FEEDBACK", THR30II_INFO_DIGI[DD_FEEDBACK]},
-                {"TIME", THR30II_INFO_DIGI[DD_TIME]},
-                {"MIX", THR30II_INFO_DIGI[DD_MIX]} }
-            }
-        }
-    };
-
-    THR30II_COMP_VALS=
+    for(size_t c = 0; c < THR30IIAmpKeys.size(); c++)
     {
-        {CO_SUSTAIN, glob["Sustain"]}, 
-        {CO_LEVEL , glob["Level"]},
-        {CO_MIX   , glob["FX1Mix"]}
-    };
+        resolve(glob, THR30IIAmpKeys[c], AMP_SYMS[c]);
+    }
 
-    compressorMap=
-    {
-        {glob["SustainState"],glob["Sustain"]}, //SustainState=> Sustain,
-        {glob["LevelState"]  ,glob["Level"]  },  //LEVELSTATE=> Level,
-        {glob["FX1MixState"] ,glob["FX1Mix"] }  //FX1MixState=> FX1Mix Compressor-Mix
-    };
-    
-    effect_setting=
-    {
-        {
-            {PHASER ,{ {PH_SPEED,    0.0}, {PH_FEEDBACK , 0.0}, {PH_MIX  , 0.0} }},
-            {TREMOLO,{ {TR_SPEED,    0.0}, {TR_DEPTH    , 0.0}, {TR_MIX  , 0.0} }},
-            {FLANGER,{ {FL_DEPTH,    0.0}, {FL_SPEED    , 0.0}, {FL_MIX  , 0.0} }},
-            {CHORUS ,{ {CH_FEEDBACK, 0.0}, {CH_DEPTH    , 0.0}, {CH_SPEED, 0.0}, {CH_PREDELAY , 0.0}, {CH_MIX, 0.0} } }
-        }
-    };
-            
-}
+    resolve(glob, THR30II_UNITS_VALS, UNITS_DEFS);  //first, the unit keys are used by the parameter registry
+    resolve(glob, THR30II_EFF_TYPES_VALS, EFF_TYPES_DEFS);
+    resolve(glob, THR30II_REV_TYPES_VALS, REV_TYPES_DEFS);
+    resolve(glob, THR30II_ECHO_TYPES_VALS, ECHO_TYPES_DEFS);
+    resolve_params(glob);
+
+    TRACE_THR30IIPEDAL(
+        size_t ram = sizeof(THR30IIAmpKeys) + sizeof(THR30II_UNITS_VALS) + sizeof(THR30II_EFF_TYPES_VALS) + sizeof(THR30II_REV_TYPES_VALS)
+                   + sizeof(THR30II_ECHO_TYPES_VALS) + sizeof(THR30II_PARAM_KEYS) + sizeof(next_by_dk) + sizeof(next_by_ck);
+        Serial.printf("Dictionaries: %d bytes RAM static, %d bytes heap (parameter index), free memory: %d\n\r",
+                       (int) ram, 2 * (int) param_index_len, freeMemory());
+    )
+
+    effect_setting = {};
 
+}
\ No newline at end of file
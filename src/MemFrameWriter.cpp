@@ -0,0 +1,120 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* MemFrameWriter.cpp
+*  SysEx frames of a memory write (patch uploads, user presets, the patch name), bitbucketed while the data is generated
+*/
+
+#include <Arduino.h>
+#include <array>
+#include <algorithm>
+#include "Globals.h"   //Enbucket()
+#include "MemFrameWriter.h"
+
+//Frames of a memory write:
+//header:  f0 00 01 0c 24 02 4d 01 06 00 01 0b  (28 bytes bitbucketed)  f7   = 45 bytes
+//slices:  f0 00 01 0c 24 02 4d 01 07 <slice nr> <length field>  (up to 210 bytes bitbucketed)  f7
+#define MEMFRAME_HEADER_LEN 45
+static const byte MEMFRAME_PREFIX[8] = { 0xf0, 0x00, 0x01, 0x0c, 0x24, 0x02, 0x4d, 0x01 };
+
+MemFrameWriter::MemFrameWriter(PatchFrames &pf) : _pf(pf), _last(pf.data), _stackLow((const byte *) UINTPTR_MAX)
+{
+	_pf.count = 1;  //the header frame is reserved, finish() fills it
+	_pf.len[0] = MEMFRAME_HEADER_LEN;
+	_last += MEMFRAME_HEADER_LEN;
+}
+
+bool MemFrameWriter::reserve(size_t n)
+{
+	if(_overflow || _last + n > std::end(_pf.data))
+	{
+		_overflow = true;
+		return false;
+	}
+	return true;
+}
+
+void MemFrameWriter::beginSlice()
+{
+	if(_pf.count >= PATCH_FRAMES_MAX || !reserve(12))
+	{
+		_overflow = true;
+		return;
+	}
+	_frame = _last;
+	_last = std::copy(std::begin(MEMFRAME_PREFIX), std::end(MEMFRAME_PREFIX), _last);
+	*_last++ = 0x07;                            //memory frame counter is not incremented inside sent patches
+	*_last++ = (byte)((_pf.count - 1) % 128);   //slice counter
+	_last += 2;                                 //length field is set by endSlice()
+}
+
+void MemFrameWriter::put(byte b)
+{
+	if(_inGroup == 0)  //start a new 8/7 group
+	{
+		if(_inSlice == 0)
+		{
+			beginSlice();
+		}
+		if(!reserve(8 + 1))  //the group and a closing 0xF7
+		{
+			return;
+		}
+		_group = _last;
+		memset(_group, 0, 8);
+		_last += 8;
+	}
+	_group[0] |= (byte)((b & 0b10000000) >> (1 + _inGroup));  //MSB into the "bit bucket" in front of the group
+	_group[1 + _inGroup] = (byte)(b & 0b01111111);             //the rest behind it
+	_inGroup = (uint8_t)((_inGroup + 1) % 7);
+	_len++;
+	if(++_inSlice == 210)
+	{
+		endSlice(0x0d, 0x01);  //full slice
+	}
+}
+
+void MemFrameWriter::endSlice(byte len1, byte len2)
+{
+	_frame[10] = len1;
+	_frame[11] = len2;
+	*_last++ = 0xF7;
+	_pf.len[_pf.count++] = (uint16_t)(_last - _frame);
+	_inSlice = 0;
+	_inGroup = 0;
+	byte probe;  //a slice is finished in the deepest call of the generating code
+	if(&probe < _stackLow) _stackLow = &probe;
+}
+
+bool MemFrameWriter::finish(uint32_t target)
+{
+	if(_inSlice > 0 && !_overflow)  //last slice: length of its data before bitbucketing
+	{
+		endSlice((byte)((_inSlice - 1) / 16), (byte)((_inSlice - 1) % 16));
+	}
+	if(_overflow)
+	{
+		_pf.count = 0;
+		return false;
+	}
+
+	//opcode memory write, 1st length field (data + 3 values + type field), user patch (0..4, 0xFFFFFFFF: actual patch),
+	//2nd length field (data + the following 3 values), 3 values that are always the same
+	const uint32_t fields[7] = { 0x0du, _len + 20, target, _len + 12, 0x0u, 0x1u, 0x0u };
+	std::array<byte,28> hdr;
+	for(size_t i = 0; i < 28; i++)
+	{
+		hdr[i] = (byte)(fields[i / 4] >> (8 * (i % 4)));
+	}
+	std::array<byte,32> bucketed;
+	byte *blast = Enbucket(bucketed, hdr, hdr.end());  //gives no incomplete 8/7 group
+
+	byte *h = std::copy(std::begin(MEMFRAME_PREFIX), std::end(MEMFRAME_PREFIX), _pf.data);
+	*h++ = 0x06;  //memory frame counter
+	*h++ = 0x00;  //"same frame counter" and payload size for the header
+	*h++ = 0x01;
+	*h++ = 0x0b;
+	h = std::copy(bucketed.begin(), blast, h);
+	*h = 0xF7;
+	return true;
+}
@@ -0,0 +1,61 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* MemFrameWriter.h
+*  SysEx frames of a memory write (patch uploads, user presets, the patch name), bitbucketed while the data is generated
+*/
+
+#ifndef _MEMFRAMEWRITER_H_
+#define _MEMFRAMEWRITER_H_
+
+#include <Arduino.h>
+#include <vector>
+
+#define PATCH_FRAMES_MAX 12                     //header frame + slices of an upload (up to 2000 bytes of patch data)
+#define PATCH_FRAMES_BYTES (PATCH_FRAMES_MAX * 253)  //a slice is 210 bytes, 240 after bitbucketing, 253 with SysEx header and 0xF7
+#define UPLOAD_MSG_ID 100                       //out message ids of uploads and the patch name: UPLOAD_MSG_ID (header), UPLOAD_MSG_ID + 1... (slices)
+
+//The finished SysEx frames of a patch upload, ready for streaming to THR
+struct PatchFrames
+{
+	uint8_t count = 0;                     //number of frames (0 = nothing prepared)
+	uint32_t context = 0;                  //THR30II_Settings::PatchContext() when the frames were built
+	uint16_t len[PATCH_FRAMES_MAX] {};     //length of each frame
+	byte data[PATCH_FRAMES_BYTES];         //the frames one after the other
+};
+
+//Builds the frames of a memory write (see renderPatch()) while the data is generated:
+//each byte is bitbucketed at once into the frame of its 210-byte slice, a frame is finished as soon as its slice is full.
+//The header frame (it contains the total length) is reserved in front and filled by finish().
+//Every memory write (patch uploads, user presets, the patch name) is built by it and queued by queueMemoryWrite().
+class MemFrameWriter
+{
+	public:
+	  MemFrameWriter(PatchFrames &pf);
+	  void put(byte b);
+	  void put(const byte *p, size_t n) { while(n--) put(*p++); };
+	  void put(const std::vector<byte> &v) { put(v.data(), v.size()); };
+	  void put2(uint16_t v) { put((byte)v); put((byte)(v >> 8)); };
+	  void put4(uint32_t v) { put2((uint16_t)v); put2((uint16_t)(v >> 16)); };
+	  bool finish(uint32_t target = 0xFFFFFFFFu);  //header and last slice, target: user preset 0..4 or 0xFFFFFFFF (actual patch)
+	                                          //(false: frames did not fit, nothing prepared)
+	  uint32_t length() const { return _len; };  //data bytes (before bitbucketing)
+	  const byte *stackLow() const { return _stackLow; };  //deepest stack address seen, when a slice was finished
+
+	private:
+	  bool reserve(size_t n);                 //room for n more bytes in the current frame
+	  void beginSlice();
+	  void endSlice(byte len1, byte len2);    //length field of the slice and 0xF7
+
+	  PatchFrames &_pf;
+	  byte *_last;                            //end of the written frames
+	  byte *_frame = nullptr;                 //start of the current slice frame
+	  byte *_group = nullptr;                 //current 8/7 group
+	  const byte *_stackLow;
+	  uint32_t _len = 0;
+	  uint8_t _inSlice = 0;                   //data bytes in the current slice (up to 210)
+	  uint8_t _inGroup = 0;                   //data bytes in the current group (up to 7)
+	  bool _overflow = false;
+};
+
+#endif
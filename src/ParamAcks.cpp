@@ -0,0 +1,230 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* ParamAcks.cpp
+*  Parameter changes tracked until THR acknowledged them (rollback of lost changes, ack latency per parameter)
+*/
+
+#include <Arduino.h>
+#include "ParamAcks.h"
+
+//Normal TRACE/DEBUG
+#define TRACE_THR30IIPEDAL(x) x
+//#define TRACE_THR30IIPEDAL(x)
+
+//Verbose TRACE/DEBUG
+//#define TRACE_V_THR30IIPEDAL(x)	x
+#define TRACE_V_THR30IIPEDAL(x)
+
+ParamAcks param_acks;
+
+int8_t ParamAcks::find(THR30II_PARAM p) const
+{
+	for(uint8_t i = 0; i < _count; i++)
+	{
+		if(_ring[(_head + i) % PARAM_ACK_RING].param == p)
+		{
+			return (int8_t) i;
+		}
+	}
+	return -1;
+}
+
+bool ParamAcks::pending(THR30II_PARAM p) const
+{
+	for(uint8_t i = 0; i < _count; i++)
+	{
+		const Pending &e = _ring[(_head + i) % PARAM_ACK_RING];
+		if(e.param == p && e.epoch == _epoch)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+ParamAcks::Pending ParamAcks::pop(int8_t k)
+{
+	Pending e = _ring[(_head + k) % PARAM_ACK_RING];
+	_head = (uint8_t)((_head + k + 1) % PARAM_ACK_RING);
+	_count = (uint8_t)(_count - k - 1);
+	return e;
+}
+
+void ParamAcks::Queued(THR30II_PARAM p, uint32_t before, uint32_t value)
+{
+	if(p >= P_COUNT)
+	{
+		return;
+	}
+	if(_count == PARAM_ACK_RING)  //can not happen with the out queue size of 30
+	{
+		TRACE_THR30IIPEDAL(Serial.printf("ParamAcks: ring full, change of parameter %u not tracked\n\r", p);)
+		return;
+	}
+	if(!pending(p))
+	{
+		_confirmed[p] = before;
+	}
+	_ring[(_head + _count) % PARAM_ACK_RING] = Pending { p, value, micros(), 0, _epoch };
+	_count++;
+}
+
+void ParamAcks::Dropped(THR30II_PARAM p)
+{
+	if(p < P_COUNT)
+	{
+		_lost[p] = true;  //THR keeps its value, the mirror still has it
+		_dropped++;
+		_droppedNew = true;
+	}
+}
+
+void ParamAcks::Sent(uint16_t id)
+{
+	if(id < PARAM_ACK_ID || id >= PARAM_ACK_ID + P_COUNT)
+	{
+		return;
+	}
+	for(uint8_t i = 0; i < _count; i++)
+	{
+		Pending &e = _ring[(_head + i) % PARAM_ACK_RING];
+		if(e.param == (THR30II_PARAM)(id - PARAM_ACK_ID) && e.sent_us == 0)
+		{
+			e.sent_us = micros();
+			e.sent_us += e.sent_us == 0 ? 1 : 0;  //0 means "not sent"
+			return;
+		}
+	}
+}
+
+bool ParamAcks::Acked(uint16_t id)
+{
+	if(id < PARAM_ACK_ID || id >= PARAM_ACK_ID + P_COUNT)
+	{
+		return false;
+	}
+	THR30II_PARAM p = (THR30II_PARAM)(id - PARAM_ACK_ID);
+	int8_t k = find(p);
+	if(k < 0)
+	{
+		return false;
+	}
+	Pending e = pop(k);
+	uint32_t now = micros();
+	uint32_t lat = e.sent_us != 0 ? now - e.sent_us : 0;
+	_last[p] = lat;
+	_worst[p] = max(_worst[p], lat);
+	_count_p[p]++;
+	_sum += lat;
+	_worst_all = max(_worst_all, lat);
+	_acks++;
+	TRACE_V_THR30IIPEDAL(Serial.printf("ParamAcks: parameter %u acknowledged after %lu us (%lu us queued)\n\r", p, lat, now - e.queued_us);)
+
+	bool changed = now - e.queued_us > PARAM_SLOW_US;  //unit was shown behind
+	if(e.epoch == _epoch)
+	{
+		_confirmed[p] = e.value;
+		changed = changed || _lost[p];
+		_lost[p] = false;
+	}
+	return changed;
+}
+
+THR30II_PARAM ParamAcks::Timeout(uint16_t id, uint32_t &value, uint32_t &rollback)
+{
+	if(id < PARAM_ACK_ID || id >= PARAM_ACK_ID + P_COUNT)
+	{
+		return P_NONE;
+	}
+	THR30II_PARAM p = (THR30II_PARAM)(id - PARAM_ACK_ID);
+	int8_t k = find(p);
+	if(k < 0)
+	{
+		return P_NONE;
+	}
+	Pending e = pop(k);
+	_lost_p[p]++;
+	_timeouts++;
+	if(e.epoch != _epoch)  //settings came from THR meanwhile
+	{
+		return P_NONE;
+	}
+	_lost[p] = true;
+	if(pending(p))  //the newer change decides
+	{
+		return P_NONE;
+	}
+	value = e.value;
+	rollback = _confirmed[p];
+	return p;
+}
+
+void ParamAcks::Resync()
+{
+	_epoch++;
+	_lost.reset();
+}
+
+void ParamAcks::Flush()
+{
+	_head = 0;
+	_count = 0;
+}
+
+void ParamAcks::Reset()
+{
+	memset(_last, 0, sizeof(_last));
+	memset(_worst, 0, sizeof(_worst));
+	memset(_count_p, 0, sizeof(_count_p));
+	memset(_lost_p, 0, sizeof(_lost_p));
+	_sum = 0;
+	_worst_all = 0;
+	_acks = 0;
+	_timeouts = 0;
+	_dropped = 0;
+}
+
+ParamSync ParamAcks::UnitSync(THR30II_UNITS u) const
+{
+	for(uint8_t p = 0; p < P_COUNT; p++)
+	{
+		if(_lost[p] && THR30II_PARAMS[p].unit == u)
+		{
+			return PSYNC_LOST;
+		}
+	}
+	uint32_t now = micros();
+	for(uint8_t i = 0; i < _count; i++)
+	{
+		const Pending &e = _ring[(_head + i) % PARAM_ACK_RING];
+		if(THR30II_PARAMS[e.param].unit == u && now - e.queued_us > PARAM_SLOW_US)
+		{
+			return PSYNC_BEHIND;
+		}
+	}
+	return PSYNC_OK;
+}
+
+bool ParamAcks::Overdue()
+{
+	bool overdue = _count > 0 && micros() - _ring[_head].queued_us > PARAM_SLOW_US;
+	bool changed = (overdue && !_overdue) || _droppedNew;
+	_overdue = overdue;
+	_droppedNew = false;
+	return changed;
+}
+
+void ParamAcks::Export() const
+{
+	Serial.printf("\n\rParameter changes: %lu acknowledged, %lu timed out, %lu dropped, %u pending, ack mean %lu us, worst %lu us\n\r",
+	              _acks, _timeouts, _dropped, _count, mean(), worst());
+	Serial.println("param,key,acks,timeouts,last_us,worst_us");
+	for(uint8_t p = 0; p < P_COUNT; p++)
+	{
+		if(_count_p[p] > 0 || _lost_p[p] > 0)
+		{
+			Serial.printf("%u,%s,%u,%u,%lu,%lu\n\r", p, THR30II_PARAMS[p].dk, _count_p[p], _lost_p[p], _last[p], _worst[p]);
+		}
+	}
+}
@@ -0,0 +1,85 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* ParamAcks.h
+*  Parameter changes tracked until THR acknowledged them (rollback of lost changes, ack latency per parameter)
+*/
+
+#ifndef _PARAMACKS_H_
+#define _PARAMACKS_H_
+
+#include <Arduino.h>
+#include "THR30II.h"   //THR30II_PARAM, THR30II_UNITS
+
+#define PARAM_ACK_ID   1100    //out message ids of tracked parameter changes: PARAM_ACK_ID + parameter (header frames keep 1000)
+#define PARAM_ACK_RING 16      //changes waiting for their ack (2 out messages each, so the out queue holds less of them)
+#define PARAM_SLOW_US  100000  //a change waiting longer for its ack shows THR falling behind
+
+enum ParamSync : uint8_t
+{
+	PSYNC_OK,         //all changes of the unit acknowledged
+	PSYNC_BEHIND,     //a change of the unit waits longer than PARAM_SLOW_US
+	PSYNC_LOST        //a change of the unit timed out (rolled back to the value THR acknowledged last)
+};
+
+//THR acknowledges the body frames in the order of the out queue, so the pending changes are kept in a ring in the same order.
+//The value THR acknowledged last is remembered per parameter, while changes of it are pending. A change, that times out,
+//is rolled back to it, unless a newer change of the parameter is still on its way (it decides then).
+class ParamAcks
+{
+	public:
+	  static uint16_t Id(THR30II_PARAM p) { return (uint16_t)(PARAM_ACK_ID + p); };
+	  void Queued(THR30II_PARAM p, uint32_t before, uint32_t value);  //change queued (before: value in the mirror of THR)
+	  void Dropped(THR30II_PARAM p);              //change could not be queued (out queue full)
+	  void Sent(uint16_t id);                     //an out message was sent out
+	  bool Acked(uint16_t id);                    //an out message was acknowledged (true: sync state of a unit changed)
+	  THR30II_PARAM Timeout(uint16_t id, uint32_t &value, uint32_t &rollback);  //parameter to roll back from value (P_NONE: nothing to do)
+	  void Resync();                              //all settings came from THR (pending changes do not roll back any more)
+	  void Flush();                               //out queue was cleared
+	  void Reset();                               //statistics
+	  ParamSync UnitSync(THR30II_UNITS u) const;
+	  bool Waiting(THR30II_PARAM p) const { return find(p) >= 0; };  //a change of p is not acknowledged yet
+	  bool Lost(THR30II_PARAM p) const { return p < P_COUNT && _lost[p]; };
+	  bool Overdue();                             //true once, when the oldest pending change gets too slow or a change was dropped (redraw the markers)
+	  uint8_t backlog() const { return _count; };
+	  uint32_t acks() const { return _acks; };
+	  uint32_t timeouts() const { return _timeouts; };
+	  uint32_t mean() const { return _acks > 0 ? (uint32_t)(_sum / _acks) : 0; };  //us from sending until the ack
+	  uint32_t worst() const { return _worst_all; };
+	  void Export() const;                        //latency per parameter as CSV over serial
+
+	private:
+	  struct Pending
+	  {
+		  THR30II_PARAM param;
+		  uint32_t value;
+		  uint32_t queued_us;
+		  uint32_t sent_us;                       //0: still in the out queue
+		  uint16_t epoch;
+	  };
+	  int8_t find(THR30II_PARAM p) const;         //oldest pending change of p (-1: none)
+	  bool pending(THR30II_PARAM p) const;        //a change of p of the actual epoch is pending
+	  Pending pop(int8_t k);                      //removes entry k (and the older ones, they will never be answered)
+
+	  Pending _ring[PARAM_ACK_RING] {};
+	  uint8_t _head = 0;
+	  uint8_t _count = 0;
+	  uint16_t _epoch = 0;
+	  bool _overdue = false;
+	  bool _droppedNew = false;                   //a change was dropped since the last Overdue()
+	  uint32_t _confirmed[P_COUNT] {};            //value THR acknowledged last (while changes of the parameter are pending)
+	  std::bitset<P_COUNT> _lost;
+	  uint32_t _last[P_COUNT] {};                 //ack latency (us) per parameter
+	  uint32_t _worst[P_COUNT] {};
+	  uint16_t _count_p[P_COUNT] {};
+	  uint16_t _lost_p[P_COUNT] {};
+	  uint64_t _sum = 0;
+	  uint32_t _worst_all = 0;
+	  uint32_t _acks = 0;
+	  uint32_t _timeouts = 0;
+	  uint32_t _dropped = 0;
+};
+
+extern ParamAcks param_acks;
+
+#endif
@@ -10,6 +10,8 @@
 //#include <stdexcept>   //exceptions are problematic on Arduino / Teensy we avoid them
 #include "THR30II_Pedal.h"
 #include "Globals.h"
+#include "SlotSync.h"
+#include "ParamAcks.h"
 
 //Function walks through an incoming MIDI-SysEx-Message and parses it's meaning
 //cur[] : the buffer
@@ -23,7 +25,7 @@ String THR30II_Settings::ParseSysEx(const byte cur[], int cur_len)
         return "SysEx too short!";
     }
 
-    std::map<String,uint16_t> & glob = Constants::glo ;  //Reference to the symbol table (received in the forefield)
+    const SymbolTable & glob = Constants::glo ;  //Reference to the symbol table (received in the forefield)
 
     sendChangestoTHR = false;  //do not send THR-caused setting changes back to THR!
 
@@ -363,6 +365,24 @@ String THR30II_Settings::ParseSysEx(const byte cur[], int cur_len)
                                     outqueue.getHeadPtr()->_answered = true;  //this request is answered
                                 }
 
+                                forget_symbol_cache();  //the table of this firmware replaces the one before (load_symbol_cache() arms the verification again)
+
+                                if (Constants::set_baked(Firmware))  //symbol table for this firmware is baked into flash
+                                {
+                                    result+="\n\rUsing baked symbol table (dump request skipped).\n\r";
+                                    Init_Dictionaries();  //Now use constants in this App's dictionaries
+                                    SendStartupRequests();
+                                    break;
+                                }
+
+                                if (load_symbol_cache(Firmware))  //symbol table for this firmware was stored on SD before
+                                {
+                                    result+="\n\rSymbol table loaded from SD cache (dump request skipped).\n\r";
+                                    Init_Dictionaries();  //Now use constants in this App's dictionaries
+                                    SendStartupRequests();
+                                    break;
+                                }
+
                                 //Now ask for the symbol table
                                 //Answer will be the symbol dump, we can not go on without it - await answer
                                 //Question requires no following frame
@@ -453,124 +473,124 @@ String THR30II_Settings::ParseSysEx(const byte cur[], int cur_len)
                         {
                             col_amp ca {CLASSIC, CLEAN};
                         
-                            if(msgVals[3]==THR30IIAmpKeys[ col_amp{CLASSIC, CLEAN} ]) //0x004A:  "THR10C_Deluxe"
+                            if(msgVals[3]==THR30IIAmpKeys[CLASSIC][CLEAN]) //0x004A:  "THR10C_Deluxe"
                             {
                                 result+=" CLEAN CLASSIC";
                                 ca = THR30IIAmpKey_ToColAmp((uint16_t)msgVals[3]);
                                 SetColAmp( ca.c, ca.a );
                             }
-                            else if (msgVals[3]== THR30IIAmpKeys[col_amp{BOUTIQUE, CRUNCH} ]) //0x0071: "THR10C_Mini"
+                            else if (msgVals[3]== THR30IIAmpKeys[BOUTIQUE][CRUNCH]) //0x0071: "THR10C_Mini"
                             {
                                 result+=" CRUNCH BOUTIQUE";
                                 ca = THR30IIAmpKey_ToColAmp((uint16_t)msgVals[3]);
                                 SetColAmp(ca.c, ca.a);
                             }
-                            else if(msgVals[3] == THR30IIAmpKeys[col_amp{CLASSIC, SPECIAL}]) //0x0078:  "THR10X_Brown1"
+                            else if(msgVals[3] == THR30IIAmpKeys[CLASSIC][SPECIAL]) //0x0078:  "THR10X_Brown1"
                             {    result+=" SPECIAL  CLASSIC";
                                 ca = THR30IIAmpKey_ToColAmp((uint16_t)msgVals[3]);
                                 SetColAmp(ca.c, ca.a);
                             }
-                            else if(msgVals[3] == THR30IIAmpKeys[col_amp{CLASSIC, HI_GAIN}]) //0x007F:  "THR10_Modern"
+                            else if(msgVals[3] == THR30IIAmpKeys[CLASSIC][HI_GAIN]) //0x007F:  "THR10_Modern"
                             {    result+=" HIGHGAIN Classic";
                                 ca = THR30IIAmpKey_ToColAmp((uint16_t)msgVals[3]);
                                 SetColAmp(ca.c, ca.a);
                             }
-                            else if(msgVals[3] == THR30IIAmpKeys[col_amp{BOUTIQUE, SPECIAL}])//0x0084: "THR10X_South"
+                            else if(msgVals[3] == THR30IIAmpKeys[BOUTIQUE][SPECIAL])//0x0084: "THR10X_South"
                             {    result+=" SPECIAL BOUTIQUE";
                                 ca = THR30IIAmpKey_ToColAmp((uint16_t)msgVals[3]);
                                 SetColAmp(ca.c, ca.a);
                             }
-                            else if(msgVals[3] == THR30IIAmpKeys[col_amp{CLASSIC, CRUNCH}])//0x0088:  "THR10C_DC30"
+                            else if(msgVals[3] == THR30IIAmpKeys[CLASSIC][CRUNCH])//0x0088:  "THR10C_DC30"
                             {    result+=" CRUNCH CLASSIC";
                                 ca = THR30IIAmpKey_ToColAmp((uint16_t)msgVals[3]);
                                 SetColAmp(ca.c, ca.a);
                             }
-                            else if(msgVals[3] == THR30IIAmpKeys[col_amp{MODERN, HI_GAIN}])//0x008B:  "THR10X_Brown2"
+                            else if(msgVals[3] == THR30IIAmpKeys[MODERN][HI_GAIN])//0x008B:  "THR10X_Brown2"
                             {    result+=" HIGAIN MODERN";
                                 ca = THR30IIAmpKey_ToColAmp((uint16_t)msgVals[3]);
                                 SetColAmp(ca.c, ca.a);
                             }
-                            else if(msgVals[3] ==  THR30IIAmpKeys[col_amp{CLASSIC, FLAT}])//0x008F:  "THR10_Flat"
+                            else if(msgVals[3] ==  THR30IIAmpKeys[CLASSIC][FLAT])//0x008F:  "THR10_Flat"
                             {    result+=" FLAT CLASSIC";
                                 ca = THR30IIAmpKey_ToColAmp((uint16_t)msgVals[3]);
                                 SetColAmp(ca.c, ca.a);
                             }
-                            else if(msgVals[3] == THR30IIAmpKeys[col_amp{CLASSIC, ACO}])//0x0093:  "THR10_Aco_Condenser1"
+                            else if(msgVals[3] == THR30IIAmpKeys[CLASSIC][ACO])//0x0093:  "THR10_Aco_Condenser1"
                             {    result+=" ACOUSTIC CLASSIC";
                                 ca = THR30IIAmpKey_ToColAmp((uint16_t)msgVals[3]);
                                 SetColAmp(ca.c, ca.a);
                             }
-                            else if(msgVals[3] == THR30IIAmpKeys[col_amp{MODERN, ACO}])//0x0097:  "THR10_Aco_Dynamic1"
+                            else if(msgVals[3] == THR30IIAmpKeys[MODERN][ACO])//0x0097:  "THR10_Aco_Dynamic1"
                             {    result+=" ACOUSTIC MODERN";
                                 ca = THR30IIAmpKey_ToColAmp((uint16_t)msgVals[3]);
                                 SetColAmp(ca.c, ca.a);
                             }
-                            else if(msgVals[3]  == THR30IIAmpKeys[col_amp{BOUTIQUE, ACO}])//0x0098:  "THR10_Aco_Tube1"
+                            else if(msgVals[3]  == THR30IIAmpKeys[BOUTIQUE][ACO])//0x0098:  "THR10_Aco_Tube1"
                             {    result+=" ACOUSTIC BOUTIQUE";
                                 ca = THR30IIAmpKey_ToColAmp((uint16_t)msgVals[3]);
                                 SetColAmp(ca.c, ca.a);
                             }
-                            else if(msgVals[3]  == THR30IIAmpKeys[col_amp{CLASSIC, LEAD}])//0x0099:  "THR10_Lead"
+                            else if(msgVals[3]  == THR30IIAmpKeys[CLASSIC][LEAD])//0x0099:  "THR10_Lead"
                             {    result+=" LEAD CLASSIC";
                                 ca = THR30IIAmpKey_ToColAmp((uint16_t)msgVals[3]);
                                 SetColAmp(ca.c, ca.a);
                             }
-                            else if(msgVals[3]  == THR30IIAmpKeys[col_amp{MODERN, SPECIAL}])//0x009C:  "THR30_Stealth"
+                            else if(msgVals[3]  == THR30IIAmpKeys[MODERN][SPECIAL])//0x009C:  "THR30_Stealth"
                             {    result+=" SPECIAL MODERN";
                                 ca = THR30IIAmpKey_ToColAmp((uint16_t)msgVals[3]);
                                 SetColAmp(ca.c, ca.a);
                             }
-                            else if(msgVals[3]  == THR30IIAmpKeys[col_amp{MODERN, CRUNCH}]) //0x00A3:  "THR30_SR101"
+                            else if(msgVals[3]  == THR30IIAmpKeys[MODERN][CRUNCH]) //0x00A3:  "THR30_SR101"
                             {    result+=" CRUNCH MODERN";
                                 ca = THR30IIAmpKey_ToColAmp((uint16_t)msgVals[3]);
                                 SetColAmp(ca.c, ca.a);
                             }
-                            else if(msgVals[3]  == THR30IIAmpKeys[col_amp{BOUTIQUE, LEAD}])//0x00A8:  "THR30_Blondie"
+                            else if(msgVals[3]  == THR30IIAmpKeys[BOUTIQUE][LEAD])//0x00A8:  "THR30_Blondie"
                             {    result+=(" LEAD BOUTIQUE");
                                 ca = THR30IIAmpKey_ToColAmp((uint16_t)msgVals[3]);
                                 SetColAmp(ca.c, ca.a);
                             }
-                            else if(msgVals[3]  == THR30IIAmpKeys[col_amp{BOUTIQUE, BASS}])//0x000AB: "THR10_Bass_Mesa"
+                            else if(msgVals[3]  == THR30IIAmpKeys[BOUTIQUE][BASS])//0x000AB: "THR10_Bass_Mesa"
                             {    result+=" BASS-Model BOUTIQUE";
                                 ca = THR30IIAmpKey_ToColAmp((uint16_t)msgVals[3]);
                                 SetColAmp(ca.c, ca.a);
                             }
-                            else if(msgVals[3]  == THR30IIAmpKeys[col_amp{BOUTIQUE, HI_GAIN}])//0x00AF: "THR30_FLead"
+                            else if(msgVals[3]  == THR30IIAmpKeys[BOUTIQUE][HI_GAIN])//0x00AF: "THR30_FLead"
                             {    result+=(" HIGHGAIN BOUTIQUE");
                                 ca = THR30IIAmpKey_ToColAmp((uint16_t)msgVals[3]);
                                 SetColAmp(ca.c, ca.a);
                             }
-                            else if(msgVals[3]  == THR30IIAmpKeys[col_amp{MODERN, CLEAN}])//0x00B2: "THR30_Carmen"
+                            else if(msgVals[3]  == THR30IIAmpKeys[MODERN][CLEAN])//0x00B2: "THR30_Carmen"
                             {    result+=" CLEAN MODERN";
                                 ca = THR30IIAmpKey_ToColAmp((uint16_t)msgVals[3]);
                                 SetColAmp(ca.c, ca.a);
                             }
-                            else if(msgVals[3]  == THR30IIAmpKeys[col_amp{BOUTIQUE, FLAT}])//0x00B4: "THR10_Flat_B"
+                            else if(msgVals[3]  == THR30IIAmpKeys[BOUTIQUE][FLAT])//0x00B4: "THR10_Flat_B"
                             {    result+=" FLAT BOUTIQUE";
                                 ca = THR30IIAmpKey_ToColAmp((uint16_t)msgVals[3]);
                                 SetColAmp(ca.c, ca.a);
                             }
-                            else if(msgVals[3]  == THR30IIAmpKeys[col_amp{MODERN, FLAT}])//0x00B5: "THR10_Flat_V"
+                            else if(msgVals[3]  == THR30IIAmpKeys[MODERN][FLAT])//0x00B5: "THR10_Flat_V"
                             {    result+=" FLAT MODERN";
                                 ca = THR30IIAmpKey_ToColAmp((uint16_t)msgVals[3]);
                                 SetColAmp(ca.c, ca.a);
                             }
-                            else if(msgVals[3]  == THR30IIAmpKeys[col_amp{BOUTIQUE, CLEAN}])//0x00B6: "THR10C_BJunior2"
+                            else if(msgVals[3]  == THR30IIAmpKeys[BOUTIQUE][CLEAN])//0x00B6: "THR10C_BJunior2"
                             {    result+=" CLEAN BOUTIQUE";
                                 ca = THR30IIAmpKey_ToColAmp((uint16_t)msgVals[3]);
                                 SetColAmp(ca.c, ca.a);
                             }
-                            else if(msgVals[3]  == THR30IIAmpKeys[col_amp{CLASSIC, BASS}])//0x00B7:  "THR10_Bass_Eden_Marcus"
+                            else if(msgVals[3]  == THR30IIAmpKeys[CLASSIC][BASS])//0x00B7:  "THR10_Bass_Eden_Marcus"
                             {    result+=" BASS-Model CLASSIC";
                                 ca = THR30IIAmpKey_ToColAmp((uint16_t)msgVals[3]);
                                 SetColAmp(ca.c, ca.a);
                             }
-                            else if(msgVals[3]  == THR30IIAmpKeys[col_amp{MODERN, BASS}])//0x00B8: "THR30_JKBass2"
+                            else if(msgVals[3]  == THR30IIAmpKeys[MODERN][BASS])//0x00B8: "THR30_JKBass2"
                             {    result+=" BASS-Model MODERN";
                                 ca = THR30IIAmpKey_ToColAmp((uint16_t)msgVals[3]);
                                 SetColAmp(ca.c, ca.a);
                             }
-                            else if(msgVals[3]  == THR30IIAmpKeys[col_amp{MODERN, LEAD}])//0x00BB: "THR10_Brit"
+                            else if(msgVals[3]  == THR30IIAmpKeys[MODERN][LEAD])//0x00BB: "THR10_Brit"
                             {    result+=" LEAD MODERN";
                                 ca = THR30IIAmpKey_ToColAmp((uint16_t)msgVals[3]);
                                 SetColAmp(ca.c, ca.a);
@@ -684,6 +704,11 @@ String THR30II_Settings::ParseSysEx(const byte cur[], int cur_len)
                     {
                         result+=(" OPCODE 3 but not expected LEN 8  0x"+String(msgVals[3],HEX));
                     }
+                    if (mirrorValid)  //THR reported its amp or a unit type
+                    {
+                        mirror.col = col; mirror.amp = amp;
+                        mirror.effecttype = effecttype; mirror.echotype = echotype; mirror.reverbtype = reverbtype;
+                    }
                 }
             break;  //of "message 16 Bytes"
             
@@ -871,7 +896,12 @@ String THR30II_Settings::ParseSysEx(const byte cur[], int cur_len)
                     //msgVals: The Message: [0]:Opcode, [1]:Length, [2]:Block-Key/TargetType
                     if (msgVals[0] == 2 && msgVals[1] == 0x10)  //User-Setting change report
                     {
-                            if(msgVals[3]<5)   //a user setting was changed on THR (pressed one of knobs "1"..."5")
+                            if(msgVals[3]<5 && outqueue.item_count() > 0 && SlotSync::ReadbackSlot(outqueue.getHeadPtr()->_id) == (int8_t) msgVals[3])
+                            {
+                                //the report belongs to our readback of this user setting (its dump follows), it was not selected on THR
+                                result+=("\n\rUSER Setting "+String(msgVals[3] + 1)+" is dumped for verification.");
+                            }
+                            else if(msgVals[3]<5)   //a user setting was changed on THR (pressed one of knobs "1"..."5")
                             {
                                 result+=("\n\rUSER Setting "+String(msgVals[3] + 1)+" is activated. Following values: 0x"+String(msgVals[4],HEX)+" and 0x"+String(msgVals[5],HEX));
                                 activeUserSetting = msgVals[3]>4?-1:(int)msgVals[3]; //if value would be ushort FFFF (actual setting) we have to cast to int -1
@@ -912,228 +942,35 @@ String THR30II_Settings::ParseSysEx(const byte cur[], int cur_len)
                     {
                         result+=String("\n\rParameter change report: ");
                         //select from   msgVals[2]  //Unit
-                        if(msgVals[2] == THR30II_UNITS_VALS[GATE].key) //0x013C: //Block Mix/Gate (GuitarProc))
+                        if(msgVals[2] != 0xFFFFFFFF && KeyIndex(THR30II_UNITS_VALS, (uint16_t) msgVals[2]) < THR30II_UNITS_VALS.size())  //Blocks Mix/Gate (GuitarProc), Compressor, Reverb, Amp, Effect, Echo
                         {
                             userSettingsHaveChanged = true;
-                            activeUserSetting=-1;
-                            //select from  msgVals[3]  (the value - here the parameter key)
-                            if(msgVals[3] == THR30II_CAB_COMMAND)//0x0105:
+                            activeUserSetting = -1;
+                            //select from  msgVals[3]  (the value - here the parameter key) by the parameter registry
+                            THR30II_PARAM p = FindParam(msgVals[2], msgVals[3], false);
+                            if(p == P_CAB)
                             {       uint16_t cab =(NumberToVal(msgVals[5]) / 100.0f);  //Values 0...16 come in as floats 
-                                    result+=(" CAB: "+THR30II_CAB_NAMES[(THR30II_CAB) constrain(cab, 0x00, 0x10)]);
+                                    result+=(String(" CAB: ")+THR30II_CAB_NAMES[(THR30II_CAB) constrain(cab, 0x00, 0x10)]);
                                     SetCab((THR30II_CAB)cab);
+                                    StoreRaw(mirror, P_CAB, this->cab);  //THR has it already
                             }
-                            else if(msgVals[3] == THR30II_INFO_PHAS[PH_MIX].sk) //0x010E:
-                            {       result+=(" MIX (EFFECT) ");
-                                    val = THR30II_Settings::NumberToVal(msgVals[5]);
-                                    result+=String(val,0);
-                                    EffectSetting(THR30II_INFO_EFFECT[effecttype]["MIX"].sk, val);
-                            }
-                            else if(msgVals[3] == THR30II_INFO_TAPE[TA_MIX].sk)  //0x0111:
-                            {       result+=(" MIX (ECHO) ");
-                                    val = THR30II_Settings::NumberToVal(msgVals[5]);
-                                    result+=String(val,0);
-                                    EchoSetting(THR30II_INFO_ECHO[echotype]["MIX"].sk, val);
-                            }
-                            else if(msgVals[3] == THR30II_INFO_SPRI[SP_MIX].sk)//0x0128:
-                            {       result+=(" MIX (REVERB) ");
-                                    val = THR30II_Settings::NumberToVal(msgVals[5]);
-                                    result+=String(val,0);
-                                    ReverbSetting(THR30II_INFO_REVERB[reverbtype]["MIX"].sk, val);
-                            }
-
-                            else if(msgVals[3]== THR30II_UNIT_ON_OFF_COMMANDS[GATE]) //0x0102:
-                            {       result+=(" UNIT GATE "+String((msgVals[5] != 0 ? "On" : "Off")));
-                                    Switch_On_Off_Gate_Unit(msgVals[5] != 0);
-                            }
-                            else if(msgVals[3] == THR30II_UNIT_ON_OFF_COMMANDS[ECHO]) //0x012C:
-                            {       result+=(" UNIT ECHO "+String((msgVals[5] != 0 ? "On" : "Off")));
-                                    Switch_On_Off_Echo_Unit(msgVals[5] != 0);
-                            }
-                            else if(msgVals[3]== THR30II_UNIT_ON_OFF_COMMANDS[EFFECT]) //0x012D:
-                            {       result+=(" UNIT EFFECT "+String((msgVals[5] != 0 ? "On" : "Off")));
-                                    Switch_On_Off_Effect_Unit(msgVals[5] != 0);
-                            }
-                            else if(msgVals[3]== THR30II_UNIT_ON_OFF_COMMANDS[COMPRESSOR]) //0x012E:
-                            {        result+=(" UNIT COMPRESSOR "+String((msgVals[5] != 0 ? "On" : "Off")));
-                                    Switch_On_Off_Compressor_Unit(msgVals[5] != 0);
-                            }
-                            else if(msgVals[3] == THR30II_UNIT_ON_OFF_COMMANDS[REVERB]) //0x0130:
-                            {       result+=(" UNIT REVERB "+String((msgVals[5] != 0 ? "On" : "Off")));
-                                    Switch_On_Off_Reverb_Unit(msgVals[5] != 0);
-                            }
-
-                            else if(msgVals[3]== THR30II_GATE_VALS[GA_THRESHOLD]) //0x0069:
-                            {       result+=(" GATE-THRESHOLD ");
-                                    val = THR30II_Settings::NumberToVal_Threshold(msgVals[5]);
-                                    result+=String(val,0);
-                                    GateSetting(GA_THRESHOLD, val);
-                            }
-                            else if( msgVals[3] == THR30II_GATE_VALS[GA_DECAY]) //0x006B:
-                            {       result+=(" GATE-DECAY ");
-                                    val = THR30II_Settings::NumberToVal(msgVals[5]);
-                                    result+=String(val,0);
-                                    GateSetting(GA_DECAY, val);
-                            }
-                            else
-                            {      
-                                 result+=("\n\runknown "+String(msgVals[3],HEX)+" in Block Mix/Gate");
-                            }
-                        }
-                        else if(msgVals[2] == THR30II_UNITS_VALS[REVERB].key ) //0x0112:  //Block Reverb
-                        {
-                            //result+=String("Block Reverb: ");
-                            userSettingsHaveChanged = true;
-                            activeUserSetting = -1;
-                            //select from  msgVals[3]  (the value - here the parameter key)
-                            if(msgVals[3] == THR30II_INFO_PLAT[PL_DECAY].sk) //0x006B:
-                            {    result+=(" REVERB-DECAY ");
-                                val = THR30II_Settings::NumberToVal(msgVals[5]);
-                                result+=String(val,0);
-                                ReverbSetting(reverbtype, THR30II_INFO_PLAT[PL_DECAY].sk, val); //0x006B, val);
-                            }   
-                            else if( msgVals[3] == THR30II_INFO_SPRI[SP_REVERB].sk) //0x00ED:
-                            {    result+=(" REVERB-REVERB ");
-                                val = THR30II_Settings::NumberToVal(msgVals[5]);
-                                result+=String(val,0);
-                                ReverbSetting(reverbtype, THR30II_INFO_SPRI[SP_REVERB].sk, val);//0x00ED, val);
-                            }
-                            else if(msgVals[3] == THR30II_INFO_PLAT[PL_TONE].sk) //0x00F4:
-                            {    result+=(" REVERB-TONE ");
-                                val = THR30II_Settings::NumberToVal(msgVals[5]);
-                                result+=String(val,0);
-                                ReverbSetting(reverbtype, THR30II_INFO_PLAT[PL_TONE].sk, val);//0x00F4, val);
-                            }
-                            else if(msgVals[3] == THR30II_INFO_PLAT[PL_PREDELAY].sk) //0x00FA:
-                            {    result+=(" REVERB-PRE DELAY ");
-                                val = THR30II_Settings::NumberToVal(msgVals[5]);
-                                result+=String(val,0);
-                                ReverbSetting(reverbtype, THR30II_INFO_PLAT[PL_PREDELAY].sk, val);// 0x00FA, val);
-                            }
-                            else
+                            else if(p != P_NONE)
                             {
-                                    result+=(" REVERB Unknown: "+String(msgVals[5],HEX));
-                            }
-                        }//of Block Reverb
-                        else if(msgVals[2] == THR30II_UNITS_VALS[CONTROL].key) //0x010a:   //Block Amp
-                        {
-                            //result+=String("Amp: ");
-                            userSettingsHaveChanged = true;
-                            activeUserSetting = -1;
-                            //select from  msgVals[3]  (the value - here the parameter key)
-
-                            if(msgVals[3]  == THR30II_CTRL_VALS[CTRL_GAIN]) //0x58:
-                            {   result+=(" GAIN ");
-                                val = THR30II_Settings::NumberToVal(msgVals[5]);
-                                SetControl(THR30II_CTRL_SET::CTRL_GAIN, val);
-                                result+=String(val,0);
-                            }
-                            else if(msgVals[3]  == THR30II_CTRL_VALS[CTRL_MASTER]) //0x4C:
-                            {   result+=(" MASTER ");
-                                val = THR30II_Settings::NumberToVal(msgVals[5]);
-                                SetControl(CTRL_MASTER, val);
-                                result+=String(val,0);
-                            }
-                            else if(msgVals[3]  == THR30II_CTRL_VALS[CTRL_BASS]) //0x54:
-                            {   result+=(" TONE-BASS ");
-                                val = THR30II_Settings::NumberToVal(msgVals[5]);
-                                result+=String(val,0);
-                                SetControl(CTRL_BASS, val);
-                            }
-                            else if(msgVals[3]  == THR30II_CTRL_VALS[CTRL_MID]) //0x56:
-                            {   result+=(" TONE-MID ");
-                                val = THR30II_Settings::NumberToVal(msgVals[5]);
-                                SetControl(CTRL_MID, val);
-                                result+=String(val,0);
-                            }
-                            else if(msgVals[3]  == THR30II_CTRL_VALS[CTRL_TREBLE]) //0x57:
-                            {   result+=(" TONE-TREBLE ");
-                                val = THR30II_Settings::NumberToVal(msgVals[5]);
-                                SetControl(CTRL_TREBLE, val);
-                                result+=String(val,0);
-                            }
-                            else
-                            {
-                                result+=(" AMP Unknown "+String(msgVals[5],HEX));
-                            }
-                        }//of Block Amp
-                        else if( msgVals[2]== THR30II_UNITS_VALS[EFFECT].key) //0x010c: //Block Effect
-                        {
-                            //result+=String("Block Effect: ");
-                            userSettingsHaveChanged=true;
-                            activeUserSetting = -1;
-                            //select from  msgVals[3]  (the value - here the parameter key)
-                            if(msgVals[3]  == THR30II_INFO_EFFECT[PHASER]["SPEED"].sk) //0x00D4:
-                            {   result+=(" EFFECT SPEED (Phaser/Tremolo) ");
-                                val = THR30II_Settings::NumberToVal(msgVals[5]);
-                                result+=String(val,0);
-                                EffectSetting(effecttype, msgVals[3], val);
-                            }
-                            else if(msgVals[3]  == THR30II_INFO_EFFECT[PHASER]["FEEDBACK"].sk) //0x00D6:
-                            {   result+=(" EFFECT FEEDBACK ");
-                                val = THR30II_Settings::NumberToVal(msgVals[5]);
-                                result+=String(val,0);
-                                EffectSetting(effecttype, msgVals[3], val);
-                            }
-                            else if(msgVals[3]  == THR30II_INFO_EFFECT[CHORUS]["DEPTH"].sk) //0x00E0:
-                            {   result+=(" EFFECT DEPTH (Flanger/Chorus/Tremolo) ");
-                                val = THR30II_Settings::NumberToVal(msgVals[5]);
-                                result+=String(val,0);
-                                EffectSetting(effecttype, msgVals[3], val);
-                            }
-                            else if(msgVals[3]  == THR30II_INFO_EFFECT[FLANGER]["SPEED"].sk) //0x00E4:
-                            {   result+=(" EFFECT SPEED (Flanger / Chorus) ");
-                                val = THR30II_Settings::NumberToVal(msgVals[5]);
-                                result+=String(val,0);
-                                EffectSetting(effecttype, msgVals[3], val);
-                            }
-                            else if(msgVals[3]  == THR30II_INFO_EFFECT[CHORUS]["PREDELAY"].sk) //0x00E8:
-                            {   result+=(" EFFECT PRE-DELAY ");
-                                val = THR30II_Settings::NumberToVal(msgVals[5]);
-                                result+=String(val,0);
-                                EffectSetting(effecttype, msgVals[3], val);
-                            }
-                            else
-                            {
-                                result+=(" EFFECT Unknown: "+String(msgVals[3],HEX));
-                            }
-                        }//of Block Effect
-                        else if( msgVals[2]== THR30II_UNITS_VALS[ECHO].key) //0x010f:  //Block Echo
-                        {
-                            // result+=String("Block Mix/Gate: ");
-                            userSettingsHaveChanged=true;
-                            activeUserSetting = -1;
-                            //select from  msgVals[3]  (the value - here the parameter key)
-                            
-                            if(msgVals[3]  == THR30II_INFO_ECHO[TAPE_ECHO]["BASS"].sk) //0x0054:
-                            {   result+=(" ECHO-BASS ");
-                                val = THR30II_Settings::NumberToVal(msgVals[5]);
-                                result+=String(val,0);
-                                EchoSetting(echotype,msgVals[3], val);
-                            }
-                            else if(msgVals[3]  == THR30II_INFO_ECHO[TAPE_ECHO]["TREBLE"].sk) //0x0057:
-                            {   result+=(" ECHO-TREBLE ");
-                                val = THR30II_Settings::NumberToVal(msgVals[5]);
-                                result+=String(val,0);
-                                EchoSetting(echotype,msgVals[3], val);
-                            }
-                            else if(msgVals[3]  == THR30II_INFO_ECHO[TAPE_ECHO]["FEEDBACK"].sk) //0x00D6:
-                            {   result+=(" Echo FEEDBACK ");
-                                val = THR30II_Settings::NumberToVal(msgVals[5]);
-                                result+=String(val,0);
-                                EchoSetting(echotype,msgVals[3], val);
-                            }
-                            else if(msgVals[3]  == THR30II_INFO_ECHO[TAPE_ECHO]["TIME"].sk) //0x00ED:
-                            {   result+=(" ECHO-TIME ");
-                                val = THR30II_Settings::NumberToVal(msgVals[5]);
-                                result+=String(val,0);
-                                EchoSetting(echotype,msgVals[3], val);
+                                    val = DecodeParam(p, msgVals[5]);  //display value only for the report
+                                    result+=(String(" ")+THR30II_PARAMS[p].label+" ");
+                                    result+=(THR30II_PARAMS[p].enc == ENC_BOOL ? String(val != 0.0 ? "On" : "Off") : String(val,0));
+                                    if(history.LastParam() != p)  //turning one knob on THR gives one undo step
+                                    {
+                                            history.BeginGroup();
+                                    }
+                                    SetRaw(p, msgVals[5]);  //store the protocol value unchanged
+                                    StoreRaw(mirror, p, msgVals[5]);  //THR has it already
                             }
                             else
                             {
-                                result+=(" ECHO Unknown: "+String(msgVals[5],HEX));
+                                    result+=("\n\runknown "+String(msgVals[3],HEX)+" in Block "+String(msgVals[2],HEX));
                             }
-                            
-                        }//of "Block Echo"
+                        }
                         else if( msgVals[2]== 0xFFFFFFFF) //Global Parameter Settings) 
                         {
                             //select from  msgVals[3]  (the value - here the Extended setting's key)
@@ -1360,12 +1197,29 @@ String THR30II_Settings::ParseSysEx(const byte cur[], int cur_len)
                         {
                             result+=" Dump finished in chunk "+String(dumpFrameNumber + 1);
 
-                            if (patchdump)
+                            int8_t slot = -1;  //user preset, whose readback was requested (see SlotSync)
+                            if (patchdump && outqueue.item_count() > 0 && outqueue.getHeadPtr()->_sent_out)
+                            {
+                                slot = SlotSync::ReadbackSlot(outqueue.getHeadPtr()->_id);
+                            }
+
+                            if (patchdump && slot >= 0)  //compare with the upload, THR's actual settings are not concerned
+                            {
+                                result+="\n\rReadback of user setting "+String(slot + 1)+" finished.\n\r";
+                                _state = States::St_idle;
+                                slot_verified(slot, DumpDigest(dump, dump_len));
+                                outqueue.getHeadPtr()->_answered = true;
+                            }
+                            else if (patchdump)
                             {
                                 result+="\n\rDoing Patch Set All:\n\r";
                                 _state = States::St_idle;
                                 //Set constans from symbol table
                                 patch_setAll(dump,dump_len); //using dump_len, that does not include the 4  32-Bit-values 0 0 1 0 )
+                                mirror = Snapshot();  //the settings are THR's now
+                                mirrorValid = true;
+                                param_acks.Resync();
+                                report_boot_time();  //first settings dump after connecting means "ready"
                             }
                             else if (symboldump)
                             {
@@ -1379,7 +1233,14 @@ String THR30II_Settings::ParseSysEx(const byte cur[], int cur_len)
                                 //              0x57,0x69,0x64,0x65,0x53,0x74,0x65,0x72,0x65,0x6F,0x57,0x69,0x64,0x74,0x68,0x00,
                                 //              0x47,0x75,0x69,0x74,0x61,0x72,0x44,0x49,0x45,0x6E,0x61,0x62,0x6C,0x65,0x00
                                 //              };
-                                Constants::set_all(dump);  //Now we can get the right keys for this firmware from the table
+                                forget_symbol_cache();  //table from THR replaces a cached one
+                                bool symOk = Constants::set_all(dump, dump_len);  //Now we can get the right keys for this firmware from the table
+                                dump = nullptr;  //buffer is owned by the symbol table now (names are looked up inside it)
+
+                                if (symOk)
+                                {
+                                    store_symbol_cache(Firmware);  //next boot with this firmware will not need the dump
+                                }
                                 
                                 Init_Dictionaries();  //Now use constants in this App's dictionaries
                                 
@@ -1396,18 +1257,7 @@ String THR30II_Settings::ParseSysEx(const byte cur[], int cur_len)
                                     }
                                 }
 
-                                //#S6 (05-Message "01"-version") Request unknown reason (Answ. always the same: expext 0x00000080)                                            
-                                //answer will be a number (seems to be always 0x80)
-                                
-                                outqueue.enqueue(Outmessage(SysExMessage((const byte[29]) { 0xf0, 0x00, 0x01, 0x0c, 0x22, 0x02, 0x4d, 0x01, 0x01, 0x00, 0x00, 0x07, 0x00, 0x05, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf7 },29), 6, false, true));
-
-                                //#S7  (0F-Message)   Ask: Have User-Settings changed?
-                                //answer will we changed (1) or not changed(0)
-                                //after that we should react dependent of the answer: If settings have changed: We need the actual settings
-                                //and the five user presets
-                                //If settings have not changed (a User-Preset is active and not modified):
-                                //We only need the 5 User Presets
-                                outqueue.enqueue(Outmessage(SysExMessage( (const byte[29]) { 0xf0, 0x00, 0x01, 0x0c, 0x22, 0x02, 0x4d, 0x00, 0x03, 0x00, 0x00, 0x07, 0x00, 0x0f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf7 },29), 7, false, true));
+                                SendStartupRequests();
 
                             } //end of "is SymbolDump"
                             
@@ -1416,6 +1266,7 @@ String THR30II_Settings::ParseSysEx(const byte cur[], int cur_len)
                             symboldump = false;
 
                             delete[] dump;
+                            dump = nullptr;
 
                         }//end of "fetched enough bytes for complete dump"
                     } //end of "if it seems to be a dump (  24 < len < 0x100  ) 
@@ -1425,6 +1276,7 @@ String THR30II_Settings::ParseSysEx(const byte cur[], int cur_len)
                         patchdump = false;
                         symboldump = false;
                         delete[] dump;
+                        dump = nullptr;
                         dumpFrameNumber = 0;
                         result+=" Unknown message payload size 0x"+String(payloadSize - 1,HEX)+"\r\n";
                     }
@@ -1462,86 +1314,20 @@ String THR30II_Settings::ParseSysEx(const byte cur[], int cur_len)
     
     return result;
 } //Parse SysEx (THR30II)
-//                                             bool cut = true  (preset parameter)
-double THR30II_Settings::NumberToVal(uint32_t num, bool cut ) //convert the 32Bit parameter value to 0..100 Slider value 
-{
-    float val;
-    
-    if (num >= 998277251)  //=0.00392156979069  , cut hard to 0 if too small
-    {
-        memcpy(&val,&num,4);
-        //val = *((float*) &num);
-        val = 100.0*val;
-    }
-    else
-    {
-        val = 0;
-    }
-    return cut ? floor(val) : val;   //cut decimals, if requested (default)
-}
-//                                      bool cut = true  (preset parameter)
-double THR30II_Settings::NumberToVal_Threshold(uint32_t num, bool cut ) //convert the 32Bit parameter value to a 0..100 Slider value 
-{  
-    float val;
-    //0xC2C00000 read as float -> -96
-    //0xBE500000 read as float -> -0.203125
-    if (num >= 0xBE500000 && num < 0xC2C00000)
-    {
-        //val= *((float*) &num);
-        memcpy(&val,&num,4);
-        val = 100.0 + 100.0/96 * val;   //change range from [-96dB ... 0dB] to [0...100]
-    }
-    else if (num >= 0xC2C00000)
-    {
-        val = 0.0;
-    }
-    else
-    {
-        val = 100.0;
-    }
 
-    return cut ? floor(val) : val; //cut decimals, if requested (default)
-}
-
-uint32_t THR30II_Settings::ValToNumber(double val) //convert a 0..100 Slider value to a 32Bit parameter value 
+//Enqueue the boot dialog requests, that need the symbol table (from the dump or from the SD cache)
+void THR30II_Settings::SendStartupRequests()
 {
-    uint32_t number;
-    float v= val/(double)100.0;
-
-    memcpy(&number,&v,4);
-    //number= *((uint32_t*) &v);
-            
-    if (number < 999277251)
-    {
-        number = 0u;
-    }
-
-    return number;
-}
-
-uint32_t THR30II_Settings::ValToNumber_Threshold(double val) //convert a 0..100 Slider value to a 32Bit parameter value (for internal -96dB to 0dB range)
-{   
-    uint32_t number;
-    //val 0   -> -96dB
-    //val 100 ->   0dB
-    //-96       float read as uint32_t -> 0xC2C00000  
-    //-0.203125 float read as uint32_t -> 0xBE500000 
+    //#S6 (05-Message "01"-version") Request unknown reason (Answ. always the same: expext 0x00000080)                                            
+    //answer will be a number (seems to be always 0x80)
     
-    float v=-(100.0-val) * 96.0 / 100.0 + 0.4; //change range from [0...100] to [-96dB ... 0dB]           
-
-    memcpy(&number,&v,4);
-    //number = *((uint32_t*) &v) ;
-
-    //Limit number to allowed range
-
-    if (number < 0xBE500000)
-    {
-        number = 0u;
-    }
-    if (number > 0xC2C00000)
-    {
-        number = 0xC2C00000;
-    }
-
-    return number;
-}
\ No newline at end of file
+    outqueue.enqueue(Outmessage(SysExMessage((const byte[29]) { 0xf0, 0x00, 0x01, 0x0c, 0x22, 0x02, 0x4d, 0x01, 0x01, 0x00, 0x00, 0x07, 0x00, 0x05, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf7 },29), 6, false, true));
+
+    //#S7  (0F-Message)   Ask: Have User-Settings changed?
+    //answer will we changed (1) or not changed(0)
+    //after that we should react dependent of the answer: If settings have changed: We need the actual settings
+    //and the five user presets
+    //If settings have not changed (a User-Preset is active and not modified):
+    //We only need the 5 User Presets
+    outqueue.enqueue(Outmessage(SysExMessage( (const byte[29]) { 0xf0, 0x00, 0x01, 0x0c, 0x22, 0x02, 0x4d, 0x00, 0x03, 0x00, 0x00, 0x07, 0x00, 0x0f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf7 },29), 7, false, true));
+}
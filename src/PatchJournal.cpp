@@ -0,0 +1,405 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* PatchJournal.cpp
+*  Append-only journal of patch saves and moves on top of the patch library
+*
+* Order of writes, so power loss at any point leaves a consistent state:
+*  Save/Move:  record is appended and synced -> index is written into the older slot
+*              (a record without index is replayed at the next start, a torn record is cut off)
+*  Compaction: new text file complete -> index state COMPACTED -> text file replaced -> old library removed
+*              -> journal reset -> index CLEAN (recover() repeats the steps behind COMPACTED)
+*              The old library must go: if only moves were compacted, the new text file has the old length, and a card
+*              without real time clock gives all files the same date, so the start could not tell it is outdated.
+*/
+
+#include <Arduino.h>
+#include <stddef.h>
+#include <algorithm>
+#include "PatchJournal.h"
+#include "PatchLibrary.h"
+
+//Normal TRACE/DEBUG
+#define TRACE_THR30IIPEDAL(x) x
+//#define TRACE_THR30IIPEDAL(x)
+
+//Verbose TRACE/DEBUG
+//#define TRACE_V_THR30IIPEDAL(x)	x
+#define TRACE_V_THR30IIPEDAL(x)
+
+#define FNV_INIT 2166136261ul
+
+static uint32_t fnv(uint32_t h, const void *data, size_t len)
+{
+	const uint8_t *p = (const uint8_t *) data;
+	while(len--)
+	{
+		h = (h ^ *p++) * 16777619ul;
+	}
+	return h;
+}
+
+static uint32_t index_crc(const JournalIndex &idx)
+{
+	return fnv(FNV_INIT, &idx, offsetof(JournalIndex, crc));
+}
+
+bool PatchJournal::readIndex(JournalIndex &idx)
+{
+	File32 f;
+	if(!f.open(JOURNAL_INDEX_FILE, O_RDONLY))
+	{
+		return false;
+	}
+
+	bool found = false;
+	JournalIndex slot;
+	for(uint8_t i = 0; i < 2; i++)
+	{
+		if(f.seekSet(i * JOURNAL_INDEX_SLOT) && f.read(&slot, sizeof(slot)) == (int) sizeof(slot) && slot.magic == JOURNAL_MAGIC && slot.crc == index_crc(slot)
+		   && slot.saves <= JOURNAL_SLOTS && slot.moves <= JOURNAL_MOVES && (!found || slot.seq > idx.seq))
+		{
+			idx = slot;
+			found = true;
+		}
+	}
+	f.close();
+	return found;
+}
+
+bool PatchJournal::writeIndex()
+{
+	_idx.magic = JOURNAL_MAGIC;
+	_idx.seq++;
+	_idx.crc = index_crc(_idx);
+
+	File32 f;
+	if(!f.open(JOURNAL_INDEX_FILE, O_RDWR | O_CREAT))
+	{
+		return false;
+	}
+	bool ok = true;
+	if(f.fileSize() < 2 * JOURNAL_INDEX_SLOT)  //both slots must exist, before one of them can be overwritten
+	{
+		static const byte zero[64] = {};  //pad behind existing bytes: an index of the older layout still serves as start of the replay
+		uint32_t n = f.fileSize();
+		ok = f.seekSet(n);
+		while(ok && n < 2 * JOURNAL_INDEX_SLOT)
+		{
+			uint32_t k = std::min<uint32_t>(2 * JOURNAL_INDEX_SLOT - n, sizeof(zero));
+			ok = f.write(zero, k) == k;
+			n += k;
+		}
+	}
+	ok = ok && f.seekSet((_idx.seq & 1) * JOURNAL_INDEX_SLOT) && (f.write(&_idx, sizeof(_idx)) == sizeof(_idx)) && f.sync();
+	f.close();
+	return ok;
+}
+
+bool PatchJournal::apply(JournalIndex &idx, const JournalRecord &r, uint32_t pos)
+{
+	switch(r.op)
+	{
+		case JOP_SAVE:
+		{
+			uint16_t i = 0;
+			while(i < idx.saves && idx.save[i].nr != r.nr)  //saved before: the new record replaces the old one
+			{
+				i++;
+			}
+			if(i == JOURNAL_SLOTS || r.nr == 0)
+			{
+				return false;
+			}
+			idx.save[i].nr = r.nr;
+			idx.save[i].pos = pos;
+			idx.saves = std::max<uint16_t>(idx.saves, i + 1);
+			idx.size = std::max(idx.size, r.nr);
+			idx.length = pos + sizeof(r) + r.length;
+		}
+		break;
+
+		case JOP_MOVE:
+			if(idx.moves == JOURNAL_MOVES || r.nr == 0 || r.nr2 == 0 || r.nr > idx.size || r.nr2 > idx.size)
+			{
+				return false;
+			}
+			idx.move[idx.moves].a = r.nr;
+			idx.move[idx.moves].b = r.nr2;
+			idx.moves++;
+			idx.length = pos + sizeof(r);
+		break;
+
+		default:
+			return false;
+	}
+	return true;
+}
+
+bool PatchJournal::reset(uint32_t sourceLength, uint32_t sourceStamp, uint32_t generation)
+{
+	if(_file.isOpen())
+	{
+		_file.close();
+	}
+	_hdr = { JOURNAL_MAGIC, JOURNAL_VERSION, 0, sourceLength, sourceStamp, generation };
+	bool ok = _file.open(JOURNAL_FILE, O_RDWR | O_CREAT | O_TRUNC) && (_file.write(&_hdr, sizeof(_hdr)) == sizeof(_hdr)) && _file.sync();
+
+	uint32_t seq = _idx.seq;
+	_idx = {};
+	_idx.seq = seq;
+	_idx.generation = generation;
+	_idx.length = sizeof(_hdr);
+	_idx.state = JST_CLEAN;
+	_idx.size = _count;
+	return ok && writeIndex();
+}
+
+bool PatchJournal::open(const PatchLibHeader &lib, uint16_t count)
+{
+	close();
+	_count = count;
+
+	bool haveIndex = readIndex(_idx);
+	bool ok = _file.open(JOURNAL_FILE, O_RDWR) && (_file.read(&_hdr, sizeof(_hdr)) == (int) sizeof(_hdr))
+	          && (_hdr.magic == JOURNAL_MAGIC) && (_hdr.version == JOURNAL_VERSION);
+
+	if(ok && (_hdr.sourceLength != lib.sourceLength || _hdr.sourceStamp != lib.sourceStamp))  //patch text file was replaced on PC
+	{
+		TRACE_THR30IIPEDAL(Serial.println(F("Patch journal belongs to another patch file, putting it aside as \"" JOURNAL_OLD_FILE "\"."));)
+		_file.close();
+		SD.remove(JOURNAL_OLD_FILE);
+		SD.rename(JOURNAL_FILE, JOURNAL_OLD_FILE);
+		ok = false;
+	}
+	if(!ok)
+	{
+		return reset(lib.sourceLength, lib.sourceStamp, haveIndex ? _idx.generation + 1 : 1);
+	}
+
+	if(!haveIndex || _idx.generation != _hdr.generation || _idx.length < sizeof(_hdr) || _idx.length > _file.fileSize())
+	{
+		uint32_t seq = haveIndex ? _idx.seq : 0;  //index is outdated: replay the whole journal
+		_idx = {};
+		_idx.seq = seq;
+		_idx.generation = _hdr.generation;
+		_idx.length = sizeof(_hdr);
+	}
+	_idx.size = std::max(_idx.size, _count);
+	return replay();
+}
+
+void PatchJournal::close()
+{
+	if(_file.isOpen())
+	{
+		_file.close();
+	}
+}
+
+bool PatchJournal::replay()
+{
+	uint32_t t0 = micros();
+	uint32_t pos = _idx.length;
+	uint16_t n = 0;
+	JournalRecord r;
+	byte buf[256];
+
+	while(_file.seekSet(pos) && (_file.read(&r, sizeof(r)) == (int) sizeof(r)) && r.magic == JOURNAL_MAGIC)
+	{
+		uint32_t crc = r.crc;
+		r.crc = 0;
+		uint32_t h = fnv(FNV_INIT, &r, sizeof(r));
+		uint32_t len = (r.op == JOP_SAVE) ? r.length : 0;
+		bool ok = true;
+		for(uint32_t left = len; ok && left > 0; )
+		{
+			uint32_t k = std::min<uint32_t>(left, sizeof(buf));
+			ok = _file.read(buf, k) == (int) k;
+			h = fnv(h, buf, k);
+			left -= k;
+		}
+		r.crc = crc;
+		if(!ok || h != crc || !apply(_idx, r, pos))
+		{
+			break;
+		}
+		pos = _idx.length;
+		n++;
+	}
+
+	if(_file.fileSize() > pos)  //torn record behind the last valid one (power loss while saving)
+	{
+		TRACE_THR30IIPEDAL(Serial.printf("Patch journal: cutting off %lu bytes of an incomplete record.\n\r", (unsigned long)(_file.fileSize() - pos));)
+		_file.truncate(pos);
+		_file.sync();
+	}
+
+	bool ok = (n == 0) || writeIndex();
+	TRACE_THR30IIPEDAL(Serial.printf("Patch journal: generation %lu, %d saved, %d moved patches, %d records replayed in %lu us\n\r",
+	                                  (unsigned long) _idx.generation, _idx.saves, _idx.moves, n, micros() - t0);)
+	return ok;
+}
+
+uint16_t PatchJournal::resolve(uint16_t pos) const  //the latest move first
+{
+	for(int16_t i = (int16_t) _idx.moves - 1; i >= 0; i--)
+	{
+		if(pos == _idx.move[i].a)
+		{
+			pos = _idx.move[i].b;
+		}
+		else if(pos == _idx.move[i].b)
+		{
+			pos = _idx.move[i].a;
+		}
+	}
+	return pos;
+}
+
+bool PatchJournal::entry(uint16_t nr, PatchLibEntry &e) const
+{
+	for(uint16_t i = 0; i < _idx.saves; i++)
+	{
+		if(_idx.save[i].nr == nr)
+		{
+			JournalRecord r;
+			if(!_file.seekSet(_idx.save[i].pos) || _file.read(&r, sizeof(r)) != (int) sizeof(r))
+			{
+				return false;
+			}
+			e.offset = r.offset | PATCHLIB_JOURNAL;
+			e.length = r.length;
+			memcpy(e.name, r.name, sizeof(e.name));
+			e.name[PATCH_NAME_LEN] = '\0';
+			e.col = r.col;
+			e.amp = r.amp;
+			e.cab = r.cab;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool PatchJournal::append(JournalRecord &r, const char *text)
+{
+	uint32_t t0 = micros();
+	uint32_t pos = _idx.length;
+	uint32_t len = (r.op == JOP_SAVE) ? r.length : 0;
+
+	r.magic = JOURNAL_MAGIC;
+	r.seq = _idx.seq + 1;
+	r.offset = (r.op == JOP_SAVE) ? pos + sizeof(r) : 0;
+	r.crc = 0;
+	r.crc = fnv(fnv(FNV_INIT, &r, sizeof(r)), text, len);
+
+	JournalIndex next = _idx;
+	if(!_file.isOpen() || !apply(next, r, pos))
+	{
+		TRACE_THR30IIPEDAL(Serial.println(F("Patch journal is full, it must be compacted first."));)
+		return false;
+	}
+
+	//the record must be complete on SD-card, before the index refers to it
+	bool ok = _file.seekSet(pos) && (_file.write(&r, sizeof(r)) == sizeof(r)) && (len == 0 || _file.write(text, len) == len) && _file.sync();
+	if(ok)
+	{
+		_idx = next;
+		ok = writeIndex();  //if this fails, the record is replayed at the next start
+	}
+	TRACE_THR30IIPEDAL(Serial.printf("Patch journal: %s #%d written in %lu us (%s)\n\r", r.op == JOP_SAVE ? "save" : "move", r.nr, micros() - t0, ok ? "ok" : "write error");)
+	return ok;
+}
+
+bool PatchJournal::Save(uint16_t pos, const char *text, uint32_t len, const PatchLibEntry &summary)
+{
+	if(pos < 1 || pos > _idx.size + 1 || text == nullptr || len == 0)
+	{
+		return false;
+	}
+	JournalRecord r {};
+	r.op = JOP_SAVE;
+	r.nr = resolve(pos);  //a new patch at size() + 1 is not affected by moves
+	r.length = len;
+	memcpy(r.name, summary.name, sizeof(r.name));
+	r.col = summary.col;
+	r.amp = summary.amp;
+	r.cab = summary.cab;
+	return append(r, text);
+}
+
+bool PatchJournal::Move(uint16_t a, uint16_t b)
+{
+	if(a < 1 || b < 1 || a > _idx.size || b > _idx.size || a == b)
+	{
+		return false;
+	}
+	JournalRecord r {};
+	r.op = JOP_MOVE;
+	r.nr = a;
+	r.nr2 = b;
+	return append(r, nullptr);
+}
+
+bool PatchJournal::full() const
+{
+	return _idx.saves >= JOURNAL_SLOTS || _idx.moves >= JOURNAL_MOVES;
+}
+
+bool PatchJournal::needsCompaction() const
+{
+	return _idx.saves >= JOURNAL_SLOTS / 2 || _idx.moves >= JOURNAL_MOVES / 2 || _idx.length > JOURNAL_COMPACT_LEN;
+}
+
+bool PatchJournal::Compacted(const char *source, const char *library)
+{
+	_idx.state = JST_COMPACTED;
+	if(!writeIndex())
+	{
+		_idx.state = JST_CLEAN;
+		return false;
+	}
+	return finish(source, library);  //from here on, recover() completes the compaction after a power loss
+}
+
+bool PatchJournal::finish(const char *source, const char *library)
+{
+	if(SD.exists(JOURNAL_COMPACT_TMP))  //not renamed yet
+	{
+		SD.remove(source);
+		if(!SD.rename(JOURNAL_COMPACT_TMP, source))
+		{
+			return false;
+		}
+	}
+
+	File32 f;
+	if(!f.open(source, O_RDONLY))
+	{
+		return false;
+	}
+	uint16_t date = 0, time = 0;
+	f.getModifyDateTime(&date, &time);
+	uint32_t length = f.fileSize();
+	f.close();
+
+	if(SD.exists(library) && !SD.remove(library))  //compiled from the old text file
+	{
+		return false;
+	}
+
+	return reset(length, ((uint32_t) date << 16) | time, _idx.generation + 1);  //the new text file is the journal's base now
+}
+
+void PatchJournal::recover(const char *source, const char *library)
+{
+	PatchJournal j;
+	if(!readIndex(j._idx) || j._idx.state != JST_COMPACTED)
+	{
+		return;
+	}
+	TRACE_THR30IIPEDAL(Serial.println(F("Patch journal: finishing an interrupted compaction...")));
+	bool ok = j.finish(source, library);
+	j.close();
+	TRACE_THR30IIPEDAL(Serial.printf("Patch journal: compaction %s.\n\r", ok ? "finished" : "failed"));
+}
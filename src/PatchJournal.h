@@ -0,0 +1,115 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* PatchJournal.h
+*  Append-only journal of patch saves and moves on top of the patch library
+*/
+
+#ifndef _PATCHJOURNAL_H_
+#define _PATCHJOURNAL_H_
+
+#include <Arduino.h>
+#include <SD.h>
+#include "THR30II.h"   //PATCH_NAME_LEN
+
+#define JOURNAL_FILE        "patches.thrjnl"  //appended patch saves and moves
+#define JOURNAL_INDEX_FILE  "patches.thrjdx"  //two alternating copies of the journal index
+#define JOURNAL_OLD_FILE    "patches.throld"  //journal of a library, that was replaced on PC (put aside, not deleted)
+#define JOURNAL_COMPACT_TMP "patchsrc.tmp"    //compaction writes the new patch text file here
+#define JOURNAL_MAGIC       0x4a524854ul      //"THRJ"
+#define JOURNAL_VERSION     1
+#define JOURNAL_SLOTS       64                //saved patches between two compactions
+#define JOURNAL_MOVES       32                //moves between two compactions
+#define JOURNAL_COMPACT_LEN 0x10000ul         //compact, if the journal grows longer (bytes)
+#define JOURNAL_INDEX_SLOT  1024              //bytes per index copy (whole sectors, so a torn write can not hit the other copy)
+
+struct PatchLibEntry;
+struct PatchLibHeader;
+
+enum JournalOp : uint8_t { JOP_SAVE = 1, JOP_MOVE = 2 };
+enum JournalState : uint8_t { JST_CLEAN = 0, JST_COMPACTED = 1 };  //COMPACTED: new patch text file is complete, journal not reset yet
+
+//Identifies the library (patch text file) the journal belongs to
+struct JournalHeader
+{
+	uint32_t magic;         //JOURNAL_MAGIC
+	uint16_t version;       //JOURNAL_VERSION
+	uint16_t reserved;
+	uint32_t sourceLength;  //see PatchLibHeader
+	uint32_t sourceStamp;
+	uint32_t generation;    //incremented by each compaction
+};
+
+//A record is only valid with a matching checksum, so a save torn by power loss is simply cut off
+struct JournalRecord
+{
+	uint32_t magic;         //JOURNAL_MAGIC
+	uint32_t seq;           //sequence number of the index, when the record was appended
+	JournalOp op;
+	uint8_t reserved;
+	uint16_t nr;            //JOP_SAVE: patch, JOP_MOVE: position
+	uint16_t nr2;           //JOP_MOVE: other position
+	uint16_t reserved2;
+	uint32_t crc;           //FNV-1a of the record (with crc = 0) and the patch text behind it
+	uint32_t offset;        //JOP_SAVE: position of the patch text inside the journal
+	uint32_t length;        //JOP_SAVE: length of the patch text
+	char name[PATCH_NAME_LEN + 1];  //JOP_SAVE: summary as in PatchLibEntry
+	uint8_t col;
+	uint8_t amp;
+	uint8_t cab;
+};
+
+//The index is written alternately into two slots of JOURNAL_INDEX_FILE (the one with the valid checksum
+//and the higher sequence number counts), so an interrupted write always leaves the previous index.
+//Each slot starts on its own JOURNAL_INDEX_SLOT boundary, as the SD card writes whole 512 byte sectors.
+struct JournalIndex
+{
+	uint32_t magic;          //JOURNAL_MAGIC
+	uint32_t seq;            //incremented by each write of the index
+	uint32_t generation;     //of the journal (see JournalHeader)
+	uint32_t length;         //journal bytes covered by this index
+	JournalState state;
+	uint8_t reserved;
+	uint16_t size;           //number of patches (library and new ones)
+	uint16_t saves;
+	uint16_t moves;
+	struct { uint16_t nr; uint16_t reserved; uint32_t pos; } save[JOURNAL_SLOTS];  //last record of each saved patch
+	struct { uint16_t a; uint16_t b; } move[JOURNAL_MOVES];                       //positions swapped (in this order)
+	uint32_t crc;
+};
+static_assert(sizeof(JournalIndex) <= JOURNAL_INDEX_SLOT, "JournalIndex must fit into its slot");
+
+//Patch numbers are library numbers (1-based), positions are the numbers shown after the moves.
+class PatchJournal
+{
+	public:
+	  static void recover(const char *source, const char *library);  //finishes a compaction interrupted by power loss (before the library is opened)
+	  bool open(const PatchLibHeader &lib, uint16_t count);  //journal of this library (replays records not in the index yet)
+	  void close();
+	  uint16_t size() const { return _idx.size; };
+	  uint32_t revision() const { return _idx.seq; };
+	  uint16_t resolve(uint16_t pos) const;        //patch number shown at position pos
+	  bool entry(uint16_t nr, PatchLibEntry &e) const;  //summary of a saved patch (false: not in the journal)
+	  File32 &file() const { return _file; };
+	  bool Save(uint16_t pos, const char *text, uint32_t len, const PatchLibEntry &summary);  //pos = size() + 1: new patch
+	  bool Move(uint16_t a, uint16_t b);           //swap the patches at positions a and b
+	  bool full() const;                           //a save or move might not find space any more
+	  bool needsCompaction() const;
+	  bool Compacted(const char *source, const char *library);  //new patch text file is complete in JOURNAL_COMPACT_TMP: replace source, remove library, reset journal
+
+	private:
+	  bool append(JournalRecord &r, const char *text);
+	  static bool apply(JournalIndex &idx, const JournalRecord &r, uint32_t pos);
+	  bool replay();
+	  bool finish(const char *source, const char *library);
+	  bool writeIndex();
+	  bool reset(uint32_t sourceLength, uint32_t sourceStamp, uint32_t generation);
+	  static bool readIndex(JournalIndex &idx);
+
+	  mutable File32 _file;
+	  JournalHeader _hdr {};
+	  JournalIndex _idx {};
+	  uint16_t _count = 0;     //patches in the library
+};
+
+#endif
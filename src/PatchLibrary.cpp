@@ -0,0 +1,534 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* PatchLibrary.cpp
+*  Binary patch library on SD-card (header, fixed size index, patch records)
+*/
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "PatchLibrary.h"
+#include "Globals.h"
+
+//Normal TRACE/DEBUG
+#define TRACE_THR30IIPEDAL(x) x
+//#define TRACE_THR30IIPEDAL(x)
+
+//Verbose TRACE/DEBUG
+//#define TRACE_V_THR30IIPEDAL(x)	x
+#define TRACE_V_THR30IIPEDAL(x)
+
+#define PATCHLIB_TMP "patchlib.tmp"  //library is compiled into this file and renamed when complete
+
+const DynamicJsonDocument &PatchFilter(bool full)
+{
+	static DynamicJsonDocument summary(256);
+	static DynamicJsonDocument all(2048);   //keys are constants in flash, so only the nodes need space
+
+	if(summary.isNull())
+	{
+		for(DynamicJsonDocument *f : { &summary, &all })
+		{
+			(*f)["data"]["meta"]["name"] = true;
+			(*f)["data"]["tone"]["THRGroupAmp"]["@asset"] = true;
+			(*f)["data"]["tone"]["THRGroupCab"]["SpkSimType"] = true;
+		}
+
+		all["data"]["meta"]["tnid"] = true;
+		all["data"]["tone"]["global"]["THRPresetParamTempo"] = true;
+
+		for(uint8_t i = 0; i < P_COUNT; i++)
+		{
+			const param_def &d = THR30II_PARAMS[i];
+			if(d.json[0] == '\0')  //not in patch files (or CAB, see above)
+			{
+				continue;
+			}
+			const char *grp = THR30II_JSON_GROUPS[d.unit];
+			if(d.type >= 0)  //type dependent parameters are stored in a subgroup named by the type's asset
+			{
+				all["data"]["tone"][grp]["@asset"] = true;
+				all["data"]["tone"][grp]["*"][d.json] = true;
+			}
+			else
+			{
+				all["data"]["tone"][grp][d.json] = true;
+			}
+		}
+		TRACE_THR30IIPEDAL(Serial.printf("Patch filter: %d bytes (full), %d bytes (summary)\n\r", (int) all.memoryUsage(), (int) summary.memoryUsage());)
+	}
+	return full ? all : summary;
+}
+
+bool PatchLibrary::open(const char *path)
+{
+	close();
+
+	if(!_file.open(path, O_RDONLY))
+	{
+		return false;
+	}
+
+	bool ok = (_file.read(&_hdr, sizeof(_hdr)) == (int) sizeof(_hdr)) && (_hdr.magic == PATCHLIB_MAGIC)
+	          && (_hdr.version == PATCHLIB_VERSION) && (_hdr.entrySize == sizeof(PatchLibEntry)) && (_hdr.count <= 0xFFFF)
+	          && (_hdr.dataOffset == _hdr.indexOffset + _hdr.count * _hdr.entrySize) && (_file.fileSize() >= _hdr.dataOffset);
+
+	if(!ok)
+	{
+		TRACE_THR30IIPEDAL(Serial.printf("Patch library \"%s\" is invalid.\n\r", path);)
+		close();
+		return false;
+	}
+
+	_count = (uint16_t) _hdr.count;
+	if(path != _path)
+	{
+		strncpy(_path, path, sizeof(_path) - 1);
+	}
+
+	if(!_journal.open(_hdr, _count))  //without journal the library is still usable (read only)
+	{
+		TRACE_THR30IIPEDAL(Serial.println(F("Patch journal could not be opened, patches can not be saved."));)
+	}
+	return true;
+}
+
+void PatchLibrary::close()
+{
+	stopCompaction();
+	_journal.close();
+	if(_file.isOpen())
+	{
+		_file.close();
+	}
+	_count = 0;
+}
+
+bool PatchLibrary::entry(uint16_t nr, PatchLibEntry &e) const
+{
+	if(nr < 1 || nr > size())
+	{
+		return false;
+	}
+
+	nr = _journal.resolve(nr);
+	if(_journal.entry(nr, e))  //saved on the pedal
+	{
+		return true;
+	}
+	if(nr > _count)
+	{
+		return false;
+	}
+
+	bool ok = _file.seekSet(_hdr.indexOffset + (uint32_t)(nr - 1) * _hdr.entrySize) && (_file.read(&e, sizeof(e)) == (int) sizeof(e));
+	e.name[PATCH_NAME_LEN] = '\0';
+	return ok;
+}
+
+DeserializationError PatchLibrary::parse(const PatchLibEntry &e, JsonDocument &doc, bool full) const
+{
+	bool inJournal = (e.offset & PATCHLIB_JOURNAL) != 0;
+	File32 &f = inJournal ? _journal.file() : _file;
+	uint32_t offset = e.offset & ~PATCHLIB_JOURNAL;
+
+	if((!inJournal && offset < _hdr.dataOffset) || !f.seekSet(offset))
+	{
+		return DeserializationError::IncompleteInput;
+	}
+	//ArduinoJson stops reading at the end of the patch object, so the record needs no own buffer
+	return deserializeJson(doc, f, DeserializationOption::Filter(PatchFilter(full)));
+}
+
+bool PatchLibrary::copyRecord(const PatchLibEntry &e, File32 &dst) const
+{
+	File32 &f = (e.offset & PATCHLIB_JOURNAL) ? _journal.file() : _file;
+	byte buf[512];
+	bool ok = f.seekSet(e.offset & ~PATCHLIB_JOURNAL);
+
+	for(uint32_t left = e.length; ok && left > 0; )
+	{
+		uint32_t k = left < sizeof(buf) ? left : sizeof(buf);
+		ok = (f.read(buf, k) == (int) k) && (dst.write(buf, k) == k);
+		left -= k;
+	}
+	return ok;
+}
+
+bool PatchLibrary::Save(uint16_t nr, const char *text, uint32_t len, const PatchLibEntry &summary)
+{
+	stopCompaction();  //the copied patches may be outdated now
+	return _journal.Save(nr, text, len, summary);
+}
+
+bool PatchLibrary::Move(uint16_t a, uint16_t b)
+{
+	stopCompaction();
+	return _journal.Move(a, b);
+}
+
+void PatchLibrary::stopCompaction()
+{
+	if(_compactPos != 0)
+	{
+		_compact.close();
+		_compactPos = 0;
+		TRACE_THR30IIPEDAL(Serial.println(F("Patch library: compaction stopped."));)
+	}
+}
+
+//Writes all patches (in the actual order, with the saved ones) into a new text file, one patch per call,
+//so it runs in idle time without blocking the loop. At the end the library is compiled from the new text file.
+int8_t PatchLibrary::CompactStep(const char *source)
+{
+	uint32_t t = micros();
+
+	if(_compactPos == 0)  //start
+	{
+		if(!_compact.open(JOURNAL_COMPACT_TMP, O_RDWR | O_CREAT | O_TRUNC))
+		{
+			return -1;
+		}
+		_compactPos = 1;
+		_compactT0 = millis();
+		_compactWorst = 0;
+		TRACE_THR30IIPEDAL(Serial.printf("Patch library: compacting %d patches...\n\r", size());)
+		return 1;
+	}
+
+	if(_compactPos <= size())
+	{
+		PatchLibEntry e;
+		if(!entry(_compactPos, e) || !copyRecord(e, _compact) || _compact.write("\r\n", 2) != 2)
+		{
+			TRACE_THR30IIPEDAL(Serial.printf("Patch library: compaction failed at patch #%d.\n\r", _compactPos);)
+			stopCompaction();
+			SD.remove(JOURNAL_COMPACT_TMP);
+			return -1;
+		}
+		_compactPos++;
+		_compactWorst = std::max(_compactWorst, micros() - t);
+		return 1;
+	}
+
+	_compactPos = 0;
+	if(!_compact.sync() || !_compact.close())
+	{
+		SD.remove(JOURNAL_COMPACT_TMP);
+		return -1;
+	}
+
+	uint32_t tc = millis();
+	char path[sizeof(_path)];
+	strcpy(path, _path);
+	close();  //Compacted() removes the library file
+	bool ok = _journal.Compacted(source, path);  //text file replaced, journal empty (or recover() finishes it at the next start)
+	ok = ok && compile(source, path);
+	ok = open(path) && ok;
+	TRACE_THR30IIPEDAL(Serial.printf("Patch library: compaction %s after %lu ms (longest step %lu us, compiling %lu ms)\n\r",
+	                                  ok ? "finished" : "failed", millis() - _compactT0, _compactWorst, millis() - tc);)
+	return ok ? 0 : -1;
+}
+
+void PatchScanner::begin(File32 &f)
+{
+	_file = &f;
+	_blockPos = _len = _idx = _scanned = _depth = 0;
+	_inString = _escape = _error = false;
+}
+
+//Reads the block following the actual one (seeks, because the file may have been used in between)
+bool PatchScanner::fill()
+{
+	_blockPos += _len;
+	_len = _idx = 0;
+
+	if(_file == nullptr || !_file->seekSet(_blockPos))
+	{
+		return false;
+	}
+	int n = _file->read(_buf, sizeof(_buf));
+	if(n <= 0)
+	{
+		return false;
+	}
+	_len = (uint32_t) n;
+	_scanned += _len;
+	return true;
+}
+
+size_t PatchScanner::feed(const uint8_t *buf, size_t len, uint32_t pos, bool &found)
+{
+	size_t i = 0;
+	found = false;
+
+	while(i < len)
+	{
+		if(_inString)
+		{
+			if(_escape)  //escaped character (may be the first one of a new block)
+			{
+				_escape = false;
+				i++;
+				continue;
+			}
+			while(i < len && buf[i] != '"' && buf[i] != '\\')  //skip string contents in one go
+			{
+				i++;
+			}
+			if(i == len)
+			{
+				break;
+			}
+			_escape = (buf[i] == '\\');
+			_inString = _escape;
+			i++;
+			continue;
+		}
+
+		switch(buf[i++])
+		{
+			case '"':
+				_inString = (_depth > 0);  //text between the patches is no JSON
+			break;
+
+			case '{':
+				if(_depth++ == 0)  //top level {} block opens here
+				{
+					_beg = pos + i - 1;
+				}
+			break;
+
+			case '}':
+				if(_depth == 0)  //block must not close, if not open!
+				{
+					TRACE_THR30IIPEDAL(Serial.printf("Unexpected } at %lu\n\r", (unsigned long)(pos + i - 1));)
+					_error = true;
+					return i;
+				}
+				if(--_depth == 0)
+				{
+					_end = pos + i;
+					found = true;
+					return i;
+				}
+			break;
+		}
+	}
+	return i;
+}
+
+bool PatchScanner::next(uint32_t &beg, uint32_t &end)
+{
+	while(!_error)
+	{
+		if(_idx >= _len && !fill())
+		{
+			return false;
+		}
+
+		bool found = false;
+		_idx += feed(_buf + _idx, _len - _idx, _blockPos + _idx, found);
+		if(found)
+		{
+			beg = _beg;
+			end = _end;
+			return true;
+		}
+	}
+	return false;
+}
+
+//Summary of a patch for the index (name, amp, cab), so browsing the library never needs to decode records
+static void summarize(File32 &src, PatchLibEntry &e, DynamicJsonDocument &djd)
+{
+	djd.clear();
+	DeserializationError dse = deserializeJson(djd, src, DeserializationOption::Filter(PatchFilter(false)));
+
+	if(dse != DeserializationError::Ok)
+	{
+		Serial.print(F("deserializeJson() failed with code ")); Serial.println(dse.f_str());
+		strcpy(e.name, "error");
+		return;
+	}
+
+	const char *name = djd["data"]["meta"]["name"].as<const char*>();
+	strncpy(e.name, name != nullptr ? name : "", PATCH_NAME_LEN);  //cut, if necessary
+	e.name[PATCH_NAME_LEN] = '\0';
+
+	col_amp ca;
+	if(AmpAsset_ToColAmp(djd["data"]["tone"]["THRGroupAmp"]["@asset"].as<const char*>(), ca))
+	{
+		e.col = ca.c;
+		e.amp = ca.a;
+	}
+
+	uint16_t cab = djd["data"]["tone"]["THRGroupCab"]["SpkSimType"].as<uint16_t>();
+	if(cab <= Bypass)
+	{
+		e.cab = (uint8_t) cab;
+	}
+	TRACE_V_THR30IIPEDAL(Serial.printf("%s: col %d, amp %d, cab %d (JSON document %d bytes)\n\r", e.name, e.col, e.amp, e.cab, (int) djd.memoryUsage());)
+}
+
+bool PatchLibrary::compile(const char *source, const char *target)
+{
+	uint32_t t0 = millis();
+
+	File32 src, dst;
+	if(!src.open(source, O_RDONLY))
+	{
+		TRACE_THR30IIPEDAL(Serial.printf("Patch source \"%s\" not found.\n\r", source);)
+		return false;
+	}
+
+	uint16_t date = 0, time = 0;
+	src.getModifyDateTime(&date, &time);
+
+	//1st pass: count the patches, so the fixed size index can be placed in front of the records
+	PatchScanner scan;  //on the stack only while compiling (block buffer)
+	uint32_t beg = 0, end = 0, count = 0;
+	uint32_t ts = micros();
+	scan.begin(src);
+	while(scan.next(beg, end))
+	{
+		count++;
+	}
+	ts = micros() - ts;
+	TRACE_THR30IIPEDAL(Serial.printf("Patch source: %lu patches in %lu bytes scanned in %lu us (%lu KB/s)\n\r", (unsigned long) count,
+	                                  (unsigned long) scan.scanned(), ts, ts > 0 ? (unsigned long)((uint64_t) scan.scanned() * 1000000ull / 1024 / ts) : 0ul);)
+
+	if(scan.error() || count > 0xFFFF || !src.rewind() || !dst.open(PATCHLIB_TMP, O_RDWR | O_CREAT | O_TRUNC))
+	{
+		src.close();
+		return false;
+	}
+
+	PatchLibHeader h = { PATCHLIB_MAGIC, PATCHLIB_VERSION, (uint16_t) sizeof(PatchLibEntry), count, (uint32_t) sizeof(PatchLibHeader),
+	                     (uint32_t)(sizeof(PatchLibHeader) + count * sizeof(PatchLibEntry)), (uint32_t) src.fileSize(), ((uint32_t) date << 16) | time };
+
+	PatchLibEntry e {};
+	bool ok = dst.write(&h, sizeof(h)) == sizeof(h);
+	for(uint32_t n = 0; ok && n < count; n++)  //reserve the index
+	{
+		ok = dst.write(&e, sizeof(e)) == sizeof(e);
+	}
+
+	//2nd pass: copy the records and fill in their index entries
+	DynamicJsonDocument djd(PATCH_SUMMARY_SIZE);
+	byte buf[512];
+	uint32_t pos = h.dataOffset;
+	uint32_t n = 0;
+
+	scan.begin(src);
+	while(ok && n < count && scan.next(beg, end))
+	{
+		e = {};
+		e.offset = pos;
+		e.length = end - beg;
+		e.col = e.amp = e.cab = PATCHLIB_NONE;
+
+		ok = src.seekSet(beg);
+		if(ok)
+		{
+			summarize(src, e, djd);  //streamed through the summary filter
+			ok = src.seekSet(beg) && dst.seekSet(pos);
+		}
+
+		for(uint32_t left = e.length; ok && left > 0; )  //copy the record in blocks
+		{
+			uint32_t k = left < sizeof(buf) ? left : sizeof(buf);
+			ok = (src.read(buf, k) == (int) k) && (dst.write(buf, k) == k);
+			left -= k;
+		}
+
+		ok = ok && dst.seekSet(h.indexOffset + n * sizeof(e)) && (dst.write(&e, sizeof(e)) == sizeof(e));
+		pos += e.length;
+		n++;
+	}
+
+	src.close();
+	ok = dst.close() && ok && (n == count);
+
+	if(ok)
+	{
+		SD.remove(target);
+		ok = SD.rename(PATCHLIB_TMP, target);
+	}
+	else
+	{
+		SD.remove(PATCHLIB_TMP);  //never leave a half written library
+	}
+
+	TRACE_THR30IIPEDAL(Serial.printf("Patch library \"%s\": %lu patches compiled from \"%s\" in %lu ms (%s).\n\r",
+	                                  target, (unsigned long) n, source, millis() - t0, ok ? "ok" : "write error");)
+	return ok;
+}
+
+const THR30II_Patch *PatchCache::find(uint16_t nr)
+{
+	for(size_t i = 0; i < PATCH_CACHE_SIZE; i++)
+	{
+		if(_used[i] != 0 && _slots[i].pat.nr == nr)
+		{
+			_used[i] = ++_clock;
+			_hits++;
+			return &_slots[i].pat;
+		}
+	}
+	_misses++;
+	return nullptr;
+}
+
+THR30II_Patch &PatchCache::insert(uint16_t nr)
+{
+	size_t lru = PATCH_CACHE_SIZE;
+	for(size_t i = 0; i < PATCH_CACHE_SIZE; i++)  //empty slots have the oldest "time" 0
+	{
+		bool pinned = _used[i] != 0 && (_slots[i].pat.nr == _pinned[0] || _slots[i].pat.nr == _pinned[1]);
+		if(!pinned && (lru == PATCH_CACHE_SIZE || _used[i] < _used[lru]))
+		{
+			lru = i;
+		}
+	}
+	_slots[lru].pat = THR30II_Patch();
+	_slots[lru].pat.nr = nr;
+	_slots[lru].frames.count = 0;
+	_used[lru] = ++_clock;
+	return _slots[lru].pat;
+}
+
+PatchFrames *PatchCache::frames(uint16_t nr)
+{
+	for(size_t i = 0; i < PATCH_CACHE_SIZE; i++)
+	{
+		if(_used[i] != 0 && _slots[i].pat.nr == nr)
+		{
+			return &_slots[i].frames;
+		}
+	}
+	return nullptr;
+}
+
+void PatchCache::erase(uint16_t nr)
+{
+	for(size_t i = 0; i < PATCH_CACHE_SIZE; i++)
+	{
+		if(_slots[i].pat.nr == nr)
+		{
+			_used[i] = 0;
+			_slots[i].pat.nr = 0;
+			_slots[i].frames.count = 0;
+		}
+	}
+}
+
+void PatchCache::clear()
+{
+	_used.fill(0);
+	for(Slot &s : _slots)
+	{
+		s.pat.nr = 0;
+		s.frames.count = 0;
+	}
+}
@@ -0,0 +1,157 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* PatchLibrary.h
+*  Binary patch library on SD-card (header, fixed size index, patch records)
+*/
+
+#ifndef _PATCHLIBRARY_H_
+#define _PATCHLIBRARY_H_
+
+#include <Arduino.h>
+#include <SD.h>
+#include <ArduinoJson.h>
+#include <algorithm>
+#include "THR30II.h"   //PATCH_NAME_LEN
+#include "PatchJournal.h"
+
+#define PATCHLIB_MAGIC   0x4c524854ul  //"THRL" in the patch library file header
+#define PATCHLIB_VERSION 1             //increment, if the layout changes
+#define PATCHLIB_NONE    0xFF          //summary field is unknown (e.g. amp asset not found)
+#define PATCHLIB_JOURNAL 0x80000000ul  //flag in PatchLibEntry::offset: the record is in the patch journal
+
+//File layout (little endian, as written by Teensy):
+//  PatchLibHeader
+//  PatchLibEntry[count]   (fixed size, so entry n is at indexOffset + n * entrySize)
+//  patch records          (the .thrl6p JSON text of each patch, found by offset/length from the index)
+struct PatchLibHeader
+{
+	uint32_t magic;         //PATCHLIB_MAGIC
+	uint16_t version;       //PATCHLIB_VERSION
+	uint16_t entrySize;     //sizeof(PatchLibEntry)
+	uint32_t count;         //number of patches
+	uint32_t indexOffset;   //position of the first index entry
+	uint32_t dataOffset;    //position of the first patch record
+	uint32_t sourceLength;  //length of the text file the library was compiled from
+	uint32_t sourceStamp;   //modification date (high word) and time (low word) of that text file (0: built on PC, see tools/build_patchlib)
+};
+
+struct PatchLibEntry
+{
+	uint32_t offset;                   //position of the patch record inside the library
+	uint32_t length;                   //length of the patch record
+	char name[PATCH_NAME_LEN + 1];     //patch name ("error", if the record could not be decoded)
+	uint8_t col;                       //THR30II_COL of the amp (or PATCHLIB_NONE)
+	uint8_t amp;                       //THR30II_AMP of the amp (or PATCHLIB_NONE)
+	uint8_t cab;                       //THR30II_CAB (or PATCHLIB_NONE)
+};
+
+//Schema of the fields used from .thrl6p patch files, as ArduinoJson filter (built once from the parameter registry)
+//full: everything needed for a decoded patch, else: only the summary for the library index (name, amp, cabinet)
+const DynamicJsonDocument &PatchFilter(bool full);
+
+#define PATCH_DOC_SIZE 3072    //JSON document for a filtered full patch
+#define PATCH_SUMMARY_SIZE 512 //JSON document for a filtered patch summary
+
+#define PATCHSCAN_BLOCK 8192  //bytes read from SD at once (multiple of the 512 byte sector, so reads stay sector aligned)
+
+//Finds the top level {} blocks of a text file with concatenated .thrl6p patches ({...}{...}...).
+//The file is read in aligned blocks into the scanner's buffer, braces inside JSON strings are ignored.
+//The tokenizer (feed) only works on memory, so it does not depend on the SD-card.
+class PatchScanner
+{
+	public:
+	  void begin(File32 &f);                      //scans f from the beginning
+	  bool next(uint32_t &beg, uint32_t &end);    //position of the next '{' and behind its matching '}'
+	  size_t feed(const uint8_t *buf, size_t len, uint32_t pos, bool &found);  //tokenizes buf (at file position pos) until a block is complete
+	  void block(uint32_t &beg, uint32_t &end) const { beg = _beg; end = _end; };  //position of the block, that feed() found last
+	  bool error() const { return _error; };      //unbalanced '}' found
+	  uint32_t scanned() const { return _scanned; };  //bytes read from SD since begin()
+
+	private:
+	  bool fill();
+	  File32 *_file = nullptr;
+	  uint8_t _buf[PATCHSCAN_BLOCK];
+	  uint32_t _blockPos = 0;   //file position of _buf[0]
+	  uint32_t _len = 0;        //valid bytes in _buf
+	  uint32_t _idx = 0;        //next byte to tokenize
+	  uint32_t _scanned = 0;
+	  uint32_t _depth = 0;      //actual bracket level
+	  uint32_t _beg = 0, _end = 0;
+	  bool _inString = false;
+	  bool _escape = false;     //last byte inside the string was a '\'
+	  bool _error = false;
+};
+
+//Opening a library only reads and checks the header. Index entries and records are read on demand,
+//so boot time and RAM use do not depend on the number of patches.
+//Patches saved or moved on the pedal are kept in the PatchJournal, until a compaction writes them into the text file
+//and the library is compiled from it again.
+class PatchLibrary
+{
+	public:
+	  bool open(const char *path);                            //checks the header and keeps the file open (opens the journal, too)
+	  void close();
+	  uint16_t size() const { return std::max(_count, _journal.size()); };
+	  uint32_t revision() const { return _journal.revision(); };  //changes with every save or move
+	  const PatchLibHeader &header() const { return _hdr; };
+	  bool matchesSource(uint32_t length, uint32_t stamp) const { return _hdr.sourceLength == length && (_hdr.sourceStamp == stamp || _hdr.sourceStamp == 0); };
+	  bool entry(uint16_t nr, PatchLibEntry &e) const;        //index entry of patch nr (1-based, after moves and saves)
+	  DeserializationError parse(const PatchLibEntry &e, JsonDocument &doc, bool full) const;  //record streamed from SD through PatchFilter()
+
+	  bool Save(uint16_t nr, const char *text, uint32_t len, const PatchLibEntry &summary);  //nr = size() + 1: new patch
+	  bool Move(uint16_t a, uint16_t b);                      //swap patches a and b
+	  bool full() const { return _journal.full(); };
+	  bool needsCompaction() const { return _journal.needsCompaction(); };
+	  int8_t CompactStep(const char *source);                 //one patch per call (1: busy, 0: finished and reopened, -1: failed)
+	  bool compacting() const { return _compactPos != 0; };
+	  bool writable() const { return _journal.file().isOpen(); };
+
+	  //builds a library from a text file with concatenated .thrl6p patches ({...}{...}...)
+	  static bool compile(const char *source, const char *target);
+
+	private:
+	  bool copyRecord(const PatchLibEntry &e, File32 &dst) const;
+	  void stopCompaction();
+
+	  mutable File32 _file;     //stays open, an entry or record is one seek and one read
+	  PatchLibHeader _hdr {};
+	  uint16_t _count = 0;
+	  char _path[32] {};
+	  PatchJournal _journal;
+	  File32 _compact;          //new text file, while compacting
+	  uint16_t _compactPos = 0; //next patch to copy (0: no compaction running)
+	  uint32_t _compactT0 = 0;
+	  uint32_t _compactWorst = 0;
+};
+
+#define PATCH_CACHE_SIZE 6  //number of decoded patches kept in RAM (independent of the library size): active, preselected and 4 neighbours
+
+//Small LRU cache of decoded library patches and their rendered upload frames
+class PatchCache
+{
+	public:
+	  const THR30II_Patch *find(uint16_t nr);   //cached patch nr (marked as most recently used) or nullptr
+	  THR30II_Patch &insert(uint16_t nr);       //slot for patch nr (replaces the least recently used one)
+	  PatchFrames *frames(uint16_t nr);         //upload frames of cached patch nr (count 0, if not rendered yet) or nullptr
+	  void erase(uint16_t nr);                  //e.g. if decoding failed
+	  void clear();
+	  void pin(uint16_t staged, uint16_t live) { _pinned[0] = staged; _pinned[1] = live; };  //never replaced by insert()
+	  uint32_t hits() const { return _hits; };
+	  uint32_t misses() const { return _misses; };
+
+	private:
+	  struct Slot
+	  {
+		THR30II_Patch pat;
+		PatchFrames frames;
+	  };
+	  std::array<Slot, PATCH_CACHE_SIZE> _slots;
+	  std::array<uint32_t, PATCH_CACHE_SIZE> _used {};  //"time" of last use (0 = empty)
+	  uint32_t _clock = 0;
+	  uint16_t _pinned[2] {};   //preselected patch (staging) and active patch (its frames make switching back instant)
+	  uint32_t _hits = 0;
+	  uint32_t _misses = 0;
+};
+
+#endif
@@ -0,0 +1,662 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* PatchNavigator.cpp
+*  Navigation through large patch libraries (banks, sorted names, favourites, recently used patches)
+*/
+
+#include <Arduino.h>
+#include <algorithm>
+#include <new>
+#include "PatchNavigator.h"
+
+//Normal TRACE/DEBUG
+#define TRACE_THR30IIPEDAL(x) x
+//#define TRACE_THR30IIPEDAL(x)
+
+//Verbose TRACE/DEBUG
+//#define TRACE_V_THR30IIPEDAL(x)	x
+#define TRACE_V_THR30IIPEDAL(x)
+
+#define NAV_TMP "patchnav.tmp"  //name index is built into this file and renamed when complete
+#define NAV_RUN_A "patchnav.ra"  //sorted runs of keys, while the name index is built
+#define NAV_RUN_B "patchnav.rb"
+#define NAV_RUN_KEYS 256         //keys sorted in RAM at once (2.5 KB)
+#define NAV_KEY_BUF 32           //keys read at once from a run
+#define NAV_RANK_BLOCK 512       //entries of sorted[] / rank[] written at once (rank[] is filled in one pass over the sorted keys per block)
+
+const char * const NAV_LIST_NAMES[NAV_LISTS] = { "All", "Names", "Favourites", "Recent" };
+
+static bool read16(File32 &f, uint32_t pos, uint16_t &v)
+{
+	return f.seekSet(pos) && (f.read(&v, 2) == 2);
+}
+
+static int nameCmp(const char *a, const char *b)  //case insensitive, same order as the first characters used for jumps
+{
+	for(;; a++, b++)
+	{
+		int c = toupper((unsigned char) *a) - toupper((unsigned char) *b);
+		if(c != 0 || *a == '\0')
+		{
+			return c;
+		}
+	}
+}
+
+void PatchNavigator::begin(const PatchLibrary *lib, uint16_t count)
+{
+	_lib = lib;
+	_count = count;
+	_names = false;
+	_favs = 0;
+	_state = NavState();
+
+	if(_lib == nullptr)  //patches from PROGMEM: nothing on SD-card
+	{
+		return;
+	}
+
+	File32 f;
+	if(f.open(NAV_STATE_FILE, O_RDONLY))
+	{
+		NavState s;
+		if(f.read(&s, sizeof(s)) == (int) sizeof(s) && s.magic == NAV_MAGIC)
+		{
+			_state = s;
+		}
+		f.close();
+	}
+	if(_state.bankSize != 10 && _state.bankSize != 20)
+	{
+		_state.bankSize = 5;
+	}
+	_state.list = _state.list < NAV_LISTS ? _state.list : NAV_ALL;
+	uint8_t n = 0;
+	for(uint8_t i = 0; i < _state.recents && i < NAV_RECENTS; i++)  //drop patches, that are not in the library any more
+	{
+		if(_state.recent[i] >= 1 && _state.recent[i] <= _count)
+		{
+			_state.recent[n++] = _state.recent[i];
+		}
+	}
+	_state.recents = n;
+
+	uint32_t t0 = micros();
+	const PatchLibHeader &lh = _lib->header();
+	if(_index.isOpen())
+	{
+		_index.close();
+	}
+	_names = _index.open(NAV_FILE, O_RDONLY) && (_index.read(&_hdr, sizeof(_hdr)) == (int) sizeof(_hdr)) && (_hdr.magic == NAV_MAGIC)
+	         && (_hdr.version == NAV_VERSION) && (_hdr.count == _count) && (_hdr.sourceLength == lh.sourceLength) && (_hdr.sourceStamp == lh.sourceStamp)
+	         && (_hdr.revision == _lib->revision());
+	if(!_names && _count > 0)
+	{
+		_names = buildIndex();
+	}
+	if(!_names)
+	{
+		_hdr = {};
+	}
+	TRACE_THR30IIPEDAL(Serial.printf("Patch navigator: name index %s (%lu us), %d initials\n\r", _names ? "ok" : "not available", micros() - t0, _hdr.initials);)
+
+	if(_fav.isOpen())
+	{
+		_fav.close();
+	}
+	if(_fav.open(NAV_FAV_FILE, O_RDWR | O_CREAT))
+	{
+		_favs = (uint16_t) std::min<uint32_t>((uint32_t) _fav.fileSize() / 2, NAV_FAV_MAX);
+	}
+
+	if(length(_state.list) == 0)
+	{
+		_state.list = NAV_ALL;
+	}
+}
+
+//The name index is sorted on SD-card (external merge sort), so building it needs the same RAM for any library size:
+//runs of NAV_RUN_KEYS keys are sorted in RAM, then pairs of runs are merged between two files until one run is left.
+struct NavKey  //first characters (upper case) are enough to sort most names without reading them again
+{
+	char key[8];
+	uint16_t nr;
+};
+
+class NavKeyReader  //buffered reading of the keys [from, to) of a run file
+{
+	public:
+	  NavKeyReader(File32 &f, uint32_t from, uint32_t to) : _f(f), _pos(from), _to(to) {}
+	  const NavKey *peek()
+	  {
+		if(_i == _n && _pos < _to)
+		{
+			_n = (uint8_t) std::min<uint32_t>(NAV_KEY_BUF, _to - _pos);
+			_i = 0;
+			if(!_f.seekSet(_pos * sizeof(NavKey)) || _f.read(_buf, _n * sizeof(NavKey)) != (int)(_n * sizeof(NavKey)))
+			{
+				_n = 0;
+				_error = true;
+				_pos = _to;
+				return nullptr;
+			}
+			_pos += _n;
+		}
+		return _i < _n ? &_buf[_i] : nullptr;
+	  }
+	  void pop() { _i++; }
+	  bool error() const { return _error; }
+
+	private:
+	  File32 &_f;
+	  uint32_t _pos, _to;
+	  NavKey _buf[NAV_KEY_BUF];
+	  uint8_t _i = 0, _n = 0;
+	  bool _error = false;
+};
+
+static bool keyLess(const PatchLibrary *lib, const NavKey &a, const NavKey &b)
+{
+	int c = memcmp(a.key, b.key, sizeof(a.key));
+	if(c == 0 && a.key[sizeof(a.key) - 1] != '\0')  //equal beginning: compare the complete names
+	{
+		PatchLibEntry ea, eb;
+		lib->entry(a.nr, ea);
+		lib->entry(b.nr, eb);
+		c = nameCmp(ea.name, eb.name);
+	}
+	return c != 0 ? c < 0 : a.nr < b.nr;
+}
+
+bool PatchNavigator::buildIndex()
+{
+	//Only while building, independent of the number of patches: one run of keys and one block of sorted[] or rank[]
+	NavKey *keys = new (std::nothrow) NavKey[NAV_RUN_KEYS];
+	uint16_t *block = new (std::nothrow) uint16_t[NAV_RANK_BLOCK];
+	const PatchLibrary *lib = _lib;
+	File32 run[2];
+	bool ok = keys != nullptr && block != nullptr && _count > 0
+	          && run[0].open(NAV_RUN_A, O_RDWR | O_CREAT | O_TRUNC) && run[1].open(NAV_RUN_B, O_RDWR | O_CREAT | O_TRUNC);
+
+	//Sorted runs
+	PatchLibEntry e;
+	for(uint32_t i = 0; ok && i < _count; i += NAV_RUN_KEYS)
+	{
+		uint16_t n = (uint16_t) std::min<uint32_t>(NAV_RUN_KEYS, _count - i);
+		for(uint16_t j = 0; ok && j < n; j++)
+		{
+			ok = _lib->entry(i + j + 1, e);
+			strncpy(keys[j].key, e.name, sizeof(keys[j].key));
+			for(char &c : keys[j].key)
+			{
+				c = toupper((unsigned char) c);
+			}
+			keys[j].nr = i + j + 1;
+		}
+		std::sort(keys, keys + n, [lib](const NavKey &a, const NavKey &b) { return keyLess(lib, a, b); });
+		ok = ok && run[0].write(keys, n * sizeof(NavKey)) == n * sizeof(NavKey);
+	}
+
+	//Merge passes (the key buffer collects the output)
+	uint8_t src = 0;
+	for(uint32_t len = NAV_RUN_KEYS; ok && len < _count; len *= 2, src ^= 1)
+	{
+		File32 &dst = run[src ^ 1];
+		ok = dst.seekSet(0);
+		for(uint32_t beg = 0; ok && beg < _count; beg += 2 * len)
+		{
+			uint32_t mid = std::min<uint32_t>(beg + len, _count);
+			NavKeyReader a(run[src], beg, mid), b(run[src], mid, std::min<uint32_t>(beg + 2 * len, _count));
+			uint16_t n = 0;
+			while(ok)
+			{
+				const NavKey *ka = a.peek(), *kb = b.peek();
+				if(ka == nullptr && kb == nullptr)
+				{
+					break;
+				}
+				bool takeA = kb == nullptr || (ka != nullptr && !keyLess(lib, *kb, *ka));
+				keys[n++] = takeA ? *ka : *kb;
+				takeA ? a.pop() : b.pop();
+				if(n == NAV_RUN_KEYS)
+				{
+					ok = dst.write(keys, n * sizeof(NavKey)) == n * sizeof(NavKey);
+					n = 0;
+				}
+			}
+			ok = ok && !a.error() && !b.error() && dst.write(keys, n * sizeof(NavKey)) == n * sizeof(NavKey);
+		}
+	}
+
+	//sorted[] and the initials from the last run
+	File32 f;
+	const PatchLibHeader &lh = _lib->header();
+	_hdr = { NAV_MAGIC, NAV_VERSION, 0, _count, lh.sourceLength, lh.sourceStamp, 0, _lib->revision() };
+	ok = ok && f.open(NAV_TMP, O_RDWR | O_CREAT | O_TRUNC) && (f.write(&_hdr, sizeof(_hdr)) == sizeof(_hdr));
+	if(ok)
+	{
+		NavKeyReader r(run[src], 0, _count);
+		uint32_t group = 0;
+		char last = 0;
+		uint16_t n = 0;
+		for(uint32_t i = 0; ok && i < _count; i++)
+		{
+			const NavKey *k = r.peek();
+			ok = k != nullptr;
+			if(ok)
+			{
+				if(i == 0 || k->key[0] != last)
+				{
+					_hdr.initials++;
+					group = 0;
+				}
+				last = k->key[0];
+				_hdr.maxGroup = std::max(_hdr.maxGroup, ++group);
+				block[n++] = k->nr;
+				r.pop();
+			}
+			if(ok && (n == NAV_RANK_BLOCK || i + 1 == _count))
+			{
+				ok = f.write(block, n * 2) == (size_t)(n * 2);
+				n = 0;
+			}
+		}
+	}
+
+	//rank[], one block of patch numbers per pass over the sorted keys
+	for(uint32_t lo = 0; ok && lo < _count; lo += NAV_RANK_BLOCK)
+	{
+		uint16_t n = (uint16_t) std::min<uint32_t>(NAV_RANK_BLOCK, _count - lo);
+		NavKeyReader r(run[src], 0, _count);
+		for(uint32_t i = 0; i < _count; i++)
+		{
+			const NavKey *k = r.peek();
+			if(k == nullptr)
+			{
+				ok = false;
+				break;
+			}
+			if(k->nr - 1u - lo < n)
+			{
+				block[k->nr - 1 - lo] = i;
+			}
+			r.pop();
+		}
+		ok = ok && f.write(block, n * 2) == (size_t)(n * 2);
+	}
+	ok = ok && f.seekSet(0) && (f.write(&_hdr, sizeof(_hdr)) == sizeof(_hdr));
+	if(f.isOpen())
+	{
+		ok = f.close() && ok;
+	}
+
+	delete[] keys;
+	delete[] block;
+	run[0].close();
+	run[1].close();
+	SD.remove(NAV_RUN_A);
+	SD.remove(NAV_RUN_B);
+
+	if(ok)
+	{
+		SD.remove(NAV_FILE);
+		ok = SD.rename(NAV_TMP, NAV_FILE) && _index.open(NAV_FILE, O_RDONLY);
+	}
+	else
+	{
+		SD.remove(NAV_TMP);
+		TRACE_THR30IIPEDAL(Serial.printf("Patch navigator: name index for %d patches could not be built.\n\r", _count);)
+	}
+	return ok;
+}
+
+void PatchNavigator::saveState() const
+{
+	File32 f;
+	if(_lib != nullptr && f.open(NAV_STATE_FILE, O_RDWR | O_CREAT | O_TRUNC))
+	{
+		f.write(&_state, sizeof(_state));
+		f.close();
+	}
+}
+
+uint16_t PatchNavigator::length(NavList l) const
+{
+	switch(l)
+	{
+		case NAV_ALL:        return _count;
+		case NAV_NAMES:      return _names ? _count : 0;
+		case NAV_FAVOURITES: return _favs;
+		case NAV_RECENT:     return _state.recents;
+		default:             return 0;
+	}
+}
+
+uint16_t PatchNavigator::at(uint16_t pos) const
+{
+	uint16_t nr = 0;
+	if(pos >= length(_state.list))
+	{
+		return 0;
+	}
+	switch(_state.list)
+	{
+		case NAV_ALL:        nr = pos + 1;                                           break;
+		case NAV_NAMES:      read16(_index, sizeof(NavHeader) + pos * 2u, nr);      break;
+		case NAV_FAVOURITES: read16(_fav, pos * 2u, nr);                             break;
+		case NAV_RECENT:     nr = _state.recent[pos];                                break;
+		default:                                                                     break;
+	}
+	return nr;
+}
+
+int32_t PatchNavigator::find(uint16_t nr) const
+{
+	if(nr < 1 || nr > _count)
+	{
+		return -1;
+	}
+	uint16_t pos = 0;
+	switch(_state.list)
+	{
+		case NAV_ALL:
+			return nr - 1;
+
+		case NAV_NAMES:
+			return (_names && read16(_index, sizeof(NavHeader) + (_count + nr - 1) * 2u, pos)) ? pos : -1;
+
+		case NAV_FAVOURITES:
+			return findFavourite(nr);
+
+		case NAV_RECENT:
+			for(uint8_t i = 0; i < _state.recents; i++)
+			{
+				if(_state.recent[i] == nr)
+				{
+					return i;
+				}
+			}
+			return -1;
+
+		default:
+			return -1;
+	}
+}
+
+int32_t PatchNavigator::findFavourite(uint16_t nr) const  //binary search in the ascending list
+{
+	int32_t lo = 0, hi = (int32_t) _favs - 1;
+	while(lo <= hi)
+	{
+		int32_t mid = (lo + hi) / 2;
+		uint16_t v = 0;
+		if(!read16(_fav, mid * 2u, v))
+		{
+			return -1;
+		}
+		if(v == nr)
+		{
+			return mid;
+		}
+		if(v < nr)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid - 1;
+		}
+	}
+	return -1;
+}
+
+uint8_t PatchNavigator::initial(uint16_t pos) const
+{
+	PatchLibEntry e;
+	return _lib->entry(at(pos), e) ? (uint8_t) toupper((unsigned char) e.name[0]) : 0;
+}
+
+uint16_t PatchNavigator::firstOf(int c) const  //lower bound, the names are sorted by their initials
+{
+	uint16_t lo = 0, hi = _count;
+	while(lo < hi)
+	{
+		uint16_t mid = (lo + hi) / 2;
+		if(initial(mid) < c)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+uint16_t PatchNavigator::Step(uint16_t nr, int8_t dir) const
+{
+	uint16_t len = length(_state.list);
+	if(len == 0)
+	{
+		return nr;
+	}
+	int32_t pos = find(nr);
+	if(pos < 0)  //not in this list: start at its beginning / end
+	{
+		return at(dir < 0 ? len - 1 : 0);
+	}
+	return at((uint16_t)((pos + dir + len) % len));
+}
+
+uint16_t PatchNavigator::Bank(uint16_t nr, int8_t dir) const
+{
+	uint16_t len = length(_state.list);
+	if(len == 0)
+	{
+		return nr;
+	}
+	int32_t pos = std::max<int32_t>(find(nr), 0);
+	int32_t banks = (len + _state.bankSize - 1) / _state.bankSize;
+	int32_t bank = (pos / _state.bankSize + dir + banks) % banks;
+	return at((uint16_t)(bank * _state.bankSize));
+}
+
+uint16_t PatchNavigator::Jump(uint16_t nr, int8_t dir) const
+{
+	uint16_t len = length(_state.list);
+	if(len == 0)
+	{
+		return nr;
+	}
+	int32_t pos = std::max<int32_t>(find(nr), 0);
+
+	if(_state.list != NAV_NAMES)  //bank of banks
+	{
+		int32_t size = _state.bankSize * _state.bankSize;
+		int32_t blocks = (len + size - 1) / size;
+		return at((uint16_t)(((pos / size + dir + blocks) % blocks) * size));
+	}
+
+	uint16_t start = firstOf(initial(pos));  //first name with the same initial
+	if(dir > 0)
+	{
+		uint16_t next = firstOf(initial(pos) + 1);
+		return at(next < len ? next : 0);
+	}
+	if(dir < 0 && pos == start)  //already at the beginning: previous initial
+	{
+		return at(firstOf(initial(start > 0 ? start - 1 : len - 1)));
+	}
+	return at(start);
+}
+
+uint8_t PatchNavigator::Window(uint16_t nr, uint16_t (&icons)[NAV_ICONS]) const
+{
+	uint16_t len = length(_state.list);
+	int32_t pos = find(nr);
+	uint8_t n = 0;
+
+	uint16_t first = pos - pos % NAV_ICONS;  //bank sizes are multiples of NAV_ICONS
+	for(uint8_t i = 0; i < NAV_ICONS; i++)
+	{
+		if(pos < 0)  //not in the active list: show nr alone
+		{
+			icons[i] = (i == 0) ? nr : 0;
+		}
+		else
+		{
+			icons[i] = (first + i < len) ? at(first + i) : 0;
+		}
+		n += icons[i] != 0;
+	}
+	return n;
+}
+
+void PatchNavigator::NextList()
+{
+	for(uint8_t k = 1; k <= NAV_LISTS; k++)
+	{
+		NavList l = (NavList)((_state.list + k) % NAV_LISTS);
+		if(length(l) > 0)
+		{
+			_state.list = l;
+			break;
+		}
+	}
+	saveState();
+	TRACE_THR30IIPEDAL(Serial.printf("Patch list: %s (%d patches)\n\r", NAV_LIST_NAMES[_state.list], length(_state.list));)
+}
+
+void PatchNavigator::NextBankSize()
+{
+	_state.bankSize = _state.bankSize == 5 ? 10 : _state.bankSize == 10 ? 20 : 5;
+	saveState();
+	TRACE_THR30IIPEDAL(Serial.printf("Bank size: %d (any patch in %d presses)\n\r", _state.bankSize, MaxPresses());)
+}
+
+bool PatchNavigator::IsFavourite(uint16_t nr) const
+{
+	return findFavourite(nr) >= 0;
+}
+
+bool PatchNavigator::ToggleFavourite(uint16_t nr)
+{
+	if(!_fav.isOpen() || nr < 1 || nr > _count)
+	{
+		return false;
+	}
+
+	uint16_t favs[NAV_FAV_MAX];  //the list is small, so it is rewritten completely
+	if(!_fav.seekSet(0) || _fav.read(favs, _favs * 2) != _favs * 2)
+	{
+		return false;
+	}
+
+	uint16_t *p = std::lower_bound(favs, favs + _favs, nr);
+	bool isFav = (p == favs + _favs || *p != nr);
+	if(!isFav)
+	{
+		std::copy(p + 1, favs + _favs, p);
+		_favs--;
+	}
+	else if(_favs < NAV_FAV_MAX)
+	{
+		std::copy_backward(p, favs + _favs, favs + _favs + 1);
+		*p = nr;
+		_favs++;
+	}
+	else
+	{
+		TRACE_THR30IIPEDAL(Serial.printf("No more than %d favourites possible.\n\r", NAV_FAV_MAX);)
+		return false;
+	}
+
+	bool ok = _fav.seekSet(0) && (_fav.write(favs, _favs * 2) == (size_t)(_favs * 2)) && _fav.truncate(_favs * 2) && _fav.sync();
+	TRACE_THR30IIPEDAL(Serial.printf("Patch #%d %s favourites (%s)\n\r", nr, isFav ? "added to" : "removed from", ok ? "ok" : "write error");)
+	if(_favs == 0 && _state.list == NAV_FAVOURITES)
+	{
+		_state.list = NAV_ALL;
+	}
+	return isFav;
+}
+
+void PatchNavigator::Used(uint16_t nr)
+{
+	if(_lib == nullptr || nr < 1 || nr > _count || (_state.recents > 0 && _state.recent[0] == nr))
+	{
+		return;
+	}
+
+	uint8_t i = 0;
+	while(i < _state.recents && _state.recent[i] != nr)  //was used before?
+	{
+		i++;
+	}
+	if(i < _state.recents && _state.list == NAV_RECENT)  //do not reorder the list, while it is browsed
+	{
+		return;
+	}
+	if(i == _state.recents && _state.recents < NAV_RECENTS)
+	{
+		_state.recents++;
+	}
+	for(i = std::min<uint8_t>(i, NAV_RECENTS - 1); i > 0; i--)  //move the others back, nr to the front
+	{
+		_state.recent[i] = _state.recent[i - 1];
+	}
+	_state.recent[0] = nr;
+	saveState();
+}
+
+void PatchNavigator::Swapped(uint16_t a, uint16_t b)
+{
+	if(_lib == nullptr || a == b)
+	{
+		return;
+	}
+
+	bool changed = false;
+	for(uint8_t i = 0; i < _state.recents; i++)
+	{
+		if(_state.recent[i] == a || _state.recent[i] == b)
+		{
+			_state.recent[i] = _state.recent[i] == a ? b : a;
+			changed = true;
+		}
+	}
+	if(changed)
+	{
+		saveState();
+	}
+
+	uint16_t favs[NAV_FAV_MAX];
+	if(!_fav.isOpen() || !_fav.seekSet(0) || _fav.read(favs, _favs * 2) != _favs * 2)
+	{
+		return;
+	}
+	uint16_t *pa = std::lower_bound(favs, favs + _favs, a);
+	uint16_t *pb = std::lower_bound(favs, favs + _favs, b);
+	bool favA = (pa != favs + _favs && *pa == a);
+	bool favB = (pb != favs + _favs && *pb == b);
+	if(favA == favB)  //both or none of them are favourites: the list stays the same
+	{
+		return;
+	}
+	*(favA ? pa : pb) = favA ? b : a;
+	std::sort(favs, favs + _favs);
+	bool ok = _fav.seekSet(0) && (_fav.write(favs, _favs * 2) == (size_t)(_favs * 2)) && _fav.sync();
+	TRACE_THR30IIPEDAL(Serial.printf("Favourite #%d is #%d now (%s)\n\r", favA ? a : b, favA ? b : a, ok ? "ok" : "write error");)
+}
+
+uint16_t PatchNavigator::MaxPresses() const  //with jumps and banks in both directions and single steps
+{
+	uint32_t b = _state.bankSize;
+	if(_state.list == NAV_NAMES)  //jump to the initial, then banks and steps inside its group
+	{
+		return (uint16_t)(_hdr.initials / 2 + ((_hdr.maxGroup + b - 1) / b) / 2 + b / 2);
+	}
+	uint32_t blocks = (length(_state.list) + b * b - 1) / (b * b);
+	return (uint16_t)(blocks / 2 + b / 2 + b / 2);
+}
@@ -0,0 +1,95 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* PatchNavigator.h
+*  Navigation through large patch libraries (banks, sorted names, favourites, recently used patches)
+*/
+
+#ifndef _PATCHNAVIGATOR_H_
+#define _PATCHNAVIGATOR_H_
+
+#include <Arduino.h>
+#include <SD.h>
+#include "PatchLibrary.h"
+
+#define NAV_FILE        "patches.thrnav"     //name index of the library (rebuilt, whenever the library changed)
+#define NAV_FAV_FILE    "favourites.thrnav"  //patch numbers of the favourites (ascending uint16_t)
+#define NAV_STATE_FILE  "navstate.thrnav"    //bank size, active list and recently used patches
+#define NAV_MAGIC       0x4e524854ul         //"THRN"
+#define NAV_VERSION     2
+#define NAV_FAV_MAX     256                  //favourites
+#define NAV_RECENTS     16                   //recently used patches
+#define NAV_ICONS       5                    //patch icons on the display
+
+enum NavList : uint8_t { NAV_ALL, NAV_NAMES, NAV_FAVOURITES, NAV_RECENT, NAV_LISTS };
+
+extern const char * const NAV_LIST_NAMES[NAV_LISTS];
+
+//File layout of NAV_FILE:
+//  NavHeader
+//  uint16_t sorted[count]   patch numbers in the order of their names (case insensitive)
+//  uint16_t rank[count]     position of patch nr inside sorted[] (at index nr - 1)
+struct NavHeader
+{
+	uint32_t magic;         //NAV_MAGIC
+	uint16_t version;       //NAV_VERSION
+	uint16_t initials;      //number of different first characters of the names
+	uint32_t count;         //number of patches
+	uint32_t sourceLength;  //identify the library the index belongs to (see PatchLibHeader)
+	uint32_t sourceStamp;
+	uint32_t maxGroup;      //patches with the most frequent first character
+	uint32_t revision;      //of the library's journal (patches saved or moved on the pedal)
+};
+
+//Saved, whenever it changes (small, so it is always written completely)
+struct NavState
+{
+	uint32_t magic = NAV_MAGIC;
+	uint8_t bankSize = 5;
+	NavList list = NAV_ALL;
+	uint8_t recents = 0;                     //valid entries in recent[]
+	uint8_t reserved = 0;
+	uint16_t recent[NAV_RECENTS] {};         //most recently used first
+};
+
+//Lists are addressed by position, their contents stay on SD-card (only the recently used patches are in RAM).
+//All functions take and return patch numbers (1-based), 0 means "none".
+class PatchNavigator
+{
+	public:
+	  void begin(const PatchLibrary *lib, uint16_t count);   //lib == nullptr: no SD-card library, only NAV_ALL
+	  NavList list() const { return _state.list; };
+	  void NextList();                                    //rotates through the lists, that are not empty
+	  uint8_t bankSize() const { return _state.bankSize; };
+	  void NextBankSize();                                //5 -> 10 -> 20 -> 5
+	  uint16_t Step(uint16_t nr, int8_t dir) const;       //previous / next patch of the active list (dir 0: nr or the first one)
+	  uint16_t Bank(uint16_t nr, int8_t dir) const;       //first patch of the previous / next bank
+	  uint16_t Jump(uint16_t nr, int8_t dir) const;       //previous / next first character (NAV_NAMES) or bank of banks
+	  uint8_t Window(uint16_t nr, uint16_t (&icons)[NAV_ICONS]) const;  //patches shown as icons around nr
+	  bool ToggleFavourite(uint16_t nr);                  //true, if nr is a favourite now
+	  bool IsFavourite(uint16_t nr) const;
+	  void Used(uint16_t nr);                             //patch was activated
+	  void Swapped(uint16_t a, uint16_t b);               //patches a and b were swapped in the library (favourites and recents follow)
+	  uint16_t MaxPresses() const;                        //presses to reach any patch of the active list (worst case)
+
+	private:
+	  uint16_t length(NavList l) const;
+	  uint16_t at(uint16_t pos) const;                    //patch nr at position pos of the active list
+	  int32_t find(uint16_t nr) const;                    //position of patch nr in the active list (-1: not in it)
+	  uint8_t initial(uint16_t pos) const;                //(NAV_NAMES) upper case first character of the name at pos
+	  uint16_t firstOf(int c) const;                      //(NAV_NAMES) first position with initial >= c
+	  int32_t findFavourite(uint16_t nr) const;           //position in NAV_FAV_FILE (-1: not found)
+	  bool buildIndex();
+	  void saveState() const;
+
+	  const PatchLibrary *_lib = nullptr;
+	  mutable File32 _index;      //stays open like the library
+	  mutable File32 _fav;
+	  NavHeader _hdr {};
+	  uint16_t _count = 0;
+	  uint16_t _favs = 0;
+	  bool _names = false;        //name index available
+	  NavState _state;
+};
+
+#endif
@@ -0,0 +1,103 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* PedalStream.cpp
+*  Expression pedal streamed to THR: paced by THR's acks, rate capped, slew limited, resting value always sent
+*/
+
+#include <Arduino.h>
+#include "PedalStream.h"
+
+//Normal TRACE/DEBUG
+#define TRACE_THR30IIPEDAL(x) x
+//#define TRACE_THR30IIPEDAL(x)
+
+//Verbose TRACE/DEBUG
+//#define TRACE_V_THR30IIPEDAL(x)	x
+#define TRACE_V_THR30IIPEDAL(x)
+
+void PedalStream::Input(uint16_t v)
+{
+	if(abs((int) v - (int) _target) > PEDAL_MARGIN)
+	{
+		_target = v;
+		_moved_us = micros();
+		_settled = false;
+	}
+}
+
+bool PedalStream::Due(bool waiting)
+{
+	if(_out == _target && !_resend)
+	{
+		return false;
+	}
+	if(waiting)  //paced by THR's acks
+	{
+		return false;
+	}
+	return micros() - _sent_us >= 1000000ul / _hz;
+}
+
+uint16_t PedalStream::Next()
+{
+	uint32_t now = micros();
+	uint32_t period = 1000000ul / _hz;
+	uint32_t dt = min(now - _sent_us, 2 * period);  //after a pause the first step is not larger than two steps at full rate
+	int32_t step = max((int32_t)((uint64_t) PEDAL_SLEW * dt / 1000000ul), (int32_t) 1);
+	int32_t diff = (int32_t) _target - (int32_t) _out;
+	_out = (uint16_t)(_out + constrain(diff, -step, step));
+	_sent_us = now;
+	_inflight = true;
+	_resend = false;
+	_sends++;
+	TRACE_V_THR30IIPEDAL(Serial.printf("PedalStream: %u (target %u)\n\r", _out, _target);)
+	return _out;
+}
+
+void PedalStream::Acked()
+{
+	if(!_inflight)  //change from somewhere else (UI)
+	{
+		return;
+	}
+	_inflight = false;
+	if(abs((int) _target - (int) _out) > PEDAL_MARGIN)
+	{
+		_stale++;
+	}
+	if(_out == _target && !_settled)
+	{
+		uint32_t lat = micros() - _moved_us;
+		_settled = true;
+		_settled_n++;
+		_settle_sum += lat;
+		_settle_worst = max(_settle_worst, lat);
+	}
+}
+
+void PedalStream::Lost()
+{
+	if(_inflight)
+	{
+		_inflight = false;
+		_resend = true;
+		_lost++;
+	}
+}
+
+void PedalStream::Reset()
+{
+	_sends = 0;
+	_stale = 0;
+	_lost = 0;
+	_settled_n = 0;
+	_settle_sum = 0;
+	_settle_worst = 0;
+}
+
+void PedalStream::Export() const
+{
+	Serial.printf("\n\rPedal stream (cap %u Hz): %lu sends, %lu stale, %lu lost, %lu resting values acknowledged after mean %lu us, worst %lu us\n\r",
+	              _hz, _sends, _stale, _lost, _settled_n, mean(), worst());
+}
@@ -0,0 +1,58 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* PedalStream.h
+*  Expression pedal streamed to THR: paced by THR's acks, rate capped, slew limited, resting value always sent
+*/
+
+#ifndef _PEDALSTREAM_H_
+#define _PEDALSTREAM_H_
+
+#include <Arduino.h>
+
+#define PEDAL_POLL_MS   10     //pedal inputs are read every 10 ms
+#define PEDAL_STREAM_HZ 50     //default cap of the send rate (a send waits for the ack of the previous one anyway)
+#define PEDAL_SLEW      4096   //pedal units (0..1023) per second the streamed value may move at most
+#define PEDAL_MARGIN    1      //readings closer to the target are noise
+
+//The target follows the pedal readings, the output follows the target one send at a time. A new value is only sent,
+//when THR acknowledged the previous one and the rate cap allows it, so the stream never piles up in the out queue
+//and the rate adapts to THR. As long as the output differs from the target, sending goes on (resting value).
+class PedalStream
+{
+	public:
+	  void Input(uint16_t v);                     //pedal reading (0..1023)
+	  bool Due(bool waiting);                     //a value should be sent now (waiting: a change of the parameter is not acknowledged yet)
+	  uint16_t Next();                            //value to send now (slew limited)
+	  void Acked();                               //THR acknowledged a change of the parameter
+	  void Lost();                                //the last value did not reach THR (it is sent again)
+	  void setRate(uint16_t hz) { _hz = hz > 0 ? hz : 1; };
+	  uint16_t rate() const { return _hz; };
+	  uint16_t target() const { return _target; };
+	  uint16_t output() const { return _out; };
+	  uint32_t sends() const { return _sends; };
+	  uint32_t stale() const { return _stale; };
+	  uint32_t settled() const { return _settled_n; };
+	  uint32_t mean() const { return _settled_n > 0 ? (uint32_t)(_settle_sum / _settled_n) : 0; };  //us from the pedal's last move until its value was acknowledged
+	  uint32_t worst() const { return _settle_worst; };
+	  void Reset();                               //statistics
+	  void Export() const;                        //statistics over serial
+
+	private:
+	  uint16_t _hz = PEDAL_STREAM_HZ;
+	  uint16_t _target = 0;
+	  uint16_t _out = 0;                          //last value sent
+	  bool _inflight = false;                     //_out waits for its ack
+	  bool _resend = false;
+	  bool _settled = true;                       //resting value acknowledged
+	  uint32_t _moved_us = 0;                     //last change of the target
+	  uint32_t _sent_us = 0;
+	  uint32_t _sends = 0;
+	  uint32_t _stale = 0;                        //values, the pedal had already left, when THR acknowledged them
+	  uint32_t _lost = 0;
+	  uint32_t _settled_n = 0;
+	  uint64_t _settle_sum = 0;
+	  uint32_t _settle_worst = 0;
+};
+
+#endif
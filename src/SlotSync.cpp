@@ -0,0 +1,216 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* SlotSync.cpp
+*  Bulk upload of library patches into THR's five user presets (verified by reading back their dumps)
+*/
+
+#include <Arduino.h>
+#include "SlotSync.h"
+
+//Normal TRACE/DEBUG
+#define TRACE_THR30IIPEDAL(x) x
+//#define TRACE_THR30IIPEDAL(x)
+
+//Verbose TRACE/DEBUG
+//#define TRACE_V_THR30IIPEDAL(x)	x
+#define TRACE_V_THR30IIPEDAL(x)
+
+const char * const SLOT_STATUS_NAMES[SLOT_STATES] = { "kept", "waiting", "queued", "written", "ok", "MISMATCH", "FAILED" };
+
+bool SlotSync::Begin(const uint16_t (&nrs)[SYNC_SLOTS])
+{
+	if(_busy)
+	{
+		return false;
+	}
+	*this = SlotSync();
+	for(uint8_t s = 0; s < SYNC_SLOTS; s++)
+	{
+		_slot[s].patch = nrs[s];
+		_slot[s].status = nrs[s] != 0 ? SLOT_WAITING : SLOT_KEEP;
+	}
+	if(selected() == 0)
+	{
+		return false;
+	}
+	_t0 = millis();
+	_busy = true;
+	TRACE_THR30IIPEDAL(Serial.printf("SlotSync: writing %u patches into the user presets\n\r", selected());)
+	return true;
+}
+
+int8_t SlotSync::NextUpload() const
+{
+	for(uint8_t s = 0; s < SYNC_SLOTS; s++)
+	{
+		if(_slot[s].status == SLOT_WAITING)
+		{
+			return (int8_t) s;
+		}
+	}
+	return -1;
+}
+
+int8_t SlotSync::NextReadback() const
+{
+	if(!_busy || NextUpload() >= 0)  //readbacks only behind all uploads (a dump request blocks the out queue until the dump arrived)
+	{
+		return -1;
+	}
+	for(uint8_t s = 0; s < SYNC_SLOTS; s++)
+	{
+		if((_slot[s].status == SLOT_QUEUED || _slot[s].status == SLOT_WRITTEN) && !_slot[s].readback)
+		{
+			return (int8_t) s;
+		}
+	}
+	return -1;
+}
+
+void SlotSync::Rendered(uint8_t slot, uint32_t digest, uint32_t bytes)
+{
+	_slot[slot].digest = digest;
+	_slot[slot].bytes = bytes;
+}
+
+void SlotSync::Queued(uint8_t slot)
+{
+	_slot[slot].status = SLOT_QUEUED;
+}
+
+void SlotSync::ReadbackQueued(uint8_t slot)
+{
+	_slot[slot].readback = true;
+}
+
+void SlotSync::Failed(uint8_t slot)
+{
+	_slot[slot].status = SLOT_FAILED;
+	check();
+}
+
+int8_t SlotSync::uploadSlot(uint16_t id)
+{
+	if(id < SYNC_UPLOAD_ID || id >= SYNC_UPLOAD_ID + SYNC_ID_STRIDE * SYNC_SLOTS || (id - SYNC_UPLOAD_ID) % SYNC_ID_STRIDE >= PATCH_FRAMES_MAX)
+	{
+		return -1;
+	}
+	return (int8_t)((id - SYNC_UPLOAD_ID) / SYNC_ID_STRIDE);
+}
+
+int8_t SlotSync::ReadbackSlot(uint16_t id)
+{
+	return id >= SYNC_READBACK_ID && id < SYNC_READBACK_ID + SYNC_SLOTS ? (int8_t)(id - SYNC_READBACK_ID) : -1;
+}
+
+void SlotSync::Acked(uint16_t id)
+{
+	int8_t s = uploadSlot(id);
+	if(_busy && s >= 0 && _slot[s].status == SLOT_QUEUED)
+	{
+		_slot[s].status = SLOT_WRITTEN;
+		_slot[s].written_ms = millis() - _t0;
+	}
+}
+
+void SlotSync::Timeout(uint16_t id)
+{
+	if(!_busy)
+	{
+		return;
+	}
+	int8_t s = uploadSlot(id);
+	if(s >= 0)  //the readback still tells, whether the upload arrived
+	{
+		TRACE_THR30IIPEDAL(Serial.printf("SlotSync: upload into slot %d not acknowledged\n\r", s + 1);)
+		return;
+	}
+	s = ReadbackSlot(id);
+	if(s >= 0 && (_slot[s].status == SLOT_QUEUED || _slot[s].status == SLOT_WRITTEN))
+	{
+		_slot[s].status = SLOT_FAILED;
+		check();
+	}
+}
+
+void SlotSync::Verified(uint8_t slot, uint32_t digest)
+{
+	if(!_busy || slot >= SYNC_SLOTS || (_slot[slot].status != SLOT_QUEUED && _slot[slot].status != SLOT_WRITTEN))
+	{
+		return;
+	}
+	_slot[slot].status = digest == _slot[slot].digest ? SLOT_OK : SLOT_MISMATCH;
+	_slot[slot].verified_ms = millis() - _t0;
+	TRACE_V_THR30IIPEDAL(Serial.printf("SlotSync: slot %u read back: %08lx (uploaded %08lx)\n\r", slot + 1, digest, _slot[slot].digest);)
+	check();
+}
+
+void SlotSync::check()
+{
+	for(uint8_t s = 0; s < SYNC_SLOTS; s++)
+	{
+		if(_slot[s].status == SLOT_WAITING || _slot[s].status == SLOT_QUEUED || _slot[s].status == SLOT_WRITTEN)
+		{
+			return;
+		}
+	}
+	_busy = false;
+	_total_ms = millis() - _t0;
+	_total_ms += _total_ms == 0 ? 1 : 0;  //0 means "no result"
+	Report();
+}
+
+void SlotSync::Clear()
+{
+	if(!_busy)
+	{
+		*this = SlotSync();
+	}
+}
+
+uint8_t SlotSync::count(SlotStatus st) const
+{
+	uint8_t n = 0;
+	for(uint8_t s = 0; s < SYNC_SLOTS; s++)
+	{
+		n += _slot[s].status == st ? 1 : 0;
+	}
+	return n;
+}
+
+uint8_t SlotSync::selected() const
+{
+	return (uint8_t)(SYNC_SLOTS - count(SLOT_KEEP));
+}
+
+void SlotSync::Report() const
+{
+	uint32_t written = 0;
+	uint32_t bytes = 0;
+	for(uint8_t s = 0; s < SYNC_SLOTS; s++)
+	{
+		written = max(written, _slot[s].written_ms);
+		bytes += _slot[s].bytes;
+	}
+	Serial.printf("\n\rSlotSync: %u slots in %lu ms (%lu bytes, all uploads written after %lu ms): %u ok, %u mismatch, %u failed\n\r",
+	              selected(), total(), bytes, written, count(SLOT_OK), count(SLOT_MISMATCH), count(SLOT_FAILED));
+	for(uint8_t s = 0; s < SYNC_SLOTS; s++)
+	{
+		const Slot &sl = _slot[s];
+		if(sl.status != SLOT_KEEP)
+		{
+			Serial.printf("  slot %u: patch #%u %s, %lu bytes, written %lu ms, verified %lu ms\n\r",
+			              s + 1, sl.patch, SLOT_STATUS_NAMES[sl.status], sl.bytes, sl.written_ms, sl.verified_ms);
+		}
+	}
+}
+
+SysExMessage SlotSync::ReadbackRequest(uint8_t slot)
+{
+	//like request #S8 (settings dump of the actual patch), but with the preset number instead of 0xFFFFFFFF
+	//(so the bit bucket in front of it has no MSBs set)
+	byte req[29] = { 0xf0, 0x00, 0x01, 0x0c, 0x24, 0x02, 0x4d, 0x01, 0x02, 0x00, 0x00, 0x0b, 0x00, 0x0c, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf7 };
+	req[22] = slot;
+	return SysExMessage(req, sizeof(req));
+}
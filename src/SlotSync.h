@@ -0,0 +1,83 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* SlotSync.h
+*  Bulk upload of library patches into THR's five user presets (verified by reading back their dumps)
+*/
+
+#ifndef _SLOTSYNC_H_
+#define _SLOTSYNC_H_
+
+#include <Arduino.h>
+#include "THR30II.h"   //SysExMessage, PATCH_FRAMES_MAX
+
+#define SYNC_SLOTS       5     //user presets "1".."5" of THR (slot 0..4 in the protocol)
+#define SYNC_UPLOAD_ID   300   //out message ids of the slot uploads: SYNC_UPLOAD_ID + SYNC_ID_STRIDE * slot + frame
+#define SYNC_ID_STRIDE   16    //>= PATCH_FRAMES_MAX
+#define SYNC_READBACK_ID 90    //out message ids of the readback requests: SYNC_READBACK_ID + slot
+
+enum SlotStatus : uint8_t
+{
+	SLOT_KEEP,        //not part of the sync (THR's preset stays)
+	SLOT_WAITING,     //upload not queued yet
+	SLOT_QUEUED,      //upload frames in the out queue
+	SLOT_WRITTEN,     //THR acknowledged the last frame of the upload
+	SLOT_OK,          //readback dump has the uploaded settings
+	SLOT_MISMATCH,    //readback dump differs from the upload
+	SLOT_FAILED,      //patch not available, upload or readback timed out
+	SLOT_STATES
+};
+
+extern const char * const SLOT_STATUS_NAMES[SLOT_STATES];
+
+//All uploads are queued back to back (the next slot is rendered, while the previous one is streaming),
+//the readback requests follow behind them, so THR never waits for a dump between two uploads.
+//The uploads are compared with their readback by THR30II_Settings::UploadDigest().
+class SlotSync
+{
+	public:
+	  bool Begin(const uint16_t (&nrs)[SYNC_SLOTS]);   //library patch for each slot (0: keep the slot), false if a sync is running
+	  int8_t NextUpload() const;                       //slot to render and queue next (-1: all uploads are queued)
+	  int8_t NextReadback() const;                     //slot to request the readback of next (-1: none or uploads not queued yet)
+	  void Rendered(uint8_t slot, uint32_t digest, uint32_t bytes);  //upload of slot was rendered
+	  void Queued(uint8_t slot);                       //upload frames of slot are in the out queue
+	  void ReadbackQueued(uint8_t slot);
+	  void Failed(uint8_t slot);                       //patch of slot could not be fetched or rendered
+	  void Acked(uint16_t id);                         //an out message was acknowledged (only the last frame of an upload needs it)
+	  void Timeout(uint16_t id);                       //an out message timed out (fails its slot)
+	  void Verified(uint8_t slot, uint32_t digest);    //readback dump of slot arrived (digest of its settings)
+	  void Clear();                                    //forget the result of the last sync (not while it is running)
+	  bool busy() const { return _busy; };
+	  bool finished() const { return !_busy && _total_ms > 0; };
+	  uint16_t patch(uint8_t slot) const { return _slot[slot].patch; };
+	  SlotStatus status(uint8_t slot) const { return _slot[slot].status; };
+	  uint8_t count(SlotStatus s) const;               //number of slots in status s
+	  uint8_t selected() const;                        //number of slots in the sync
+	  uint32_t total() const { return _busy ? millis() - _t0 : _total_ms; };  //ms from Begin() until the last slot was verified
+	  void Report() const;                             //results over serial
+
+	  static uint16_t UploadId(uint8_t slot, uint8_t frame) { return (uint16_t)(SYNC_UPLOAD_ID + SYNC_ID_STRIDE * slot + frame); };
+	  static int8_t ReadbackSlot(uint16_t id);         //slot of a readback request (-1: other message)
+	  static SysExMessage ReadbackRequest(uint8_t slot);  //request for the settings dump of a user preset
+
+	private:
+	  static int8_t uploadSlot(uint16_t id);
+	  void check();                                    //finishes the sync, when no slot is pending any more
+
+	  struct Slot
+	  {
+		  uint16_t patch = 0;
+		  SlotStatus status = SLOT_KEEP;
+		  bool readback = false;                       //readback request is queued
+		  uint32_t digest = 0;                         //of the uploaded settings
+		  uint32_t bytes = 0;                          //upload size
+		  uint32_t written_ms = 0;                     //from Begin() until THR acknowledged the upload
+		  uint32_t verified_ms = 0;                    //from Begin() until the readback was compared
+	  } _slot[SYNC_SLOTS];
+
+	  bool _busy = false;
+	  uint32_t _t0 = 0;
+	  uint32_t _total_ms = 0;
+};
+
+#endif
@@ -0,0 +1,162 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* SwitchLatency.cpp
+*  Stage markers and histograms of the time a patch switch takes (foot switch until THR acknowledged the upload)
+*/
+
+#include <Arduino.h>
+#include <algorithm>
+#include "SwitchLatency.h"
+#include "MemFrameWriter.h"   //PATCH_FRAMES_MAX, UPLOAD_MSG_ID
+
+//Normal TRACE/DEBUG
+#define TRACE_THR30IIPEDAL(x) x
+//#define TRACE_THR30IIPEDAL(x)
+
+//Verbose TRACE/DEBUG
+//#define TRACE_V_THR30IIPEDAL(x)	x
+#define TRACE_V_THR30IIPEDAL(x)
+
+const char * const LAT_STAGE_NAMES[LAT_STAGES] = { "input", "decode", "build", "first", "last", "ack" };
+
+static uint8_t bucketOf(uint32_t us)
+{
+	uint32_t q = us / LAT_BUCKET_US;
+	uint8_t b = 0;
+	while(q > 0 && b < LAT_BUCKETS - 1)  //bucket b holds times below LAT_BUCKET_US << b
+	{
+		q >>= 1;
+		b++;
+	}
+	return b;
+}
+
+void SwitchLatency::Begin(uint32_t input_us)
+{
+	if(_active)
+	{
+		_superseded++;  //the previous switch was not acknowledged yet
+	}
+	memset(_t, 0, sizeof(_t));
+	_t[LAT_INPUT] = input_us;
+	_active = true;
+}
+
+void SwitchLatency::Mark(LatencyStage s)
+{
+	if(_active && _t[s] == 0)
+	{
+		_t[s] = micros() | 1;  //0 means "not reached"
+	}
+}
+
+bool SwitchLatency::upload(uint16_t id) const
+{
+	return id >= UPLOAD_MSG_ID && id < UPLOAD_MSG_ID + PATCH_FRAMES_MAX;
+}
+
+void SwitchLatency::Sent(uint16_t id, bool last)
+{
+	if(!_active || !upload(id) || _t[LAT_BUILD] == 0)  //frames of an older upload may still be in the queue
+	{
+		return;
+	}
+	Mark(LAT_FIRST_FRAME);
+	if(last)
+	{
+		Mark(LAT_LAST_FRAME);
+	}
+}
+
+void SwitchLatency::Acked(uint16_t id)
+{
+	if(!_active || !upload(id) || _t[LAT_LAST_FRAME] == 0)
+	{
+		return;
+	}
+	Mark(LAT_ACK);
+	_active = false;
+
+	for(uint8_t s = 0; s < LAT_STAGES; s++)
+	{
+		uint32_t dt = _t[s] - _t[LAT_INPUT];
+		if(s == LAT_INPUT)
+		{
+			dt = 0;
+		}
+		uint16_t &h = _hist[s][bucketOf(dt)];
+		if(h < UINT16_MAX)
+		{
+			h++;
+		}
+		_sum[s] += dt;
+		_worst[s] = std::max(_worst[s], dt);
+	}
+	_count++;
+
+	TRACE_THR30IIPEDAL(Serial.printf("SwitchLatency: decode %lu us, build %lu us, first frame %lu us, last frame %lu us, ack %lu us\n\r",
+	                                 _t[LAT_DECODE] - _t[LAT_INPUT], _t[LAT_BUILD] - _t[LAT_INPUT], _t[LAT_FIRST_FRAME] - _t[LAT_INPUT],
+	                                 _t[LAT_LAST_FRAME] - _t[LAT_INPUT], _t[LAT_ACK] - _t[LAT_INPUT]);)
+}
+
+void SwitchLatency::Timeout(uint16_t id)
+{
+	if(_active && upload(id))
+	{
+		_active = false;
+		_timeouts++;
+	}
+}
+
+void SwitchLatency::Reset()
+{
+	*this = SwitchLatency();
+}
+
+uint32_t SwitchLatency::percentile(LatencyStage s, uint8_t pct) const
+{
+	if(_count == 0)
+	{
+		return 0;
+	}
+	uint32_t need = (_count * pct + 99) / 100;  //number of switches at or below the percentile
+	uint32_t n = 0;
+	for(uint8_t b = 0; b < LAT_BUCKETS - 1; b++)
+	{
+		n += _hist[s][b];
+		if(n >= need)
+		{
+			return limit(b);
+		}
+	}
+	return _worst[s];  //in the open last bucket
+}
+
+void SwitchLatency::Export() const
+{
+	Serial.printf("\n\r#switch latency: %lu switches, %lu timeouts, %lu superseded\n\r", _count, _timeouts, _superseded);
+	Serial.print("stage,mean_us,p50_us,p95_us,worst_us");
+	for(uint8_t b = 0; b < LAT_BUCKETS; b++)
+	{
+		if(b < LAT_BUCKETS - 1)
+		{
+			Serial.printf(",<%lu", limit(b));
+		}
+		else
+		{
+			Serial.printf(",>=%lu", limit(b - 1));
+		}
+	}
+	Serial.println();
+	for(uint8_t s = LAT_DECODE; s < LAT_STAGES; s++)
+	{
+		LatencyStage st = (LatencyStage) s;
+		Serial.printf("%s,%lu,%lu,%lu,%lu", LAT_STAGE_NAMES[s], mean(st), percentile(st, 50), percentile(st, 95), worst(st));
+		for(uint8_t b = 0; b < LAT_BUCKETS; b++)
+		{
+			Serial.printf(",%u", _hist[s][b]);
+		}
+		Serial.println();
+	}
+}
@@ -0,0 +1,64 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* SwitchLatency.h
+*  Stage markers and histograms of the time a patch switch takes (foot switch until THR acknowledged the upload)
+*/
+
+#ifndef _SWITCHLATENCY_H_
+#define _SWITCHLATENCY_H_
+
+#include <Arduino.h>
+
+#define LAT_BUCKETS   12    //histogram buckets: < 0.25 ms, < 0.5 ms, ... < 256 ms, >= 256 ms
+#define LAT_BUCKET_US 250   //upper limit of the first bucket (each further bucket doubles it)
+
+enum LatencyStage : uint8_t
+{
+	LAT_INPUT,        //foot switch event in read_buttons()
+	LAT_DECODE,       //patch fetched (cache, SD-card) and decoded
+	LAT_BUILD,        //settings applied, upload frames rendered (or taken from the prefetch) and queued
+	LAT_FIRST_FRAME,  //header frame of the upload sent out
+	LAT_LAST_FRAME,   //last slice sent out
+	LAT_ACK,          //THR acknowledged the last slice
+	LAT_STAGES
+};
+
+extern const char * const LAT_STAGE_NAMES[LAT_STAGES];
+
+//Times are measured from LAT_INPUT, so the histogram of a stage shows the latency until it was reached.
+//Only complete switches (acknowledged) are recorded, timeouts and switches superseded by the next one are counted.
+class SwitchLatency
+{
+	public:
+	  void Begin(uint32_t input_us);              //a patch switch was submitted by the foot switch event at input_us
+	  void Mark(LatencyStage s);                  //stage s reached (ignored, if no switch is measured)
+	  void Sent(uint16_t id, bool last);          //an upload frame (out message id) was sent out
+	  void Acked(uint16_t id);                    //an upload frame was acknowledged (completes the switch)
+	  void Timeout(uint16_t id);                  //an out message timed out (aborts the switch, if it is an upload frame)
+	  void Reset();
+	  bool active() const { return _active; };
+	  uint32_t count() const { return _count; };
+	  uint32_t timeouts() const { return _timeouts; };
+	  uint32_t superseded() const { return _superseded; };
+	  uint16_t bucket(LatencyStage s, uint8_t b) const { return _hist[s][b]; };
+	  uint32_t percentile(LatencyStage s, uint8_t pct) const;  //upper limit (us) of the bucket containing the percentile
+	  uint32_t worst(LatencyStage s) const { return _worst[s]; };
+	  uint32_t mean(LatencyStage s) const { return _count > 0 ? (uint32_t)(_sum[s] / _count) : 0; };
+	  static uint32_t limit(uint8_t b) { return (uint32_t) LAT_BUCKET_US << b; };  //upper limit (us) of bucket b
+	  void Export() const;                        //histograms and summary as CSV over serial
+
+	private:
+	  bool upload(uint16_t id) const;             //id of a frame of a patch upload
+
+	  bool _active = false;
+	  uint32_t _t[LAT_STAGES] {};                 //time stamps of the actual switch (0: stage not reached)
+	  uint16_t _hist[LAT_STAGES][LAT_BUCKETS] {};
+	  uint64_t _sum[LAT_STAGES] {};
+	  uint32_t _worst[LAT_STAGES] {};
+	  uint32_t _count = 0;
+	  uint32_t _timeouts = 0;
+	  uint32_t _superseded = 0;
+};
+
+#endif
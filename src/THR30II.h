@@ -12,6 +12,7 @@
 
 #include <Arduino.h>
 #include "Globals.h"
+#include "MemFrameWriter.h"  //PatchFrames
 
 #undef max     //we need another version of max / min, not this one
 #undef min
@@ -19,6 +20,8 @@
 #include <map>
 #include <vector>
 #include <array>
+#include <type_traits>
+#include <bitset>
 #include <ArduinoJson.h>   //For patches stored in JSON (.thrl6p) format
 #include <ArduinoQueue.h>  //For message queuing in and out
 
@@ -67,11 +70,8 @@ const byte THR30II_IDENTIFY [] { 0xF0, 0x00, 0x01, 0x0C, 0x24, 0x02, 0x7E, 0x7F,
 //Effect units (global) 
 enum THR30II_UNITS { COMPRESSOR, CONTROL, EFFECT, ECHO, REVERB, GATE };
 
-extern std::map<THR30II_UNITS, uint16_t> THR30II_UNIT_ON_OFF_COMMANDS;
-
-//CAB-Simulation is Sub-Unit of GATE 
-extern uint16_t THR30II_CAB_COMMAND;// SpkSimType
-extern uint16_t THR30II_CAB_COMMAND_DUMP;// SpkSimTypeState
+//All dictionaries below are flat arrays indexed by the enums. 
+//The symbol names are constant tables in flash, Init_Dictionaries() resolves them once to the keys in RAM.
 
 //Simulation collections 
 enum THR30II_COL { CLASSIC = 0, BOUTIQUE, MODERN };
@@ -80,9 +80,9 @@ enum THR30II_COL { CLASSIC = 0, BOUTIQUE, MODERN };
 enum THR30II_AMP { CLEAN = 0, CRUNCH, LEAD, HI_GAIN, SPECIAL, BASS, ACO, FLAT };
 
 //The constant amplifier names
-extern std::map<THR30II_AMP, String> THR30II_AMP_NAMES;
+extern const char THR30II_AMP_NAMES[FLAT + 1][8];
 //The constant collection names
-extern std::map<THR30II_COL, String> THR30II_COL_NAMES;
+extern const char THR30II_COL_NAMES[MODERN + 1][9];
 
 //Cabinet Simulation models
 enum THR30II_CAB
@@ -114,25 +114,102 @@ enum THR30II_ECHO_TYPES { TAPE_ECHO, DIGITAL_DELAY };   //NEW for 1.40.0a
 enum THR30II_ECHO_SET_TAPE { TA_BASS, TA_TREBLE, TA_FEEDBACK, TA_TIME, TA_MIX, TA_SYNCSELECT }; //NEW for 1.40.0a
 enum THR30II_ECHO_SET_DIGI { DD_BASS, DD_TREBLE, DD_FEEDBACK, DD_TIME, DD_MIX, DD_SYNCSELECT }; //NEW for 1.40.0a
 
-//Mapping the MIDI-dump keys to the corresponding single command MIDI keys
-extern std::map<uint16_t, uint16_t> unitOnMap;
-extern std::map<uint16_t, uint16_t> controlMap;
-
 //THR30II manual control knobs settings
 enum THR30II_CTRL_SET { CTRL_GAIN, CTRL_MASTER, CTRL_BASS, CTRL_MID, CTRL_TREBLE };
 
-//Main Controls
-extern std::map<THR30II_CTRL_SET, uint16_t> THR30II_CTRL_VALS;
-
 //---------GATE--------------
 enum THR30II_GATE { GA_THRESHOLD, GA_DECAY };
-extern std::map<THR30II_GATE, uint16_t> THR30II_GATE_VALS;
-extern std::map<uint16_t, uint16_t> gateMap;
 
 //--------COMPRESSOR---------------
 enum THR30II_COMP { CO_SUSTAIN, CO_LEVEL, CO_MIX };   //MIX not in THR-Remote (value always = 0x3F000000)
-extern std::map<THR30II_COMP, uint16_t> THR30II_COMP_VALS;
-extern std::map<uint16_t,uint16_t> compressorMap;
+
+//--------PARAMETER REGISTRY---------------
+//Every THR30II parameter is described exactly once in THR30II_PARAMS (flash):
+//unit and subunit type, key in patch dumps, key for single parameter commands, value encoding, limits and label.
+//Init_Dictionaries() resolves the keys into THR30II_PARAM_KEYS and builds the reverse index (key => parameter).
+
+//All parameters. The parameters of a subunit type are a block in the order of it's settings enum (P_CH_FEEDBACK + CH_MIX == P_CH_MIX)
+enum THR30II_PARAM : uint8_t
+{
+	P_CO_SUSTAIN, P_CO_LEVEL, P_CO_MIX,
+	P_CTRL_GAIN, P_CTRL_MASTER, P_CTRL_BASS, P_CTRL_MID, P_CTRL_TREBLE,
+	P_GA_THRESHOLD, P_GA_DECAY,
+	P_CAB,
+	P_ON_COMPRESSOR, P_ON_EFFECT, P_ON_ECHO, P_ON_REVERB, P_ON_GATE,
+	P_PH_SPEED, P_PH_FEEDBACK, P_PH_MIX,
+	P_TR_SPEED, P_TR_DEPTH, P_TR_MIX,
+	P_FL_DEPTH, P_FL_SPEED, P_FL_MIX,
+	P_CH_FEEDBACK, P_CH_DEPTH, P_CH_SPEED, P_CH_PREDELAY, P_CH_MIX, P_CH_SYNCSELECT,
+	P_SP_REVERB, P_SP_TONE, P_SP_MIX,
+	P_PL_DECAY, P_PL_TONE, P_PL_PREDELAY, P_PL_MIX,
+	P_HA_DECAY, P_HA_TONE, P_HA_PREDELAY, P_HA_MIX,
+	P_RO_DECAY, P_RO_TONE, P_RO_PREDELAY, P_RO_MIX,
+	P_TA_BASS, P_TA_TREBLE, P_TA_FEEDBACK, P_TA_TIME, P_TA_MIX, P_TA_SYNCSELECT,
+	P_DD_BASS, P_DD_TREBLE, P_DD_FEEDBACK, P_DD_TIME, P_DD_MIX, P_DD_SYNCSELECT,
+	P_COUNT,
+	P_NONE = 0xFF
+};
+
+//How a parameter's value is coded in the 32-Bit MIDI value
+enum THR30II_ENC : uint8_t
+{
+	ENC_LINEAR,     //float 0.0 ... 1.0     <=> 0...100 (slider)
+	ENC_THRESHOLD,  //float -96dB ... 0dB   <=> 0...100 (slider)
+	ENC_ENUM,       //integer number        <=> number
+	ENC_BOOL        //0 / 1                 <=> off / on
+};
+
+//Type markers for the encodings (in single parameter commands / inside patch dumps)
+constexpr byte THR30II_ENC_CMD_TYPE[ENC_BOOL + 1] { 0x04, 0x04, 0x02, 0x03 };
+constexpr uint32_t THR30II_ENC_DUMP_TYPE[ENC_BOOL + 1] { 0x00030000u, 0x00030000u, 0x00020000u, 0x00010000u };
+
+//Structure to describe a parameter (constant, in flash)
+struct param_def
+{
+	THR30II_UNITS unit;     //unit holding the value (for ENC_BOOL: the unit, that is switched on / off)
+	int8_t type;            //subunit type (effect, echo or reverb type) or -1
+	uint8_t index;          //index of the value inside the unit's (subunit type's) settings enum
+	THR30II_UNITS cmdunit;  //unit, whose key addresses the parameter (MIX, on/off, CAB and the gate belong to GuitarProc)
+	char dk[16];            //symbol name of the key inside patch dumps
+	char ck[14];            //symbol name of the key for single parameter commands ("" => "fix" is the key)
+	uint16_t fix;
+	THR30II_ENC enc;
+	int8_t ll;              //lower limit
+	int8_t ul;              //upper limit
+	char json[10];          //key inside the unit's group of a .thrl6p patch file ("" => not in patch files)
+	char label[11];         //display label
+};
+
+//Structure to hold the resolved keys of a parameter
+struct param_keys
+{
+	uint16_t uk;  //unit key for single parameter commands (and for the unit inside patch dumps)
+	uint16_t dk;  //key inside patch dumps (e.g. "BassState")
+	uint16_t ck;  //key for single parameter commands (e.g. "Bass")
+};
+
+extern const param_def THR30II_PARAMS[P_COUNT];
+extern std::array<param_keys, P_COUNT> THR30II_PARAM_KEYS;
+
+//Groups of the units inside "data"/"tone" of a .thrl6p patch file
+extern const char * const THR30II_JSON_GROUPS[GATE + 1];
+
+//Parameter blocks of the subunit types (first parameter of each type) and their MIX parameters
+constexpr THR30II_PARAM THR30II_EFF_PARAMS[CHORUS + 1] { P_PH_SPEED, P_TR_SPEED, P_FL_DEPTH, P_CH_FEEDBACK };
+constexpr THR30II_PARAM THR30II_EFF_MIX_PARAMS[CHORUS + 1] { P_PH_MIX, P_TR_MIX, P_FL_MIX, P_CH_MIX };
+constexpr THR30II_PARAM THR30II_REV_PARAMS[ROOM + 1] { P_SP_REVERB, P_PL_DECAY, P_HA_DECAY, P_RO_DECAY };
+constexpr THR30II_PARAM THR30II_REV_MIX_PARAMS[ROOM + 1] { P_SP_MIX, P_PL_MIX, P_HA_MIX, P_RO_MIX };
+constexpr THR30II_PARAM THR30II_ECHO_PARAMS[DIGITAL_DELAY + 1] { P_TA_BASS, P_DD_BASS };
+constexpr THR30II_PARAM THR30II_ECHO_MIX_PARAMS[DIGITAL_DELAY + 1] { P_TA_MIX, P_DD_MIX };
+//on/off parameter of each unit (CONTROL can not be switched off)
+constexpr THR30II_PARAM THR30II_UNIT_ON_PARAMS[GATE + 1] { P_ON_COMPRESSOR, P_NONE, P_ON_EFFECT, P_ON_ECHO, P_ON_REVERB, P_ON_GATE };
+
+//Reverse index lookup (never inserts): first parameter with dump key / command key "key", 
+//"next" gives the following parameters with the same key (or P_NONE)
+extern THR30II_PARAM ParamByKey(uint16_t key, bool dump);
+extern THR30II_PARAM NextParamByKey(THR30II_PARAM p, bool dump);
+extern uint8_t ParamRawToDisplay(THR30II_ENC enc, uint32_t raw);    //raw 32Bit protocol value -> display value 0..100 (lookup table, no float math)
+extern uint32_t ParamDisplayToRaw(THR30II_ENC enc, uint8_t val);    //display value 0..100 -> raw 32Bit protocol value (lookup table)
 
 //structures 
 struct un_cmd
@@ -175,17 +252,7 @@ inline bool operator < (const col_amp & one, const col_amp & two) {return ((one.
 struct key_name
 {
 	uint16_t key;
-	String name;
-};
-
-//Structure to describe a parameter setting (composed of the unit key and the subunit key, the parameter's name and the value's limits)
-struct unit_info
-{
- uint16_t uk;
- uint16_t sk;
- String na;
- double ll;
- double ul;
+	const char *name;  //points to the constant name table in flash
 };
 
 //Structure to describe a value as a 16-Bit type key and a 32-Bit value
@@ -207,69 +274,44 @@ struct string_or_ulong
 };
 
 //Dictionary to store unit key and unit name for each (effect-)unit
-extern std::map<THR30II_UNITS, key_name> THR30II_UNITS_VALS;
-
-//Mapping the MIDI-dump keys to the corresponding single command MIDI keys
-extern std::map<uint16_t, uint16_t> effectMap;
+extern std::array<key_name, GATE + 1> THR30II_UNITS_VALS;
 
 //Dictionary to store subunit key and subunit name for each subunit of the unit "effect"
-extern std::map<THR30II_EFF_TYPES, key_name> THR30II_EFF_TYPES_VALS;
-
-//Dictionary to store info for the settings parameter of subunit "phaser" of the unit "effect"
-extern std::map<THR30II_EFF_SET_PHAS, unit_info> THR30II_INFO_PHAS;
-//Dictionary to store info for the settings parameter of subunit "tremolo" of the unit "effect"
-extern std::map<THR30II_EFF_SET_TREM, unit_info> THR30II_INFO_TREM;
-//Dictionary to store info for the settings parameter of subunit "flanger" of the unit "effect"
-extern std::map<THR30II_EFF_SET_FLAN, unit_info> THR30II_INFO_FLAN;
-//Dictionary to store info for the settings parameter of subunit "chorus" of the unit "effect"
-extern std::map<THR30II_EFF_SET_CHOR, unit_info> THR30II_INFO_CHOR;
-
-//Dictionary to store all the dictionaries with info for the settings parameters of the unit "effect"
-extern std::map<THR30II_EFF_TYPES, std::map<String, unit_info>> THR30II_INFO_EFFECT;
-
-//Mapping the MIDI-dump keys to the corresponding single command MIDI keys
-extern std::map<uint16_t, uint16_t> reverbMap;
-
+extern std::array<key_name, CHORUS + 1> THR30II_EFF_TYPES_VALS;
 //Dictionary to store subunit key and subunit name for each subunit of the unit "reverb"
-extern std::map<THR30II_REV_TYPES, key_name> THR30II_REV_TYPES_VALS;
-//Dictionary to store info for the settings parameter of subunit "spring" of the unit "reverb"
-extern std::map<THR30II_REV_SET_SPRI, unit_info> THR30II_INFO_SPRI;
-//Dictionary to store info for the settings parameter of subunit "plate" of the unit "reverb"
-extern std::map<THR30II_REV_SET_PLAT, unit_info> THR30II_INFO_PLAT;
-//Dictionary to store info for the settings parameter of subunit "hall" of the unit "reverb"
-extern std::map<THR30II_REV_SET_HALL, unit_info> THR30II_INFO_HALL;
-//Dictionary to store info for the settings parameter of subunit "room" of the unit "reverb"
-extern std::map<THR30II_REV_SET_ROOM, unit_info> THR30II_INFO_ROOM;
-
-//Dictionary to store all the dictionaries with info for the settings parameters of the unit "reverb"
-extern std::map<THR30II_REV_TYPES, std::map<String, unit_info>> THR30II_INFO_REVERB;
-
-//Mapping the MIDI-dump keys to the corresponding single command MIDI keys for unit ECHO
-extern std::map<uint16_t, uint16_t> echoMap;
-
+extern std::array<key_name, ROOM + 1> THR30II_REV_TYPES_VALS;
 //Dictionary to store subunit key and subunit name for each subunit of the unit "echo"
-extern std::map<THR30II_ECHO_TYPES, key_name> THR30II_ECHO_TYPES_VALS;
-//Dictionary to store info for the settings parameter of subunit "tape delay" of the unit "echo"
-extern std::map<THR30II_ECHO_SET_TAPE, unit_info> THR30II_INFO_TAPE;
-//Dictionary to store info for the settings parameter of subunit "digital delay" of the unit "echo"
-extern std::map<THR30II_ECHO_SET_DIGI, unit_info> THR30II_INFO_DIGI;
-//Dictionary to store all the dictionaries with info for the settings parameters of the unit "echo"
-extern std::map<THR30II_ECHO_TYPES, std::map<String, unit_info>> THR30II_INFO_ECHO;
-
-//Mapping the MIDI-dump keys to the corresponding single command MIDI keys
-extern uint16_t CompressorMap(uint16_t u);
-extern uint16_t UnitOnMap(uint16_t u);
-extern uint16_t EchoMap(uint16_t u);
-extern uint16_t EffectMap(uint16_t u);
-extern uint16_t ReverbMap(uint16_t u);
+extern std::array<key_name, DIGITAL_DELAY + 1> THR30II_ECHO_TYPES_VALS;
+
+//Reverse lookups (key => enum index) in the flat dictionaries
+//return the index of the entry with key "k" or N, if there is none
+template <size_t N>
+size_t KeyIndex(const std::array<uint16_t, N> &vals, uint16_t k)
+{
+	size_t i = 0;
+	while(i < N && vals[i] != k) i++;
+	return i;
+}
+
+template <size_t N>
+size_t KeyIndex(const std::array<key_name, N> &vals, uint16_t k)
+{
+	size_t i = 0;
+	while(i < N && vals[i].key != k) i++;
+	return i;
+}
 
 //The constant cabinet names
-extern std::map<THR30II_CAB, String> THR30II_CAB_NAMES;
+extern const char THR30II_CAB_NAMES[Bypass + 1][16];
 
-extern std::map<col_amp, uint16_t> THR30IIAmpKeys;
+//The amplifier keys by simulation collection and amp simulation model
+extern std::array<std::array<uint16_t, FLAT + 1>, MODERN + 1> THR30IIAmpKeys;
 
 extern col_amp THR30IIAmpKey_ToColAmp(uint16_t ampkey);
 
+extern bool AmpAsset_ToColAmp(const char *asset, col_amp &ca);  //e.g. "THR10C_DC30" => CLASSIC / CRUNCH
+extern const char *ColAmp_ToAmpAsset(THR30II_COL c, THR30II_AMP a);  //e.g. CLASSIC / CRUNCH => "THR10C_DC30"
+
 extern byte * dump;   //dynamic Array because of big size
 
 extern size_t dump_len; //size of the dynamic dump array
@@ -277,16 +319,148 @@ extern size_t dump_len; //size of the dynamic dump array
 class Outmessage;    //forward declaration
 class SysExMessage;  //forward declaration
 
+#define PATCH_NAME_LEN 64  //limitation by Windows THR30 Remote
+
+//All values of the actual THR30II settings (tone, unit states, patch names)
+//Only fixed size arrays and plain fields, so snapshot and restore are a single memcpy (no heap, no deep copy)
+//Parameter values are kept as the raw 32-Bit words of the protocol (IEEE float bits), so dumps and patches
+//are reproduced bit-exact. Conversion to display values 0..100 happens only for rendering (see DecodeParam()).
+struct THR30II_State
+{
+	std::array<uint32_t,CTRL_TREBLE-CTRL_GAIN+1> control {{0x3F000000,0x3F000000,0x3F000000,0x3F000000,0x3F000000}}; //actual state of main control knobs (0.5)
+	std::array<uint32_t,CTRL_TREBLE-CTRL_GAIN+1> control_store {{0x3F000000,0x3F000000,0x3F000000,0x3F000000,0x3F000000}}; //state of main control knobs for simple Volume-Solo
+
+	std::array<bool,GATE-COMPRESSOR+1> unit {};  //actual on/off state of the effect units
+
+	THR30II_REV_TYPES reverbtype = SPRING;
+	THR30II_EFF_TYPES effecttype = PHASER;
+	THR30II_ECHO_TYPES echotype = TAPE_ECHO;
+	THR30II_AMP amp; //Field for the simulated AMP model
+	THR30II_COL col; //Field for the simulation collection (BOUTIQUE, CLASSIC, MODERN)
+	THR30II_CAB cab; //Field for the simulated cabinet
+
+	int8_t activeUserSetting = -1; //Field for the selected user preset's index (0..4 , -1 for none / actual)
+	bool userSettingsHaveChanged = false; //Field for state of selected user preset
+
+	std::array<uint32_t,CO_MIX-CO_SUSTAIN +1> compressor_setting {};   //Field for the Compressor settings
+	std::array<uint32_t, GA_DECAY-GA_THRESHOLD+1 > gate_setting {{ 0xC2C00000, 0 }};   //Field for the Gate settings (threshold -96dB)
+
+	//Fields for the settings of the subunit types (indexed by type and the type's settings enum)
+	std::array<std::array<uint32_t, TA_SYNCSELECT + 1>, DIGITAL_DELAY + 1> echo_setting
+	{{
+		{ 0x3F000000, 0x3F000000, 0x3F000000, 0x3F000000, 0x3F000000, 0x3F000000 },   //TAPE_ECHO (0.5)
+		{ 0x3F000000, 0x3F000000, 0x3F000000, 0x3F000000, 0x3F000000, 0x3F000000 }    //DIGITAL_DELAY (0.5)
+	}};
+
+	std::array<std::array<uint32_t, PL_MIX + 1>, ROOM + 1> reverb_setting
+	{{
+		{ 0x3DCCCCCD, 0x3E800000, 0x3F451EB8 },               //SPRING (0.1, 0.25, 0.77)
+		{ 0x3DCCCCCD, 0x3E800000, 0x3F451EB8, 0x3F6147AE },   //PLATE  (0.1, 0.25, 0.77, 0.88)
+		{ 0x3DCCCCCD, 0x3E800000, 0x3F451EB8, 0x3F6147AE },   //HALL
+		{ 0x3DCCCCCD, 0x3E800000, 0x3F451EB8, 0x3F6147AE }    //ROOM
+	}};
+
+	std::array<std::array<uint32_t, CH_SYNCSELECT + 1>, CHORUS + 1> effect_setting {};  //PHASER, TREMOLO, FLANGER, CHORUS
+
+	char patchNames[6][PATCH_NAME_LEN + 1] { "Actual", "UserSetting1", "UserSetting2", "UserSetting3", "UserSetting4", "UserSetting5" };
+
+	uint32_t Tnid = 0;  //global from Patch dump
+	uint32_t UnknownGlobal = 0; //global from Patch dump
+	uint32_t ParTempo = 0; //global from Patch dump (minimum value of 110 is coded with 0x00000000)
+};
+
+static_assert(std::is_trivially_copyable<THR30II_State>::value, "THR30II_State must stay memcpy-able");
+
+//A library patch decoded into the settings model (raw protocol values of the registry parameters found in the patch file)
+//Fixed size without heap, so decoded patches can be cached. -1 / missing "has" bit: keep the actual setting.
+struct THR30II_Patch
+{
+	uint16_t nr = 0;           //library patch number (0 = none)
+	int8_t col = -1;           //THR30II_COL
+	int8_t amp = -1;           //THR30II_AMP
+	int8_t effecttype = -1;    //THR30II_EFF_TYPES
+	int8_t echotype = -1;      //THR30II_ECHO_TYPES
+	int8_t reverbtype = -1;    //THR30II_REV_TYPES
+	uint32_t Tnid = 0;
+	uint32_t ParTempo = 0;
+	std::array<uint32_t, P_COUNT> raw {};
+	std::bitset<P_COUNT> has;  //parameter is contained in the patch
+	char name[PATCH_NAME_LEN + 1] {};
+};
+
+//Cost of sending changed settings on the wire (see SendParameterValue() and renderPatch())
+#define SYNC_PARAM_BYTES 61   //header frame (29 bytes) and body frame (32 bytes) of a single parameter change
+#define SYNC_ACK_BYTES 256    //waiting for an acknowledge (round-trip) expressed in bytes on the wire
+enum SyncPlan : uint8_t { SYNC_NONE, SYNC_PARAMS, SYNC_UPLOAD };
+
+#define HISTORY_SIZE 128  //number of parameter changes in the undo/redo ring (RAM stays constant, oldest changes are dropped)
+
+//One recorded parameter change (raw protocol values as in THR30II_State)
+struct param_delta
+{
+	uint32_t before;
+	uint32_t after;
+	uint16_t group;       //all changes of one button action (or one knob move) share a group and are undone together
+	THR30II_PARAM param;
+};
+
+//Bounded undo/redo history of parameter changes in a fixed ring
+//Counters run freely, the ring index is counter % HISTORY_SIZE
+//_tail: oldest change, _head: end of the undoable changes, _top: end of the redoable changes
+class THR30II_History
+{
+  public:
+	void BeginGroup() { _newGroup = true; };  //the next recorded change starts a new undo step
+	void Record(THR30II_PARAM p, uint32_t before, uint32_t after);
+	void Clear() { _tail = _head = _top = 0; _newGroup = true; };
+	bool CanUndo() const { return _head != _tail; };
+	bool CanRedo() const { return _top != _head; };
+	THR30II_PARAM LastParam() const { return CanUndo() ? at(_head - 1).param : P_NONE; };
+	bool paused = false;  //set while changes are applied in bulk (patch loading) or replayed (undo/redo)
+
+  private:
+	friend class THR30II_Settings;  //Undo() / Redo() replay the changes through the settings' setters
+	param_delta &at(uint32_t c) { return _ring[c % HISTORY_SIZE]; };
+	const param_delta &at(uint32_t c) const { return _ring[c % HISTORY_SIZE]; };
+
+	std::array<param_delta, HISTORY_SIZE> _ring;
+	uint32_t _tail = 0;
+	uint32_t _head = 0;
+	uint32_t _top = 0;
+	uint16_t _group = 0;
+	bool _newGroup = true;
+};
+
 //The main class for handling all settings and transfers of THR30II
-class THR30II_Settings
+//The settings themselves are the THR30II_State base, everything else is connection / transfer state
+class THR30II_Settings : public THR30II_State
 {
   public:
+	THR30II_State Snapshot() const { return *this; };  //copy of the settings (one memcpy)
+	void Restore(const THR30II_State &s) { static_cast<THR30II_State &>(*this) = s; history.Clear(); };  //settings back from a snapshot (one memcpy)
+
+	THR30II_History history;  //undo/redo of parameter changes (not part of the snapshots)
+	bool Undo();  //revert the last group of changes (sent to THR)
+	bool Redo();  //apply the last undone group of changes again (sent to THR)
+
 	uint32_t ConnectedModel;  //FamilyID (2 Byte) + ModelNr.(2 Byte) , 0x00240002=THR30II
 	static std::map<String, std::vector<byte> > tokens;
 	
 	int patch_setAll(uint8_t * buf, uint16_t buf_len );
-	int SetLoadedPatch(const DynamicJsonDocument &djd );
+	bool DecodePatch(const DynamicJsonDocument &djd, THR30II_Patch &pat) const;  //thrl6p-JSON -> decoded patch (settings stay unchanged)
+	bool EncodePatch(DynamicJsonDocument &djd, const char *name) const;  //actual settings -> thrl6p-JSON (for saving a patch)
+	int ApplyPatch(const THR30II_Patch &pat, PatchFrames *pf = nullptr);  //invoke all settings from a decoded patch and upload them to THR (using/filling prepared frames)
+	bool PrerenderPatch(const THR30II_Patch &pat, PatchFrames &pf);  //upload frames of a patch in advance (settings stay unchanged)
+	bool RenderSlotPatch(const THR30II_Patch &pat, uint8_t slot, PatchFrames &pf, uint32_t &digest);  //upload of a patch into user preset slot 0..4 (settings stay unchanged)
+	uint32_t UploadDigest(const char *name) const;  //checksum of everything an upload of the actual settings carries
+	uint32_t DumpDigest(uint8_t *buf, uint16_t buf_len);  //UploadDigest() of a patch dump (settings stay unchanged)
+	static bool IsComplete(const THR30II_Patch &pat);  //patch contains all settings of an upload
 	void createPatch();
+	void SyncToTHR();  //send the settings, that differ from THR's, as single parameters or as a full upload (the cheaper way)
+	void InvalidateMirror() { mirrorValid = false; };  //THR's settings are unknown (connection lost)
+	void renderPatch(PatchFrames &pf, uint32_t target = 0xFFFFFFFFu) const;  //build the upload frames of the actual settings (target: see MemFrameWriter::finish())
+	void sendPatchFrames(const PatchFrames &pf);  //stream prepared upload frames to THR
+	uint32_t PatchContext() const;                //stamp of everything in an upload, that is not part of a library patch
 	void CreateNamePatch(); //fill send buffer with just setting for actual patchname, creating a valid SysEx for sending to THR30II
 	void SetControl(uint8_t ctrl, double value);
 	double GetControl(uint8_t ctrl);
@@ -322,121 +496,31 @@ class THR30II_Settings
 	template <typename T>
 	void  SendParameterSetting( un_cmd command, type_val <T> valu)  //Send setting to THR
 	{
-		// Serial.println("SendParameterSetting()");
-		//Serial.println(command);
-		//Serial.println(valu);
-		if (!MIDI_Activated)
-			return;
-		
-		extern ArduinoQueue<Outmessage> outqueue;
-
-		std::array<byte,16> raw_msg_body = {}; //4 Ints:  Unit + Setting + Type + Val
-		std::array<byte,8>  raw_msg_head = {};  //2 Ints:  Opcode + Len(Body)
-
-		raw_msg_head[0] = 0x0A;  //0x0A = Opcode for "parameter change"
-		raw_msg_head[4] = (byte) 16; //Length of body  
-
-		raw_msg_body[0] = (byte)(command.unit % 256);
-		raw_msg_body[1] = (byte)(command.unit / 256);
-		raw_msg_body[4] = (byte)(command.command % 256);
-		raw_msg_body[5] = (byte)(command.command / 256);
-		raw_msg_body[8] = valu.type;
-
-		uint32_t c_val = 0x00lu;
-		
-		if(valu.type != (byte)0x04)  //0x04 = double
-		{	
-		      c_val = (uint32_t) valu.val;
-		}
-		else
-		{
-			//in these cases the T-Parameter is of type double => overwrite it with 
-			if (command.command == THR30II_UNITS_VALS[GATE].key && command.unit==THR30II_GATE_VALS[GA_THRESHOLD])
-			{
-				c_val = ValToNumber_Threshold((double) valu.val);
-			}
-			else if(valu.type == 0x04 ) //marker for double
-			{
-				c_val = ValToNumber((double) valu.val);
-			}
-		}
-		raw_msg_body[12] = (byte)(c_val & 0xFF);
-		raw_msg_body[13] = (byte)((c_val & 0xFF00) >> 8);
-		raw_msg_body[14] = (byte)((c_val & 0xFF0000) >> 16);
-		raw_msg_body[15] = (byte)((c_val & 0xFF000000) >> 24);
-
-		//Prepare Message-Body
-		std::array<byte,100> msg_body = { };
-		byte *mblast = msg_body.begin();
-
-		mblast=Enbucket(msg_body, raw_msg_body, raw_msg_body.end() );
-		
-		//PC_SYSEX_BEGIN.size() =7u
-		//msg_body.size() = 100u
-		std::array<byte,(size_t)(7u + 2u + 3u + 100u + 1u)>  sendbuf_body = {};  //for "00" and frame-counter; 3 for Lenght-Field, 1 for "F7"
-        byte* sbblast=sendbuf_body.begin();
-
-		sbblast=std::copy(PC_SYSEX_BEGIN.begin(), PC_SYSEX_BEGIN.end(), sbblast);
-		
-		sbblast++;
-		*sbblast++ = 0x00; //place holder for SysExSendCounter
-		*sbblast++ = 0x00;  //only one frame in this message
-		*sbblast++ = (byte)((raw_msg_body.size() - 1) / 16);  //Length Field (Hi)
-		*sbblast++ = (byte)((raw_msg_body.size() - 1) % 16); //Length Field (Low)
-
-		sbblast = std::copy(msg_body.begin(),mblast, sbblast);
-		*sbblast++ = SYSEX_STOP;
-		
-		//Prepare Message-Header
-		std::array<byte,16> msg_head = {};  //The 8 Bytes of raw_msg_head result in 2 groups of  (7 bytes+ 1 bitbucket byte)
-		byte * mhlast=msg_head.begin();
-		mhlast = Enbucket(msg_head, raw_msg_head, raw_msg_head.end());
-
-		//PC_SYSEX_BEGIN.size() =7u
-		//msg_body.size() = 100u
-		//msg_head.size() = 16u
-		std::array<byte, 7 + 2 + 3 + 16 + 1> sendbuf_head = {};  //29 Bytes
-		byte *sbhlast = sendbuf_head.begin();
-
-		sbhlast=std::copy(PC_SYSEX_BEGIN.begin(), PC_SYSEX_BEGIN.end(),sbhlast);
-
-		sbhlast++;
-		*sbhlast++ = 0x00;
-		*sbhlast++ = 0x00;  //only one frame in this message
-		*sbhlast++ = (byte)((raw_msg_head.size() - 1) / 16);  //Length Field (Hi)
-		*sbhlast++ = (byte)((raw_msg_head.size() - 1) % 16);  //Length Field (Low)
-		sbhlast=std::copy(msg_head.begin(), mhlast, sbhlast );
-		*sbhlast++ = SYSEX_STOP;
-		
-		sendbuf_head[PC_SYSEX_BEGIN.size() + 1] = UseSysExSendCounter();
-		
-		hexdump(sendbuf_head,sendbuf_head.size());
-		outqueue.enqueue(Outmessage(SysExMessage ( sendbuf_head.data(), sendbuf_head.size()),1000,false,false)); //no ack/answ for the header  
-		
-		sendbuf_body[PC_SYSEX_BEGIN.size() + 1] = UseSysExSendCounter();
-		hexdump(sendbuf_body,sbblast-sendbuf_body.begin());
-		outqueue.enqueue(Outmessage(SysExMessage( sendbuf_body.data(), sbblast-sendbuf_body.begin()),1001,true,false)); //needs ack  
-
-		//ToDO:  handle ACK for id=1001
-		//e.g. only accept parameter as changed, if ack. has arrived - otherwise show broken connection/timeout
-		//and roll back parameter change in the internal mirror settings
+		//0x04 = double (0..100 slider value) - all others are sent as they are
+		SendParameterValue(command, valu.type, valu.type != (byte)0x04 ? (uint32_t) valu.val : ValToNumber((double) valu.val));
 	}	//of SendParameterSetting
 
-	std::array<double,CTRL_TREBLE-CTRL_GAIN+1> control {{50,50,50,50,50}}; //actual state of main control knobs
-	std::array<double,CTRL_TREBLE-CTRL_GAIN+1> control_store {{50,50,50,50,50}}; //state of main control knobs for simple Volume-Solo
-	
+	bool SendParameterValue(un_cmd command, byte type, uint32_t c_val, uint16_t id = 1001);  //Send already encoded 32-Bit value to THR (false: not queued)
+
 	static double NumberToVal(uint32_t num, bool cut = true); //convert the 32Bit parameter value to 0..100 Slider value
 	static double NumberToVal_Threshold(uint32_t num, bool cut = true); //convert the 32Bit parameter value to a 0..100 Slider value
 	static uint32_t ValToNumber_Threshold(double val); //convert a 0..100 Slider value to a 32Bit parameter value (for internal -96dB to 0dB range)
 	static uint32_t ValToNumber(double val); //convert a 0..100 Slider value to a 32Bit parameter value
 
-	void EchoSetting(THR30II_ECHO_TYPES type, uint16_t ctrl, double value);  //Setter for the Echo Parameters
-	void EchoSetting(uint16_t ctrl, double value); //using the internally selected actual Echo type
-	void EffectSetting(THR30II_EFF_TYPES type, uint16_t ctrl, double value);  //Setter for Effect parameters
-	void EffectSetting(uint16_t ctrl, double value); //using the internally selected actual effect type
+	void SetParam(THR30II_PARAM p, double value);  //Setter for any parameter of the registry by display value (encodes, stores and sends it to THR)
+	double GetParam(THR30II_PARAM p) const;  //Getter for any parameter of the registry (display value 0..100, enum number or 0/1)
+	void SetRaw(THR30II_PARAM p, uint32_t raw);  //Setter by the raw 32Bit protocol value (stored unchanged, sent to THR)
+	uint32_t GetRaw(THR30II_PARAM p) const { return GetRaw(*this, p); };  //Getter for the raw 32Bit protocol value
+	static uint32_t GetRaw(const THR30II_State &s, THR30II_PARAM p);  //raw value inside any settings (e.g. the mirror of THR)
+	static void StoreRaw(THR30II_State &s, THR30II_PARAM p, uint32_t raw);  //store a raw value (no sending, no history)
+	void SendParam(THR30II_PARAM p);  //Send the stored value of a parameter to THR
+	bool ParamTimeout(uint16_t id);   //THR did not acknowledge a parameter change: roll it back (true: unit state changed)
+	THR30II_PARAM FindParam(uint16_t uk, uint16_t key, bool dump) const;  //parameter for unit key + dump/command key (actual subunit types) or P_NONE
+	static uint32_t EncodeParam(THR30II_PARAM p, double value);  //convert a display value to the parameter's 32Bit MIDI value
+	static double DecodeParam(THR30II_PARAM p, uint32_t num);    //convert a parameter's 32Bit MIDI value to the display value (lookup table)
+	int8_t SubunitType(THR30II_UNITS u) const;  //actual selected type of unit EFFECT, ECHO or REVERB (-1 for the others)
+
 	void GateSetting(THR30II_GATE ctrl, double value); //Setter for gate effect parameters
-	void ReverbSetting(THR30II_REV_TYPES type, uint16_t ctrl, double value); //Setter for Reverb parameters
-	void ReverbSetting(uint16_t ctrl, double value);  //using internally selected actual reverb type
 	void CompressorSetting(THR30II_COMP ctrl, double value);  //Setter for compressor effect parameters
 	void Switch_On_Off_Gate_Unit(bool state);   //Setter for switching on / off the effect unit
 	void Switch_On_Off_Echo_Unit(bool state);   //Setter for switching on / off the Echo unit
@@ -444,6 +528,7 @@ class THR30II_Settings
 	void Switch_On_Off_Compressor_Unit(bool state);  //setter for switching on /off the compressor unit
 	void Switch_On_Off_Reverb_Unit(bool state);   //Setter for switching on / off the reverb unit
     void Init_Dictionaries();
+	void SendStartupRequests();  //#S6 + #S7 of the boot dialog (as soon as the symbol table is available)
 
 	byte UseSysExSendCounter(); //returns the actual counter value and increments it afterwards
 	
@@ -458,24 +543,12 @@ class THR30II_Settings
 	bool sendChangestoTHR = true;  //set to false, if changes come from THR-Knobs
 	//State vars
 
-	//Try making this one public to solve error - seems to help
-	std::array<bool,GATE-COMPRESSOR+1> unit;  //actual on/off state of the effect units
-
-	//try making these public to solve error
-	THR30II_REV_TYPES reverbtype = SPRING;
-	THR30II_EFF_TYPES effecttype = PHASER;
-	THR30II_ECHO_TYPES echotype = TAPE_ECHO;
-	THR30II_AMP amp; //Field for the simulated AMP model
-    THR30II_COL col; //Field for the simulation collection (BOUTIQUE, CLASSIC, MODERN)
-    THR30II_CAB cab; //Field for the simulated cabinet
-
   private:
 	bool MIDI_Activated = false;   //set true, if MIDI unlocked by magic key (success checked by receiving first regular THR-SysEx)
 	
 	bool dumpInProgress = false;
 	bool patchdump = false;
 	bool symboldump = false;
-	std::array< String, 6 > patchNames { { "Actual", "UserSetting1", "UserSetting2", "UserSetting3", "UserSetting4", "UserSetting5" } }; //better than an array, because it can be deep copied
 
 	uint16_t dumpFrameNumber = 0; 
 	uint32_t dumpByteCount = 0;  //received bytes
@@ -486,46 +559,18 @@ class THR30II_Settings
      //00 24 00 02 : THR30IIWireless
      //00 24 00 03 : THR30IIAcousticWireless
 
-	//Try making this one public to solve error - seems to help
-	//std::array<bool,GATE-COMPRESSOR+1> unit;  //actual on/off state of the effect units
-	
-	// THR30II_AMP amp; //Field for the simulated AMP model
-    // THR30II_COL col; //Field for the simulation collection (BOUTIQUE, CLASSIC, MODERN)
-    // THR30II_CAB cab; //Field for the simulated cabinet
-    int8_t activeUserSetting; //Field for the selected user preset's index (0..4 , -1 for none / actual)
-    bool userSettingsHaveChanged; //Field for state of selected user preset
-
-    std::array<double,CO_MIX-CO_SUSTAIN +1> compressor_setting;   //Field for the Compressor settings
-	//double echo_setting[EC_MIX-EC_BASS+1];    //Field for the Echo settings
-    std::array<double, GA_DECAY-GA_THRESHOLD+1 > gate_setting;   //Field for the Gate settings
-	
-	std::map<THR30II_ECHO_TYPES, std::map<int, double>> echo_setting =     //Fields
-	{
-	 {
-		{ TAPE_ECHO ,     {  {(int)TA_BASS ,50.0}, {(int)TA_TREBLE, 50.0}, {(int)TA_FEEDBACK, 50.0}, {(int)TA_TIME, 50.0}, {(int)TA_MIX, 50.0}, {(int)TA_SYNCSELECT, 50.0} } } ,
-		{ DIGITAL_DELAY , {  {(int)TA_BASS ,50.0}, {(int)DD_TREBLE, 50.0}, {(int)DD_FEEDBACK, 50.0}, {(int)DD_TIME, 50.0}, {(int)DD_MIX, 50.0}, {(int)DD_SYNCSELECT, 50.0} } } 
-	 }	
-	}; 
+	static const uint32_t *ParamStore(const THR30II_State &s, THR30II_PARAM p);  //where the raw value of a (slider) parameter is stored (nullptr for ENC_ENUM, ENC_BOOL)
+	const uint32_t *ParamStore(THR30II_PARAM p) const { return ParamStore(*this, p); };
+	uint32_t *ParamStore(THR30II_PARAM p) { return const_cast<uint32_t *>(ParamStore(*this, p)); };
+	uint8_t ParamBars(double bars[5], std::initializer_list<THR30II_PARAM> params) const;  //fill bar chart values (0..100) for the UI
+	void SetDumpValues(uint16_t uk, const std::map<uint16_t, key_longval> &values);  //set the values of one (sub)unit from a patch dump
+	void setPatchFields(const THR30II_Patch &pat);  //local fields from a decoded patch (without sending)
+	bool InUpload(THR30II_PARAM p) const;  //parameter is part of an upload (selected types only)
+	SyncPlan PlanSync(std::bitset<P_COUNT> &diff) const;  //differing parameters and the cheaper way to send them
 
-	std::map<THR30II_REV_TYPES, std::map<int, double>> reverb_setting =     //Fields
-	{
-	 {
-		{ SPRING , {  {(int)SP_REVERB ,10.0}, {(int)SP_TONE, 25.0}, {(int)SP_MIX, 77.0} } } ,
-		{ PLATE  , {  {(int)PL_DECAY,  10.0}, {(int)PL_TONE, 25.0}, {(int)PL_PREDELAY, 77.0}, {(int)PL_MIX, 88.0} } },
-		{ HALL   , {  {(int)HA_DECAY , 10.0}, {(int)HA_TONE, 25.0}, {(int)HA_PREDELAY, 77.0}, {(int)HA_MIX, 88.0} } },
-		{ ROOM   , {  {(int)RO_DECAY,  10.0}, {(int)RO_TONE, 25.0}, {(int)RO_PREDELAY, 77.0}, {(int)RO_MIX, 88.0} } } 
-	 }	
-	}; 
-
-	std::map<THR30II_EFF_TYPES, std::map<int, double>> effect_setting=   //Fields
-	{            
-		{
-			{PHASER, { {PH_SPEED, 0.0},    {PH_FEEDBACK, 0.0}, {PH_MIX, 0.0}  } },
-			{TREMOLO,{ {TR_SPEED, 0.0},    {TR_DEPTH, 0.0},    {TR_MIX, 0.0}  } },
-			{FLANGER,{ {FL_DEPTH, 0.0},    {FL_SPEED, 0.0},    {FL_MIX, 0.0}  } },
-			{CHORUS, { {CH_FEEDBACK, 0.0}, {CH_DEPTH, 0.0},    {CH_SPEED, 0.0 }, {CH_PREDELAY, 0.0}, {CH_MIX, 0.0} } }
-		}
-	};
+	THR30II_State mirror;               //settings THR has (last upload, single parameters sent and changes reported by THR)
+	bool mirrorValid = false;           //a settings dump was received or an upload was sent
+	uint32_t uploadBytes = PATCH_FRAMES_BYTES;  //size of the last upload (cost estimate for the planner)
 
 	//try making these public to solve error
 	// THR30II_REV_TYPES reverbtype = SPRING;
@@ -535,10 +580,6 @@ class THR30II_Settings
     //Yamaha THRII models names
     String THR30II_MODEL_NAME();
 
-	uint32_t Tnid;  //global from Patch dump
-	uint32_t UnknownGlobal; //global from Patch dump
-	uint32_t ParTempo; //global from Patch dump (minimum value of 110 is coded with 0x00000000)
-
 	byte SysExSendCounter;
 
 
@@ -593,4 +634,6 @@ class Outmessage
 
 }; 
 
+uint32_t queueMemoryWrite(const PatchFrames &pf, uint16_t first_id);  //frames of a memory write into the out queue (returns their bytes)
+
 #endif /* THR30II_H_ */
\ No newline at end of file
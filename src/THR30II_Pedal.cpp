@@ -38,6 +38,12 @@ using namespace ace_button;
 #include "THR30II_Pedal.h"
 #include "Globals.h"		  	//For the global keys	
 #include "THR30II.h"   			//Constants for THRII devices	  
+#include "PatchLibrary.h"		//Binary patch library on SD-card
+#include "PatchNavigator.h"		//Banks, name index, favourites and recently used patches
+#include "SwitchLatency.h"		//Timing of patch switches (diagnostics screen)
+#include "SlotSync.h"			//Library patches into THR's user presets
+#include "ParamAcks.h"			//Parameter changes tracked until acknowledged
+#include "PedalStream.h"		//Volume pedal paced by THR's acks
 
 // Locally supplied fonts
 //#include "Free_Fonts.h"
@@ -73,9 +79,12 @@ TFT_eSprite spr = TFT_eSprite(&tft); // Sprite class needs to be invoked
 #include <SD.h>
 const int sd_chipsel=BUILTIN_SDCARD;
 File32 file;
+#define SYMCACHE_MAGIC   0x53524854ul  //"THRS" in the symbol table cache file header
+#define SYMCACHE_VERSION 1
 
 // #define PATCH_FILE "patches.txt" //If you want to use a SD card, a file with this name contains the patches
 #define PATCH_FILE "jsonSDtest.txt" 
+#define PATCHLIB_FILE "patches.thrlib"  //binary library, compiled from PATCH_FILE whenever that file was changed
 #else
 //#include <avr/pgmspace.h>
 #include "patches.h"  //Patches located in PROGMEM  (for Teensy 3.6/4.0/4.1 there is enough space there for hundreds of patches)
@@ -126,7 +135,8 @@ uint16_t pedal_1_val = 0;
 uint16_t pedal_2_val = 0;
 uint16_t pedal_1_old_val = 0;
 uint16_t pedal_2_old_val = 0;
-uint16_t pedal_margin = 1;
+uint16_t pedal_margin = PEDAL_MARGIN;
+static PedalStream pedal_stream;  //volume pedal (pedal 2) sent to THR
 bool pedal_1_sense = 0;
 bool pedal_2_sense = 0;
 enum ampSelectModes {COL, AMP, CAB};
@@ -185,23 +195,36 @@ String patchname;  //limitation by Windows THR30 Remote is 64 Bytes.
 String preSelName; //Global variable: Name of the pre selected patch
 
 class THR30II_Settings THR_Values;			//actual settings of the connected THR30II
-class THR30II_Settings stored_THR_Values;   //stored settings, when applying a patch (to be able to restore them later on)
-class THR30II_Settings stored_Patch_Values; //stored settings of a (modified) patch, when applying a solo (to be able to restore them later on)
+THR30II_State stored_THR_Values;   //stored settings, when applying a patch (to be able to restore them later on)
+THR30II_State stored_Patch_Values; //stored settings of a (modified) patch, when applying a solo (to be able to restore them later on)
 
 static volatile int16_t presel_patch_id;   	//ID of actually pre-selected patch (absolute number)
 static volatile int16_t active_patch_id;   	//ID of actually selected patch     (absolute number)
 static volatile bool send_patch_now = false;//pre-select patch to send (false) or send immediately (true)
 
-static std::vector <String> libraryPatchNames;  //all the names of the patches stored on SD-card or in PROGMEN
-
 //class Outmessage OM_dummy(SysExMessage(nullptr,0),0,false,false);  //make a empty Outmessage as a dummy for use in some cases
 
 static volatile uint16_t npatches = 0;   //counts the patches stored on SD-card or in PROGMEN
 
+static PatchCache patch_cache;               //the last decoded library patches
+static uint32_t patch_fetch_worst_us = 0;    //worst case time for reading and decoding a patch (compare with upload time)
+static int16_t fetched_presel_id = -1;       //preselected patch, whose neighbourhood is prefetched
+static uint32_t patch_submits = 0;           //patch activations
+static uint32_t patch_submits_ready = 0;     //activations, that found their frames prepared (prefetch hits)
+static uint32_t patch_switch_worst_us = 0;   //worst case time from activation until all frames are queued
+static PatchNavigator navigator;             //patch lists for selection (their indices are on SD-card)
+static uint16_t save_target = 0;             //position the actual settings are saved to (UI_save, npatches + 1: new patch)
+static uint32_t last_button_ms = 0;          //compaction of the patch library waits for a pause of the foot switches
+static uint32_t button_us = 0;               //time stamp of the last foot switch event (start of a patch switch)
+static SwitchLatency switch_latency;         //stage times of patch switches (UI_diag)
+static SlotSync slot_sync;                   //library patches written into THR's user presets (UI_diag)
+static PatchFrames slot_frames;              //upload of the next slot (rendered, while the previous one is streaming)
+
 #if USE_SDCARD
-	std::vector<std::string> patchesII;   //patches are read in dynamically, not as a static PROGMEM array
+	PatchLibrary library;                 //patches are read on demand from the binary library on SD-card
 #else
 	                                      //patchesII is declared in "patches.h" in this case
+	static std::vector <String> libraryPatchNames;  //all the names of the patches stored in PROGMEN
 #endif
 
 uint32_t msgcount = 0;
@@ -241,117 +264,45 @@ void setup()  //do preparations
 	{
 		Serial.println(F("Card initialized."));
 		
-			TRACE_THR30IIPEDAL( Serial.print(F("VolumeBegin->success. FAT-Type: "));)
-
-			if(file.open(PATCH_FILE))  //Open the patch file "patches.txt" in ReadOnly mode
-			{
-				while(file.isBusy());
-				uint64_t inBrack=0;  //actual bracket level
-				uint64_t blockBeg=0, blockEnd=0;  //start and end point of actual patch inside the file
-				bool error=false;
-				
-				Serial.println(F("\n\rFound \"patches.txt\"."));
-				file.rewind();
+			uint32_t tl = micros();
+			int heapBefore = freeMemory();
 
-				char c=file.peek();
-				
-				while(!error && file.available32()>0)
-				{ 
-					// TRACE_THR30IIPEDAL(Serial.printf("%c",c);)
-				
-					switch(c)
-					{
-						case '{':
-							if(inBrack==0)  //top level {} block opens here
-							{
-								blockBeg = file.curPosition();
-								TRACE_THR30IIPEDAL(Serial.printf("Found { at %d\n\r",blockBeg);)
-							}
-							inBrack++;
-							// TRACE_THR30IIPEDAL(Serial.printf("+%d\n\r",inBrack);)
-						break;
-
-						case '}':
-							if(inBrack==1)  //actually open top level {} block closes here
-							{	
-								blockEnd = file.curPosition();
-								
-								TRACE_THR30IIPEDAL(Serial.printf("Found } at %d\n\r",blockEnd);)
-								
-								error=!(file.seekSet(blockBeg-1));
-								
-								if(!error)
-								{
-									String pat = file.readString(blockEnd-blockBeg+1);
-
-									if(file.getReadError()==0)
-									{
-										patchesII.emplace_back(std::string(pat.c_str()));
-										//TRACE_V_THR30IIPEDAL(Serial.println(patchesII.back().c_str()) ;)
-										npatches++;
-										TRACE_V_THR30IIPEDAL(Serial.printf("Loaded npatches: %d",npatches) ;)
-									}
-									else
-									{
-										TRACE_THR30IIPEDAL(Serial.println("Read Error");)
-										error=true;
-									}
-								}
-								else
-								{
-									TRACE_THR30IIPEDAL( Serial.println("SeekSet(blockBeg-1) failed!" );)
-								}
+			PatchJournal::recover(PATCH_FILE, PATCHLIB_FILE);  //finish a compaction, that was interrupted by power loss
 
-								error=!(file.seekSet(blockEnd));
-								
-								if(error)
-								{
-									TRACE_THR30IIPEDAL( Serial.println("SeekSet(blockEnd) failed!" );)	
-								}
-								else
-								{
-									TRACE_THR30IIPEDAL( Serial.println("SeekSet(blockEnd) succeeded." );)	
-								}
-							}
-							else if(inBrack==0)  //block must not close, if not open!
-							{
-								TRACE_THR30IIPEDAL(Serial.printf("Unexpected } at %d\n\r",file.curPosition());)
-								error=true; 	
-								break;
-							}
-							inBrack--;
-							// TRACE_THR30IIPEDAL(Serial.printf("-%d\n\r",inBrack);)
-						break;
-					}			
+			uint32_t srcLength = 0, srcStamp = 0;  //to detect, if the text file was changed on PC
+			if(file.open(PATCH_FILE, O_RDONLY))
+			{
+				uint16_t date = 0, time = 0;
+				file.getModifyDateTime(&date, &time);
+				srcLength = file.fileSize();
+				srcStamp = ((uint32_t) date << 16) | time;
+				file.close();
+			}
 
-					if(!error)
-					{
-						if(file.available32()>0)
-						{
-							c=(char) file.read();
-							while(file.isBusy());
-						}
-					}
-					else
-					{
-						TRACE_THR30IIPEDAL( Serial.println("Error proceeding in file!" );)	
-					}
-					//TRACE_THR30IIPEDAL(Serial.println(inBrack);)
+			bool libOk = library.open(PATCHLIB_FILE);
 
-				}
+			if(srcLength > 0 && !(libOk && library.matchesSource(srcLength, srcStamp)))  //no library yet or outdated
+			{
+				Serial.println(F("Compiling patch library from \"" PATCH_FILE "\"..."));
+				libOk = PatchLibrary::compile(PATCH_FILE, PATCHLIB_FILE) && library.open(PATCHLIB_FILE);
+			}
 
-				TRACE_THR30IIPEDAL(Serial.println("Read through \"patches.txt\".\n\r");)
-				
-				file.close();
+			if(libOk)
+			{
+				npatches = library.size();
+				TRACE_THR30IIPEDAL(Serial.printf("Patch library \"%s\" opened in %lu us (%d bytes RAM used).\n\r",
+				                                  PATCHLIB_FILE, micros() - tl, heapBefore - freeMemory());)
+				navigator.begin(&library, npatches);
 			}
 			else
 			{
-				Serial.println(F("File \"patches.txt\" was not found on SD-card."));
+				Serial.println(F("No patch library and no file \"" PATCH_FILE "\" on SD-card."));
 			}
 	}
 	#else
 		npatches = patchesII.size();  //from file patches.h 
 		TRACE_V_THR30IIPEDAL(Serial.printf("From PROGMEM: npatches: %d",npatches) ;)
+		navigator.begin(nullptr, npatches);  //only the list of all patches
 	#endif	
 
     // Button setup
@@ -389,7 +340,7 @@ void setup()  //do preparations
 	// Initialise patch status
 	if(npatches>0) // patch(es) exist(s)
 	{
-		presel_patch_id = 1;   //preselect the first available patch (if available at all)
+		presel_patch_id = navigator.Step(1, 0);   //preselect the first available patch (of the list chosen last time)
 	}
 	else // no patches
 	{
@@ -398,15 +349,17 @@ void setup()  //do preparations
 	active_patch_id =-1;   //always start up with local settings
 
 	TRACE_THR30IIPEDAL( Serial.printf(F("\n\rThere are %d JSON patches in patches.h / patches.txt.\n\r"), npatches);)
+
+	#if !USE_SDCARD
 	TRACE_THR30IIPEDAL( Serial.println(F("Fetching Library Patch Names:")); )
 
-	DynamicJsonDocument djd (4096);   //Buffer size for JSON decoding of thrl6p-files is at least 1967 (ArduinoJson Assistant) 2048 recommended
+	DynamicJsonDocument djd (PATCH_SUMMARY_SIZE);   //only the filtered summary fields are stored
 	
 	for(int i = 0; i<npatches; i++)   //get the patch names by de-serializing
 	{
 			using namespace std;
 			djd.clear();
-			DeserializationError dse= deserializeJson(djd, patchesII[i]);
+			DeserializationError dse= deserializeJson(djd, patchesII[i], DeserializationOption::Filter(PatchFilter(false)));
 			if(dse==DeserializationError::Ok)
 			{
 				libraryPatchNames.push_back( (const char*) (djd["data"]["meta"]["name"]) ) ;
@@ -420,6 +373,7 @@ void setup()  //do preparations
 				Serial.println(patchesII[i].c_str());
 			}
 	 }
+	#endif
 
 	delay(250);  //could be reduced in release version
 
@@ -442,6 +396,7 @@ void read_buttons(AceButton* button, uint8_t eventType, uint8_t buttonState)
   	switch (eventType) {
     	case AceButton::kEventClicked:
       		button_state = button_map[button->getPin() - 14];
+			button_us = micros();
 	  		TRACE_V_THR30IIPEDAL(Serial.println();)
 			TRACE_V_THR30IIPEDAL(Serial.println("==============================");)
 			TRACE_V_THR30IIPEDAL(Serial.print(F("Button "));)
@@ -450,6 +405,7 @@ void read_buttons(AceButton* button, uint8_t eventType, uint8_t buttonState)
       	break;
     	case AceButton::kEventLongPressed:
 			button_state = button_map[button->getPin() - 14];
+			button_us = micros();
 			TRACE_V_THR30IIPEDAL(Serial.println();)
 			TRACE_V_THR30IIPEDAL(Serial.println("==============================");)
 			TRACE_V_THR30IIPEDAL(Serial.print(F("Button "));)
@@ -617,6 +573,7 @@ void loop()  //infinite working loop:  check midi connection status, poll button
 	 	midi_connected = false;  //this will lead to Re-Send-Out of activation SysEx's
 		_uistate=UI_idle; //re-initialize UI state machine
 		THR_Values.ConnectedModel=0x00000000;
+		THR_Values.InvalidateMirror();  //settings of the next THR are unknown until its dump
 
 		drawConnIcon(midi_connected);
 
@@ -628,6 +585,10 @@ void loop()  //infinite working loop:  check midi connection status, poll button
 
 	WorkingTimer_Tick(); //timing for MIDI-message send/receive is shortest loop
 
+	verify_symbol_cache(); //lazy checksum check of a symbol table loaded from SD (does nothing, if not needed)
+
+	compact_library(); //rewrites the patch library in idle time after many saves (does nothing, if not needed)
+
     // Poll buttons - should be called every 4-5ms or faster, for the default debouncing time of ~20ms.
     button1.check();
     button2.check();
@@ -640,11 +601,12 @@ void loop()  //infinite working loop:  check midi connection status, poll button
     button9.check();
     button10.check();
 	
-	if (tickpedals >= 50)
+	if (tickpedals >= PEDAL_POLL_MS)
 	{
 		pollpedalinputs();
 		tickpedals = 0;
 	}
+	stream_pedal();  //as fast as THR acknowledges, capped by the rate of pedal_stream
 	
 
 
@@ -657,6 +619,8 @@ void loop()  //infinite working loop:  check midi connection status, poll button
 
 	if(button_state!=0) //A foot switch was pressed
 	{
+		last_button_ms = millis();
+		THR_Values.history.BeginGroup();  //all changes caused by this button action are undone in one step
 		TRACE_V_THR30IIPEDAL(Serial.println();)
 		TRACE_V_THR30IIPEDAL(Serial.println("button_state: " + String(button_state));)
 		TRACE_V_THR30IIPEDAL(Serial.println("Old UI_state: " + String(_uistate));)
@@ -680,7 +644,7 @@ void loop()  //infinite working loop:  check midi connection status, poll button
 								if(npatches>0) //if at least one patch-settings file is available
 								{ //store actual settings and activate presel patch
 									TRACE_V_THR30IIPEDAL(Serial.println(F("Storing local settings..."));)
-									stored_THR_Values = THR_Values;  //THR30II_Settings class is deep copyable
+									stored_THR_Values = THR_Values.Snapshot();  //plain settings struct, one memcpy
 									patch_activate(presel_patch_id);
 								}
 							break;
@@ -758,7 +722,7 @@ void loop()  //infinite working loop:  check midi connection status, poll button
 								Serial.println("Cabinet switched to: "+String(THR_Values.cab));
 							break;
 						}
-						THR_Values.createPatch();
+						THR_Values.SyncToTHR();
 						maskUpdate=true;  //request display update to show new states quickly
 						button_state=0;  //remove flag, because it is handled
 					break;
@@ -769,39 +733,23 @@ void loop()  //infinite working loop:  check midi connection status, poll button
 						button_state=0;  //remove flag, because it is handled
 					break;
 
-					case 4: // Decrement patch
-						presel_patch_id--;	//decrement pre-selected patch-ID
-						if (presel_patch_id < 1)	//detect wraparound
-						{
-							presel_patch_id = npatches;	//wrap back round to last patch in library
-						}
-						Serial.printf("Patch #%d pre-selected\n\r", presel_patch_id);
-						//if immediate mode selected & new patch selected, send immediately
-						if ((send_patch_now) && (presel_patch_id != active_patch_id))	
-						{
-							patch_activate(presel_patch_id);
-						}
+					case 4: // Decrement patch (previous one of the active patch list, wraps around)
+						patch_preselect(navigator.Step(presel_patch_id, -1));
 						maskUpdate=true;  //request display update to show new states quickly
 						button_state=0;  //remove flag, because it is handled
 					break;
 						
-					case 5: // Increment patch
-						presel_patch_id++;	//increment pre-selected patch-ID
-						if (presel_patch_id > npatches)	//detect wraparound
-						{
-							presel_patch_id = 1;	//wrap back round to first patch in library
-						}
-						Serial.printf("Patch #%d pre-selected\n\r", presel_patch_id);
-						//if immediate mode selected & new patch selected, send immediately
-						if ((send_patch_now) && (presel_patch_id != active_patch_id))
-						{
-							patch_activate(presel_patch_id);
-						}
+					case 5: // Increment patch (next one of the active patch list, wraps around)
+						patch_preselect(navigator.Step(presel_patch_id, 1));
 						maskUpdate=true;  //request display update to show new states quickly
 						button_state=0;  //remove flag, because it is handled
 					break;
 
-					case 6:
+					case 6: // Undo last change
+						if(!THR_Values.Undo())
+						{
+							Serial.println("Nothing to undo");
+						}
 						maskUpdate=true;  //request display update to show new states quickly
 						button_state=0;  //remove flag, because it is handled
 					break;
@@ -898,7 +846,14 @@ void loop()  //infinite working loop:  check midi connection status, poll button
 						button_state=0;  //remove flag, because it is handled
 					break;
 
-					case 11:
+					case 11: // Patch save mode (target is the pre-selected patch)
+						#if USE_SDCARD
+						if(library.writable() && Constants::glo.size() > 0)  //asset names of the patch need the symbol table
+						{
+							save_target = presel_patch_id > 0 ? presel_patch_id : npatches + 1;
+							_uistate = UI_save;
+						}
+						#endif
 						maskUpdate=true;  //request display update to show new states quickly
 						button_state=0;  //remove flag, because it is handled
 					break;
@@ -915,7 +870,11 @@ void loop()  //infinite working loop:  check midi connection status, poll button
 						button_state=0;  //remove flag, because it is handled
 					break;
 
-					case 13:
+					case 13: // Redo last undone change
+						if(!THR_Values.Redo())
+						{
+							Serial.println("Nothing to redo");
+						}
 						maskUpdate=true;  //request display update to show new states quickly
 						button_state=0;  //remove flag, because it is handled
 					break;
@@ -926,18 +885,8 @@ void loop()  //infinite working loop:  check midi connection status, poll button
 						button_state=0;  //remove flag, because it is handled
 					break;
 
-					case 15: // Increment patch to first entry in next bank of 5
-						presel_patch_id = ((presel_patch_id-1)/5 + 1) * 5 + 1;	//increment pre-selected patch-ID to first of next bank
-						if (presel_patch_id > npatches)	//detect if last patch selected
-						{
-							presel_patch_id = 1;	//wrap back round to first patch in library
-						}
-						Serial.printf("Patch #%d pre-selected\n\r", presel_patch_id);
-						//if immediate mode selected & new patch selected, send immediately
-						if ((send_patch_now) && (presel_patch_id != active_patch_id))
-						{
-							patch_activate(presel_patch_id);
-						}
+					case 15: // Increment patch to first entry in next bank (bank size see UI_edit)
+						patch_preselect(navigator.Bank(presel_patch_id, 1));
 						maskUpdate=true;  //request display update to show new states quickly
 						button_state=0;  //remove flag, because it is handled
 					break;
@@ -983,7 +932,7 @@ void loop()  //infinite working loop:  check midi connection status, poll button
 								Serial.println("Effect unit switched from Tremolo to Chorus");
 							break;
 						}
-						THR_Values.createPatch();
+						THR_Values.SyncToTHR();
 						maskUpdate=true;  //request display update to show new states quickly
 						button_state=0;  //remove flag, because it is handled
 					break;
@@ -1001,7 +950,7 @@ void loop()  //infinite working loop:  check midi connection status, poll button
 								Serial.println("Effect unit switched from Digital Delay to Tape Echo");
 							break;
 						}
-						THR_Values.createPatch();
+						THR_Values.SyncToTHR();
 						maskUpdate=true;  //request display update to show new states quickly
 						button_state=0;  //remove flag, because it is handled
 					break;
@@ -1029,7 +978,7 @@ void loop()  //infinite working loop:  check midi connection status, poll button
 								Serial.println("Reverb unit switched from Hall to Spring");
 							break;
 						}
-						THR_Values.createPatch();
+						THR_Values.SyncToTHR();
 						maskUpdate=true;  //request display update to show new states quickly
 						button_state=0;  //remove flag, because it is handled
 					break;
@@ -1052,7 +1001,11 @@ void loop()  //infinite working loop:  check midi connection status, poll button
 						button_state=0;  //remove flag, because it is handled
 					break;
 
-					case 2:
+					case 2: // Toggle favourite (pre-selected patch)
+						if(presel_patch_id > 0)
+						{
+							navigator.ToggleFavourite(presel_patch_id);
+						}
 						maskUpdate=true;  //request display update to show new states quickly
 						button_state=0;  //remove flag, because it is handled
 					break;
@@ -1062,17 +1015,20 @@ void loop()  //infinite working loop:  check midi connection status, poll button
 						button_state=0;  //remove flag, because it is handled
 					break;
 
-					case 4:
+					case 4: // Previous bank of the active patch list
+						patch_preselect(navigator.Bank(presel_patch_id, -1));
 						maskUpdate=true;  //request display update to show new states quickly
 						button_state=0;  //remove flag, because it is handled
 					break;
 						
-					case 5:
+					case 5: // Next bank of the active patch list
+						patch_preselect(navigator.Bank(presel_patch_id, 1));
 						maskUpdate=true;  //request display update to show new states quickly
 						button_state=0;  //remove flag, because it is handled
 					break;
 
-					case 6:
+					case 6: // Diagnostics screen (patch switch latency)
+						_uistate = UI_diag;
 						maskUpdate=true;  //request display update to show new states quickly
 						button_state=0;  //remove flag, because it is handled
 					break;
@@ -1174,22 +1130,27 @@ void loop()  //infinite working loop:  check midi connection status, poll button
 						button_state=0;  //remove flag, because it is handled
 					break;
 
-					case 12:
+					case 12: // Rotate bank size (5 -> 10 -> 20 -> )
+						navigator.NextBankSize();
 						maskUpdate=true;  //request display update to show new states quickly
 						button_state=0;  //remove flag, because it is handled
 					break;
 
-					case 13:
+					case 13: // Rotate patch list (all -> by name -> favourites -> recently used -> )
+						navigator.NextList();
+						patch_preselect(navigator.Step(presel_patch_id, 0));  //stays, if it is in the new list
 						maskUpdate=true;  //request display update to show new states quickly
 						button_state=0;  //remove flag, because it is handled
 					break;
 
-					case 14:
+					case 14: // Jump back (previous first letter in name list, else previous bank of banks)
+						patch_preselect(navigator.Jump(presel_patch_id, -1));
 						maskUpdate=true;  //request display update to show new states quickly
 						button_state=0;  //remove flag, because it is handled
 					break;
 
-					case 15:
+					case 15: // Jump forward (next first letter in name list, else next bank of banks)
+						patch_preselect(navigator.Jump(presel_patch_id, 1));
 						maskUpdate=true;  //request display update to show new states quickly
 						button_state=0;  //remove flag, because it is handled
 					break;
@@ -1234,7 +1195,7 @@ void loop()  //infinite working loop:  check midi connection status, poll button
 								Serial.println("Effect unit switched from Tremolo to Chorus");
 							break;
 						}
-						THR_Values.createPatch();
+						THR_Values.SyncToTHR();
 						maskUpdate=true;  //request display update to show new states quickly
 						button_state=0;  //remove flag, because it is handled
 					break;
@@ -1252,7 +1213,7 @@ void loop()  //infinite working loop:  check midi connection status, poll button
 								Serial.println("Effect unit switched from Digital Delay to Tape Echo");
 							break;
 						}
-						THR_Values.createPatch();
+						THR_Values.SyncToTHR();
 						maskUpdate=true;  //request display update to show new states quickly
 						button_state=0;  //remove flag, because it is handled
 					break;
@@ -1280,7 +1241,7 @@ void loop()  //infinite working loop:  check midi connection status, poll button
 								Serial.println("Reverb unit switched from Hall to Spring");
 							break;
 						}
-						THR_Values.createPatch();
+						THR_Values.SyncToTHR();
 						maskUpdate=true;  //request display update to show new states quickly
 						button_state=0;  //remove flag, because it is handled
 					break;
@@ -1292,13 +1253,121 @@ void loop()  //infinite working loop:  check midi connection status, poll button
 			break;
 
 			case UI_save:
+				switch (button_state)
+				{
+					case 1: // Save actual settings to the target (it becomes the active patch)
+						if(patch_save(save_target))
+						{
+							presel_patch_id = save_target;
+							if(active_patch_id > 0)
+							{
+								active_patch_id = save_target;
+							}
+						}
+						_uistate = active_patch_id > 0 ? UI_home_patch : UI_home_amp;
+						maskUpdate=true;  //request display update to show new states quickly
+						button_state=0;  //remove flag, because it is handled
+					break;
+
+					case 4: // Previous target
+						if(save_target > 1)
+						{
+							save_target--;
+						}
+						maskUpdate=true;  //request display update to show new states quickly
+						button_state=0;  //remove flag, because it is handled
+					break;
+
+					case 5: // Next target (behind the last patch: save as a new patch)
+						if(save_target <= npatches)
+						{
+							save_target++;
+						}
+						maskUpdate=true;  //request display update to show new states quickly
+						button_state=0;  //remove flag, because it is handled
+					break;
+
+					case 14: // Move the target patch one position up
+					case 15: // Move the target patch one position down
+						#if USE_SDCARD
+						{
+							uint16_t other = button_state == 14 ? save_target - 1 : save_target + 1;
+							if(save_target <= npatches && other >= 1 && other <= npatches && library.Move(save_target, other))
+							{
+								//selection follows the patches
+								if(presel_patch_id == save_target) { presel_patch_id = other; } else if(presel_patch_id == other) { presel_patch_id = save_target; }
+								if(active_patch_id == save_target) { active_patch_id = other; } else if(active_patch_id == other) { active_patch_id = save_target; }
+								navigator.Swapped(save_target, other);
+								save_target = other;
+								library_changed();
+							}
+						}
+						#endif
+						maskUpdate=true;  //request display update to show new states quickly
+						button_state=0;  //remove flag, because it is handled
+					break;
+
+					case 11: // Leave save mode without saving
+						_uistate = active_patch_id > 0 ? UI_home_patch : UI_home_amp;
+						maskUpdate=true;  //request display update to show new states quickly
+						button_state=0;  //remove flag, because it is handled
+					break;
 
+					default:
+						button_state=0;  //other foot switches are not used in save mode
+					break;
+				}
 			break;
 
 			case UI_name:
 
 			break;
 
+			case UI_diag:
+				switch (button_state)
+				{
+					case 1: // Back to edit mode
+						_uistate = UI_edit;
+					break;
+
+					case 2: // Export the histograms (and the ack latency of parameter changes) over serial
+						switch_latency.Export();
+						param_acks.Export();
+						pedal_stream.Export();
+					break;
+
+					case 3: // Reset the histograms (and the result of the last user preset sync)
+						switch_latency.Reset();
+						slot_sync.Clear();
+						param_acks.Reset();
+						pedal_stream.Reset();
+					break;
+
+					case 4: // Write the preselected patch and the next ones of the active list into THR's user presets 1..5
+						if(presel_patch_id > 0 && Constants::glo.size() > 0)  //symbol table needed for rendering
+						{
+							uint16_t nrs[SYNC_SLOTS] {};
+							uint16_t nr = presel_patch_id;
+							for(uint8_t s = 0; s < SYNC_SLOTS && nr > 0; s++)
+							{
+								nrs[s] = nr;
+								nr = navigator.Step(nr, 1);
+								if(nr == nrs[0])  //list shorter than the presets (the rest is kept)
+								{
+									nr = 0;
+								}
+							}
+							slot_sync.Begin(nrs);
+						}
+					break;
+
+					default:  //other foot switches are not used on the diagnostics screen
+					break;
+				}
+				maskUpdate=true;  //request display update to show new states quickly
+				button_state=0;  //remove flag, because it is handled
+			break;
+
 			default:
 
 			break;
@@ -1309,10 +1378,181 @@ void loop()  //infinite working loop:  check midi connection status, poll button
 
 	} //button_state!=0
 
+	prefetch_patches(); //decode and render the preselected patch and its neighbours in idle time
+	sync_user_slots();  //queue the next upload of a running user preset sync
+
 }//end of loop()
 
 
 
+/////////////////////////////////////////////////////////////////////////////////////////////////
+    // SYMBOL TABLE CACHE //
+/////////////////////////////////////////////////////////////////////////////////////////////////
+
+//The symbol table dump is the biggest transfer in the boot dialog, but it is the same for every THRII with the same firmware.
+//So it is stored on SD after the first dump and loaded from there on the next boot with a matching firmware.
+
+static uint32_t boot_time0 = 0;          //millis() when send_init() started the boot dialog
+static bool boot_time_reported = true;   //boot time is traced only once per connection
+static bool symtab_from_cache = false;   //symbol table of this session was loaded from SD
+static bool symtab_unverified = false;   //checksum of the table loaded from SD still has to be checked
+static uint32_t symtab_checksum = 0;     //checksum stored in the cache file
+static uint32_t symtab_firmware = 0;     //firmware version the loaded table belongs to
+
+#if USE_SDCARD
+struct SymCacheHeader   //header of a symbol table cache file on SD (raw dump follows)
+{
+	uint32_t magic;     //SYMCACHE_MAGIC
+	uint16_t version;   //SYMCACHE_VERSION (increment, if the layout changes)
+	uint16_t reserved;
+	uint32_t firmware;  //firmware version the table was received from
+	uint32_t length;    //length of the raw dump following the header
+	uint32_t checksum;  //SymbolTable::checksum() of the raw dump
+};
+
+static void symbol_cache_name(char *name, uint32_t firmware)  //one cache file per firmware version
+{
+	sprintf(name, "symtab_%08lx.bin", (unsigned long) firmware);
+}
+#endif
+
+bool load_symbol_cache(uint32_t firmware)  //returns true, if Constants::glo was filled from SD
+{
+	#if USE_SDCARD
+	char name[24];
+	symbol_cache_name(name, firmware);
+	
+	uint32_t t0 = micros();
+	File32 f;
+	
+	if(!f.open(name, O_RDONLY))
+	{
+		TRACE_THR30IIPEDAL(Serial.printf("No symbol table cache \"%s\" on SD.\n\r", name);)
+		return false;
+	}
+
+	SymCacheHeader h;
+	byte *buf = nullptr;
+	bool ok = (f.read(&h, sizeof(h)) == (int) sizeof(h)) && (h.magic == SYMCACHE_MAGIC) && (h.version == SYMCACHE_VERSION)
+	          && (h.firmware == firmware) && (h.length > 8) && (h.length <= 0xFFFF);
+
+	if(ok)
+	{
+		buf = new byte[h.length];
+		ok = (buf != nullptr) && (f.read(buf, h.length) == (int) h.length);
+	}
+	f.close();
+
+	if(!ok)
+	{
+		delete[] buf;
+		TRACE_THR30IIPEDAL(Serial.printf("Symbol table cache \"%s\" is invalid.\n\r", name);)
+		return false;
+	}
+
+	if(!Constants::set_all(buf, h.length))  //takes ownership of buf (also on failure)
+	{
+		return false;
+	}
+
+	//checksum is not computed here, to keep the boot dialog going (see verify_symbol_cache())
+	symtab_from_cache = true;
+	symtab_unverified = true;
+	symtab_checksum = h.checksum;
+	symtab_firmware = firmware;
+
+	TRACE_THR30IIPEDAL(Serial.printf("Symbol table for firmware %08lx loaded from SD in %lu us.\n\r", (unsigned long) firmware, micros() - t0);)
+	return true;
+	#else
+	(void) firmware;
+	return false;
+	#endif
+}
+
+bool store_symbol_cache(uint32_t firmware)  //returns true, if the actual symbol table was written to SD
+{
+	forget_symbol_cache();
+
+	#if USE_SDCARD
+	if(Constants::glo.data() == nullptr)
+	{
+		return false;
+	}
+
+	char name[24];
+	symbol_cache_name(name, firmware);
+
+	SymCacheHeader h = { SYMCACHE_MAGIC, SYMCACHE_VERSION, 0, firmware, (uint32_t) Constants::glo.length(), Constants::glo.checksum() };
+	File32 f;
+
+	if(!f.open(name, O_WRONLY | O_CREAT | O_TRUNC))
+	{
+		TRACE_THR30IIPEDAL(Serial.printf("Could not create symbol table cache \"%s\".\n\r", name);)
+		return false;
+	}
+
+	bool ok = (f.write(&h, sizeof(h)) == sizeof(h)) && (f.write(Constants::glo.data(), h.length) == h.length);
+	ok = f.close() && ok;
+
+	if(!ok)
+	{
+		SD.remove(name);  //never leave a half written cache file
+	}
+
+	TRACE_THR30IIPEDAL(Serial.printf("Symbol table cache \"%s\" %s.\n\r", name, ok ? "written" : "write error");)
+	return ok;
+	#else
+	(void) firmware;
+	return false;
+	#endif
+}
+
+void forget_symbol_cache()  //the symbol table is replaced (or the THR reconnected): no verification pending any more
+{
+	symtab_from_cache = false;
+	symtab_unverified = false;
+	symtab_checksum = 0;
+	symtab_firmware = 0;
+}
+
+void verify_symbol_cache()  //lazy verification of a table loaded from SD
+{
+	if(!symtab_unverified || outqueue.item_count() > 0 || inqueue.item_count() > 0)  //only in idle time
+	{
+		return;
+	}
+	symtab_unverified = false;
+
+	if(Constants::glo.checksum() == symtab_checksum)
+	{
+		TRACE_THR30IIPEDAL(Serial.println(F("Symbol table cache verified."));)
+		return;
+	}
+
+	Serial.println(F("Symbol table cache checksum error! Discarding it and requesting the table from THR."));
+	
+	#if USE_SDCARD
+	char name[24];
+	symbol_cache_name(name, symtab_firmware);
+	SD.remove(name);
+	#endif
+	symtab_from_cache = false;
+
+	//Request the symbol table again. The answer leads through set_all(), Init_Dictionaries() and the rest of the boot dialog.
+	outqueue.enqueue(Outmessage(SysExMessage((const byte[29]){ 0xf0, 0x00, 0x01, 0x0c, 0x24, 0x02, 0x4d, 0x00, 0x03, 0x00, 0x00, 0x07, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf7},29), 777, false, true));
+}
+
+void report_boot_time()  //boot-to-ready time (compare runs with and without symbol table cache)
+{
+	if(boot_time_reported)
+	{
+		return;
+	}
+	boot_time_reported = true;
+	TRACE_THR30IIPEDAL(Serial.printf("Boot to ready: %lu ms (symbol table from %s).\n\r", millis() - boot_time0,
+	                                 Constants::glo.isBaked() ? "flash" : (symtab_from_cache ? "SD cache" : "THR dump"));)
+}
+
 void send_init()  //Try to activate THR30II MIDI 
 {    
 	//For debugging on old Arduino Due version: print USB-Endpoint information 
@@ -1323,6 +1563,11 @@ void send_init()  //Try to activate THR30II MIDI
 	// }
 	
 	while(outqueue.item_count()>0) outqueue.dequeue(); //clear Queue (in case some message got stuck)
+	param_acks.Flush();
+	forget_symbol_cache();  //a verification of the last session must not discard the cache of this one
+
+	boot_time0 = millis();
+	boot_time_reported = false;
 	
 	Serial.println(F("\r\nOutque cleared.\r\n"));
 	// PC to THR30II Message:
@@ -1391,19 +1636,28 @@ void pollpedalinputs()	// Poll pedal inputs
 		pedal_2_val = 0;
 	}
 	if ((pedal_2_val > (pedal_2_old_val + pedal_margin)) || (pedal_2_val < (pedal_2_old_val - pedal_margin))) {
-		updatemastervolume(pedal_2_val);
 		// Serial.println(pedal_2_val);
 		maskUpdate=true;  //request display update to show new states quickly
 	}
+	pedal_stream.Input(pedal_2_val);  //sent by stream_pedal()
+}
+
+void stream_pedal()  //sends the next master volume of pedal 2, when THR acknowledged the previous one
+{
+	if (!pedal_stream.Due(param_acks.Waiting(P_CTRL_MASTER)))
+	{
+		return;
+	}
+	updatemastervolume(pedal_stream.Next());
+	if (!param_acks.Waiting(P_CTRL_MASTER) && param_acks.Lost(P_CTRL_MASTER))  //out queue was full
+	{
+		pedal_stream.Lost();
+	}
 }
 
 void updatemastervolume(int mastervolume)
 {
-	Serial.print("updatemastervolume(" + String(mastervolume) + ") = ");
-	// Serial.print(mastervolume);
-	// Serial.println(")");
 	scaledvolume = min(max((static_cast<double>(mastervolume)+1) * 100 / 1024, 0), 100);
-	Serial.println(scaledvolume);
 	THR_Values.sendChangestoTHR=true;
 	THR_Values.SetControl(CTRL_MASTER, scaledvolume);
 	THR_Values.sendChangestoTHR=false;
@@ -1422,7 +1676,7 @@ void do_gain_boost()
 void undo_gain_boost()
 {
 	THR_Values.sendChangestoTHR=true;
-	THR_Values.SetControl(CTRL_GAIN, THR_Values.control_store[CTRL_GAIN]);
+	THR_Values.SetRaw(P_CTRL_GAIN, THR_Values.control_store[CTRL_GAIN]);  //bit-exact value from before the boost
 	THR_Values.sendChangestoTHR=false;
 	boost_activated = false;
 }
@@ -1441,9 +1695,12 @@ void THR30II_Settings::EchoTempoTap()
 		tempotapbpm = 60000/tempotapint;
 		Serial.println(tempotapbpm);
 
-		echo_setting[TAPE_ECHO][TA_TIME] = tempotapsetting;
-		echo_setting[DIGITAL_DELAY][DD_TIME] = tempotapsetting;
-		createPatch();
+		bool send = sendChangestoTHR;
+		sendChangestoTHR = false;  //both times through the registry (history), but sent together below
+		SetRaw(P_TA_TIME, EncodeParam(P_TA_TIME, tempotapsetting));
+		SetRaw(P_DD_TIME, EncodeParam(P_DD_TIME, tempotapsetting));
+		sendChangestoTHR = send;
+		SyncToTHR();  //only the time of the selected echo type is sent
 	}
 	
 }
@@ -1451,11 +1708,11 @@ void THR30II_Settings::EchoTempoTap()
 void patch_deactivate()
 {
 	//restore local settings
-	THR_Values = stored_THR_Values;   //THR30II_Settings class is deep copyable!
+	THR_Values.Restore(stored_THR_Values);   //plain settings struct, one memcpy
 	TRACE_THR30IIPEDAL(Serial.println(F("Patch_deactivate(): Restored local settings mirror..."));)
 	
 	//activate local settings in THRxxII again
-	THR_Values.createPatch();  //Create a patch from all the local settings and send it completely via MIDI-patch-upload
+	THR_Values.SyncToTHR();  //only the differences, if they are cheaper than a complete MIDI-patch-upload
 	
 	TRACE_THR30IIPEDAL(Serial.println(F("Patch_deactivate(): Local settings activated on THRII."));)
 				
@@ -1469,8 +1726,10 @@ void patch_activate(uint16_t pnr)  //check patchnumber and send patch as a SysEx
 	{
 		//activate the patch (overwrite either the actual patch or the local settings)
 		TRACE_THR30IIPEDAL(Serial.printf("Patch_activate(): Activating patch #%d \n\r", pnr);)
+		switch_latency.Begin(button_us);  //all activations are caused by a foot switch
 		send_patch(pnr); //now send this patch as a SysEx message to THR30II 
 		active_patch_id = pnr;
+		navigator.Used(pnr);
 		boost_activated = false;
 		_uistate = UI_home_patch;  //State "patch" reached
 	} 
@@ -1480,2254 +1739,298 @@ void patch_activate(uint16_t pnr)  //check patchnumber and send patch as a SysEx
 	}
 }
 
-void send_patch(uint8_t patch_id)  //Send a patch from preset library to THRxxII
-{ 
-	DynamicJsonDocument djd(4096);  //contains accessible values from a JSON File (2048?)
-	
-	DeserializationError dse= deserializeJson(djd, patchesII[patch_id-1]);	//patchesII is zero-indexed
-	
-	if(dse==DeserializationError::Ok)
+void patch_preselect(uint16_t pnr)  //pre-select a patch chosen by the navigator (and activate it in immediate mode)
+{
+	if(pnr < 1 || pnr > npatches)
 	{
-		TRACE_THR30IIPEDAL( Serial.print(F("Send_patch(): Success-Deserializing. We fetched patch: "));)
-		TRACE_THR30IIPEDAL( Serial.println( djd["data"]["meta"]["name"].as<const char*>() );)
-		//Here we must copy values to local THRII-Settings and / or send them to THRII
-		THR_Values.SetLoadedPatch(djd); //set all local fields from thrl6p-JSON-File 
+		return;
 	}
-	else
+	presel_patch_id = pnr;
+	Serial.printf("Patch #%d pre-selected\n\r", presel_patch_id);
+	//if immediate mode selected & new patch selected, send immediately
+	if ((send_patch_now) && (presel_patch_id != active_patch_id))
 	{
-		 THR_Values.SetPatchName("error",-1);  //-1 = actual settings
-		 TRACE_THR30IIPEDAL(Serial.println(F("Send_patch(): Error-Deserial"));)
+		patch_activate(presel_patch_id);
 	}
-	
-} //End of send_patch()
+}
 
-int THR30II_Settings::SetLoadedPatch(const DynamicJsonDocument &djd ) //invoke all settings from a loaded patch
+#if USE_SDCARD
+void library_changed()  //patches were saved, moved or compacted
 {
-	if (!MIDI_Activated)
-	{
-		TRACE_THR30IIPEDAL(Serial.println("Midi Sync is not ready!");)
-		return -1;
-	}
-
-	sendChangestoTHR = false;  //We apply all the settings in one shot with a MIDI-Patch-Upload to THRII via "createPatch()" 
-                               //and not each setting separately. So we use the setters only for our local fields!
-
-	TRACE_THR30IIPEDAL(Serial.println(F("SetLoadedPatch(): Setting loaded patch..."));)
-
-	std::map <String,uint16_t>  & glob = Constants::glo;
-	
-	//Patch name
-	SetPatchName( djd["data"]["meta"]["name"].as<const char*>(), presel_patch_id);
-	
-	//unknown global parameter
-	Tnid = djd["data"]["meta"]["tnid"].as<uint32_t>();
-
-	//Unit states
-	Switch_On_Off_Compressor_Unit(djd["data"]["tone"]["THRGroupFX1Compressor"]["@enabled"].as<bool>());
-	Switch_On_Off_Gate_Unit(djd["data"]["tone"]["THRGroupGate"]["@enabled"].as<bool>());
-	Switch_On_Off_Effect_Unit(djd["data"]["tone"]["THRGroupFX2Effect"]["@enabled"].as<bool>());
-	Switch_On_Off_Echo_Unit(djd["data"]["tone"]["THRGroupFX3EffectEcho"]["@enabled"].as<bool>());
-	Switch_On_Off_Reverb_Unit(djd["data"]["tone"]["THRGroupFX4EffectReverb"]["@enabled"].as<bool>());
-	TRACE_V_THR30IIPEDAL(Serial.printf("Comp on/off: %d\n\r",unit[THR30II_UNITS::COMPRESSOR] );)
-	TRACE_V_THR30IIPEDAL(Serial.printf("Gate on/off: %d\n\r",unit[THR30II_UNITS::GATE] );)
-	TRACE_V_THR30IIPEDAL(Serial.printf("Eff on/off: %d\n\r",unit[THR30II_UNITS::EFFECT] );)
-	TRACE_V_THR30IIPEDAL(Serial.printf("Echo on/off: %d\n\r",unit[THR30II_UNITS::ECHO] );)
-	TRACE_V_THR30IIPEDAL(Serial.printf("Rev on/off: %d\n\r",unit[THR30II_UNITS::REVERB] );)
-
-	//global parameter tempo
-	ParTempo = djd["data"]["tone"]["global"]["THRPresetParamTempo"].as<uint32_t>();
-
-
-
-	//FX1 Compressor (no different types)
-	CompressorSetting(CO_SUSTAIN,  djd["data"]["tone"]["THRGroupFX1Compressor"]["Sustain"].as<double>() * 100);
-	CompressorSetting(CO_LEVEL, djd["data"]["tone"]["THRGroupFX1Compressor"]["Level"].as<double>() * 100);
-	//CompressorSetting(THR30II_COMP_SET.MIX, pat.data.tone.THRGroupFX1Compressor. * 100);  //No Mix-Parameter in Patch-Files
-	
-
-
-	//Amp / Collection
-	uint16_t key = glob[djd["data"]["tone"]["THRGroupAmp"]["@asset"].as<const char*>() ];  //e.g. "THR10C_DC30" => 0x88
-	setColAmp(key);
-	TRACE_V_THR30IIPEDAL(Serial.printf("Amp: %x\n\r",key );)
-
-	//Main Amp Controls
-	SetControl(CTRL_GAIN,  djd["data"]["tone"]["THRGroupAmp"]["Drive"].as<double>() * 100);
-	SetControl(CTRL_MASTER,  djd["data"]["tone"]["THRGroupAmp"]["Master"].as<double>() * 100);
-	SetControl(CTRL_BASS, djd["data"]["tone"]["THRGroupAmp"]["Bass"].as<double>() * 100);
-	SetControl(CTRL_MID,  djd["data"]["tone"]["THRGroupAmp"]["Mid"].as<double>() * 100);
-	SetControl(CTRL_TREBLE,  djd["data"]["tone"]["THRGroupAmp"]["Treble"].as<double>() * 100);
-	TRACE_V_THR30IIPEDAL(Serial.println( "Controls: G, M , B , Mi , T" );)
-	TRACE_V_THR30IIPEDAL(Serial.println(control[0]);)
-	TRACE_V_THR30IIPEDAL(Serial.println(control[1]);)
-	TRACE_V_THR30IIPEDAL(Serial.println(control[2]);)
-	TRACE_V_THR30IIPEDAL(Serial.println(control[3]);)
-	TRACE_V_THR30IIPEDAL(Serial.println(control[4]);)
-
-	//Cab Simulation             
-	uint16_t val = djd["data"]["tone"]["THRGroupCab"]["SpkSimType"].as<uint16_t>(); //e.g. 10 
-	SetCab((THR30II_CAB)val);  //e.g. 10 =>  Boutique_2x12
-	TRACE_V_THR30IIPEDAL(Serial.printf("Cab: %x\n\r",val );)
-
-
+	patch_cache.clear();  //positions may refer to other patches now
+	fetched_presel_id = -1;
+	npatches = library.size();
+	navigator.begin(&library, npatches);
+}
+#endif
 
-	//Noise Gate
-	double v = 100.0 - 100.0 / 96 * -  djd["data"]["tone"]["THRGroupGate"]["Thresh"].as<double>() ;   //change range from [-96dB ... 0dB] to [0...100]
-	GateSetting(GA_THRESHOLD, v);
-	GateSetting(GA_DECAY, djd["data"]["tone"]["THRGroupGate"]["Decay"].as<double>() * 100);
-	TRACE_V_THR30IIPEDAL(Serial.println( "Gate Thresh:" );)
-	TRACE_V_THR30IIPEDAL(Serial.println( v );)
+bool patch_save(uint16_t pos)  //save the actual settings as library patch pos (pos = npatches + 1: new patch)
+{
+	#if USE_SDCARD
+	uint32_t t0 = micros();
+	String name = active_patch_id > 0 ? libraryPatchName(active_patch_id) : String("Patch ") + String(pos);
 
+	DynamicJsonDocument djd(PATCH_DOC_SIZE);
+	if(!THR_Values.EncodePatch(djd, name.c_str()))
+	{
+		return false;
+	}
+	std::vector<char> text(measureJson(djd) + 1);
+	size_t len = serializeJson(djd, text.data(), text.size());
 
+	PatchLibEntry e {};
+	strncpy(e.name, name.c_str(), PATCH_NAME_LEN);
+	e.col = (uint8_t) THR_Values.col;
+	e.amp = (uint8_t) THR_Values.amp;
+	e.cab = (uint8_t) THR_Values.cab;
 
-	//FX2 Effect Settings
-	String type (djd["data"]["tone"]["THRGroupFX2Effect"]["@asset"].as<const char*>());
-	TRACE_V_THR30IIPEDAL(Serial.printf("EffType: %s\n\r",type.c_str() );)
-	
-	if(type == "StereoSquareChorus")
+	bool ok = library.Save(pos, text.data(), len, e);
+	if(ok)
 	{
-		EffectSelect(CHORUS);
+		library_changed();
 	}
-	else if (type == "L6Flanger")
+	TRACE_THR30IIPEDAL(Serial.printf("Patch_save(): \"%s\" to #%d %s (%d bytes, %lu us)\n\r", name.c_str(), pos, ok ? "saved" : "failed", (int) len, micros() - t0);)
+	if(library.full())
 	{
-		EffectSelect(FLANGER);
+		Serial.println(F("Patch library: no more saves possible until it is compacted (in idle time)."));
 	}
-	else if (type == "Phaser")
+	return ok;
+	#else
+	(void) pos;
+	return false;  //patches in PROGMEM can not be saved
+	#endif
+}
+
+void compact_library()  //rewrites the patch library after many saves, one patch per call in idle time
+{
+	#if USE_SDCARD
+	static uint32_t failed_ms = 0;  //do not retry a failed compaction immediately
+
+	if(!(library.compacting() || library.needsCompaction()) || _uistate == UI_save
+	   || outqueue.item_count() > 0 || inqueue.item_count() > 0 || millis() - last_button_ms < 10000
+	   || (failed_ms != 0 && millis() - failed_ms < 300000))
 	{
-		EffectSelect(PHASER);
+		return;
 	}
-	else if (type == "BiasTremolo")
+
+	int8_t r = library.CompactStep(PATCH_FILE);
+	if(r == 1)  //busy
 	{
-		EffectSelect(TREMOLO);
+		return;
 	}
-	EffectSetting(CHORUS, glob["Freq"], djd["data"]["tone"]["THRGroupFX2Effect"]["StereoSquareChorus"]["Freq"].as<double>()* 100);
-	EffectSetting(CHORUS, glob["Depth"], djd["data"]["tone"]["THRGroupFX2Effect"]["StereoSquareChorus"]["Depth"].as<double>()*100);
-	EffectSetting(CHORUS, glob["Pre"], djd["data"]["tone"]["THRGroupFX2Effect"]["StereoSquareChorus"]["Pre"].as<double>()* 100);
-	EffectSetting(CHORUS, glob["Feedback"], djd["data"]["tone"]["THRGroupFX2Effect"]["StereoSquareChorus"]["Feedback"].as<double>()* 100);
-	EffectSetting(CHORUS, glob["FX2Mix"], djd["data"]["tone"]["THRGroupFX2Effect"]["StereoSquareChorus"]["@wetDry"].as<double>()* 100);
-	
-	EffectSetting(FLANGER, glob["Freq"], djd["data"]["tone"]["THRGroupFX2Effect"]["L6Flanger"]["Freq"].as<double>() * 100);
-	EffectSetting(FLANGER, glob["Depth"] ,djd["data"]["tone"]["THRGroupFX2Effect"]["L6Flanger"]["Depth"].as<double>() * 100);
-	EffectSetting(FLANGER, glob["FX2Mix"], djd["data"]["tone"]["THRGroupFX2Effect"]["L6Flanger"]["@wetDry"].as<double>() * 100);
-	
-	EffectSetting(PHASER, glob["Speed"], djd["data"]["tone"]["THRGroupFX2Effect"]["Phaser"]["Speed"].as<double>() * 100);
-	EffectSetting(PHASER, glob["Feedback"], djd["data"]["tone"]["THRGroupFX2Effect"]["Phaser"]["Feedback"].as<double>() * 100);
-	EffectSetting(PHASER, glob["FX2Mix"], djd["data"]["tone"]["THRGroupFX2Effect"]["Phaser"]["@wetDry"].as<double>() * 100);
-	
-	EffectSetting(TREMOLO, glob["Speed"],  djd["data"]["tone"]["THRGroupFX2Effect"]["BiasTremolo"]["Speed"].as<double>()*100);
-	EffectSetting(TREMOLO, glob["Depth"],  djd["data"]["tone"]["THRGroupFX2Effect"]["BiasTremolo"]["Depth"].as<double>()*100);
-	EffectSetting(TREMOLO, glob["FX2Mix"], djd["data"]["tone"]["THRGroupFX2Effect"]["BiasTremolo"]["@wetDry"].as<double>()*100);
-
+	failed_ms = r < 0 ? millis() | 1 : 0;
+	library_changed();
+	#endif
+}
 
+String libraryPatchName(uint16_t nr)  //name of a library patch (nr is 1-based)
+{
+	#if USE_SDCARD
+	PatchLibEntry e;
+	return library.entry(nr, e) ? String(e.name) : String("error");  //read from the index on SD
+	#else
+	return (nr >= 1 && nr <= libraryPatchNames.size()) ? libraryPatchNames[nr - 1] : String("error");
+	#endif
+}
 
-	//FX3 Echo Settings
-	type=djd["data"]["tone"]["THRGroupFX3EffectEcho"]["@asset"].as<const char*>() ;
-	TRACE_V_THR30IIPEDAL(Serial.printf("EchoType: %s\n\r",type.c_str() );)
-	if (type == "TapeEcho")
+//Decoded library patches are kept in a small LRU cache, so RAM use does not depend on the library size
+const THR30II_Patch *fetch_patch(uint16_t nr)  //decoded patch nr (1-based) from cache or SD-card (nullptr on error)
+{
+	const THR30II_Patch *cached = patch_cache.find(nr);
+	if(cached != nullptr)
 	{
-		EchoSelect(TAPE_ECHO);
+		return cached;
 	}
-	else if (type == "L6DigitalDelay")
+
+	if(Constants::glo.size() == 0 || nr < 1 || nr > npatches)  //decoding needs the symbol table
 	{
-		EchoSelect(DIGITAL_DELAY);
+		return nullptr;
 	}
-	EchoSetting(TAPE_ECHO, glob["Time"], djd["data"]["tone"]["THRGroupFX3EffectEcho"]["TapeEcho"]["Time"].as<double>() * 100);
-	EchoSetting(TAPE_ECHO, glob["Feedback"] , djd["data"]["tone"]["THRGroupFX3EffectEcho"]["TapeEcho"]["Feedback"].as<double>() * 100);
-	EchoSetting(TAPE_ECHO, glob["Bass"], djd["data"]["tone"]["THRGroupFX3EffectEcho"]["TapeEcho"]["Bass"].as<double>() * 100);
-	EchoSetting(TAPE_ECHO, glob["Treble"], djd["data"]["tone"]["THRGroupFX3EffectEcho"]["TapeEcho"]["Treble"].as<double>() * 100);
-	EchoSetting(TAPE_ECHO, glob["FX3Mix"], djd["data"]["tone"]["THRGroupFX3EffectEcho"]["TapeEcho"]["@wetDry"].as<double>() * 100);
-	
-	EchoSetting(DIGITAL_DELAY, glob["Time"], djd["data"]["tone"]["THRGroupFX3EffectEcho"]["L6DigitalDelay"]["Time"].as<double>() * 100);
-	EchoSetting(DIGITAL_DELAY, glob["Feedback"], djd["data"]["tone"]["THRGroupFX3EffectEcho"]["L6DigitalDelay"]["Feedback"].as<double>() * 100);
-	EchoSetting(DIGITAL_DELAY, glob["Bass"], djd["data"]["tone"]["THRGroupFX3EffectEcho"]["L6DigitalDelay"]["Bass"].as<double>() * 100);
-	EchoSetting(DIGITAL_DELAY, glob["Treble"], djd["data"]["tone"]["THRGroupFX3EffectEcho"]["L6DigitalDelay"]["Treble"].as<double>() * 100);
-	EchoSetting(DIGITAL_DELAY, glob["FX3Mix"], djd["data"]["tone"]["THRGroupFX3EffectEcho"]["L6DigitalDelay"]["@wetDry"].as<double>() * 100);
-	
 
+	uint32_t t0 = micros();
+	DynamicJsonDocument djd(PATCH_DOC_SIZE);  //contains the filtered values from a JSON File
+	
+	#if USE_SDCARD
+	PatchLibEntry e;
+	DeserializationError dse = DeserializationError::IncompleteInput;
 
-	//FX4 Reverb Settings
-	type=djd["data"]["tone"]["THRGroupFX4EffectReverb"]["@asset"].as<const char*>();
-	TRACE_V_THR30IIPEDAL(Serial.printf("RevType: %s\n\r",type.c_str() );)
-	if ( type ==  "StandardSpring")
-	{
-		ReverbSelect(SPRING);
-	}
-	else if (type=="SmallRoom1")
+	if(library.entry(nr, e))
 	{
-		ReverbSelect(ROOM);
+		dse = library.parse(e, djd, true);  //streamed from SD, only the fields of the patch schema are kept
 	}
-	else if (type== "LargePlate1")
-	{
-		ReverbSelect(PLATE);
-	}
-	else if (type == "ReallyLargeHall")
-	{
-		ReverbSelect(HALL);
-	}
-	ReverbSetting(SPRING, glob["Time"], djd["data"]["tone"]["THRGroupFX4EffectReverb"]["StandardSpring"]["Time"].as<double>() * 100);
-	ReverbSetting(SPRING, glob["Tone"],  djd["data"]["tone"]["THRGroupFX4EffectReverb"]["StandardSpring"]["Tone"].as<double>() * 100);
-	ReverbSetting(SPRING, glob["FX4WetSend"],  djd["data"]["tone"]["THRGroupFX4EffectReverb"]["StandardSpring"]["@wetDry"].as<double>() * 100);
-
-	ReverbSetting(ROOM, glob["Decay"],  djd["data"]["tone"]["THRGroupFX4EffectReverb"]["SmallRoom1"]["Decay"].as<double>() * 100);
-	ReverbSetting(ROOM, glob["Tone"],  djd["data"]["tone"]["THRGroupFX4EffectReverb"]["SmallRoom1"]["Tone"].as<double>() * 100);
-	ReverbSetting(ROOM, glob["PreDelay"],  djd["data"]["tone"]["THRGroupFX4EffectReverb"]["SmallRoom1"]["PreDelay"].as<double>() * 100);
-	ReverbSetting(ROOM, glob["FX4WetSend"],  djd["data"]["tone"]["THRGroupFX4EffectReverb"]["SmallRoom1"]["@wetDry"].as<double>() * 100);
-
-	ReverbSetting(PLATE, glob["Decay"],  djd["data"]["tone"]["THRGroupFX4EffectReverb"]["LargePlate1"]["Decay"].as<double>() * 100);
-	ReverbSetting(PLATE, glob["PreDelay"],  djd["data"]["tone"]["THRGroupFX4EffectReverb"]["LargePlate1"]["PreDelay"].as<double>() * 100);
-	ReverbSetting(PLATE, glob["Tone"],   djd["data"]["tone"]["THRGroupFX4EffectReverb"]["LargePlate1"]["Tone"].as<double>() * 100);
-	ReverbSetting(PLATE, glob["FX4WetSend"],  djd["data"]["tone"]["THRGroupFX4EffectReverb"]["LargePlate1"]["@wetDry"].as<double>() * 100);
-
-	ReverbSetting(HALL, glob["Decay"], djd["data"]["tone"]["THRGroupFX4EffectReverb"]["ReallyLargeHall"]["Decay"].as<double>() * 100);
-	ReverbSetting(HALL, glob["PreDelay"],  djd["data"]["tone"]["THRGroupFX4EffectReverb"]["ReallyLargeHall"]["PreDelay"].as<double>() * 100);
-	ReverbSetting(HALL, glob["Tone"],   djd["data"]["tone"]["THRGroupFX4EffectReverb"]["ReallyLargeHall"]["Tone"].as<double>() * 100);
-	ReverbSetting(HALL, glob["FX4WetSend"],  djd["data"]["tone"]["THRGroupFX4EffectReverb"]["ReallyLargeHall"]["@wetDry"].as<double>() * 100);
-
-
-
-	createPatch();  //send all settings as a patch dump SysEx to THRII
-	
-	TRACE_THR30IIPEDAL(Serial.println(F("SetLoadedPatch(): Done setting."));)
-
-	return 0;
-}
-
-THR30II_Settings::States THR30II_Settings::_state = THR30II_Settings::States::St_idle;  //the actual state of the state engine for creating a patch
-
-void THR30II_Settings::createPatch() //fill send buffer with actual settings, creating a valid SysEx for sending to THR30II
-{
-	//1.) Make the data buffer (structure and values) store the length.
-	//    Add 12 to get the 2nd length-field for the header. Add 8 to get the 1st length field for the header.
-	//2.) Cut it to slices with 0x0d02 (210 dez.) bytes (gets the payload of the frames)
-	//    These frames will thus not have incomplete 8/7 groups after bitbucketing but total frame length is 253 (just below the possible 255 bytes).
-	//    The remaining bytes will build the last frame (perhaps with last 8/7 group inclomplete)
-	//    Store the length of the last slice (all others are fixed 210 bytes  long.)
-	//3.) Create the header:
-	//    SysExStart:  f0 00 01 0c 22 02 4d (always the same)
-	//                 01   (memory command, not settings command)
-	//                 Get actual counter for memory frames and append it here
-	//                 00 01 0b  ("same frame counter" and payload size  for the header)
-	//                 hang following 4-Byte values together:
-	//
-	//                 0d 00 00 00   (Opcode for memory write/send)
-	//                 (len +8+12)   (1st length field = total length= data length + 3 values + type field/netto length )
-	//                 FF FF FF FF   (user patch number to overwrite/ 0xFFFFFFFF for actual patch)
-	//                 (len   +12)   (2nd length field = netto length= data length + the following 3 values)
-	//                 00 00 00 00   (always the same, kind of opcode?)
-	//                 01 00 00 00   (always the same, kind of opcode?)
-	//                 00 00 00 00   (always the same, kind of opcode?)
-	//
-	//                 Bitbucket this group (gives no incomplete 8/7 group!)
-	//                 and append it to the header
-	//                 finish header with 0xF7
-	//                 Header frame may already be sent out!
-	//4.)              For each slice:
-	//                 Bitbucket encode the slice
-	//                 Build frame:
-	//                 f0 00 01 0c 22 02 4d(always the same)
-	//                 01   (memory command, not settings command)
-	//                 Get actual counter for memory frames and append it here
-	//                 append same frame counter (is the slice counter) as a byte
-	//                 0d 01  (except for last frame, where we use it's stored length before bitbucketing)
-	//                 bitbucketed data for this slice
-	//                 0xF7
-	//                 Send it out.
-	TRACE_V_THR30IIPEDAL(Serial.println(F("Create_patch(): "));)
-
-	std::array<byte,2000> dat;
-	auto datlast =dat.begin();  //iterator to last element (starts on begin! )
-	std::array<byte,300> sb;
-	auto sblast = sb.begin();  //iterator to last element (starts on begin! )
-	std::array<byte,300> sb2;
-	auto sb2last = sb2.begin();  //iterator to last element (starts on begin! )
-
-	std::map<String,uint16_t> &glob = Constants::glo;
-	
-	std::array<byte,4> toInsert4;
-	std::array<byte,6> toInsert6;
-
-	#define datback(x)  for(const byte &b : x ) { *datlast++ = b; };
-	
-	//Macro for converting a 32-Bit value to a 4-byte array<byte,4> and append it to "dat"
-	#define conbyt4(x) toInsert4={ (byte)(x), (byte) ((x)>>8), (byte)((x)>>16) , (byte) ((x)>>24) };  datlast= std::copy( std::begin(toInsert4), std::end(toInsert4), datlast ); 
-	//Macro for appending a 16-Bit value to "dat"
-	#define conbyt2(x) *datlast++=(byte)(x); *datlast++= (byte)((x)>>8); 
-
-	//1.) Make the data buffer (structure and values)
-
-	datback( tokens["StructOpen"] );
-	//Meta
-	datback(tokens["Meta"] ) ;          
-	datback(tokens["TokenMeta"] );
-	toInsert6= { 0x00, 0x00, 0x00, 0x00, 0x04, 0x00 };
-	datlast=std::copy( std::begin(toInsert6),std::end(toInsert6),datlast) ;    //number 0x0000, type 0x00040000 (String)
-	
-	conbyt4(  patchNames[0].length() + 1 ) // Length of patchname (incl. '\0')
-		//32Bit-Value (little endian; low byte first) 
-	
-	std::string nam =patchNames[0u].c_str();
-	datback( nam ); //copy the patchName  //!!ZWEZWE!! mind UTF-8 ?
-	*datlast++='\0'; //append  '\0' to the patchname
-	
-	toInsert6={0x01, 0x00, 0x00, 0x00, 0x02, 0x00 };
-	datlast=std::copy(std::begin(toInsert6), std::end(toInsert6),datlast );      //number 0x0001, type 0x00020000 (int)
-	
-	conbyt4(Tnid);     //32Bit-Value (little endian; low byte first) Tnid
-
-	toInsert6={ 0x02, 0x00, 0x00, 0x00, 0x02, 0x00 };    //number 0x0002, type 0x00020000 (int)
-	datlast=std::copy(std::begin(toInsert6), std::end(toInsert6),datlast ); 
-	conbyt4(UnknownGlobal);	    //32Bit-Value (little endian; low byte first) Unknown Global
-
-	toInsert6={ 0x03, 0x00, 0x00, 0x00, 0x03, 0x00 }; //number 0x0003, type 0x00030000 (int)
-	datlast=std::copy(std::begin(toInsert6), std::end(toInsert6),datlast );
-	conbyt4(ParTempo);  //32Bit-Value (little endian; low byte first) ParTempo (min=110 =0x00000000)
-	
-	datback(tokens["StructClose"]);
-	//Data           
-	datback(tokens["StructOpen"]);
-	datback(tokens["Data"]);
-	datback(tokens["TokenData"]);
-
-	//unit GuitarProc
-	datback(tokens["UnitOpen"]);
-	conbyt2(glob["GuitarProc"]);
-	datback(tokens["UnitType"]);
-	datback(tokens["PseudoVal"]);
-	conbyt2(glob["Y2GuitarFlow"]);
-	datback(tokens["ParCount"]);
-	datback(tokens["PseudoType"]);
-	conbyt4(11u); //32-Bit value  number of parameters (here: 11)
-	//1601 = FX1EnableState  (CompOn)
-	conbyt2(glob["FX1EnableState"]);
-	conbyt4(0x00010000u);//Type binary
-	conbyt4( unit[COMPRESSOR] ? 0x01u : 0x00u );
-	//1901 = FX2EnableState  (EffectOn)
-	conbyt2(glob["FX2EnableState"]);
-	conbyt4(0x00010000u);//Type binary
-	conbyt4( unit[EFFECT] ? 0x01u : 0x00u );
-	//1801 = FX2MixState     (Eff.Mix)
-	conbyt2(glob["FX2MixState"]);				
-	conbyt4(0x00030000u);//Type int
-	
-	conbyt4(ValToNumber(effect_setting[PHASER][PH_MIX])); //MIX is independent from the effect type!
-	//1C01 = FX3EnableState  (EchoOn)
-	conbyt2(glob["FX3EnableState"]);
-	conbyt4(0x00010000u);//Type binary
-	conbyt4(unit[ECHO] ? 0x01u : 0x00u );         
-	//1B01 = FX3MixState     (EchoMix)
-	conbyt2(glob["FX3MixState"]);
-	conbyt4(0x00030000u);//Type int
-	conbyt4(ValToNumber(echo_setting[TAPE_ECHO][TA_MIX])); //MIX is independent from the echo type!
-	
-	//1F01 = FX4EnableState  (RevOn)
-	conbyt2(glob["FX4EnableState"]);		
-	conbyt4(0x00010000u);//Type binary
-	
-	conbyt4(unit[REVERB] ? 0x01u : 0x00u );
-	//2601 = FX4WetSendState (RevMix)
-	conbyt2(glob["FX4WetSendState"]);
-	conbyt4(0x00030000u);//Type int
-	conbyt4(ValToNumber(reverb_setting[SPRING][SP_MIX]) );  //MIX is independent from the effect type!
-	//2101 = GateEnableState (GateOn)
-	conbyt2(glob["GateEnableState"]);
-	conbyt4(0x00010000u);//Type binary
-	conbyt4(unit[GATE] ? 0x01u : 0x00u );
-	//2401 = SpkSimTypeState (Cabinet)
-	conbyt2(glob["SpkSimTypeState"]);
-	conbyt4(0x00020000u);//Type enum
-	
-	conbyt4((uint32_t)cab);  //Cabinet is a value from 0x00 to 0x10
-	
-	//F800 = DecayState      (GateDecay)
-	conbyt2(glob["DecayState"]);
-	conbyt4(0x00030000u);//Type int
-	conbyt4(ValToNumber(gate_setting[GA_DECAY]) );
-	//2501 = ThreshState     (GateThreshold)
-	conbyt2(glob["ThreshState"]);			     
-	conbyt4(0x00030000u);//Type int
-	
-	conbyt4(ValToNumber_Threshold(gate_setting[GA_THRESHOLD]) );
-	
-	//unit Compressor
-	datback(tokens["UnitOpen"]);
-	conbyt2(glob["FX1"]);						
-	datback(tokens["UnitType"]);		
-	datback(tokens["PseudoVal"]);		
-	conbyt2(glob["RedComp"]);				
-	datback(tokens["ParCount"]);			
-	datback(tokens["PseudoType"]);			
-	conbyt4(2u);  //32-Bit value  number of parameters (here: 2)
-	
-	//BF00 = Compressor Level(LevelState)
-	conbyt2(glob["LevelState"]);	
-	conbyt4(0x00030000u);//Type int
-	conbyt4(ValToNumber(compressor_setting[CO_LEVEL]) );	
-	//BE00 = Compressor Sustain(SustainState)
-	conbyt2(glob["SustainState"]);						
-	conbyt4(0x00030000u);//Type int
-	conbyt4(ValToNumber(compressor_setting[CO_SUSTAIN]) );
-	datback(tokens["UnitClose"] ); 	   //Close Compressor Unit
-	
-	//unit AMP (0x0A01)
-	datback(tokens["UnitOpen"] );	
-	conbyt2(glob["Amp"]);
-	datback(tokens["UnitType"] );	
-	datback(tokens["PseudoVal"] );	
-	conbyt2(THR30IIAmpKeys[col_amp(col,amp)]);	
-	datback(tokens["ParCount"] );	
-	datback(tokens["PseudoType"] );			
-	conbyt4(5u);  //32-Bit value  number of parameters (here: 5)
-	
-	//4f 00 CTRL BASS (BassState)
-	conbyt2(glob["BassState"]);
-	conbyt4(0x00030000u);//Type int
-	conbyt4(ValToNumber(control[CTRL_BASS]) );
-	//52 00 GAIN (DriveState)
-	conbyt2(glob["DriveState"]);
-	conbyt4(0x00030000u);//Type int
-	conbyt4(ValToNumber(control[CTRL_GAIN]) );
-	//53 00 MASTER (MasterState)
-	conbyt2(glob["MasterState"]);
-	conbyt4(0x00030000u);//Type int
-	conbyt4(ValToNumber(control[CTRL_MASTER]) );
-	//50 00 MID (MidState)
-	conbyt2(glob["MidState"]);
-	conbyt4(0x00030000u);//Type int
-	conbyt4(ValToNumber(control[CTRL_MID]) );
-	//51 00 CTRL TREBLE (TrebleState)
-	conbyt2(glob["TrebleState"]);
-	conbyt4(0x00030000u);//Type int
-	conbyt4 (ValToNumber(control[CTRL_TREBLE]) );
-	datback(tokens["UnitClose"] );  //close AMP Unit
-	//unit EFFECT (FX2) (0x0E01)
-	datback(tokens["UnitOpen"]) ;
-	conbyt2(glob["FX2"]);
-	datback(tokens["UnitType"] );	
-	datback(tokens["PseudoVal"] );	
-	conbyt2(THR30II_EFF_TYPES_VALS[effecttype].key );  //EffectType as a key value
-	
-	datback(tokens["ParCount"]);    
-	datback(tokens["PseudoType"]);
-		//Number and kind of parameters depend on the selcted effect type            
-	switch (effecttype)
-	{
-		case PHASER:
-			conbyt4(2u);  //32-Bit value  number of parameters (here: 2)
-			conbyt2(glob["FeedbackState"]);      
-			conbyt4(0x00030000u);//Type int
-			
-			conbyt4(ValToNumber(effect_setting[effecttype][PH_FEEDBACK]));
-			conbyt2(glob["FreqState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(effect_setting[effecttype][PH_SPEED]) );
-			break;
-		case TREMOLO:
-			conbyt4(2u);  //32-Bit value  number of parameters (here: 2)
-			conbyt2(glob["DepthState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(effect_setting[effecttype][TR_DEPTH]) );
-			conbyt2(glob["SpeedState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(effect_setting[effecttype][TR_SPEED]) );
-			break;
-		case FLANGER:
-			conbyt4(2u);  //32-Bit value  number of parameters (here: 2)
-			conbyt2(glob["DepthState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(effect_setting[effecttype][FL_DEPTH]));
-			conbyt2(glob["FreqState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(effect_setting[effecttype][FL_SPEED]));
-			break;
-		case CHORUS:
-			conbyt4(4u);  //32-Bit value  number of parameters (here: 4)
-			conbyt2(glob["DepthState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(effect_setting[effecttype][CH_DEPTH]));
-			conbyt2(glob["FeedbackState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(effect_setting[effecttype][CH_FEEDBACK]));
-			conbyt2(glob["FreqState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(effect_setting[effecttype][CH_SPEED]));
-			conbyt2(glob["PreState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(effect_setting[effecttype][CH_PREDELAY]));
-			break;
-	}
-	datback(tokens["UnitClose"]); //close EFFECT Unit
-
-	//0f 01 Unit ECHO (FX3)
-	datback(tokens["UnitOpen"]);
-	conbyt2(glob["FX3"]);
-	datback(tokens["UnitType"]);
-	datback(tokens["PseudoVal"]);
-	conbyt2(THR30II_ECHO_TYPES_VALS[echotype].key );   //EchoType as a key value (variable since 1.40.0a)
-	//dat.AddRange(BitConverter.GetBytes(glob["TapeEcho"]));  //before 1.40.0a "TapeEcho" was fixed type for Unit "Echo"
-	datback(tokens["ParCount"]);
-	datback(tokens["PseudoType"]);
-	
-	//Number and kind of parameters could depend on the selected echo type (in fact it does not)           
-	switch (echotype)
-	{
-		case TAPE_ECHO:
-			conbyt4(4u);  //32-Bit value  number of parameters (here: 4)
-			conbyt2(glob["BassState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(echo_setting[echotype][TA_BASS]));
-			conbyt2(glob["FeedbackState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(echo_setting[echotype][TA_FEEDBACK]));
-			conbyt2(glob["TimeState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(echo_setting[echotype][TA_TIME]));
-			conbyt2(glob["TrebleState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(echo_setting[echotype][TA_TREBLE]));
-			break;
-		case DIGITAL_DELAY:
-			conbyt4(4u);  //32-Bit value  number of parameters (here: 4)
-			conbyt2(glob["BassState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(echo_setting[echotype][DD_BASS]));
-			conbyt2(glob["FeedbackState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(echo_setting[echotype][DD_FEEDBACK]));
-			conbyt2(glob["TimeState"]);			
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(echo_setting[echotype][DD_TIME]));
-			conbyt2(glob["TrebleState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(echo_setting[echotype][DD_TREBLE]));
-			break;
-	}
-	datback(tokens["UnitClose"]);	//close ECHO Unit
-	
-	//12 01 Unit REVERB
-	datback(tokens["UnitOpen"]);
-	conbyt2(glob["FX4"]);
-	datback(tokens["UnitType"]);
-	datback(tokens["PseudoVal"]);
-	conbyt2(THR30II_REV_TYPES_VALS[reverbtype].key); 	
-	datback(tokens["ParCount"]);
-	datback(tokens["PseudoType"]);
-	//Number and kind of parameters depend on the selected reverb type            
-	switch (reverbtype)
-	{
-		case SPRING:
-			conbyt4(2u);  //32-Bit value  number of parameters (here: 2)
-			conbyt2(glob["TimeState"]);	
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(reverb_setting[reverbtype][SP_REVERB]));
-			conbyt2(glob["ToneState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(reverb_setting[reverbtype][SP_TONE]));
-			break;
-		case PLATE:
-			conbyt4(3u);  //32-Bit value  number of parameters (here: 3)
-			conbyt2(glob["DecayState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(reverb_setting[reverbtype][PL_DECAY]));
-			conbyt2(glob["PreDelayState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(reverb_setting[reverbtype][PL_PREDELAY]));
-			conbyt2(glob["ToneState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(reverb_setting[reverbtype][PL_TONE]));
-			break;
-		case HALL:
-			conbyt4(3u);  //32-Bit value  number of parameters (here: 3)
-			conbyt2(glob["DecayState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(reverb_setting[reverbtype][HA_DECAY]) );
-			conbyt2(glob["PreDelayState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(reverb_setting[reverbtype][HA_PREDELAY]));
-			conbyt2(glob["ToneState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(reverb_setting[reverbtype][HA_TONE]));
-			break;
-		case ROOM:
-			conbyt4(3u);  //32-Bit value  number of parameters (here: 3)
-			conbyt2(glob["DecayState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(reverb_setting[reverbtype][RO_DECAY]));
-			conbyt2(glob["PreDelayState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(reverb_setting[reverbtype][RO_PREDELAY]));
-			conbyt2(glob["ToneState"]);
-			conbyt4(0x00030000u);//Type int
-			conbyt4(ValToNumber(reverb_setting[reverbtype][RO_TONE]));
-			break;
-	}
-	datback(tokens["UnitClose"]);   //close REVERB Unit
-	
-	datback(tokens["UnitClose"]);   //close Unit GuitarProcessor
-	
-	datback(tokens["StructClose"]);  //close Structure Data
-	
-	//print whole buffer as a chain of HEX
-	//TRACE_V_THR30IIPEDAL( Serial.printf("\n\rRaw frame before slicing/enbucketing:\n\r"); hexdump(dat,datlast-dat.begin());)
-
-	//    Now store the length.
-	//    Add 12 to get the 2nd length-field for the header. Add 8 to get the 1st length field for the header.
-	uint32_t datalen = (uint32_t) (datlast-dat.begin());
-	
-	//2.) cut to slices
-	uint32_t lengthfield2 = datalen + 12;
-	uint32_t lengthfield1 = datalen + 20;
-
-	int numslices = (int)datalen / 210; //number of 210-byte slices
-	int lastlen = (int)datalen % 210; //data left for last frame containing the rest
-	TRACE_V_THR30IIPEDAL(Serial.print("Datalen: "); Serial.println(datalen);)
-	TRACE_V_THR30IIPEDAL(Serial.print("Number of slices: "); Serial.println(numslices);)
-	TRACE_V_THR30IIPEDAL(Serial.print("Length of last slice: "); Serial.println(lastlen);)
-
-	//3.) Create the header:
-	//    SysExStart:  f0 00 01 0c 22 02 4d (always the same)
-	//                 01   (memory command, not settings command)
-	//                 put following 4-Byte values together:
-	//
-	//                 0d 00 00 00   (Opcode for memory write/send)
-	
-	//Macro for converting a 32-Bit value to a 4-byte vector<byte,4> and append it to "sb"
-	#define conbyt4s(x) toInsert4={ (byte)(x), (byte) ((x)>>8), (byte)((x)>>16) , (byte) ((x)>>24) };  sblast= std::copy( std::begin(toInsert4), std::end(toInsert4), sblast ); 
-	//sblast starts at sb.begin()
-	conbyt4s(0x0du);
-	//                 (len +8+12)   (1st length field = total length= data length + 3 values + type field/netto length )
-	conbyt4s(lengthfield1);
-	//                 FF FF FF FF   (number of user patch to overwrite / 0xFFFFFFFF for actual patch)
-	conbyt4s(0xFFFFFFFFu);
-	//                 (len   +12)   (2nd length field = netto length= data length + the following 3 values)
-	conbyt4s(lengthfield2);
-	//                 00 00 00 00   (always the same, kind of opcode?)
-	conbyt4s(0x0u);
-	//                 01 00 00 00   (always the same, kind of opcode?)
-	conbyt4s(0x1u);
-	//                 00 00 00 00   (always the same, kind of opcode?)
-	conbyt4s(0x0u);
-	//
-	//Bitbucket this group (gives no incomplete 8/7 group!)
-	sb2last = Enbucket(sb2,sb,sblast); 
-	//                 and append it to the header
-	//                 finish header with 0xF7
-	//                 Header frame may already be sent out!
-	byte memframecnt = 0x06;
-	//                 Get actual counter for memory frames and append it here
-
-	//                 00 01 0b  ("same frame counter" and payload size  for the header)
-	sblast=sb.begin(); //start the buffer to send
-	
-	std::array<byte,12> toInsert;
-	toInsert=std::array<byte,12>({ 0xf0, 0x00, 0x01, 0x0c, 0x24, 0x02, 0x4d, 0x01, memframecnt++, 0x00, 0x01, 0x0b });
-	sblast= std::copy( toInsert.begin(),toInsert.end(),sb.begin());
-	sblast= std::copy( sb2.begin(), sb2last, sblast);
-
-	*sblast++=0xF7; //SysEx end demarkation
-
-	SysExMessage m ( sb.data(),sblast -sb.begin() );
-	Outmessage om (m, 100, false, false);  //no Ack, no answer for the header 
-	outqueue.enqueue(om);  //send header to THRxxII
-
-	//4.)              For each slice:
-	//                 Bitbucket encode the slice
-	
-	for (int i = 0; i < numslices; i++)
-	{
-		std::array<byte,210> slice;
-		std::copy(dat.begin() + i*210, dat.begin() + i*210 +210, slice.begin() ) ;
-		sb2last=Enbucket(sb2, slice, slice.end());
-		sblast=sb.begin(); //start new buffer to send
-		//toInsert=  { 0xF0, 0x00, 0x01, 0x0c, 0x24, 0x02, 0x4d, 0x01, memframecnt++, (byte)(i % 128), 0x0d, 0x01 };
-		toInsert=  { 0xF0, 0x00, 0x01, 0x0c, 0x24, 0x02, 0x4d, 0x01, memframecnt, (byte)(i % 128), 0x0d, 0x01 };  //memframecount is not incremented inside sent patches
-		sblast=std::copy(toInsert.begin(), toInsert.end(), sblast );
-		sblast=std::copy( sb2.begin(),sb2last, sblast );
-		*sblast++=0xF7;
-		//print whole buffer as a chain of HEX
-		// TRACE_V_THR30IIPEDAL(Serial.printf("\n\rFrame %d to send in \"createpatch\":\n\r",i);
-		// 		hexdump(sb,sblast-sb.begin());
-		// )
-		m = SysExMessage(sb.data(), sblast -sb.begin() );
-		om = Outmessage(m, (uint16_t)(101 + i), false, false);  //no Ack, for all the other slices 
-		outqueue.enqueue(om);  //send slice to THRxxII
-	}
-
-	if (lastlen > 0) //last slice (could be the first, if it is the only one)
-	{
-		std::array<byte,210> slice;  //here 210 is a maximum size, not the true element count
-		byte *slicelast=slice.begin();
-		slicelast=std::copy(dat.begin() + numslices * 210, dat.begin() + numslices * 210 + lastlen, slicelast);
-	
-		sb2last=Enbucket(sb2, slice,slicelast);
-
-		sblast=sb.begin(); //start new buffer to send
-		toInsert={ 0xF0, 0x00, 0x01, 0x0c, 0x24, 0x02, 0x4d, 0x01, memframecnt++, (byte)((numslices) % 128), (byte)((lastlen - 1) / 16), (byte)((lastlen - 1) % 16) }; 
-		sblast = std::copy(toInsert.begin(),toInsert.end(),sblast);
-		sblast= std::copy(sb2.begin(),sb2last,sblast);
-		*sblast++=0xF7;
-		//print whole buffer as a chain of HEX
-		// TRACE_V_THR30IIPEDAL(Serial.println(F("\n\rLast frame to send in \"createpatch\":"));
-		// 		hexdump(sb,sblast-sb.begin());
-		// )
-		m =  SysExMessage(sb.data(),sblast-sb.begin());
-		om = Outmessage(m, (uint16_t)(101 + numslices), true, false);  //Ack, but no answer for the header 
-		outqueue.enqueue(om);  //send last slice to THRxxII
-	}
-	
-	TRACE_THR30IIPEDAL(Serial.println(F("\n\rCreate_patch(): Ready outsending."));)
-
-	userSettingsHaveChanged=false;
-	activeUserSetting=-1;
-
-	// Now we have to await acknowledgment for the last frame
-
-	// on_ack_queue.enqueue(std::make_tuple(101+numslices,Outmessage(SysExMessage((const byte[29]) { 0xf0, 0x00, 0x01, 0x0c, 0x24, 0x02, 0x4d, 0x01, 0x02, 0x00, 0x00, 0x0b, 0x00, 0x0c, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x3c, 0x00, 0x7f, 0x7f, 0x7f, 0x7f, 0x00, 0x00, 0xf7 },29), 
-	//                      101+numslices+1, false, true),nullptr,false)); //answer will be the settings dump for actual settings
-
-    // Summary of what we did just now:
-	//                 Building the SysEx frame:
-	//                 f0 00 01 0c 22 02 4d(always the same)
-	//                 01   (memory command, not a settings command)
-	//                 Get actual counter for memory frames and append it here
-	//                 append same frame counter (is the slice counter) as a byte
-	//                 set length field to  0d 01  (except for last frame, where we use it's stored length before bitbucketing)
-	//                 append "bitbucketed" data for this slice
-	//                 finish with 0xF7
-	//                 Send it out.
-
-} //End of THR30II_Settings::createPatch()
-
-byte THR30II_Settings::UseSysExSendCounter() //returns the actual counter value and increments it afterwards
-{
-  return (SysExSendCounter++)%0x80;  //cycles to 0, if more than 0x7f
-}
-
-int8_t THR30II_Settings::getActiveUserSetting() //Getter for number of the active user setting
-{
-	return activeUserSetting;
-}
-
-bool THR30II_Settings::getUserSettingsHaveChanged() //Getter for state of user Settings
-{
-	return userSettingsHaveChanged;
-}
-
-//Tokens to find inside the patch data
-std::map<String, std::vector<byte> > THR30II_Settings::tokens 
-{
-	{{"StructOpen"},  { 0x00, 0x00, 0x00, 0x80, 0x02, 0x00 }},
-	{{"StructClose"}, { 0x02, 0x00, 0x00, 0x80, 0x00, 0x00 }},
-	{{"UnitOpen"},    { 0x03, 0x00, 0x00, 0x80, 0x07, 0x00 }},
-	{{"UnitClose"},   { 0x04, 0x00, 0x00, 0x80, 0x00, 0x00 }},
-	{{"Data"},        { 0x01, 0x00, 0x00, 0x00, 0x01, 0x00 }},
-	{{"Meta"}, 		  { 0x02, 0x00, 0x00, 0x00, 0x01, 0x00 }},
-	{{"TokenMeta"},	  { 0x00, 0x80, 0x02, 0x00, 0x50, 0x53, 0x52, 0x50 }},
-	{{"TokenData"},   { 0x00, 0x80, 0x02, 0x00, 0x54, 0x52, 0x54, 0x47 }},
-	{{"UnitType"},	  { 0x00, 0x00, 0x05, 0x00 }},
-	{{"ParCount"},	  { 0x00, 0x00, 0x06, 0x00 }},
-	{{"PseudoVal"},	  { 0x00, 0x80, 0x07, 0x00 }},   
-	{{"PseudoType"},  { 0x00, 0x80, 0x02, 0x00 }}
-};
-
-static std::map<uint16_t, string_or_ulong> globals;   //global settings from a patch-dump
-std::map<uint16_t, Dumpunit> units;  //ushort value for UnitKey
-uint16_t actualUnitKey = 0, actualSubunitKey = 0;
-static String logg ;   //the log while analyzing dump
-
-//helper for "patchSetAll()"
-//check key and following token, if in state "Structure"
-static THR30II_Settings::States checkKeyStructure(byte key[], byte * buf, int buf_len, uint16_t &pt)
-{
-	if (pt + 6 > buf_len - 8)  //if no following octet fits in the buffer
-	{
-		logg+="Error: Unexpected end of buffer while in Structure context!\n"; 
-		return THR30II_Settings::States::St_error;  //Stay in state Structure
-	}
-
-	byte next_octet[8];
-
-	memcpy(next_octet,buf+pt+6,8);  //Fetch following octet from buffer
-
-	if (memcmp(key, THR30II_Settings::tokens["Data"].data(),6)==0)
-	{
-		logg+="Token Data found. ";
-		if (memcmp(next_octet, THR30II_Settings::tokens["TokenData"].data(),8)==0)
-		{
-			logg+="Token Data complete. Data:\n\r";
-			pt += 8;
-			return THR30II_Settings::States::St_data;
-		}
-	}
-	else if (memcmp(key, THR30II_Settings::tokens["Meta"].data(),6)==0)
-	{
-		logg+="Token Meta found. ";
-		if (memcmp(next_octet, THR30II_Settings::tokens["TokenMeta"].data(),8)==0)
-		{
-			logg+="Token Meta complete. Global:\n\r";
-			pt += 8;
-			return THR30II_Settings::States::St_global;
-		}
-	}
-	logg+="--->Structure:\n";
-	return THR30II_Settings::States::St_structure;
-}
-
-//helper for "patchSetAll()"
-//check key, if in state "Data"
-THR30II_Settings::States checkKeyData(byte key[], byte * buf, int buf_len, uint16_t &pt)
-{
-	if (pt + 6 > buf_len)  //If no token follows (end of buffer)
-	{
-	  	logg+="Error: Unexpected end of buffer while in Data-Context!\n\r";
-		return THR30II_Settings::States::St_error;
-	}
-
-	if (memcmp(key,THR30II_Settings::tokens["UnitOpen"].data(),6)==0)
-	{
-		logg+="token UnitOpen found.  Unit:\n\r";
-		return THR30II_Settings::States::St_unit;
-	}
-	else if (memcmp(key, THR30II_Settings::tokens["StructClose"].data(),6)==0)  //This will perhaps never happen (Empty Data-Section)
-	{
-		logg+="Token StructClose found.  Idle:\n\r";
-		return THR30II_Settings::States::St_idle;
-	}
-	logg+="Data:\n\r";
-	return THR30II_Settings::States::St_data;
-}
-
-//helper for "patchSetAll()"
-//check key and eventually following token, if in state "Unit"
-THR30II_Settings::States checkKeyUnit(byte key[], byte* buf,int buf_len, uint16_t &pt)
-{
-	if (pt + 6 > buf_len)   //if buffer ends after this buffer
-	{
-		logg+="Error: Unexpected end of buffer while in a Unit!\n\r";
-		return THR30II_Settings::States::St_error;
-	}
-
-	if (memcmp(key, THR30II_Settings::tokens["UnitOpen"].data(),6)==0)
-	{
-		logg+="token UnitOpen found. State Subunit:\n\r";
-		return THR30II_Settings::States::St_subunit;
-	}
-	else if (memcmp(key+2, THR30II_Settings::tokens["UnitType"].data(),4)==0)
-	{
-		logg+="token UnitType found. ";
-		uint16_t unitKey = (uint16_t)(key[0] + 256 * key[1]);
-		if (pt + 6 > buf_len - 8)   //if no following octet fits in the buffer
-		{
-			logg+="Error: Unexpected end of buffer while in Unit "+String(unitKey) +" !\n\r";
-			return THR30II_Settings::States::St_error;
-		}
-		pt += 10;
-		uint16_t unitType = (uint16_t)(buf[pt] + 256 * buf[pt + 1]);
-		uint16_t parCount = (uint16_t)(buf[pt + 10] + 256 * buf[pt + 11]);
-
-		std::map<uint16_t, key_longval> emptyvals;
-		std::map<uint16_t, Dumpunit> emptysubUnits;
-
-		Dumpunit actualUnit =
-		{
-			unitType,
-			parCount,
-			emptyvals,      //values
-			emptysubUnits   //subUninits
-		};
-
-		units.emplace(std::pair<uint16_t,Dumpunit>(unitKey, actualUnit));  //store actual unit as a top level unit
-		pt += 8;
-
-		actualUnitKey = unitKey;
-		logg+="State ValuesUnit:\n\r";
-		return THR30II_Settings::States::St_valuesUnit;
-	}
-	else if (memcmp(key, THR30II_Settings::tokens["UnitClose"].data(),6)==0)
-	{
-		logg+="token UnitClose found. State Data:\n\r";
-		return THR30II_Settings::States::St_data;  //Should only happen at the end of last unit
-	}
-	logg+="State Error:\n\r";
-	return THR30II_Settings::States::St_error;
-}
-//helper for "patchSetAll()"
-//check key and eventually following token, if in state "SubUnit"
-THR30II_Settings::States checkKeySubunit(byte key[], byte *buf, int buf_len, uint16_t &pt)
-{
-	if (pt + 6 > buf_len)  //if buffer ends after this unit
-	{
-		logg+="Error: Unexpected end of buffer while in a SubUnit!\n\r";
-		return THR30II_Settings::States::St_error;
-	}
-
-	if (memcmp(key, THR30II_Settings::tokens["UnitOpen"].data(),6)==0)
-	{
-		logg+="token UnitOpen found.  State Error:\n\r";
-		return THR30II_Settings::States::St_error;  //no Sub-SubUnits possible
-	}
-	else if (memcmp(key+2, THR30II_Settings::tokens["UnitType"].data(), 4)==0)
-	{
-		logg+="token UnitType found. ";
-		uint16_t unitKey = (int16_t)(key[0] + 256 * key[1]);
-		if (pt + 6 > buf_len - 8)  //if no following octet fits in buffer
-		{
-			logg+="Error: Unexpected end of buffer while in SubUnit " + String(unitKey) + " !\n\r";
-			return THR30II_Settings::States::St_error;
-		}
-		pt += 10;
-		uint16_t unitType = (uint16_t)(buf[pt] + 256 * buf[pt + 1]);
-		uint16_t parCount = (uint16_t)(buf[pt + 10] + 256 * buf[pt + 11]);
-
-		std::map<uint16_t, key_longval> emptyVals;
-		std::map<uint16_t, Dumpunit> emptysubUnits;
-
-		Dumpunit actualSubunit 
-		{
-			unitType,
-			parCount,
-		    emptyVals,  //values 
-			emptysubUnits  //subUnits
-		};
-
-		units[actualUnitKey].subUnits.emplace(unitKey, actualSubunit);
-
-		pt += 8;
-		actualSubunitKey = unitKey;
-		logg+="State ValuesSubunit:\n\r";
-		return THR30II_Settings::States::St_valuesSubunit;
-	}
-	else if (memcmp(key, THR30II_Settings::tokens["UnitClose"].data(),6)==0)
-	{
-		logg+="token UnitClose found.  Unit:\n\r";
-		actualSubunitKey = 0xFFFF;  //Not in a subunit any more
-		return THR30II_Settings::States::St_unit;  //Should only happen at the end of last unit
-	}
-	logg+="Error: No allowed trigger in State SubUnit:\n\r";
-	return THR30II_Settings::States::St_error;
-}
-
-//get data, when in state "Global"
-//fetch one global setting from the patch dump (called several times, if there are several global values)
-static void getGlobal(byte * buf, int buf_len, uint16_t &pt)  
-{
-	uint16_t lfdNr = (uint16_t)buf[pt + 0] + 256 * (uint16_t)buf[pt + 1];
-
-	byte type = buf[pt + 4];  //get typ code for the global value
-
-	if (type == 0x04)  //string (the patch name)
-	{
-		byte len = buf[pt + 6];  //ignore 3 High Bytes, because string is always shorter than 255 
-		logg.append(String("found string of len ")+String((int)len)+String(" : "));
-
-		String name;
-
-		if (len > 0)
-		{
-			if (len > 64)
-			{
-			    char tmp[len];
-				memcpy(tmp,buf+pt+10,len-1)	;
-				name = String(tmp).substring(0,64);
-			}
-			else
-			{
-				char tmp[len];
-				memcpy(tmp,buf+pt+10,len-1);
-				name =  String(tmp);
-			}
-            logg.append(name + String("\n\r") );
-		}
-
-		globals.emplace(std::pair< uint16_t, string_or_ulong> ( lfdNr, (string_or_ulong){true, type, name, 0}) );
-
-		pt += (uint16_t)len + 4;
-	}
-	else if (type == 0x02 || type == 0x03)
-	{
-		globals.emplace(std::pair<uint16_t,string_or_ulong> ( lfdNr, 
-		                                                    (string_or_ulong) {false, type,
-															(uint32_t)buf[pt + 6] + ((uint32_t)buf[pt + 7] << 8)
-		                                                  + ((uint32_t)buf[pt + 8] << 16) + ((uint32_t)buf[pt + 9] << 24)} ));
-		pt += 4;
-	}
-	else
-	{
-		logg.append("unknown type code " +String(type) + " for global value!\n\r" );
-		pt += 4;
-	}
-	
-}
-
-//get data, when in state "Unit"
-//get one of the units' settings from the patch dump (called several times, if there are several values)
-THR30II_Settings::States getValueUnit(byte key[], byte * buf, int buf_len, uint16_t &pt) 
-{
-	if (memcmp(key, THR30II_Settings::tokens["UnitOpen"].data(),6)==0)
-	{
-		logg+="token UnitOpen found.  SubUnit:\n\r";
-		return THR30II_Settings::States::St_subunit;
-	}
-	else if (memcmp(key, THR30II_Settings::tokens["UnitClose"].data(),6)==0)
-	{
-		logg+="token UnitClose found. Data:\n\r";
-		return THR30II_Settings::States::St_data;
-	}
-	//No Open or Close => should be a value
-	
-	if(pt + 6 > buf_len - 4) //if no following quartet fits in the buffer
-	{
-		logg+="Error: Unexpected end of buffer while in ValueUnit context!\n\r"; 
-		return THR30II_Settings::States::St_error;  //Stay in state Structure
-	}
-	uint16_t parKey = (uint16_t)(key[0] + 256 * key[1]); //get the key for this value
-
-	byte type = buf[pt + 4];  //get the type key for the following 4-Byte-value
-	//get the 4-byte-value itself
-	uint32_t val = (uint32_t)(((uint32_t)buf[pt + 6]) + ((uint32_t)buf[pt + 7] << 8) + ((uint32_t)buf[pt + 8] << 16) + ((uint32_t)buf[pt + 9] << 24));
-	units[actualUnitKey].values.emplace(parKey, (key_longval) {type, val} );
-	pt += 4;
-	//Stay in context ValueUint to read further value(s)
-	logg+="ValuesUnit:\n\r";
-	return THR30II_Settings::States::St_valuesUnit;
-}
-
-//helper for "patchSetAll()" - checks, if there is a value in the current subUnti and extract this value (4-Byte)
-THR30II_Settings::States getValueSubunit(byte key[], byte* buf, int buf_len, uint16_t &pt)
-{
-	if (memcmp(key, THR30II_Settings::tokens["UnitOpen"].data(),6)==0)
-	{
-		logg+="token UnitOpen found.  Unit:\n\r";
-		return THR30II_Settings::States::St_error;  //No Sub-SubUnits possible
-	}
-	else if (memcmp(key, THR30II_Settings::tokens["UnitClose"].data(),6)==0)
-	{
-		logg+="token UnitClose in Subunit found.  Unit:\n\r";
-		actualSubunitKey = 0xFFFF;  // No Subunit any more
-		return THR30II_Settings::States::St_unit;
-	}
-	
-	//No Open or Close => should be a value
-	if(pt + 6 > buf_len - 4) //if no following quartet fits in the buffer
-	{
-		logg+="Error: Unexpected end of buffer while in ValueSubUnit context!\n\r"; 
-		return THR30II_Settings::States::St_error;  
-	}
-
-	uint16_t parKey = (uint16_t)(key[0] + 256 * key[1]); //get the key for this value
-	
-	byte type = buf[pt + 4];//get the type key for the following 4-Byte-value
-	//get the 4-byte-value itself
-	uint32_t val = (uint32_t)(((uint32_t)buf[pt + 6]) + ((uint32_t)buf[pt + 7] << 8) + ((uint32_t)buf[pt + 8] << 16) + ((uint32_t)buf[pt + 9] << 24));
-
-	units[actualUnitKey].subUnits[actualSubunitKey].values.emplace(parKey, (key_longval) {type, val});
-
-	pt += 4;
-	//Stay in context ValueSubUnit to read further value(s)
-	logg+="ValuesSubunit:\n\r";
-	return THR30II_Settings::States::St_valuesSubunit;
-}
-
-//extract all settings from a received dump. returns error code
-int THR30II_Settings::patch_setAll(uint8_t * buf, uint16_t buf_len)  
-{
-	uint16_t pt = 0; //index
-	_state=States::St_idle;
-	globals.clear();
-	units.clear();
-	actualUnitKey=0; actualSubunitKey=0;
-	
-	//Setting up a data structure to keep the retrieved dump data
-	logg=String();
-	//uint16_t patch_size = buf_len;
-	
-	//overwrite locally stored patch values with received buffer's data
-	
-	//Zustand "idle"
-	logg.append("Idle:\n\r");
-
-	while ((pt <= buf_len - 6) && _state!=St_error ) //walk through the patch data and look for token-sextetts
-	{
-		byte sextet[6];
-		memcpy(sextet, buf+pt, 6); //fetch token sextet from buffer
-		char tmp[36];
-		sprintf(tmp, "Byte %d of %d : %02X%02X%02X%02X%02X%02X : ",pt,buf_len, sextet[0],sextet[1],sextet[2],sextet[3],sextet[4],sextet[5]);
-		logg.append(tmp);
-		
-		if(_state == States::St_idle)
-		{
-			//From Idle-state we can reach the Structure-state, 
-			//if we send the corresponding key as a trigger.
-			if(memcmp(sextet, THR30II_Settings::tokens["StructOpen"].data(),6)==0)
-			{ 
-				//Reaches state "Structure"
-				logg.append("Structure:\n\r");					
-				_state=States::St_structure;
-				//_last_state=St_idle;
-			}
-		}
-		else if(_state== States::St_structure)
-		{
-			//Switching options from this state on
-			_state = checkKeyStructure(sextet,buf,buf_len, pt);
-			//_last_state=St_structure;
-		}
-		else if(_state== States::St_data)
-		{
-			//Switching options from this state on
-			_state = checkKeyData(sextet,buf,buf_len,pt);
-			//_last_state=St_data;
-		}
-		else if(_state== States::St_meta)
-		{
-			//Switching options from this state on
-			if(memcmp(sextet, THR30II_Settings::tokens["StructClose"].data(),6)==0)
-			{ 
-				//Reaches state "Idle"
-				logg.append("Idle:\n\r");
-				_state=St_idle;
-			}
-			else
-			{
-				//Reaches state "Global"
-				logg.append("Global:\n\r");
-				_state=St_global;
-			}
-			//_last_state= St_meta;
-		}
-		else if(_state==States::St_global)
-		{
-			//Switching options from this state on
-			if(memcmp(sextet, THR30II_Settings::tokens["StructClose"].data(),6)==0)
-			{
-				//Reaches state"Idle"
-				logg.append("Idle:\n\r");
-					_state=St_idle;
-			}
-			else
-			{ 
-				getGlobal(buf,buf_len, pt);
-				
-				//Reaches state "Global"
-				logg.append("Global:\n\r");
-				_state= St_global;
-			}
-			//_last_state=St_global;
-		}
-		else if(_state==States::St_unit)
-		{
-			//Switching options from this state on
-			_state=checkKeyUnit(sextet,buf,buf_len,pt);
-			//_last_state=St_unit;
-		}
-		else if(_state==States::St_valuesUnit )
-		{
-			//Switching options from this state on
-			_state=getValueUnit(sextet,buf,buf_len,pt);
-			//_last_state=St_valuesUnit;
-		}
-		else if(_state==States::St_subunit)
-		{
-			//Switching options from this state on
-			_state=checkKeySubunit(sextet,buf,buf_len,pt);
-			//_last_state=St_subunit;
-		}
-		else if (_state==States::St_valuesSubunit)
-		{
-			//Switching options from this state on
-			_state=getValueSubunit(sextet,buf,buf_len,pt);
-			//_last_state=St_valuesSubunit;
-		}
-		pt += 6; //advance in buffer
-	}
-
-	TRACE_THR30IIPEDAL(Serial.println("patch_setAll parsing ready - results: ");)
-	TRACE_V_THR30IIPEDAL(Serial.println(logg);)     
-	TRACE_THR30IIPEDAL(Serial.println("Setting the "+ String(globals.size())+" globals: ");)
-
-	//Walk through the globals (Structur Meta)
-	for( std::pair<uint16_t,string_or_ulong> kvp : globals)
-	{
-		if( kvp.first == 0x0000)
-		{
-			if (kvp.second.isString )
-			{
-				SetPatchName(kvp.second.nam,-1);
-			}
-		}
-		else if(kvp.first == 0x0001)
-		{
-			if (!kvp.second.isString) //int
-			{
-				Tnid = kvp.second.val;
-			}
-		}
-		if(kvp.first== 0x0002)
-		{
-			if (!kvp.second.isString)
-			{
-				UnknownGlobal = kvp.second.val;
-			}
-		}
-		if(kvp.first==  0x0003)
-		{
-			if (!kvp.second.isString )
-			{
-				ParTempo = kvp.second.val;
-			}
-		}
-	}
-
-	TRACE_THR30IIPEDAL(Serial.println("... setting unit vals: ");)
-	//Recurse through the whole data structure created while parsing the dump
-	
-	for (std::pair<uint16_t, Dumpunit> du : units)    //foreach!
-	{
-		if(du.first == THR30II_UNITS_VALS[GATE].key)  //Unit Gate also hosts MIX and Subunits COMP...REV
-		{
-			TRACE_V_THR30IIPEDAL(Serial.println("In dumpunit GATE/AMP");)
-
-			if (du.second.parCount != 0)
-			{
-				std::map<uint16_t, Dumpunit> &dict2 = du.second.subUnits;  //Get SubUnits of GATE/MIX
-
-				for (std::pair<uint16_t, Dumpunit> kvp : dict2)  //foreach
-				{
-					if(kvp.first== THR30II_UNITS_VALS[ECHO].key)   //If SubUnit "Echo"
-					{
-						TRACE_V_THR30IIPEDAL(Serial.println("In dumpSubUnit ECHO");)
-
-						//Before we set Parameters we have to select the Echo-Type
-						uint16_t t=kvp.second.type;
-
-						auto result = std::find_if(
-							THR30II_ECHO_TYPES_VALS.begin(),
-							THR30II_ECHO_TYPES_VALS.end(),
-							[t](const auto& mapobj) {return mapobj.second.key == t;}
-						);
-						if(result!=THR30II_ECHO_TYPES_VALS.end())
-						{
-							EchoSelect(result->first);
-						}
-						else  //Defaults to TAPE_ECHO
-						{
-							EchoSelect(THR30II_ECHO_TYPES::TAPE_ECHO);
-						}
-						for(std::pair<uint16_t, key_longval> p : kvp.second.values)     //Values contained in SubUnit "Echo"
-						{
-							uint16_t key = EchoMap(p.first);  //map the dump-keys to the MIDI-Keys 
-							EchoSetting(key, NumberToVal(p.second.val));
-						}
-					}
-					else if(kvp.first== THR30II_UNITS_VALS[EFFECT].key)   //If SubUnit "Effect"
-					{
-						TRACE_V_THR30IIPEDAL(Serial.println("In dumpSubUnit EFFECT");)
-
-						//Before we set Parameters we have to select the Effect-Type
-						uint16_t t=kvp.second.type;
-
-						auto result = std::find_if(
-							THR30II_EFF_TYPES_VALS.begin(),
-							THR30II_EFF_TYPES_VALS.end(),
-							[t](const auto& mapobj) {return mapobj.second.key == t;}
-						);
-						if(result!=THR30II_EFF_TYPES_VALS.end())
-						{
-							EffectSelect(result->first);
-						}
-						else  //Defaults to PHASER
-						{
-							EffectSelect(THR30II_EFF_TYPES::PHASER);
-						}
-
-						for(std::pair<uint16_t, key_longval> p : kvp.second.values)     //Values contained in SubUnit "Effect"
-						{
-							uint16_t key = EffectMap(p.first);  //map the dump-keys to the MIDI-Keys 
-							EffectSetting(key, NumberToVal(p.second.val));
-						}
-					}
-					else if(kvp.first== THR30II_UNITS_VALS[COMPRESSOR].key)   //If SubUnit "Compressor"
-					{
-						TRACE_V_THR30IIPEDAL(Serial.println("In dumpSubUnit COMPRESSOR");)
-
-						for(std::pair<uint16_t, key_longval> p :kvp.second.values)  //Values contained in SubUnit "Compressor"
-						{
-							uint16_t key = CompressorMap(p.first);   //map the dump-keys to the MIDI-Keys
-							//Find Setting for this key
-							auto result = std::find_if(
-								THR30II_COMP_VALS.begin(),
-								THR30II_COMP_VALS.end(),
-								[key](const auto& mapobj) {return mapobj.second == key;}
-							);
-							if(result!=THR30II_COMP_VALS.end())
-							{
-								CompressorSetting(result->first, NumberToVal(p.second.val) );
-							}
-							else  //Defaults to CO_SUSTAIN
-							{
-								CompressorSetting(CO_SUSTAIN, NumberToVal(p.second.val));
-							}
-						}
-					}
-					else if(kvp.first==THR30II_UNITS_VALS[THR30II_UNITS::REVERB].key)   //If SubUnit "Reverb"
-					{
-						TRACE_V_THR30IIPEDAL(Serial.println("In dumpSubUnit REVERB");)
-
-						//Before we set Parameters we have to select the Reverb-Type
-						uint16_t t=kvp.second.type;
-
-						auto result = std::find_if(
-							THR30II_REV_TYPES_VALS.begin(),
-							THR30II_REV_TYPES_VALS.end(),
-							[t](const auto& mapobj) {return mapobj.second.key == t;}
-						);
-						if(result!=THR30II_REV_TYPES_VALS.end())
-						{
-							ReverbSelect(result->first);
-						}
-						else  //Defaults to SPRING
-						{
-							ReverbSelect(SPRING);
-						}
-
-						for (std::pair<uint16_t, key_longval> p : kvp.second.values)     //Values contained in SubUnit "Reverb"
-						{
-							uint16_t key = ReverbMap(p.first);  //map the dump-keys to the MIDI-Keys 
-							ReverbSetting(key, NumberToVal(p.second.val));
-						}
-					}
-					else if(kvp.first== THR30II_UNITS_VALS[THR30II_UNITS::CONTROL].key)          //If SubUnit "Control/Amp"
-					{
-						TRACE_V_THR30IIPEDAL(Serial.println("In dumpSubUnit CTRL/AMP");)
-						setColAmp(kvp.second.type);
-						
-						for(std::pair<uint16_t, key_longval> p : kvp.second.values)     //Values contained in SubUnit "Amp"
-						{
-							uint16_t key = controlMap[p.first];   //map the dump-keys to the MIDI-Keys
-							
-							//Find Setting for this key
-							auto result = std::find_if(
-								THR30II_CTRL_VALS.begin(),
-								THR30II_CTRL_VALS.end(),
-								[key](const auto& mapobj) {return mapobj.second == key;}
-							);
-							double val=0.0;
-							if(result!=THR30II_CTRL_VALS.end())
-							{   
-								val=NumberToVal(p.second.val);
-							    TRACE_THR30IIPEDAL(Serial.printf("Setting main control %d = %.1f\n\r", ((std::_Rb_tree_iterator<std::pair<const THR30II_CTRL_SET,uint16_t>>) result)->first, val);)
-								SetControl(result->first, val);
-							}
-							else  //Defaults to  CTRL_GAIN
-							{
-								TRACE_THR30IIPEDAL(Serial.printf("Setting main control \"Gain\" (default) = %.1f\n\r", val);)
-								SetControl(THR30II_CTRL_SET::CTRL_GAIN, NumberToVal(p.second.val));
-							}
-						}
-					}
-				} //end of foreach kvp in dict2  (Subunits of GuitarProc (Gate) an their params)
-				
-				std::map<uint16_t, key_longval> &dict = du.second.values;  //Values -directly- contained in Unit GATE/MIX
-
-				for (std::pair<uint16_t, key_longval> kvp : dict)
-				{
-					if( unitOnMap[kvp.first] == THR30II_UNIT_ON_OFF_COMMANDS[EFFECT])
-					{
-						Switch_On_Off_Effect_Unit(kvp.second.val != 0);
-					}
-					else if( unitOnMap[kvp.first] == THR30II_UNIT_ON_OFF_COMMANDS[ECHO])
-					{ 
-						Switch_On_Off_Echo_Unit(kvp.second.val != 0);
-					}
-					else if( unitOnMap[kvp.first] == THR30II_UNIT_ON_OFF_COMMANDS[REVERB])
-					{
-						Switch_On_Off_Reverb_Unit(kvp.second.val != 0);
-					}
-					else if( unitOnMap[kvp.first] == THR30II_UNIT_ON_OFF_COMMANDS[COMPRESSOR])
-					{ 
-						Switch_On_Off_Compressor_Unit(kvp.second.val != 0);
-					}
-					else if( unitOnMap[kvp.first] == THR30II_UNIT_ON_OFF_COMMANDS[GATE])
-					{   
-						Switch_On_Off_Gate_Unit(kvp.second.val != 0);
-					}
-					else if(gateMap[kvp.first]== THR30II_GATE_VALS[GA_DECAY])
-					{
-						gate_setting[GA_DECAY] = NumberToVal(kvp.second.val);
-					}
-					else if(gateMap[kvp.first] == THR30II_GATE_VALS[GA_THRESHOLD])
-					{
-						gate_setting[GA_THRESHOLD] = NumberToVal_Threshold(kvp.second.val);
-					}
-					else if(reverbMap[kvp.first] == THR30II_INFO_REVERB[reverbtype]["MIX"].sk)
-					{   
-						ReverbSetting(reverbtype, reverbMap[kvp.first], NumberToVal(kvp.second.val));
-					}
-					else if(effectMap[kvp.first] == THR30II_INFO_EFFECT[effecttype]["MIX"].sk)
-					{
-						EffectSetting(effecttype, effectMap[kvp.first], NumberToVal(kvp.second.val));
-					}
-					else if(echoMap[kvp.first] == THR30II_INFO_ECHO[echotype]["MIX"].sk)
-					{
-						EchoSetting(echotype, echoMap[kvp.first], NumberToVal(kvp.second.val));
-					}
-					else if(compressorMap[kvp.first] == THR30II_COMP_VALS[CO_MIX])
-					{
-						CompressorSetting(CO_MIX, NumberToVal(kvp.second.val) );
-					}
-					else if(kvp.first == THR30II_CAB_COMMAND_DUMP)
-					{
-						SetCab((THR30II_CAB)kvp.second.val);
-					}
-					else if(kvp.first== Constants::glo["AmpEnableState"])//0x0120:   //AMP_EnableState (not used in patches to THRII)
-					{																 //But occurs in dumps from THRII to PC
-						TRACE_THR30IIPEDAL(Serial.printf("\"AmpEnableState\" %d.\n\r",kvp.second.val);)
-					}
-					
-				} // of for (each) kvp in dict
-
-			} //end of if count params !=0
-		} //end of if "Unit GATE" (contains COMP...REV as subunits)
-	} //end of foreach dumpunit
-
-	return 0; //success
-} //end of THR30II_settings::patch_setAll
-
-//following all the setters for locally stored THR30II-Settings class
-
-// void THR30II_Settings::SetAmp(uint8_t _amp)   //No separate setter necessary at the moment
-// {
-
-// }
-
-void THR30II_Settings::SetColAmp(THR30II_COL _col, THR30II_AMP _amp)  //Setter for the Simulation Collection / Amp
-{
-	// bool changed = false;
-	if (_col != col)
-	{
-		col = _col;
-		// changed = true;
-	}
-	if (_amp != amp)
-	{
-		amp = _amp;
-		// changed = true;
-	}
-	// if (changed)
-	// {
-	// 	if (sendChangestoTHR)
-	// 	{
-	// 		SendColAmp();
-	// 	}
-	// }
-}
-
-void THR30II_Settings::setColAmp(uint16_t ca)  //Setter by key
-{	
-	auto result = std::find_if(				//Lookup Key for this value
-          THR30IIAmpKeys.begin(),
-          THR30IIAmpKeys.end(),
-          [ca](const auto& mapobj) {return mapobj.second == ca; });
-
-	//RETURN VARIABLE IF FOUND
-	if(result != THR30IIAmpKeys.end())
-	{
-		col_amp foundkey = result->first;	
-		SetColAmp(foundkey.c, foundkey.a);
-	}
-}
-
-void THR30II_Settings::SetCab(THR30II_CAB _cab)  //Setter for the Cabinet Simulation
-{
-	cab = _cab;
-
-	if (sendChangestoTHR)
-	{
-		SendCab();
-	}
-}
-
-void THR30II_Settings::EchoSetting(uint16_t ctrl, double value)  //Setter for the Echo Parameters
-{
-	 EchoSetting(echotype, ctrl, value);  //using setter with actual selected echo type
-}
-
-void THR30II_Settings::EchoSetting(THR30II_ECHO_TYPES type, uint16_t ctrl, double value)  //Setter for the Echo Parameters
-{
-	switch(type)
-	{
-		case TAPE_ECHO:
-			THR30II_ECHO_SET_TAPE stt; //find setting by it's key
-			for(auto it= THR30II_INFO_TAPE.begin(); it!=THR30II_INFO_TAPE.end(); it++)
-			{
-				if(it->second.sk==ctrl)
-				{
-					stt=it->first;
-				}
-			} 
-			if (value >= THR30II_INFO_TAPE[stt].ll && value <= THR30II_INFO_TAPE[stt].ul)
-			{
-				echo_setting[TAPE_ECHO][stt] = value;  //all double values
-				// if(stt== TA_MIX) //Mix is identical for both types!
-				// {
-				// 	echo_setting[DIGITAL_DELAY][DD_MIX] = value;
-				// }
-
-				if (sendChangestoTHR)
-				{
-					SendParameterSetting( un_cmd {THR30II_INFO_TAPE[stt].uk, THR30II_INFO_TAPE[stt].sk} ,type_val<double> {0x04, value} );  //send settings change to THR
-				}
-			}
-			break;
-		case DIGITAL_DELAY:
-			THR30II_ECHO_SET_DIGI std; //find setting by it's key
-			for(auto it= THR30II_INFO_DIGI.begin(); it!=THR30II_INFO_DIGI.end(); it++)
-			{
-				if(it->second.sk==ctrl)
-				{
-					std=it->first;
-				}
-			}
-
-			if (value >= THR30II_INFO_DIGI[std].ll && value <= THR30II_INFO_DIGI[std].ul)
-			{
-				echo_setting[DIGITAL_DELAY][std] = value;  //all double values
-				// if (std == DD_MIX) //Mix is identical for both types!
-				// {
-				// 	echo_setting[TAPE_ECHO][TA_MIX] = value;
-				// }
-				if (sendChangestoTHR)
-				{
-					SendParameterSetting(un_cmd {THR30II_INFO_DIGI[std].uk, THR30II_INFO_DIGI[std].sk }, type_val<double> {0x04, value} );  //send settings change to THR
-				}
-			}
-			break;
-	}
-}
-
-void THR30II_Settings::GateSetting(THR30II_GATE ctrl, double value) //Setter for gate effect parameters
-{
-	gate_setting[ctrl] = constrain(value, 0, 100);
-
-	if (sendChangestoTHR)
-	{
-		SendParameterSetting((un_cmd){THR30II_UNITS_VALS[GATE].key, THR30II_GATE_VALS[ctrl]},(type_val<double>) {0x04, value});  //send reverb type change to THR
-	}
-}
-
-void THR30II_Settings::CompressorSetting(THR30II_COMP ctrl, double value)  //Setter for compressor effect parameters
-{
-	compressor_setting[ctrl] = constrain(value, 0, 100);
-
-	if (sendChangestoTHR)
-	{
-		if (ctrl == THR30II_COMP::CO_SUSTAIN)
-		{
-			SendParameterSetting((un_cmd){THR30II_UNITS_VALS[COMPRESSOR].key, THR30II_COMP_VALS[CO_SUSTAIN]}, (type_val<double>){0x04, value});  //send settings change to THR
-		}
-		else if (ctrl == THR30II_COMP::CO_LEVEL)
-		{
-			SendParameterSetting((un_cmd){THR30II_UNITS_VALS[COMPRESSOR].key, THR30II_COMP_VALS[CO_LEVEL]}, (type_val<double>){0x04, value});  //send settings change to THR
-		}
-		else if (ctrl == THR30II_COMP::CO_MIX)
-		{
-			SendParameterSetting((un_cmd){THR30II_UNITS_VALS[GATE].key, THR30II_COMP_VALS[CO_MIX]}, (type_val<double>){0x04, value});  //send settings change to THR
-		}
-	}
-}
-
-void THR30II_Settings::EffectSetting(uint16_t ctrl, double value) //using the internally selected actual effect type
-{
-		EffectSetting(effecttype, ctrl, value);
-}
-
-void THR30II_Settings::EffectSetting(THR30II_EFF_TYPES type, uint16_t ctrl, double value)  //Setter for Effect parameters by type and key
-{
-	switch (type)
-	{
-		case THR30II_EFF_TYPES::CHORUS:
-			
-				THR30II_EFF_SET_CHOR stc;   //find setting by it's key
-				for( auto it= THR30II_INFO_CHOR.begin(); it!=THR30II_INFO_CHOR.end(); it++)
-				{
-                       if(it->second.sk==ctrl)
-					   {
-						   stc= it->first;
-					   }
-				}
-
-				if (value >= THR30II_INFO_CHOR[stc].ll && value <= THR30II_INFO_CHOR[stc].ul)
-				{
-					effect_setting[CHORUS][stc] = value;  //all double values
-					// if(stc== CH_MIX)   //MIX is identical for all types!
-					// {
-					// 	effect_setting[FLANGER][FL_MIX] = value;
-					// 	effect_setting[PHASER][PH_MIX] = value;
-					// 	effect_setting[TREMOLO][TR_MIX] = value;
-					// }
-					if (sendChangestoTHR)     //do not send back, if change results from THR itself
-					{
-						SendParameterSetting( (un_cmd) { THR30II_INFO_CHOR[stc].uk, THR30II_INFO_CHOR[stc].sk}, (type_val<double>) {0x04, value});  //send settings change to THR
-					}
-				}
-	
-			break;
-
-		case THR30II_EFF_TYPES::FLANGER:
-
-				THR30II_EFF_SET_FLAN stf; //find setting by it's key
-				for( auto it= THR30II_INFO_FLAN.begin(); it!=THR30II_INFO_FLAN.end(); it++)
-				{
-                       if(it->second.sk==ctrl)
-					   {
-						   stf= it->first;
-					   }
-				}
-
-				if (value >= THR30II_INFO_FLAN[stf].ll && value <= THR30II_INFO_FLAN[stf].ul)
-				{
-					effect_setting[FLANGER][stf] = value;  //all double values
-					// if (stf == FL_MIX)   //MIX is identical for all types!
-					// {
-					// 	effect_setting[CHORUS][CH_MIX] = value;
-					// 	effect_setting[PHASER][PH_MIX] = value;
-					// 	effect_setting[TREMOLO][TR_MIX] = value;
-					// }					
-					if (sendChangestoTHR) //do not send back, if change results from THR itself
-					{
-						SendParameterSetting((un_cmd){THR30II_INFO_FLAN[stf].uk, THR30II_INFO_FLAN[stf].sk},(type_val<double>) {0x04, value});  //send settings change to THR
-					}
-				}
-
-			break;
-
-		case THR30II_EFF_TYPES::TREMOLO:
-
-			THR30II_EFF_SET_TREM stt ; //find setting by it's key
-			
-			for( auto it= THR30II_INFO_TREM.begin(); it!=THR30II_INFO_TREM.end(); it++)
-			{
-					if(it->second.sk==ctrl)
-					{
-						stt= it->first;
-					}
-			}
-			if (value >= THR30II_INFO_TREM[stt].ll && value <= THR30II_INFO_TREM[stt].ul)
-			{
-				effect_setting[TREMOLO][stt] = value;  //all double values
-				//  if (stt == TR_MIX)   //MIX is identical for all types!
-                //         {
-                //             effect_setting[FLANGER][FL_MIX] = value;
-                //             effect_setting[PHASER][PH_MIX] = value;
-                //             effect_setting[CHORUS][CH_MIX] = value;
-                //         }
-				if (sendChangestoTHR)  //do not send back, if change results from THR itself
-				{
-					SendParameterSetting((un_cmd){THR30II_INFO_TREM[stt].uk, THR30II_INFO_TREM[stt].sk},(type_val<double>) {0x04, value});  //send settings change to THR
-				}
-			}
-
-		break;
-		case THR30II_EFF_TYPES::PHASER:
-			THR30II_EFF_SET_PHAS stp ; //find setting by it's key
-			for( auto it= THR30II_INFO_PHAS.begin(); it!=THR30II_INFO_PHAS.end(); it++)
-			{
-					if(it->second.sk==ctrl)
-					{
-						stp= it->first;
-					}
-			}
-
-			if (value >= THR30II_INFO_PHAS[stp].ll && value <= THR30II_INFO_PHAS[stp].ul)
-			{
-				effect_setting[PHASER][stp] = value;  //all double values
-				// if (stp == PH_MIX)   //MIX is identical for all types!
-                //             {
-                //                 effect_setting[FLANGER][FL_MIX] = value;
-                //                 effect_setting[CHORUS][CH_MIX] = value;
-                //                 effect_setting[TREMOLO][TR_MIX] = value;
-                //             }
-				if (sendChangestoTHR)  //do not send back, if changes result from THR itself
-				{
-					SendParameterSetting((un_cmd){THR30II_INFO_PHAS[stp].uk, THR30II_INFO_PHAS[stp].sk},(type_val<double>) {0x04, value});  //send settings change to THR
-				}
-			}
-		break;
-	}
-}
-
-void THR30II_Settings::ReverbSetting(THR30II_REV_TYPES type, uint16_t ctrl, double value)
-{
-	switch (type)
-	{
-		case THR30II_REV_TYPES::SPRING:
-			THR30II_REV_SET_SPRI sts;  //find setting by it's key
-			for( auto it= THR30II_INFO_SPRI.begin(); it!=THR30II_INFO_SPRI.end(); it++)
-			{
-					if(it->second.sk==ctrl)
-					{
-						sts= it->first;
-					}
-			}
-
-			if (value >= THR30II_INFO_SPRI[sts].ll && value <= THR30II_INFO_SPRI[sts].ul)
-			{
-				reverb_setting[SPRING][sts] = value;  //all double values
-				//  if(sts== SP_MIX)   //MIX is identical for all types!
-                //             {
-                //                 reverb_setting[PLATE][PL_MIX] = value;
-                //                 reverb_setting[HALL][HA_MIX] = value;
-                //                 reverb_setting[ROOM][RO_MIX] = value;
-                //             }
-				if (sendChangestoTHR)
-				{
-					SendParameterSetting((un_cmd){THR30II_INFO_SPRI[sts].uk, THR30II_INFO_SPRI[sts].sk},(type_val<double>) {0x04, value});  //send settings change to THR
-				}
-			}
-			break;
-		case THR30II_REV_TYPES::PLATE:
-			THR30II_REV_SET_PLAT stp; //find setting by it's key
-			for( auto it= THR30II_INFO_PLAT.begin(); it!=THR30II_INFO_PLAT.end(); it++)
-			{
-					if(it->second.sk==ctrl)
-					{
-						stp= it->first;
-					}
-			}
-
-			if (value >= THR30II_INFO_PLAT[stp].ll && value <= THR30II_INFO_PLAT[stp].ul)
-			{
-				reverb_setting[PLATE][stp] = value;  //all double values
-				//  if (stp == PL_MIX)   //MIX is identical for all types!
-                //             {
-                //                 reverb_setting[SPRING][SP_MIX] = value;
-                //                 reverb_setting[HALL][HA_MIX] = value;
-                //                 reverb_setting[ROOM][RO_MIX] = value;
-                //             }
-				if (sendChangestoTHR)
-				{
-					SendParameterSetting((un_cmd){THR30II_INFO_PLAT[stp].uk, THR30II_INFO_PLAT[stp].sk}, (type_val<double>){0x04, value});  //send settings change to THR
-				}
-			}
-			break;
-		case THR30II_REV_TYPES::HALL:
-			THR30II_REV_SET_HALL sth; //find setting by it's key
-			for( auto it= THR30II_INFO_HALL.begin(); it!=THR30II_INFO_HALL.end(); it++)
-			{
-					if(it->second.sk==ctrl)
-					{
-						sth= it->first;
-					}
-			}
-
-			if (value >= THR30II_INFO_HALL[sth].ll && value <= THR30II_INFO_HALL[sth].ul)
-			{
-				reverb_setting[HALL][sth] = value;  //all double values
-				// if (sth == HA_MIX)   //MIX is identical for all types!
-				// {
-				// 	reverb_setting[SPRING][SP_MIX] = value;
-				// 	reverb_setting[PLATE][PL_MIX] = value;
-				// 	reverb_setting[ROOM][RO_MIX] = value;
-				// }
-				if (sendChangestoTHR)
-				{
-					SendParameterSetting((un_cmd){THR30II_INFO_HALL[sth].uk, THR30II_INFO_HALL[sth].sk},(type_val<double>) {0x04, value});  //send settings change to THR
-				}
-			}
-			break;
-		case THR30II_REV_TYPES::ROOM:
-			THR30II_REV_SET_ROOM str; //find setting by it's key
-			for( auto it= THR30II_INFO_ROOM.begin(); it!=THR30II_INFO_ROOM.end(); it++)
-			{
-					if(it->second.sk==ctrl)
-					{
-						str= it->first;
-					}
-			}
-			if (value >= THR30II_INFO_ROOM[str].ll && value <= THR30II_INFO_ROOM[str].ul)
-			{
-				reverb_setting[ROOM][str] = value;  //all double values
-				// if (str == RO_MIX)   //MIX is identical for all types!
-                //             {
-                //                 reverb_setting[SPRING][SP_MIX] = value;
-                //                 reverb_setting[PLATE][PL_MIX] = value;
-                //                 reverb_setting[HALL][HA_MIX] = value;
-                //             }
-				if (sendChangestoTHR)
-				{
-					SendParameterSetting((un_cmd){THR30II_INFO_ROOM[str].uk, THR30II_INFO_ROOM[str].sk},(type_val<double>) {0x04, value});  //send settings change to THR
-				}
-			}
-			break;
-	}
-}
-
-void THR30II_Settings::ReverbSetting(uint16_t ctrl, double value)  //using internally selected actual reverb type
-{
-	ReverbSetting(reverbtype, ctrl, value);  //use actual selected reverbtype
-}
-
-void THR30II_Settings::Switch_On_Off_Gate_Unit(bool state)   //Setter for switching on / off the effect unit
-{
-	unit[GATE] = state;
-
-	if (sendChangestoTHR)  //do not send back, if change results from THR itself
-	{
-		SendUnitState(GATE);
-	}
-}
-
-void THR30II_Settings::Switch_On_Off_Echo_Unit(bool state)   //Setter for switching on / off the Echo unit
-{
-	unit[ECHO] = state;
-
-	if (sendChangestoTHR)  //do not send back, if change results from THR itself
-	{
-		SendUnitState(ECHO);
-	}
-}
-
-void THR30II_Settings::Switch_On_Off_Effect_Unit(bool state)   //Setter for switching on / off the effect unit
-{
-	unit[EFFECT] = state;
+	#else
+	DeserializationError dse= deserializeJson(djd, patchesII[nr-1], DeserializationOption::Filter(PatchFilter(true)));	//patchesII is zero-indexed
+	#endif
+	uint32_t tp = micros() - t0;
+	TRACE_THR30IIPEDAL(Serial.printf("Fetch_patch(): #%d parsed in %lu us, JSON document %d bytes\n\r", nr, tp, (int) djd.memoryUsage());)
 
-	if (sendChangestoTHR)  //do not send back, if change results from THR itself
+	THR30II_Patch *pat = nullptr;
+	
+	if(dse==DeserializationError::Ok)
 	{
-		SendUnitState(EFFECT);
+		pat = &patch_cache.insert(nr);  //replaces the least recently used patch
+		if(!THR_Values.DecodePatch(djd, *pat))
+		{
+			patch_cache.erase(nr);
+			pat = nullptr;
+		}
 	}
-}
-
-void THR30II_Settings::Switch_On_Off_Compressor_Unit(bool state)  //Setter for switching on /off the compressor unit
-{
-	unit[COMPRESSOR] = state;
-
-	if (sendChangestoTHR) //do not send back, if change results from THR itself
+	else
 	{
-		SendUnitState(COMPRESSOR);
+		 TRACE_THR30IIPEDAL(Serial.print(F("Fetch_patch(): Error-Deserial "));Serial.println(dse.f_str());)
 	}
-}
-
-void THR30II_Settings::Switch_On_Off_Reverb_Unit(bool state)   //Setter for switching on / off the reverb unit
-{
-	unit[REVERB] = state;
 	
-	if (sendChangestoTHR)   //do not send back, if change results from THR itself
+	uint32_t t = micros() - t0;
+	if(t > patch_fetch_worst_us)
 	{
-		SendUnitState(REVERB);
+		patch_fetch_worst_us = t;
 	}
+	TRACE_THR30IIPEDAL(Serial.printf("Fetch_patch(): #%d decoded in %lu us (worst case %lu us, cache %lu hits / %lu misses)\n\r",
+	                                 nr, t, patch_fetch_worst_us, patch_cache.hits(), patch_cache.misses());)
+	return pat;
 }
 
-void THR30II_Settings::SetControl(uint8_t ctrl, double value)
+//The preselected patch and its neighbours (previous / next patch and bank of the active list) are decoded and their
+//upload frames rendered in idle time, one patch per loop pass. Submitting then only streams the prepared frames.
+//The preselected patch (staging) and the active patch are pinned in the cache, so Submit and toggling back are both instant.
+void prefetch_patches()
 {
-//    Serial.println("SetControl()");
-   control[ctrl]=value;
-   if (sendChangestoTHR)
-   {
-       SendParameterSetting( un_cmd {THR30II_UNITS_VALS[CONTROL].key,THR30II_CTRL_VALS[(THR30II_CTRL_SET)ctrl] },type_val<double> {0x04,value});
-   }
-}
+	static uint16_t targets[6] {};
+	static uint8_t count = 0;
+	static uint8_t next = 0;
+	static uint32_t context = 0;  //PatchContext() the targets were prepared for
 
-double THR30II_Settings::GetControl(uint8_t ctrl)
-{
-	return control[ctrl];
-}
+	patch_cache.pin(presel_patch_id > 0 ? presel_patch_id : 0, active_patch_id > 0 ? active_patch_id : 0);
 
-void THR30II_Settings::ReverbSelect(THR30II_REV_TYPES type)  //Setter for selection of the reverb type
-{
-	reverbtype = type;
-	
-	if (sendChangestoTHR)
+	if(presel_patch_id > 0 && Constants::glo.size() > 0 && context != THR_Values.PatchContext())  //frames of the targets are outdated
 	{
-		SendTypeSetting(REVERB, THR30II_REV_TYPES_VALS[type].key);  //send reverb type change to THR
+		context = THR_Values.PatchContext();
+		fetched_presel_id = -1;
 	}
 
-	//Todo: await Acknowledge
-}
-
-void THR30II_Settings::EffectSelect(THR30II_EFF_TYPES type)   //Setter for selection of the Effect type
-{
-	effecttype = type;
-	
-	if (sendChangestoTHR)  //do not send back, if change results from THR itself
+	if(presel_patch_id > 0 && presel_patch_id != fetched_presel_id && Constants::glo.size() > 0)  //a patch was preselected
 	{
-		SendTypeSetting(EFFECT, THR30II_EFF_TYPES_VALS[type].key);  //send effect type change to THR
+		fetched_presel_id = presel_patch_id;
+		uint16_t candidates[6] = { (uint16_t) presel_patch_id, (uint16_t) (active_patch_id > 0 ? active_patch_id : 0),
+		                           navigator.Step(presel_patch_id, 1), navigator.Step(presel_patch_id, -1),
+		                           navigator.Bank(presel_patch_id, 1), navigator.Bank(presel_patch_id, -1) };
+		count = 0;
+		next = 0;
+		for(uint16_t nr : candidates)  //most likely first, without doubles
+		{
+			if(nr > 0 && std::find(targets, targets + count, nr) == targets + count)
+			{
+				targets[count++] = nr;
+			}
+		}
 	}
 
-	//Todo: await Acknowledge
-}
-
-void THR30II_Settings::EchoSelect(THR30II_ECHO_TYPES type)   //Setter for selection of the Effect type
-{
-	echotype = type;
-	
-	if (sendChangestoTHR)  //do not send back, if change results from THR itself
+	if(next >= count || button_state != 0 || outqueue.item_count() > 0 || inqueue.item_count() > 0)  //MIDI and buttons first
 	{
-		SendTypeSetting(ECHO, THR30II_ECHO_TYPES_VALS[type].key);  //send echo type change to THR
+		return;
 	}
 
-	//Todo: await Acknowledge
-}
-
-THR30II_Settings::THR30II_Settings():patchNames( { "Actual", "UserSetting1", "UserSetting2", "UserSetting3", "UserSetting4", "UserSetting5" })  //Constructor
-{
-	dumpFrameNumber = 0; 
-	dumpByteCount = 0;  //received bytes
-	dumplen = 0;  //expected length in bytes
-    Firmware = 0x00000000;
-    ConnectedModel = 0x00000000; //FamilyID (2 Byte) + ModelNr.(2 Byte) , 0x0024_0002=THR30II
-	unit[EFFECT]=false;unit[ECHO]=false;unit[REVERB]=false;unit[COMPRESSOR]=false;unit[GATE]=false;
-}
-
-void THR30II_Settings::SetPatchName(String nam, int nr)  //nr = -1 as default for actual patchname
-{														 //corresponds to field "activeUserSetting"
-	TRACE_THR30IIPEDAL(Serial.println(String("SetPatchName(): Patchnname: ") + nam + String(" nr: ") + String(nr) );)
-	
-	nr = constrain(nr, 0, 5);  //make 0 based index for array patchNames[]
-
-	patchNames[nr] = nam.length()>64?nam.substring(0,64):nam; //cut, if necessary
-
-	if (sendChangestoTHR)
+	uint16_t nr = targets[next++];
+	uint32_t t0 = micros();
+	const THR30II_Patch *pat = fetch_patch(nr);
+	PatchFrames *pf = patch_cache.frames(nr);
+	bool rendered = false;
+	if(pat != nullptr && pf != nullptr && (pf->count == 0 || pf->context != THR_Values.PatchContext()))
 	{
-		CreateNamePatch();
+		rendered = THR_Values.PrerenderPatch(*pat, *pf);
 	}
+	TRACE_THR30IIPEDAL(Serial.printf("Prefetch_patches(): #%d %s in %lu us\n\r", nr, rendered ? "frames rendered" : "ready", micros() - t0);)
 }
 
-//---------METHOD FOR UPLOADING PATCHNAME TO THR30II -----------------
-
-void THR30II_Settings::CreateNamePatch() //fill send buffer with just setting for actual patchname, creating a valid SysEx for sending to THR30II  
-{                             //uses same algorithm as CreatePatch() - but will only be  o n e  frame!
-	//1.) Make the data buffer (structure and values) store the length.
-	//    Add 12 to get the 2nd length-field for the header. Add 8 to get the 1st length field for the header.
-	//2.) Cut it to slices with 0x0d02 (210 dez.) bytes (gets the payload of the frames)
-	//    These frames will thus not have incomplete 8/7 groups after bitbucketing but total frame length is 253 (just below the possible 255 bytes).
-	//    The remaining bytes will build the last frame (perhaps with last 8/7 group incomplete)
-	//    Store the length of the last slice (all others are fixed 210 bytes  long.)
-	//3.) Create the header:
-	//    SysExStart:  f0 00 01 0c 24 02 4d (always the same)
-	//                 01   (memory command, not settings command)
-	//                 Get actual counter for memory frames and append it here
-	//                 00 01 0b  ("same frame counter" and payload size  for the header)
-	//                 hang following 4-Byte values together:
-	//
-	//                 0d 00 00 00   (Opcode for memory write/send)
-	//                 (len +8+12)   (1st length field = total length= data length + 3 values + type field/netto length )
-	//                 FF FF FF FF   (user patch number to overwrite/ 0xFFFFFFFF for actual patch)
-	//                 (len   +12)   (2nd length field = netto length= data length + the following 3 values)
-	//                 00 00 00 00   (always the same, kind of opcode?)
-	//                 01 00 00 00   (always the same, kind of opcode?)
-	//                 00 00 00 00   (always the same, kind of opcode?)
-	//
-	//                 Bitbucket this group (gives no incomplete 8/7 group!)
-	//                 and append it to the header
-	//                 finish header with 0xF7
-	//                 Header frame may already be sent out!
-	//4.)              For each slice:
-	//                 Bitbucket encode the slice
-	//                 Build frame:
-	//                 f0 00 01 0c 24 02 4d(always the same)
-	//                 01   (memory command, not settings command)
-	//                 Get actual counter for memory frames and append it here
-	//                 append same frame counter (is the slice counter) as a byte
-	//                 0d 01  (except for last frame, where we use it's stored length before bitbucketing)
-	//                 bitbucketed data for this slice
-	//                 0xF7
-	//                 Send it out.
-
-	TRACE_V_THR30IIPEDAL(Serial.println(F("Create_Name_Patch(): "));)
-	
-	std::array<byte,300> dat;
-	auto datlast =dat.begin();  //iterator to last element (starts on begin! )
-	std::array<byte,300> sb;
-	auto sblast = sb.begin();   //iterator to last element (starts on begin! )
-	std::array<byte,300> sb2;
-	auto sb2last = sb2.begin();  //iterator to last element (starts on begin! )
-
-	std::array<byte,4> toInsert4;
-	std::array<byte,6> toInsert6;
-
-	#define datback(x)  for(const byte &b : x ) { *datlast++ = b; };
-	
-	//Macro for converting a 32-Bit value to a 4-byte array<byte,4> and append it to "dat"
-	#define conbyt4(x) toInsert4={ (byte)(x), (byte) ((x)>>8), (byte)((x)>>16) , (byte) ((x)>>24) };  datlast= std::copy( std::begin(toInsert4), std::end(toInsert4), datlast ); 
-	//Macro for appending a 16-Bit value to "dat"
-	#define conbyt2(x) *datlast++=(byte)(x); *datlast++= (byte)((x)>>8); 
-	
-	//1.) Make the data buffer (structure and values)
-
-	datback( tokens["StructOpen"] );
-	//Meta
-	datback(tokens["Meta"] ) ;          
-	datback(tokens["TokenMeta"] );
-	toInsert6= { 0x00, 0x00, 0x00, 0x00, 0x04, 0x00 };
-	datlast=std::copy( std::begin(toInsert6),std::end(toInsert6),datlast) ;    //number 0x0000, type 0x00040000 (String)
-	
-	conbyt4(  patchNames[0].length() + 1 ) // Length of patchname (incl. '\0')
-		//32Bit-Value (little endian; low byte first) 
-	
-	std::string nam =patchNames[0u].c_str();
-	datback( nam ); //copy the patchName  //!!ZWEZWE!! mind UTF-8 ?
-	*datlast++='\0'; //append  '\0' to the patchname
-	
-	datback(tokens["StructClose"]); //close Structure Meta
-	
-	//print whole buffer as a chain of HEX
-	TRACE_V_THR30IIPEDAL( Serial.printf("\n\rRaw frame before slicing/enbucketing:\n\r"); hexdump(dat,datlast-dat.begin());)
-
-	//    Now store the length.
-	//    Add 12 to get the 2nd length-field for the header. Add 8 to get the 1st length field for the header.
-	uint32_t datalen = (uint32_t) (datlast-dat.begin());
-	
-	//2.) cut to slices
-	uint32_t lengthfield2 = datalen + 12;
-	uint32_t lengthfield1 = datalen + 20;
-
-	int numslices = (int)datalen / 210; //number of 210-byte slices
-	int lastlen = (int)datalen % 210; //data left for last frame containing the rest
-	TRACE_V_THR30IIPEDAL(Serial.print("Datalen: "); Serial.println(datalen);)
-	TRACE_V_THR30IIPEDAL(Serial.print("Number of slices: "); Serial.println(numslices);)
-	TRACE_V_THR30IIPEDAL(Serial.print("Length of last slice: "); Serial.println(lastlen);)
-
-	//3.) Create the header:
-	//    SysExStart:  f0 00 01 0c 22 02 4d (always the same)
-	//                 01   (memory command, not settings command)
-	//                 put following 4-Byte values together:
-	//
-	//                 0d 00 00 00   (Opcode for memory write/send)
-	
-	//Macro for converting a 32-Bit value to a 4-byte vector<byte,4> and append it to "sb"
-	#define conbyt4s(x) toInsert4={ (byte)(x), (byte) ((x)>>8), (byte)((x)>>16) , (byte) ((x)>>24) };  sblast= std::copy( std::begin(toInsert4), std::end(toInsert4), sblast ); 
-	//sblast starts at sb.begin()
-	conbyt4s(0x0du);
-	//                 (len +8+12)   (1st length field = total length= data length + 3 values + type field/netto length )
-	conbyt4s(lengthfield1);
-	//                 FF FF FF FF   (number of user patch to overwrite / 0xFFFFFFFF for actual patch)
-	conbyt4s(0xFFFFFFFFu);
-	//                 (len   +12)   (2nd length field = netto length= data length + the following 3 values)
-	conbyt4s(lengthfield2);
-	//                 00 00 00 00   (always the same, kind of opcode?)
-	conbyt4s(0x0u);
-	//                 01 00 00 00   (always the same, kind of opcode?)
-	conbyt4s(0x1u);
-	//                 00 00 00 00   (always the same, kind of opcode?)
-	conbyt4s(0x0u);
-	//
-	//Bitbucket this group (gives no incomplete 8/7 group!)
-	sb2last = Enbucket(sb2,sb,sblast); 
-	//                 and append it to the header
-	//                 finish header with 0xF7
-	//                 Header frame may already be sent out!
-	byte memframecnt = 0x06;
-	//                 Get actual counter for memory frames and append it here
-
-	//                 00 01 0b  ("same frame counter" and payload size  for the header)
-	sblast=sb.begin(); //start the buffer to send
-	
-	std::array<byte,12> toInsert;
-	toInsert=std::array<byte,12>({ 0xf0, 0x00, 0x01, 0x0c, 0x24, 0x02, 0x4d, 0x01, memframecnt++, 0x00, 0x01, 0x0b });
-	sblast= std::copy( toInsert.begin(),toInsert.end(),sb.begin());
-	sblast= std::copy( sb2.begin(), sb2last, sblast);
-
-	*sblast++=0xF7; //SysEx end demarkation
-
-	SysExMessage m ( sb.data(),sblast -sb.begin() );
-	Outmessage om (m, 100, false, false);  //no Ack, no answer for the header 
-	outqueue.enqueue(om);  //send header to THRxxII
-
-	//4.)              For each slice:
-	//                 Bitbucket encode the slice
-	
-	for (int i = 0; i < numslices; i++)
-	{
-		std::array<byte,210> slice;
-		std::copy(dat.begin() + i*210, dat.begin() + i*210 +210, slice.begin() ) ;
-		sb2last=Enbucket(sb2, slice, slice.end());
-		sblast=sb.begin(); //start new buffer to send
-		//toInsert=  { 0xF0, 0x00, 0x01, 0x0c, 0x24, 0x02, 0x4d, 0x01, memframecnt++, (byte)(i % 128), 0x0d, 0x01 };
-		toInsert=  { 0xF0, 0x00, 0x01, 0x0c, 0x24, 0x02, 0x4d, 0x01, memframecnt, (byte)(i % 128), 0x0d, 0x01 };  //memframecount is not incremented inside sent patches
-		sblast=std::copy(toInsert.begin(), toInsert.end(), sblast );
-		sblast=std::copy( sb2.begin(),sb2last, sblast );
-		*sblast++=0xF7;
-		//print whole buffer as a chain of HEX
-		TRACE_V_THR30IIPEDAL(Serial.printf("\n\rFrame %d to send in \"Create_Name_Patch\":\n\r",i);
-				hexdump(sb,sblast-sb.begin());
-		)
-		m = SysExMessage(sb.data(), sblast -sb.begin() );
-		om = Outmessage(m, (uint16_t)(101 + i), false, false);  //no Ack, for all the other slices 
-		outqueue.enqueue(om);  //send slice to THRxxII
-	}
-
-	if (lastlen > 0) //last slice (could be the first, if it is the only one)
+//Writes library patches into THR's user presets "1".."5" (see SlotSync), one step per loop pass:
+//the next slot is rendered while the frames of the previous one are still streaming, its frames are queued as soon as
+//the out queue has room for them. The readback requests are queued behind the last upload.
+void sync_user_slots()
+{
+	if(!slot_sync.busy())
 	{
-		std::array<byte,210> slice;  //here 210 is a maximum size, not the true element count
-		byte *slicelast=slice.begin();
-		slicelast=std::copy(dat.begin() + numslices * 210, dat.begin() + numslices * 210 + lastlen, slicelast);
-	
-		sb2last=Enbucket(sb2, slice,slicelast);
-
-		sblast=sb.begin(); //start new buffer to send
-		toInsert={ 0xF0, 0x00, 0x01, 0x0c, 0x24, 0x02, 0x4d, 0x01, memframecnt++, (byte)((numslices) % 128), (byte)((lastlen - 1) / 16), (byte)((lastlen - 1) % 16) }; 
-		sblast = std::copy(toInsert.begin(),toInsert.end(),sblast);
-		sblast= std::copy(sb2.begin(),sb2last,sblast);
-		*sblast++=0xF7;
-		//print whole buffer as a chain of HEX
-		TRACE_V_THR30IIPEDAL(Serial.println(F("\n\rLast frame to send in \"Create_Name_Patch\":"));
-				hexdump(sb,sblast-sb.begin());
-		)
-		m =  SysExMessage(sb.data(),sblast-sb.begin());
-		om = Outmessage(m, (uint16_t)(101 + numslices), true, false);  //Ack, but no answer for the header 
-		outqueue.enqueue(om);  //send last slice to THRxxII
+		return;
 	}
-	
-	TRACE_THR30IIPEDAL(Serial.println(F("\n\rCreate_Name_patch(): Ready outsending."));)
-
-	// Now we have to await acknowledgment for the last frame
-
-	// on_ack_queue.enqueue(std::make_tuple(101+numslices,Outmessage(SysExMessage((const byte[29]) { 0xf0, 0x00, 0x01, 0x0c, 0x24, 0x02, 0x4d, 0x01, 0x02, 0x00, 0x00, 0x0b, 0x00, 0x0c, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x3c, 0x00, 0x7f, 0x7f, 0x7f, 0x7f, 0x00, 0x00, 0xf7 },29), 
-	//                      101+numslices+1, false, true),nullptr,false)); //answer will be the settings dump for actual settings
 
-    // Summary of what we did just now:
-	//                 Building the SysEx frame:
-	//                 f0 00 01 0c 22 02 4d(always the same)
-	//                 01   (memory command, not a settings command)
-	//                 Get actual counter for memory frames and append it here
-	//                 append same frame counter (is the slice counter) as a byte
-	//                 set length field to  0d 01  (except for last frame, where we use it's stored length before bitbucketing)
-	//                 append "bitbucketed" data for this slice
-	//                 finish with 0xF7
-	//                 Send it out.
-
-
-
-}
-
-
-String THR30II_Settings::getPatchName()
-{
-   return patchNames[constrain(activeUserSetting,0,5)];
-}
-
-//Find the correct (col, amp)-struct object for this ampkey
-col_amp THR30IIAmpKey_ToColAmp(uint16_t ampkey)
-{ 
-
-	for (auto it = THR30IIAmpKeys.begin(); it != THR30IIAmpKeys.end(); ++it)
+	int8_t slot = slot_sync.NextUpload();
+	if(slot >= 0)
 	{
-		if (it->second == ampkey)
+		if(slot_frames.count == 0)  //render the next slot
 		{
-			return (col_amp) (it->first);
+			uint32_t t0 = micros();
+			uint32_t digest = 0;
+			const THR30II_Patch *pat = fetch_patch(slot_sync.patch(slot));
+			if(pat == nullptr || !THR_Values.RenderSlotPatch(*pat, slot, slot_frames, digest))
+			{
+				TRACE_THR30IIPEDAL(Serial.printf("Sync_user_slots(): patch #%u can not be written into slot %d\n\r", slot_sync.patch(slot), slot + 1);)
+				slot_frames.count = 0;
+				slot_sync.Failed(slot);
+				return;
+			}
+			uint32_t bytes = 0;
+			for(uint8_t i = 0; i < slot_frames.count; i++)
+			{
+				bytes += slot_frames.len[i];
+			}
+			slot_sync.Rendered(slot, digest, bytes);
+			TRACE_THR30IIPEDAL(Serial.printf("Sync_user_slots(): slot %d rendered in %lu us\n\r", slot + 1, micros() - t0);)
+			return;
 		}
-	}
-	return col_amp{CLASSIC,CLEAN};
-}
-
-//---------FUNCTION FOR SENDING COL/AMP SETTING TO THR30II -----------------
-void THR30II_Settings::SendColAmp() //Send COLLLECTION/AMP setting to THR
-{
-		uint16_t ak = THR30IIAmpKeys[(col_amp){col, amp}];
-		SendTypeSetting(THR30II_UNITS::CONTROL, ak);
-}
-
-//---------FUNCTION FOR SENDING CAB SETTING TO THR30II -----------------
-void THR30II_Settings::SendCab() //Send cabinet setting to THR
-{
-	SendParameterSetting((un_cmd) {THR30II_UNITS_VALS[THR30II_UNITS::GATE].key, THR30II_CAB_COMMAND},  (type_val<uint16_t>) {0x02, (uint16_t)cab} );
-}
 
-//---------FUNCTION FOR SENDING UNIT STATE TO THR30II -----------------
-void THR30II_Settings::SendUnitState(THR30II_UNITS un) //Send unit state setting to THR30II
-{
-	type_val<uint16_t> tmp = {(byte){0x03}, unit[un] };
-	SendParameterSetting((un_cmd) {THR30II_UNITS_VALS[THR30II_UNITS::GATE].key, THR30II_UNIT_ON_OFF_COMMANDS[un]},tmp);
-}
-
-//---------FUNCTIONS FOR SENDING SETTINGS CHANGES TO THR30II -----------------
-
-void THR30II_Settings::SendTypeSetting(THR30II_UNITS unit, uint16_t val) //Send setting to THR (Col/Amp or Reverbtype or Effecttype)
-{
-	//This method is not really necessary for the THR30II-Pedal
-	//We need it on the PC where we can change settings separately
-	//
-	//Because with the the pedal settings are changed all together with complete MIDI-patches 
-	//Perhaps for future use: If knobs for switching on/off the units are added?
- /*
-	if (!MIDI_Activated)
-		return;
-
-	byte[] raw_msg_body = new byte[8]; //2 Ints:  Unit + Val
-	byte[] raw_msg_head = new byte[8]; //2 Ints:  Opcode + Len(Body)
-	raw_msg_head[0] = 0x08;   //Opcode for unit type change
-	raw_msg_head[4] = (byte)raw_msg_body.Length;  //Length of the body
-
-	ushort key = THR30II_UNITS_VALS[unit].key;
-
-	raw_msg_body[0] = (byte)(key % 256);
-	raw_msg_body[1] = (byte)(key / 256);
-	raw_msg_body[4] = (byte)(val % 256);
-	raw_msg_body[5] = (byte)(val / 256);
-
-	//Prepare Message-Body
-	byte[] msg_body = Helpers.Enbucket(raw_msg_body);
-	byte[] sendbuf_body = new byte[PC_SYSEX_BEGIN.Length + 2 + 3 + msg_body.Length + 1];  //for "00" and frame-counter; 3 for Length-Field, 1 for "F7"
-
-	Buffer.BlockCopy(PC_SYSEX_BEGIN, 0, sendbuf_body, 0, PC_SYSEX_BEGIN.Length);
-	sendbuf_body[PC_SYSEX_BEGIN.Length] = 0x00;
-	sendbuf_body[PC_SYSEX_BEGIN.Length + 2] = 0x00;  //only one frame in this message
-	sendbuf_body[PC_SYSEX_BEGIN.Length + 3] = (byte)((raw_msg_body.Length - 1) / 16);  //Length Field (Hi)
-	sendbuf_body[PC_SYSEX_BEGIN.Length + 4] = (byte)((raw_msg_body.Length - 1) % 16); //Length Field (Low)
-	Buffer.BlockCopy(msg_body, 0, sendbuf_body, PC_SYSEX_BEGIN.Length + 5, msg_body.Length);
-	sendbuf_body[sendbuf_body.GetUpperBound(0)] = SYSEX_STOP;
-
-	//Prepare Message-Header
-	byte[] msg_head = Helpers.Enbucket(raw_msg_head);
-	byte[] sendbuf_head = new byte[PC_SYSEX_BEGIN.Length + 2 + 3 + msg_head.Length + 1];
-
-	Buffer.BlockCopy(PC_SYSEX_BEGIN, 0, sendbuf_head, 0, PC_SYSEX_BEGIN.Length);
-	sendbuf_head[PC_SYSEX_BEGIN.Length] = 0x00;
-	sendbuf_head[PC_SYSEX_BEGIN.Length + 2] = 0x00;  //only one frame in this message
-	sendbuf_head[PC_SYSEX_BEGIN.Length + 3] = (byte)((raw_msg_head.Length - 1) / 16);  //Length Field (Hi)
-	sendbuf_head[PC_SYSEX_BEGIN.Length + 4] = (byte)((raw_msg_head.Length - 1) % 16); //Length Field (Low)
-	Buffer.BlockCopy(msg_head, 0, sendbuf_head, PC_SYSEX_BEGIN.Length + 5, msg_head.Length);
-	sendbuf_head[sendbuf_head.GetUpperBound(0)] = SYSEX_STOP;
-
-	if (THR10_Editor.THR10_Settings.O_device == null)
-	{
+		if(outqueue.maxQueueSize() - outqueue.item_count() < slot_frames.count)  //queue it, when the previous frames are out
+		{
+			return;
+		}
+		queueMemoryWrite(slot_frames, SlotSync::UploadId(slot, 0));
+		slot_frames.count = 0;
+		slot_sync.Queued(slot);
 		return;
 	}
-	if (!THR10_Editor.THR10_Settings.O_device.IsOpen)
-	{
-		THR10_Editor.THR10_Settings.O_device?.Open();
-	}
-	sendbuf_head[PC_SYSEX_BEGIN.Length + 1] = THR30II_Window.SysExSendCounter++;
-	THR10_Editor.THR10_Settings.O_device?.Send(new SysExMessage(sendbuf_head));
-	sendbuf_body[PC_SYSEX_BEGIN.Length + 1] = THR30II_Window.SysExSendCounter++;
-	THR10_Editor.THR10_Settings.O_device?.Send(new SysExMessage(sendbuf_body));
 
-	if (THR10_Editor.THR10_Settings.O_device.IsOpen)
+	slot = slot_sync.NextReadback();
+	if(slot >= 0 && outqueue.item_count() < outqueue.maxQueueSize())
 	{
-		THR10_Editor.THR10_Settings.O_device.Close();
+		outqueue.enqueue(Outmessage(SlotSync::ReadbackRequest(slot), (uint16_t)(SYNC_READBACK_ID + slot), false, true));  //answer will be the dump of the preset
+		slot_sync.ReadbackQueued(slot);
 	}
+}
 
-	//ToDO:  Set Wait for ACK
- */
+void slot_verified(uint8_t slot, uint32_t digest)  //readback dump of a user preset arrived (see ParseSysEx())
+{
+	slot_sync.Verified(slot, digest);
+	maskUpdate = true;
 }
 
-String THR30II_Settings::THR30II_MODEL_NAME()
+void send_patch(uint16_t patch_id)  //Send a patch from preset library to THRxxII
 { 
-	switch(ConnectedModel) 
+	uint32_t t0 = micros();
+	const THR30II_Patch *pat = fetch_patch(patch_id);
+	switch_latency.Mark(LAT_DECODE);
+	
+	if(pat != nullptr)
+	{
+		TRACE_THR30IIPEDAL( Serial.print(F("Send_patch(): We fetched patch: "));)
+		TRACE_THR30IIPEDAL( Serial.println(pat->name);)
+		//Here we must copy values to local THRII-Settings and send them to THRII
+		PatchFrames *pf = patch_cache.frames(patch_id);
+		bool prepared = pf != nullptr && pf->count > 0 && pf->context == THR_Values.PatchContext();
+		THR_Values.ApplyPatch(*pat, pf); //set all local fields from the decoded patch, stream the cached frames
+		switch_latency.Mark(LAT_BUILD);
+
+		uint32_t t = micros() - t0;
+		patch_submits++;
+		patch_submits_ready += prepared ? 1 : 0;
+		patch_switch_worst_us = std::max(patch_switch_worst_us, t);
+		TRACE_THR30IIPEDAL(Serial.printf("Send_patch(): #%d all frames queued %lu us after activation (%s), prefetch hits %lu of %lu, worst %lu us.\n\r",
+		                                 patch_id, t, prepared ? "cached frames" : "frames rendered", patch_submits_ready, patch_submits, patch_switch_worst_us);)
+	}
+	else
 	{
-		case 0x00240002:
-			return String("THR30II");
-			break;
-		
-		case 0x00240001:
-			return String("THR10II");
-			break;
-		default:
-			return String( "None");
-		break;
+		 THR_Values.SetPatchName("error",-1);  //-1 = actual settings
+		 TRACE_THR30IIPEDAL(Serial.println(F("Send_patch(): Error fetching patch"));)
 	}
-}
-
-ArduinoQueue<Outmessage> outqueue(30);  //FIFO Queue for outgoing SysEx-Messages to THRII
+	
+} //End of send_patch()
 
 //Messages, that have to be sent out,
 // and flags to change, if an awaited acknowledge comes in (adressed by their ID)
@@ -3760,8 +2063,8 @@ void drawPatchID(uint16_t fgcolour, int patchID) {
 
 void drawPatchIconBank(int presel_patch_id, int active_patch_id) {
 	uint16_t iconcolour = 0;
-	int banksize = 5;
-	int first = ((presel_patch_id-1)/banksize)*banksize+1;  // find number for 1st icon in row
+	uint16_t icons[NAV_ICONS];
+	navigator.Window(presel_patch_id, icons);  // the part of the pre-selected patch's bank, that fits on the display
 	
 	switch(_uistate) {
 		case UI_home_amp:
@@ -3788,8 +2091,9 @@ void drawPatchIconBank(int presel_patch_id, int active_patch_id) {
 		break;
 		
 		case UI_home_patch:
-			for (int i = first; i < first+banksize; i++)
+			for (int k = 0; k < NAV_ICONS; k++)
 			{
+				int i = icons[k];
 				if (i == active_patch_id)
 				{
 					iconcolour = TFT_THRCREAM;  // highlight active patch icon
@@ -3802,11 +2106,11 @@ void drawPatchIconBank(int presel_patch_id, int active_patch_id) {
 				{
 					iconcolour = TFT_THRBROWN;  // colour for unselected patch icons
 				}
-				if (i > npatches)
+				if (i == 0 || i > npatches)
 				{
 					iconcolour = TFT_BLACK;
 				}
-				drawPatchIcon(60+20*(i-first+1), 0, 20, 20, iconcolour, i);
+				drawPatchIcon(60+20*(k+1), 0, 20, 20, iconcolour, i);
 			}
 		break;
 
@@ -3894,6 +2198,54 @@ void drawPatchName(uint16_t fgcolour, String patchname) {
   spr.deleteSprite();
 }
 
+void drawLatencyScreen() {
+  //title: number of measured switches (and lost ones)
+  String title = "Latency n=" + String(switch_latency.count());
+  if (switch_latency.timeouts() > 0) {
+    title += " (" + String(switch_latency.timeouts()) + " lost)";
+  }
+  if (slot_sync.busy()) {  //user preset sync instead (its result until the histograms are reset)
+    uint8_t done = slot_sync.count(SLOT_OK) + slot_sync.count(SLOT_MISMATCH) + slot_sync.count(SLOT_FAILED);
+    title = "Presets " + String(done) + "/" + String(slot_sync.selected()) + "...";
+  } else if (slot_sync.finished()) {
+    title = "Presets " + String(slot_sync.count(SLOT_OK)) + "/" + String(slot_sync.selected()) + " ok, " + String(slot_sync.total() / 1000.0, 1) + " s";
+  }
+  drawPatchName(TFT_THRCREAM, title);
+
+  //table: time from the foot switch until each stage was reached (ms)
+  int y = 84, rowh = 18;
+  tft.fillRect(0, 80, 320, 160, TFT_BLACK);
+  tft.loadFont(AA_FONT_SMALL);
+  tft.setTextDatum(ML_DATUM);
+  tft.setTextColor(TFT_THRBROWN, TFT_BLACK);
+  tft.drawString("stage", 4, y + rowh/2);
+  tft.drawString("p50", 100, y + rowh/2);
+  tft.drawString("p95", 170, y + rowh/2);
+  tft.drawString("max", 240, y + rowh/2);
+  tft.setTextColor(TFT_THRCREAM, TFT_BLACK);
+  for (uint8_t s = LAT_DECODE; s < LAT_STAGES; s++) {
+    LatencyStage st = (LatencyStage) s;
+    y += rowh;
+    tft.drawString(LAT_STAGE_NAMES[s], 4, y + rowh/2);
+    tft.drawString(String(switch_latency.percentile(st, 50) / 1000.0, 1), 100, y + rowh/2);
+    tft.drawString(String(switch_latency.percentile(st, 95) / 1000.0, 1), 170, y + rowh/2);
+    tft.drawString(String(switch_latency.worst(st) / 1000.0, 1), 240, y + rowh/2);
+  }
+  tft.unloadFont();
+
+  //histogram of the complete switch (until THR's ack), buckets 0.25 ms ... 256 ms and more
+  int hx = 4, hy = 196, hh = 44, bw = 26;
+  uint16_t most = 1;
+  for (uint8_t b = 0; b < LAT_BUCKETS; b++) {
+    most = max(most, switch_latency.bucket(LAT_ACK, b));
+  }
+  for (uint8_t b = 0; b < LAT_BUCKETS; b++) {
+    int bh = (hh - 2) * switch_latency.bucket(LAT_ACK, b) / most;
+    tft.fillRect(hx + b*bw, hy, bw - 2, hh, TFT_THRVDARKGREY);
+    tft.fillRect(hx + b*bw, hy + hh - bh, bw - 2, bh, b < LAT_BUCKETS - 1 ? TFT_THRCREAM : TFT_THRORANGE);
+  }
+}
+
 void drawBarChart(int x, int y, int w, int h, uint16_t bgcolour, uint16_t fgcolour, String label, int barh) {
   int tpad = 20; int pad = 0;
   spr.createSprite(w, h);
@@ -4058,6 +2410,14 @@ void drawPPChart(int x, int y, int w, int h, uint16_t bgcolour, uint16_t fgcolou
 	spr.deleteSprite();
 }
 
+void drawSyncMarker(int x, int y, ParamSync state) {  //dot in the top right corner (x, y) of a unit
+  if (state == PSYNC_LOST) {
+    tft.drawSpot(x - 6, y + 6, 3, TFT_THRORANGE);  //anti-aliased against the unit colour
+  } else if (state == PSYNC_BEHIND) {
+    tft.drawSpot(x - 6, y + 6, 3, TFT_THRYELLOW);
+  }
+}
+
 void drawFXUnitEditMode()
 {
 
@@ -4091,6 +2451,13 @@ void THR30II_Settings::updateConnectedBanner() //Show the connected Model
  */
 void THR30II_Settings::updateStatusMask(uint8_t x, uint8_t y)
 {
+	if(_uistate == UI_diag)  //diagnostics screen instead of the settings
+	{
+		drawLatencyScreen();
+		maskUpdate=false;
+		return;
+	}
+
 	// patch number
   	drawPatchID(TFT_THRCREAM, active_patch_id);
 	
@@ -4209,16 +2576,16 @@ void THR30II_Settings::updateStatusMask(uint8_t x, uint8_t y)
 
 	// Gain/Master
   	if(boost_activated) {
-    	drawBarChart(0, 80, 15, 160, TFT_THRDIMORANGE, TFT_THRORANGE, "G", control[CTRL_GAIN]);
+    	drawBarChart(0, 80, 15, 160, TFT_THRDIMORANGE, TFT_THRORANGE, "G", GetParam(P_CTRL_GAIN));
   	} else {
-    	drawBarChart(0, 80, 15, 160, TFT_THRBROWN, TFT_THRCREAM, "G", control[CTRL_GAIN]);
+    	drawBarChart(0, 80, 15, 160, TFT_THRBROWN, TFT_THRCREAM, "G", GetParam(P_CTRL_GAIN));
   	}
-  	drawBarChart(15, 80, 15, 160, TFT_THRBROWN, TFT_THRCREAM, "M", control[CTRL_MASTER]);
+  	drawBarChart(15, 80, 15, 160, TFT_THRBROWN, TFT_THRCREAM, "M", GetParam(P_CTRL_MASTER));
 
 
 
 	// EQ (B/M/T)
-  	drawEQChart(30, 80, 30, 160, TFT_THRBROWN, TFT_THRCREAM, "EQ", control[CTRL_BASS], control[CTRL_MID], control[CTRL_TREBLE]);
+  	drawEQChart(30, 80, 30, 160, TFT_THRBROWN, TFT_THRCREAM, "EQ", GetParam(P_CTRL_BASS), GetParam(P_CTRL_MID), GetParam(P_CTRL_TREBLE));
 
 
 
@@ -4253,6 +2620,7 @@ void THR30II_Settings::updateStatusMask(uint8_t x, uint8_t y)
 		break;
 		case UI_save:
 		case UI_name:
+		case UI_diag:
 		break;
 	}
 	
@@ -4260,8 +2628,8 @@ void THR30II_Settings::updateStatusMask(uint8_t x, uint8_t y)
 
 
 	// FX1 Compressor
-	utilparams[0] = compressor_setting[CO_SUSTAIN];
-	utilparams[1] = compressor_setting[CO_LEVEL];
+	utilparams[0] = GetParam(P_CO_SUSTAIN);
+	utilparams[1] = GetParam(P_CO_LEVEL);
   	if(THR_Values.unit[COMPRESSOR]) {
 		drawUtilUnit(60, 140, 60, 50, 1, TFT_THRWHITE, TFT_THRDARKGREY, "Comp", utilparams);
 	} else {
@@ -4271,8 +2639,8 @@ void THR30II_Settings::updateStatusMask(uint8_t x, uint8_t y)
 
 
   	// Gate
-	utilparams[0] = gate_setting[GA_THRESHOLD];
-	utilparams[1] = gate_setting[GA_DECAY];
+	utilparams[0] = GetParam(P_GA_THRESHOLD);
+	utilparams[1] = GetParam(P_GA_DECAY);
   	if(THR_Values.unit[GATE]) {
 		drawUtilUnit(60, 190, 60, 50, 0, TFT_THRYELLOW, TFT_THRDIMYELLOW, "Gate", utilparams);
 	} else {
@@ -4298,12 +2666,7 @@ void THR30II_Settings::updateStatusMask(uint8_t x, uint8_t y)
 				FXbgcolour = TFT_THRDIMFORESTGREEN;
 				FXfgcolour = TFT_THRVDARKGREY;
 			}
-			FXparams[0] = effect_setting[CHORUS][CH_SPEED];
-			FXparams[1] = effect_setting[CHORUS][CH_DEPTH];
-			FXparams[2] = effect_setting[CHORUS][CH_PREDELAY];
-			FXparams[3] = effect_setting[CHORUS][CH_FEEDBACK];
-			FXparams[4] = effect_setting[CHORUS][CH_MIX];
-			nFXbars = 5;  
+			nFXbars = ParamBars(FXparams, { P_CH_SPEED, P_CH_DEPTH, P_CH_PREDELAY, P_CH_FEEDBACK, P_CH_MIX });
 		break;
 
 		case FLANGER: 
@@ -4320,12 +2683,7 @@ void THR30II_Settings::updateStatusMask(uint8_t x, uint8_t y)
 				FXbgcolour = TFT_THRDIMLIME;
 				FXfgcolour = TFT_THRVDARKGREY;
 			}
-			FXparams[0] = effect_setting[FLANGER][FL_SPEED];
-			FXparams[1] = effect_setting[FLANGER][FL_DEPTH];
-			FXparams[2] = effect_setting[FLANGER][FL_MIX];
-			FXparams[3] = 0;
-			FXparams[4] = 0;
-			nFXbars = 3;
+			nFXbars = ParamBars(FXparams, { P_FL_SPEED, P_FL_DEPTH, P_FL_MIX });
 		break;
 
 		case PHASER:
@@ -4342,12 +2700,7 @@ void THR30II_Settings::updateStatusMask(uint8_t x, uint8_t y)
 				FXbgcolour = TFT_THRDIMLEMON;
 				FXfgcolour = TFT_THRVDARKGREY;
 			}
-			FXparams[0] = effect_setting[PHASER][PH_SPEED];
-			FXparams[1] = effect_setting[PHASER][PH_FEEDBACK];
-			FXparams[2] = effect_setting[PHASER][PH_MIX];
-			FXparams[3] = 0;
-			FXparams[4] = 0;
-			nFXbars = 3;		  
+			nFXbars = ParamBars(FXparams, { P_PH_SPEED, P_PH_FEEDBACK, P_PH_MIX });
 		break;		
 
 		case TREMOLO:
@@ -4364,12 +2717,7 @@ void THR30II_Settings::updateStatusMask(uint8_t x, uint8_t y)
 				FXbgcolour = TFT_THRDIMMANGO;
 				FXfgcolour = TFT_THRVDARKGREY;
 			}
-			FXparams[0] = effect_setting[TREMOLO][TR_SPEED];
-			FXparams[1] = effect_setting[TREMOLO][TR_DEPTH];
-			FXparams[2] = effect_setting[TREMOLO][TR_MIX];
-			FXparams[3] = 0;
-			FXparams[4] = 0;
-			nFXbars = 3;
+			nFXbars = ParamBars(FXparams, { P_TR_SPEED, P_TR_DEPTH, P_TR_MIX });
 		break;
 	}  //of switch(effecttype)
 		
@@ -4399,12 +2747,7 @@ void THR30II_Settings::updateStatusMask(uint8_t x, uint8_t y)
 				FXbgcolour = TFT_THRDIMROYALBLUE;
 				FXfgcolour = TFT_THRVDARKGREY;
 			}
-			FXparams[0] = echo_setting[TAPE_ECHO][TA_TIME];
-			FXparams[1] = echo_setting[TAPE_ECHO][TA_FEEDBACK];
-			FXparams[2] = echo_setting[TAPE_ECHO][TA_BASS];
-			FXparams[3] = echo_setting[TAPE_ECHO][TA_TREBLE];
-			FXparams[4] = echo_setting[TAPE_ECHO][TA_MIX];
-			nFXbars = 5;
+			nFXbars = ParamBars(FXparams, { P_TA_TIME, P_TA_FEEDBACK, P_TA_BASS, P_TA_TREBLE, P_TA_MIX });
 		break;
 
 		case DIGITAL_DELAY:
@@ -4421,12 +2764,7 @@ void THR30II_Settings::updateStatusMask(uint8_t x, uint8_t y)
 				FXbgcolour = TFT_THRDIMSKYBLUE;
 				FXfgcolour = TFT_THRVDARKGREY;
 			}
-			FXparams[0] = echo_setting[DIGITAL_DELAY][DD_TIME];
-			FXparams[1] = echo_setting[DIGITAL_DELAY][DD_FEEDBACK];
-			FXparams[2] = echo_setting[DIGITAL_DELAY][DD_BASS];
-			FXparams[3] = echo_setting[DIGITAL_DELAY][DD_TREBLE];
-			FXparams[4] = echo_setting[DIGITAL_DELAY][DD_MIX];
-			nFXbars = 5;  
+			nFXbars = ParamBars(FXparams, { P_DD_TIME, P_DD_FEEDBACK, P_DD_BASS, P_DD_TREBLE, P_DD_MIX });
 		break;
 	}	//of switch(effecttype)
 	
@@ -4457,12 +2795,7 @@ void THR30II_Settings::updateStatusMask(uint8_t x, uint8_t y)
 				FXbgcolour = TFT_THRDIMRED;
 				FXfgcolour = TFT_THRVDARKGREY;
 			}
-			FXparams[0] = reverb_setting[SPRING][SP_REVERB];
-			FXparams[1] = reverb_setting[SPRING][SP_TONE];
-			FXparams[2] = reverb_setting[SPRING][SP_MIX];
-			FXparams[3] = 0;
-			FXparams[4] = 0;
-			nFXbars = 3;  
+			nFXbars = ParamBars(FXparams, { P_SP_REVERB, P_SP_TONE, P_SP_MIX });
 		break;
 
 		case ROOM:
@@ -4479,12 +2812,7 @@ void THR30II_Settings::updateStatusMask(uint8_t x, uint8_t y)
 				FXbgcolour = TFT_THRDIMMAGENTA;
 				FXfgcolour = TFT_THRVDARKGREY;
 			}
-			FXparams[0] = reverb_setting[ROOM][RO_DECAY];
-			FXparams[1] = reverb_setting[ROOM][RO_PREDELAY];
-			FXparams[2] = reverb_setting[ROOM][RO_TONE];
-			FXparams[3] = reverb_setting[ROOM][RO_MIX];
-			FXparams[4] = 0;
-			nFXbars = 4;  
+			nFXbars = ParamBars(FXparams, { P_RO_DECAY, P_RO_PREDELAY, P_RO_TONE, P_RO_MIX });
 		break;
 
 		case PLATE:
@@ -4501,12 +2829,7 @@ void THR30II_Settings::updateStatusMask(uint8_t x, uint8_t y)
 				FXbgcolour = TFT_THRDIMPURPLE;
 				FXfgcolour = TFT_THRVDARKGREY;
 			}
-			FXparams[0] = reverb_setting[PLATE][PL_DECAY];
-			FXparams[1] = reverb_setting[PLATE][PL_PREDELAY];
-			FXparams[2] = reverb_setting[PLATE][PL_TONE];
-			FXparams[3] = reverb_setting[PLATE][PL_MIX];
-			FXparams[4] = 0;
-			nFXbars = 4;  
+			nFXbars = ParamBars(FXparams, { P_PL_DECAY, P_PL_PREDELAY, P_PL_TONE, P_PL_MIX });
 		break;
 
 		case HALL:
@@ -4523,12 +2846,7 @@ void THR30II_Settings::updateStatusMask(uint8_t x, uint8_t y)
 				FXbgcolour = TFT_THRDIMVIOLET;
 				FXfgcolour = TFT_THRVDARKGREY;
 			}
-			FXparams[0] = reverb_setting[HALL][HA_DECAY];
-			FXparams[1] = reverb_setting[HALL][HA_PREDELAY];
-			FXparams[2] = reverb_setting[HALL][HA_TONE];
-			FXparams[3] = reverb_setting[HALL][HA_MIX];
-			FXparams[4] = 0;
-			nFXbars = 4;  
+			nFXbars = ParamBars(FXparams, { P_HA_DECAY, P_HA_PREDELAY, P_HA_TONE, P_HA_MIX });
 		break;
 	}	//of switch(reverbtype)
 		
@@ -4544,6 +2862,16 @@ void THR30II_Settings::updateStatusMask(uint8_t x, uint8_t y)
   	// Exp/vol pedal positions
   	drawPPChart(300, 80, 20, 160, TFT_THRBROWN, TFT_THRCREAM, "P", pedal_1_val, pedal_2_val);
 
+
+
+	// Sync markers (parameter changes not acknowledged by THR)
+	drawSyncMarker(60, 80, param_acks.UnitSync(CONTROL));
+	drawSyncMarker(120, 140, param_acks.UnitSync(COMPRESSOR));
+	drawSyncMarker(120, 190, param_acks.UnitSync(GATE));
+	drawSyncMarker(180, 140, param_acks.UnitSync(EFFECT));
+	drawSyncMarker(240, 140, param_acks.UnitSync(ECHO));
+	drawSyncMarker(300, 140, param_acks.UnitSync(REVERB));
+
 	
 
 	// Dynamics LED
@@ -4629,22 +2957,27 @@ void THR30II_Settings::updateStatusMask(uint8_t x, uint8_t y)
 			{
 				if(presel_patch_id != active_patch_id)
 				{
-					s2 = libraryPatchNames[presel_patch_id-1];	//libraryPatchNames is 0-indexed
+					s2 = libraryPatchName(presel_patch_id);
 					drawPatchName(ST7789_ORANGE, s2);
 				}
 				else
 				{
-					s2 = libraryPatchNames[active_patch_id-1];
+					s2 = libraryPatchName(active_patch_id);
 					drawPatchName(TFT_THRCREAM, s2);
 				}
 			}
 			else
 			{
-				s2 = libraryPatchNames[active_patch_id-1]+"(*)";	//libraryPatchNames is 0-indexed
+				s2 = libraryPatchName(active_patch_id)+"(*)";
 				drawPatchName(ST7789_ORANGERED, s2);
 			}
 		break;
 
+		case UI_save:  //target of the actual settings
+			s2 = save_target > npatches ? "Save as new #" + String(save_target) : "Save to #" + String(save_target) + " " + libraryPatchName(save_target);
+			drawPatchName(ST7789_ORANGE, s2);
+		break;
+
 		default:
 
 		break;
@@ -4673,6 +3006,11 @@ void WorkingTimer_Tick() // latest martinzw version + BJW debug msgs
 		maskUpdate=true;  //tell GUI to update mask one time because of changed settings       
 	}		
 
+	if(param_acks.Overdue())  //THR is slow acknowledging parameter changes: show the sync markers
+	{
+		maskUpdate=true;
+	}
+
 	//Care about next queued outgoing SysEx, if at least one is pending
     	
 	if (outqueue.item_count() > 0)   
@@ -4683,6 +3021,8 @@ void WorkingTimer_Tick() // latest martinzw version + BJW debug msgs
 		if (!msg->_sent_out)    //not sent out yet? ==> send it out
 		{  
 			midi1.sendSysEx(msg->_msg.getSize(),(uint8_t *)(msg->_msg.getData()),true);
+			switch_latency.Sent(msg->_id, msg->_needs_ack);  //only the last frame of an upload needs an ack
+			param_acks.Sent(msg->_id);
 			
 			Serial.println("msg #" + String((msg->_id)) + " sent out");
 			msg->_sent_out = true;
@@ -4703,6 +3043,16 @@ void WorkingTimer_Tick() // latest martinzw version + BJW debug msgs
 				{
 					if (!msg->_needs_answer)   //ack OK, no answer needed   ==> done with this message
 					{
+						switch_latency.Acked(msg->_id);
+						slot_sync.Acked(msg->_id);
+						if(param_acks.Acked(msg->_id))
+						{
+							maskUpdate = true;  //sync marker of a unit changes
+						}
+						if(msg->_id == ParamAcks::Id(P_CTRL_MASTER))
+						{
+							pedal_stream.Acked();
+						}
 						outqueue.dequeue();  // => ready
 						Serial.println("msg #" + String((msg->_id)) + " dequ ack, no answ, t=" + String(millis()-msg->_time_stamp) + " n=" + String(msgcount));						
 					}
@@ -4715,6 +3065,16 @@ void WorkingTimer_Tick() // latest martinzw version + BJW debug msgs
 				else if (millis()-msg->_time_stamp > OUTQUEUE_TIMEOUT )	// if msg not acknowledged, check for timeout.
 																		// if timed out, discard.  (Or re-send...?)
 				{
+					switch_latency.Timeout(msg->_id);
+					slot_sync.Timeout(msg->_id);
+					if(THR_Values.ParamTimeout(msg->_id))
+					{
+						maskUpdate = true;  //rolled back value and sync marker
+					}
+					if(msg->_id == ParamAcks::Id(P_CTRL_MASTER))
+					{
+						pedal_stream.Lost();  //volume pedal sends its value again
+					}
 					outqueue.dequeue();  //=>ready
 					Serial.println("Timeout waiting for acknowledge. Discarded Message #" + String((msg->_id)) + " t=" + String(millis()-msg->_time_stamp) + " n=" + String(msgcount));
 					rgbcolour = strip.gamma32(strip.Color(255,0,0));	//Select colour (red)
@@ -4739,6 +3099,7 @@ void WorkingTimer_Tick() // latest martinzw version + BJW debug msgs
 				}
 				else if (millis()-msg->_time_stamp > OUTQUEUE_TIMEOUT )
 				{
+					slot_sync.Timeout(msg->_id);  //readback of a user preset not answered
 					outqueue.dequeue();  //=>ready
 					Serial.println("Timeout waiting for answer. Discarded Message #" + String((msg->_id)) + " t=" + String(millis()-msg->_time_stamp) + " n=" + String(msgcount));
 					rgbcolour = strip.gamma32(strip.Color(255,0,0));	//Select colour (red)
@@ -4750,128 +3111,6 @@ void WorkingTimer_Tick() // latest martinzw version + BJW debug msgs
 	}
 }
 
-SysExMessage::SysExMessage():Data(nullptr),Size(0) //standard constructor
-{
-};  
-
-SysExMessage::~SysExMessage() //destructor
-{
-	delete[] Data;
-	Size=0;
-};  
-
-SysExMessage::SysExMessage(const byte * data ,size_t size):Size(size) //Constructor
-{
-	Data=new byte[size];
-	memcpy(Data,data,size);
-};  
-SysExMessage::SysExMessage(const SysExMessage &other ):Size(other.Size)  //Copy Constructor
-{
-	Data=new byte[other.Size];
-	memcpy(Data,other.Data,other.Size);
-}
-SysExMessage::SysExMessage( SysExMessage &&other ) noexcept : Data(other.Data), Size(other.Size) //Move Constructor
-{
-	other.Data=nullptr;
-	other.Size=0;
-}
-SysExMessage & SysExMessage::operator=( const SysExMessage & other ) //Copy-assignment
-{
-	if(&other==this) return *this;
-	delete[] Data;
-	Data=new byte[other.Size];
-	memcpy(Data,other.Data,Size=other.Size);	   
-	return *this;
-} 
-
-SysExMessage & SysExMessage::operator=( SysExMessage && other ) noexcept //Move-assignment
-{
-	if(&other==this) return *this;
-	delete[] Data;
-	Size=other.Size;
-	Data=other.Data;
-	other.Size=0;
-	return *this;	   
-} 
-
-const byte * SysExMessage::getData()  //getter for the const byte-array
-{
-	return (const byte*) Data;
-}
-
-size_t SysExMessage::getSize()  //getter for the const byte-array
-{
-	return Size;
-}
-
-uint16_t UnitOnMap(uint16_t u)
-{
-	std::map<uint16_t,uint16_t>::iterator p = unitOnMap.find(u);
-	if ( p !=unitOnMap.end() )//if map contains key u
-	{
-		return p->second; //return value for this key
-	}
-	else
-	{
-		return 0xFFFF;
-	}
-}
-
-uint16_t ReverbMap(uint16_t u)
-{
-	std::map<uint16_t,uint16_t>::iterator p = reverbMap.find(u);
-	if ( p !=reverbMap.end() )//if map contains key u
-	{
-		return p->second;//return value for this key
-	}
-	else
-	{
-		return 0xFFFF;
-	}
-}
-
-uint16_t EchoMap(uint16_t u)
-{
-	std::map<uint16_t,uint16_t>::iterator p = echoMap.find(u);
-
-	if ( p !=echoMap.end() )  //if map contains key u
-	{
-		return p->second;  //return value for this key
-	}
-	else
-	{
-		return 0xFFFF;
-	}
-}
-
-uint16_t EffectMap(uint16_t u)
-{
-	std::map<uint16_t,uint16_t>::iterator p = effectMap.find(u);
-
-	if ( p !=effectMap.end() )  //if map contains key u
-	{
-		return p->second;  //return value for this key
-	}
-	else
-	{
-		return 0xFFFF;
-	}
-}
-
-uint16_t CompressorMap(uint16_t u)
-{
-	std::map<uint16_t,uint16_t>::iterator p = compressorMap.find(u);
-
-	if ( p !=compressorMap.end() )  //if map contains key u
-	{
-		return p->second;  //return value for this key
-	}
-	else
-	{
-		return 0xFFFF;
-	}
-}
-
 void OnSysEx(const uint8_t *data, uint16_t length, bool complete)
 {
 	//Serial.println("SysEx Received "+String(length));
@@ -16,20 +16,32 @@
 #include <Arduino.h>
 #include <ArduinoQueue.h>
 #include "THR30II.h"
+#include "ParamAcks.h"   //ParamSync
 
 void OnSysEx(const uint8_t *data, uint16_t length, bool complete);
 
 //uint16_t dePack(uint8_t *raw, uint8_t *clean, uint16_t received); //not needed on Teensy
 void drawStatusMask(uint8_t x, uint8_t y);
-void send_patch(uint8_t patch_id);
+void send_patch(uint16_t patch_id);
+const THR30II_Patch *fetch_patch(uint16_t nr);  //decoded library patch from cache or SD-card
+void prefetch_patches();                        //prepares the preselected patch and its neighbours (call in idle time)
+void sync_user_slots();                         //queues the next upload of a running user preset sync (call in loop)
+void slot_verified(uint8_t slot, uint32_t digest);  //readback dump of a user preset arrived
+String libraryPatchName(uint16_t nr);
 void drawPatchID(uint16_t fgcolour, int patchID);
 void drawPatchIcon(int x, int y, int w, int h, uint16_t colour, int patchID);
 void drawPatchName(uint16_t fgcolour, String patchname);
+void drawSyncMarker(int x, int y, ParamSync state);  //parameter changes of a unit not acknowledged (lost/behind)
+void drawLatencyScreen();                    //diagnostics screen (patch switch latency)
 void send_dump_request();
 void solo_deactivate(bool restore);
 void solo_activate();
 void patch_deactivate();
 void patch_activate(uint16_t pnr);
+void patch_preselect(uint16_t pnr);
+bool patch_save(uint16_t pos);
+void library_changed();                      //patches were saved, moved or compacted
+void compact_library();                      //rewrites the patch library after many saves (call in idle time)
 void do_volume_patch();
 void undo_volume_patch();
 void send_init();         //Try to activate THR30II MIDI 
@@ -39,12 +51,18 @@ void do_gain_boost();
 void undo_gain_boost();
 void pollpedalinputs();
 void updatemastervolume(int mastervolume);
+void stream_pedal();                            //volume pedal to THR, paced by its acks (call in loop)
 void blinkTTLED();
+bool load_symbol_cache(uint32_t firmware);   //symbol table for this firmware from SD (true, if found)
+bool store_symbol_cache(uint32_t firmware);  //write the actual symbol table to SD
+void verify_symbol_cache();                  //lazy checksum check of a table loaded from SD (call in idle time)
+void forget_symbol_cache();                  //drop a pending verification (table replaced or THR reconnected)
+void report_boot_time();                     //trace time from send_init() until the first settings dump
 
 extern String preSelName; //Name of the pre selected patch
 
 // enum UIStates { UI_idle, UI_init_act_set, UI_act_vol_sol, UI_patch, UI_ded_sol, UI_pat_vol_sol}; //States for the patch/solo activation user interface
-enum UIStates {UI_idle, UI_home_amp, UI_home_patch, UI_edit, UI_save, UI_name};
+enum UIStates {UI_idle, UI_home_amp, UI_home_patch, UI_edit, UI_save, UI_name, UI_diag};
 
 extern UIStates _uistate;
 
@@ -0,0 +1,2117 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* THR30II_Settings.cpp
+*  The settings model of THR30II_Settings: patches (decode, render, dumps), parameters, undo/redo and the messages to THR.
+*  Needs no display, buttons or USB host, so it is built by the host tests ([env:native]), too.
+*/
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <algorithm>
+#include "THR30II.h"
+#include "Globals.h"
+#include "ParamAcks.h"
+
+//Normal TRACE/DEBUG
+#define TRACE_THR30IIPEDAL(x) x	// trace on
+//#define TRACE_THR30IIPEDAL(x)	// trace off
+
+//Verbose TRACE/DEBUG
+#define TRACE_V_THR30IIPEDAL(x) x	// trace on
+//#define TRACE_V_THR30IIPEDAL(x)	// trace off
+
+ArduinoQueue<Outmessage> outqueue(30);  //FIFO Queue for outgoing SysEx-Messages to THRII
+
+bool THR30II_Settings::DecodePatch(const DynamicJsonDocument &djd, THR30II_Patch &pat) const  //thrl6p-JSON -> decoded patch
+{
+	const SymbolTable & glob = Constants::glo;
+	
+	//Patch name
+	const char *name = djd["data"]["meta"]["name"].as<const char*>();
+	strncpy(pat.name, name != nullptr ? name : "", PATCH_NAME_LEN);  //cut, if necessary
+	pat.name[PATCH_NAME_LEN] = '\0';
+	
+	//unknown global parameter
+	pat.Tnid = djd["data"]["meta"]["tnid"].as<uint32_t>();
+
+	//global parameter tempo
+	pat.ParTempo = djd["data"]["tone"]["global"]["THRPresetParamTempo"].as<uint32_t>();
+
+	pat.has.reset();
+
+	//Amp / Collection (unknown assets keep the actual amp)
+	pat.col = pat.amp = -1;
+	col_amp ca;
+	if(AmpAsset_ToColAmp(djd["data"]["tone"]["THRGroupAmp"]["@asset"].as<const char*>(), ca))  //e.g. "THR10C_DC30" => CLASSIC / CRUNCH
+	{
+		pat.col = ca.c;
+		pat.amp = ca.a;
+	}
+	TRACE_V_THR30IIPEDAL(Serial.printf("Col/Amp: %d/%d\n\r", pat.col, pat.amp);)
+
+	//Selected types of FX2 Effect, FX3 Echo and FX4 Reverb (unknown assets keep the actual type)
+	size_t t = KeyIndex(THR30II_EFF_TYPES_VALS, glob[djd["data"]["tone"]["THRGroupFX2Effect"]["@asset"].as<const char*>()]);
+	pat.effecttype = t < THR30II_EFF_TYPES_VALS.size() ? (int8_t) t : -1;
+	t = KeyIndex(THR30II_ECHO_TYPES_VALS, glob[djd["data"]["tone"]["THRGroupFX3EffectEcho"]["@asset"].as<const char*>()]);
+	pat.echotype = t < THR30II_ECHO_TYPES_VALS.size() ? (int8_t) t : -1;
+	t = KeyIndex(THR30II_REV_TYPES_VALS, glob[djd["data"]["tone"]["THRGroupFX4EffectReverb"]["@asset"].as<const char*>()]);
+	pat.reverbtype = t < THR30II_REV_TYPES_VALS.size() ? (int8_t) t : -1;
+	TRACE_V_THR30IIPEDAL(Serial.printf("Types: Eff %d, Echo %d, Rev %d\n\r", pat.effecttype, pat.echotype, pat.reverbtype);)
+
+	//All parameters of the registry, that are stored in patch files (values of all types, not only the selected ones)
+	//Only keys present in the file are taken, missing ones keep the actual values (see ApplyPatch() and IsComplete())
+	for(uint8_t i = 0; i < P_COUNT; i++)
+	{
+		THR30II_PARAM p = (THR30II_PARAM) i;
+		const param_def &d = THR30II_PARAMS[p];
+		if(d.enc == ENC_ENUM)  //Cab Simulation has an own group
+		{
+			JsonVariantConst cab = djd["data"]["tone"]["THRGroupCab"]["SpkSimType"];
+			if(!cab.isNull())
+			{
+				pat.raw[p] = cab.as<uint32_t>(); //e.g. 10 =>  Boutique_2x12
+				pat.has.set(p);
+			}
+			continue;
+		}
+
+		if(d.json[0] == '\0')  //not in patch files
+		{
+			continue;
+		}
+
+		JsonVariantConst grp = djd["data"]["tone"][THR30II_JSON_GROUPS[d.unit]];
+		if(d.type >= 0)  //type dependent parameters are stored in a subgroup named by the type's asset
+		{
+			uint16_t tk = d.unit == EFFECT ? THR30II_EFF_TYPES_VALS[d.type].key : d.unit == ECHO ? THR30II_ECHO_TYPES_VALS[d.type].key : THR30II_REV_TYPES_VALS[d.type].key;
+			const char *asset = glob.name(tk);
+			if(asset == nullptr)
+			{
+				continue;
+			}
+			grp = grp[asset];  //a missing subgroup gives null values below
+		}
+
+		JsonVariantConst val = grp[d.json];
+		if(val.isNull())
+		{
+			continue;
+		}
+		if(d.enc == ENC_BOOL)
+		{
+			pat.raw[p] = val.as<bool>() ? 0x01u : 0x00u;
+		}
+		else  //patch files hold the protocol's float values ([0...1] or [-96dB ... 0dB]), so the raw word is just their bits
+		{
+			float f = val.as<float>();
+			memcpy(&pat.raw[p], &f, 4);
+		}
+		pat.has.set(p);
+	}
+
+	return true;
+}
+
+static JsonObject nested(JsonObject parent, const char *key)  //existing or new object member
+{
+	JsonObject o = parent[key];
+	if(o.isNull())
+	{
+		o = parent.createNestedObject(key);
+	}
+	return o;
+}
+
+bool THR30II_Settings::EncodePatch(DynamicJsonDocument &djd, const char *name) const  //actual settings -> thrl6p-JSON (inverse of DecodePatch)
+{
+	const SymbolTable & glob = Constants::glo;
+	djd.clear();
+
+	djd["schema"] = "L6Preset";
+	djd["version"] = 5;
+	djd["data"]["meta"]["name"] = name;
+	djd["data"]["meta"]["tnid"] = Tnid;
+	djd["data"]["tone"]["global"]["THRPresetParamTempo"] = ParTempo;
+	djd["data"]["tone"]["THRGroupAmp"]["@asset"] = ColAmp_ToAmpAsset(col, amp);
+
+	//Selected types of FX2 Effect, FX3 Echo and FX4 Reverb
+	djd["data"]["tone"]["THRGroupFX2Effect"]["@asset"] = glob.name(THR30II_EFF_TYPES_VALS[effecttype].key);
+	djd["data"]["tone"]["THRGroupFX3EffectEcho"]["@asset"] = glob.name(THR30II_ECHO_TYPES_VALS[echotype].key);
+	djd["data"]["tone"]["THRGroupFX4EffectReverb"]["@asset"] = glob.name(THR30II_REV_TYPES_VALS[reverbtype].key);
+	JsonObject tone = djd["data"]["tone"];
+
+	//All parameters of the registry, that are stored in patch files (values of all types like THR Remote does)
+	for(uint8_t i = 0; i < P_COUNT; i++)
+	{
+		THR30II_PARAM p = (THR30II_PARAM) i;
+		const param_def &d = THR30II_PARAMS[p];
+		if(d.enc == ENC_ENUM)  //Cab Simulation has an own group
+		{
+			djd["data"]["tone"]["THRGroupCab"]["SpkSimType"] = GetRaw(p);
+			continue;
+		}
+
+		if(d.json[0] == '\0')  //not in patch files
+		{
+			continue;
+		}
+
+		JsonObject grp = nested(tone, THR30II_JSON_GROUPS[d.unit]);
+		if(d.type >= 0)  //type dependent parameters are stored in a subgroup named by the type's asset
+		{
+			uint16_t tk = d.unit == EFFECT ? THR30II_EFF_TYPES_VALS[d.type].key : d.unit == ECHO ? THR30II_ECHO_TYPES_VALS[d.type].key : THR30II_REV_TYPES_VALS[d.type].key;
+			const char *asset = glob.name(tk);
+			if(asset == nullptr)
+			{
+				continue;
+			}
+			grp = nested(grp, asset);
+		}
+
+		uint32_t raw = GetRaw(p);
+		float f;
+		memcpy(&f, &raw, 4);  //patch files hold the protocol's float values, the raw word are just their bits
+		if(!(d.enc == ENC_BOOL ? grp[d.json].set(raw != 0) : grp[d.json].set(f)))
+		{
+			TRACE_THR30IIPEDAL(Serial.println(F("EncodePatch(): JSON document too small."));)
+			return false;
+		}
+	}
+
+	return !djd.overflowed();
+}
+
+int THR30II_Settings::ApplyPatch(const THR30II_Patch &pat, PatchFrames *pf) //invoke all settings from a decoded patch
+{
+	if (!MIDI_Activated)
+	{
+		TRACE_THR30IIPEDAL(Serial.println("Midi Sync is not ready!");)
+		return -1;
+	}
+
+	sendChangestoTHR = false;  //We apply all the settings in one shot with a MIDI-Patch-Upload to THRII via "createPatch()" 
+	history.Clear();           //a new patch replaces all settings, single changes can not be undone across it
+	history.paused = true;
+                               //and not each setting separately. So we use the setters only for our local fields!
+
+	TRACE_THR30IIPEDAL(Serial.println(F("ApplyPatch(): Setting loaded patch..."));)
+
+	setPatchFields(pat);
+
+	history.paused = false;
+
+	if(pf == nullptr)
+	{
+		createPatch();  //send all settings as a patch dump SysEx to THRII
+	}
+	else
+	{
+		if(pf->count == 0 || pf->context != PatchContext())  //not prepared yet or built with other names / symbol table
+		{
+			renderPatch(*pf);
+			TRACE_THR30IIPEDAL(Serial.println(F("ApplyPatch(): Frames rendered."));)
+		}
+		sendPatchFrames(*pf);  //only streaming of the finished frames
+
+		if(!IsComplete(pat))
+		{
+			pf->count = 0;  //incomplete patch: the frames contain actual settings and can not be reused
+		}
+	}
+	
+	TRACE_THR30IIPEDAL(Serial.println(F("ApplyPatch(): Done setting."));)
+
+	return 0;
+}
+
+void THR30II_Settings::setPatchFields(const THR30II_Patch &pat)  //local fields from a decoded patch (caller disables sending and history)
+{
+	SetPatchName(pat.name, pat.nr);  //the patch is the pre-selected one, when it is applied
+	Tnid = pat.Tnid;
+	ParTempo = pat.ParTempo;
+
+	if(pat.col >= 0 && pat.amp >= 0)
+	{
+		SetColAmp((THR30II_COL) pat.col, (THR30II_AMP) pat.amp);
+	}
+	if(pat.effecttype >= 0)
+	{
+		EffectSelect((THR30II_EFF_TYPES) pat.effecttype);
+	}
+	if(pat.echotype >= 0)
+	{
+		EchoSelect((THR30II_ECHO_TYPES) pat.echotype);
+	}
+	if(pat.reverbtype >= 0)
+	{
+		ReverbSelect((THR30II_REV_TYPES) pat.reverbtype);
+	}
+
+	for(uint8_t i = 0; i < P_COUNT; i++)  //parameters not in the patch keep their actual values
+	{
+		if(pat.has.test(i))
+		{
+			SetRaw((THR30II_PARAM) i, pat.raw[i]);
+		}
+	}
+}
+
+bool THR30II_Settings::IsComplete(const THR30II_Patch &pat)  //all settings of an upload are in the patch (frames do not depend on actual settings)
+{
+	static size_t inFiles = 0;  //number of registry parameters stored in patch files
+	if(inFiles == 0)
+	{
+		for(uint8_t i = 0; i < P_COUNT; i++)
+		{
+			inFiles += (THR30II_PARAMS[i].json[0] != '\0' || THR30II_PARAMS[i].enc == ENC_ENUM) ? 1 : 0;  //CAB has an own group
+		}
+	}
+	return pat.col >= 0 && pat.amp >= 0 && pat.effecttype >= 0 && pat.echotype >= 0 && pat.reverbtype >= 0 && pat.has.count() == inFiles;
+}
+
+bool THR30II_Settings::PrerenderPatch(const THR30II_Patch &pat, PatchFrames &pf)  //upload frames of a patch, the settings stay unchanged
+{
+	if(!MIDI_Activated || !IsComplete(pat))  //frames of an incomplete patch would contain the settings at activation time
+	{
+		return false;
+	}
+
+	THR30II_State keep = Snapshot();  //one memcpy
+	bool send = sendChangestoTHR;
+	bool paused = history.paused;
+	sendChangestoTHR = false;
+	history.paused = true;
+
+	setPatchFields(pat);
+	renderPatch(pf);
+
+	static_cast<THR30II_State &>(*this) = keep;  //not Restore(), the history stays
+	sendChangestoTHR = send;
+	history.paused = paused;
+	return true;
+}
+
+bool THR30II_Settings::RenderSlotPatch(const THR30II_Patch &pat, uint8_t slot, PatchFrames &pf, uint32_t &digest)  //upload into a user preset, the settings stay unchanged
+{
+	if(!MIDI_Activated || slot > 4)
+	{
+		return false;
+	}
+
+	THR30II_State keep = Snapshot();
+	bool send = sendChangestoTHR;
+	bool paused = history.paused;
+	sendChangestoTHR = false;
+	history.paused = true;
+
+	setPatchFields(pat);  //settings missing in the patch are taken from the actual ones (like ApplyPatch())
+	strncpy(patchNames[slot + 1], pat.name, PATCH_NAME_LEN);
+	patchNames[slot + 1][PATCH_NAME_LEN] = '\0';
+	renderPatch(pf, slot);
+	digest = UploadDigest(patchNames[slot + 1]);
+
+	static_cast<THR30II_State &>(*this) = keep;
+	strncpy(patchNames[slot + 1], pat.name, PATCH_NAME_LEN + 1);  //THR's preset has this name now
+	sendChangestoTHR = send;
+	history.paused = paused;
+	return pf.count > 0;
+}
+
+uint32_t THR30II_Settings::UploadDigest(const char *name) const  //FNV-1a of the name and all values, that renderPatch() writes (Tnid and UnknownGlobal are left to THR)
+{
+	uint32_t h = 2166136261UL;  //FNV-1a offset basis
+	auto mix = [&h](uint32_t v)
+	{
+		for(uint8_t i = 0; i < 4; i++)
+		{
+			h = (h ^ (byte)(v >> (8 * i))) * 16777619UL;
+		}
+	};
+	for(const char *c = name; *c != '\0'; c++)
+	{
+		h = (h ^ (byte) *c) * 16777619UL;
+	}
+	mix(col); mix(amp); mix(effecttype); mix(echotype); mix(reverbtype); mix(ParTempo);
+	for(uint8_t i = 0; i < P_COUNT; i++)
+	{
+		if(InUpload((THR30II_PARAM) i))
+		{
+			mix(GetRaw((THR30II_PARAM) i));
+		}
+	}
+	return h;
+}
+
+uint32_t THR30II_Settings::DumpDigest(uint8_t *buf, uint16_t buf_len)  //parses a dump into the settings and takes them back afterwards
+{
+	static THR30II_History keep_history;  //patch_setAll() clears the history (static: 1.5 kB)
+	THR30II_State keep = Snapshot();
+	keep_history = history;
+	bool send = sendChangestoTHR;
+	sendChangestoTHR = false;
+
+	patch_setAll(buf, buf_len);
+	uint32_t digest = UploadDigest(patchNames[0]);  //the dump's name is stored as the actual one
+
+	static_cast<THR30II_State &>(*this) = keep;
+	history = keep_history;
+	sendChangestoTHR = send;
+	return digest;
+}
+
+THR30II_Settings::States THR30II_Settings::_state = THR30II_Settings::States::St_idle;  //the actual state of the state engine for creating a patch
+
+static PatchFrames upload_frames;  //frames of uploads, that are not prepared in the patch cache (sendPatchFrames() copies them into the out queue)
+
+void THR30II_Settings::createPatch() //fill send buffer with actual settings, creating a valid SysEx for sending to THR30II
+{
+	renderPatch(upload_frames);
+	sendPatchFrames(upload_frames);
+}
+
+bool THR30II_Settings::InUpload(THR30II_PARAM p) const  //parameter is part of an upload of the actual settings (selected types only)
+{
+	const param_def &d = THR30II_PARAMS[p];
+	return d.type < 0 || d.type == SubunitType(d.unit);
+}
+
+SyncPlan THR30II_Settings::PlanSync(std::bitset<P_COUNT> &diff) const  //compare the settings with the mirror of THR
+{
+	diff.reset();
+	//amp, unit types and patch globals have no single messages on the pedal (see SendTypeSetting())
+	if(!mirrorValid || col != mirror.col || amp != mirror.amp || effecttype != mirror.effecttype || echotype != mirror.echotype
+	   || reverbtype != mirror.reverbtype || Tnid != mirror.Tnid || ParTempo != mirror.ParTempo || UnknownGlobal != mirror.UnknownGlobal
+	   || strcmp(patchNames[0], mirror.patchNames[0]) != 0)
+	{
+		return SYNC_UPLOAD;
+	}
+
+	for(uint8_t i = 0; i < P_COUNT; i++)
+	{
+		THR30II_PARAM p = (THR30II_PARAM) i;
+		if(InUpload(p) && GetRaw(p) != GetRaw(mirror, p))
+		{
+			if(THR30II_PARAM_KEYS[p].ck == 0)  //no command key in this firmware's symbol table
+			{
+				return SYNC_UPLOAD;
+			}
+			diff.set(p);
+		}
+	}
+	if(diff.none())
+	{
+		return SYNC_NONE;
+	}
+	//every single parameter is acknowledged, an upload only once (after its last slice)
+	return diff.count() * (SYNC_PARAM_BYTES + SYNC_ACK_BYTES) < uploadBytes + SYNC_ACK_BYTES ? SYNC_PARAMS : SYNC_UPLOAD;
+}
+
+void THR30II_Settings::SyncToTHR()  //send the changed settings the cheaper way: single parameters or a full upload
+{
+	uint32_t t0 = micros();
+	std::bitset<P_COUNT> diff;
+	SyncPlan plan = PlanSync(diff);
+	uint32_t bytes = 0;
+
+	switch(plan)
+	{
+		case SYNC_NONE:
+		break;
+
+		case SYNC_PARAMS:
+			for(uint8_t i = 0; i < P_COUNT; i++)
+			{
+				if(diff.test(i))
+				{
+					SendParam((THR30II_PARAM) i);  //updates the mirror
+				}
+			}
+			bytes = diff.count() * SYNC_PARAM_BYTES;
+		break;
+
+		case SYNC_UPLOAD:
+			createPatch();
+			bytes = uploadBytes;
+		break;
+	}
+	TRACE_THR30IIPEDAL(Serial.printf("SyncToTHR(): %s, %d parameter(s), %lu bytes, %d ack(s), queued in %lu us (upload would be %lu bytes)\n\r",
+	                                 plan == SYNC_NONE ? "nothing to send" : plan == SYNC_PARAMS ? "single parameters" : "full upload",
+	                                 (int) diff.count(), bytes, plan == SYNC_PARAMS ? (int) diff.count() : plan == SYNC_UPLOAD ? 1 : 0,
+	                                 micros() - t0, uploadBytes);)
+}
+
+uint32_t THR30II_Settings::PatchContext() const  //stamp of the settings, that go into an upload, but are not part of a library patch
+{
+	uint32_t h = 2166136261UL;  //FNV-1a offset basis
+	for(const char *c = patchNames[0]; *c != '\0'; c++)
+	{
+		h = (h ^ (byte) *c) * 16777619UL;
+	}
+	h = (h ^ UnknownGlobal) * 16777619UL;
+	return (h ^ Constants::generation) * 16777619UL;  //keys and tokens of the symbol table
+}
+
+void THR30II_Settings::sendPatchFrames(const PatchFrames &pf)  //stream prepared upload frames to THR
+{
+	uploadBytes = queueMemoryWrite(pf, UPLOAD_MSG_ID);
+	mirror = Snapshot();  //THR has all of the actual settings now
+	mirrorValid = true;
+	param_acks.Resync();
+
+	TRACE_THR30IIPEDAL(Serial.println(F("\n\rCreate_patch(): Ready outsending."));)
+
+	userSettingsHaveChanged=false;
+	activeUserSetting=-1;
+}
+
+uint32_t queueMemoryWrite(const PatchFrames &pf, uint16_t first_id)  //the out path of every memory write (see MemFrameWriter)
+{
+	const byte *d = pf.data;
+	for(uint8_t i = 0; i < pf.count; i++)
+	{
+		//IDs first_id (header), first_id + 1... (slices), only the last slice needs an ack
+		outqueue.enqueue(Outmessage(SysExMessage(d, pf.len[i]), (uint16_t)(first_id + i), i == pf.count - 1, false));
+		d += pf.len[i];
+	}
+	return (uint32_t)(d - pf.data);
+}
+
+void THR30II_Settings::renderPatch(PatchFrames &pf, uint32_t target) const  //build all frames of an upload of the actual settings
+{
+	//The data (structure and values) is streamed into a MemFrameWriter, that bitbucket encodes it on the fly:
+	//1.) Every 210 (0x0d02) bytes of data complete a slice frame.
+	//    These frames have no incomplete 8/7 groups after bitbucketing and a total frame length of 253 (just below the possible 255 bytes).
+	//    The remaining bytes build the last frame (perhaps with the last 8/7 group incomplete)
+	//    with the length of its data before bitbucketing in the length field (all others have 0d 01).
+	//2.) The header frame is filled in front of the slices, when the total length is known:
+	//    SysExStart:  f0 00 01 0c 22 02 4d (always the same)
+	//                 01   (memory command, not settings command)
+	//                 06   (counter for memory frames, 07 for the slices)
+	//                 00 01 0b  ("same frame counter" and payload size  for the header)
+	//                 following 4-Byte values bitbucketed:
+	//                 0d 00 00 00   (Opcode for memory write/send)
+	//                 (len +8+12)   (1st length field = total length= data length + 3 values + type field/netto length )
+	//                 FF FF FF FF   (user patch number to overwrite/ 0xFFFFFFFF for actual patch)
+	//                 (len   +12)   (2nd length field = netto length= data length + the following 3 values)
+	//                 00 00 00 00   (always the same, kind of opcode?)
+	//                 01 00 00 00   (always the same, kind of opcode?)
+	//                 00 00 00 00   (always the same, kind of opcode?)
+	//                 0xF7
+	TRACE_V_THR30IIPEDAL(Serial.println(F("Create_patch(): "));)
+	TRACE_V_THR30IIPEDAL(uint32_t cycles = ARM_DWT_CYCCNT; byte stack_mark;)
+
+	pf.context = PatchContext();
+	MemFrameWriter w(pf);
+	const char *name = target < 5 ? patchNames[target + 1] : patchNames[0];  //a user preset carries its own name
+	const SymbolTable &glob = Constants::glo;
+
+	//Appends a parameter of the registry (dump key, dump type and encoded value)
+	auto param = [&](THR30II_PARAM p)
+	{
+		w.put2(THR30II_PARAM_KEYS[p].dk);
+		w.put4(THR30II_ENC_DUMP_TYPE[THR30II_PARAMS[p].enc]);
+		w.put4(GetRaw(p));
+	};
+
+	//Meta
+	w.put(tokens["StructOpen"]);
+	w.put(tokens["Meta"]);
+	w.put(tokens["TokenMeta"]);
+	w.put2(0x0000); w.put4(0x00040000u);  //number 0x0000, type 0x00040000 (String)
+	w.put4(strlen(name) + 1);    //Length of patchname (incl. '\0')
+	w.put((const byte *)name, strlen(name) + 1);  //the patchName and its '\0'  //!!ZWEZWE!! mind UTF-8 ?
+	w.put2(0x0001); w.put4(0x00020000u);  //number 0x0001, type 0x00020000 (int)
+	w.put4(Tnid);
+	w.put2(0x0002); w.put4(0x00020000u);  //number 0x0002, type 0x00020000 (int)
+	w.put4(UnknownGlobal);
+	w.put2(0x0003); w.put4(0x00030000u);  //number 0x0003, type 0x00030000 (int)
+	w.put4(ParTempo);                     //(min=110 =0x00000000)
+	w.put(tokens["StructClose"]);
+
+	//Data
+	w.put(tokens["StructOpen"]);
+	w.put(tokens["Data"]);
+	w.put(tokens["TokenData"]);
+
+	//unit GuitarProc
+	w.put(tokens["UnitOpen"]);
+	w.put2(glob["GuitarProc"]);
+	w.put(tokens["UnitType"]);
+	w.put(tokens["PseudoVal"]);
+	w.put2(glob["Y2GuitarFlow"]);
+	w.put(tokens["ParCount"]);
+	w.put(tokens["PseudoType"]);
+	w.put4(11u);  //number of parameters (here: 11)
+	param(P_ON_COMPRESSOR);                        //1601 = FX1EnableState  (CompOn)
+	param(P_ON_EFFECT);                            //1901 = FX2EnableState  (EffectOn)
+	param(THR30II_EFF_MIX_PARAMS[effecttype]);     //1801 = FX2MixState     (Eff.Mix)
+	param(P_ON_ECHO);                              //1C01 = FX3EnableState  (EchoOn)
+	param(THR30II_ECHO_MIX_PARAMS[echotype]);      //1B01 = FX3MixState     (EchoMix)
+	param(P_ON_REVERB);                            //1F01 = FX4EnableState  (RevOn)
+	param(THR30II_REV_MIX_PARAMS[reverbtype]);     //2601 = FX4WetSendState (RevMix)
+	param(P_ON_GATE);                              //2101 = GateEnableState (GateOn)
+	param(P_CAB);                                  //2401 = SpkSimTypeState (Cabinet)
+	param(P_GA_DECAY);                             //F800 = DecayState      (GateDecay)
+	param(P_GA_THRESHOLD);                         //2501 = ThreshState     (GateThreshold)
+
+	//unit Compressor
+	w.put(tokens["UnitOpen"]);
+	w.put2(glob["FX1"]);
+	w.put(tokens["UnitType"]);
+	w.put(tokens["PseudoVal"]);
+	w.put2(glob["RedComp"]);
+	w.put(tokens["ParCount"]);
+	w.put(tokens["PseudoType"]);
+	w.put4(2u);  //number of parameters (here: 2)
+	param(P_CO_LEVEL);    //BF00 = Compressor Level(LevelState)
+	param(P_CO_SUSTAIN);  //BE00 = Compressor Sustain(SustainState)
+	w.put(tokens["UnitClose"]);  //close Compressor Unit
+
+	//unit AMP (0x0A01)
+	w.put(tokens["UnitOpen"]);
+	w.put2(glob["Amp"]);
+	w.put(tokens["UnitType"]);
+	w.put(tokens["PseudoVal"]);
+	w.put2(THR30IIAmpKeys[col][amp]);
+	w.put(tokens["ParCount"]);
+	w.put(tokens["PseudoType"]);
+	w.put4(5u);  //number of parameters (here: 5)
+	param(P_CTRL_BASS);    //4f 00 CTRL BASS (BassState)
+	param(P_CTRL_GAIN);    //52 00 GAIN (DriveState)
+	param(P_CTRL_MASTER);  //53 00 MASTER (MasterState)
+	param(P_CTRL_MID);     //50 00 MID (MidState)
+	param(P_CTRL_TREBLE);  //51 00 CTRL TREBLE (TrebleState)
+	w.put(tokens["UnitClose"]);  //close AMP Unit
+
+	//unit EFFECT (FX2) (0x0E01)
+	w.put(tokens["UnitOpen"]);
+	w.put2(glob["FX2"]);
+	w.put(tokens["UnitType"]);
+	w.put(tokens["PseudoVal"]);
+	w.put2(THR30II_EFF_TYPES_VALS[effecttype].key);  //EffectType as a key value
+	w.put(tokens["ParCount"]);
+	w.put(tokens["PseudoType"]);
+	//Number and kind of parameters depend on the selcted effect type
+	switch (effecttype)
+	{
+		case PHASER:
+			w.put4(2u);
+			param(P_PH_FEEDBACK);
+			param(P_PH_SPEED);
+			break;
+		case TREMOLO:
+			w.put4(2u);
+			param(P_TR_DEPTH);
+			param(P_TR_SPEED);
+			break;
+		case FLANGER:
+			w.put4(2u);
+			param(P_FL_DEPTH);
+			param(P_FL_SPEED);
+			break;
+		case CHORUS:
+			w.put4(4u);
+			param(P_CH_DEPTH);
+			param(P_CH_FEEDBACK);
+			param(P_CH_SPEED);
+			param(P_CH_PREDELAY);
+			break;
+	}
+	w.put(tokens["UnitClose"]);  //close EFFECT Unit
+
+	//0f 01 Unit ECHO (FX3)
+	w.put(tokens["UnitOpen"]);
+	w.put2(glob["FX3"]);
+	w.put(tokens["UnitType"]);
+	w.put(tokens["PseudoVal"]);
+	w.put2(THR30II_ECHO_TYPES_VALS[echotype].key);  //EchoType as a key value (variable since 1.40.0a)
+	w.put(tokens["ParCount"]);
+	w.put(tokens["PseudoType"]);
+	//Number and kind of parameters could depend on the selected echo type (in fact it does not)
+	switch (echotype)
+	{
+		case TAPE_ECHO:
+			w.put4(4u);
+			param(P_TA_BASS);
+			param(P_TA_FEEDBACK);
+			param(P_TA_TIME);
+			param(P_TA_TREBLE);
+			break;
+		case DIGITAL_DELAY:
+			w.put4(4u);
+			param(P_DD_BASS);
+			param(P_DD_FEEDBACK);
+			param(P_DD_TIME);
+			param(P_DD_TREBLE);
+			break;
+	}
+	w.put(tokens["UnitClose"]);  //close ECHO Unit
+
+	//12 01 Unit REVERB
+	w.put(tokens["UnitOpen"]);
+	w.put2(glob["FX4"]);
+	w.put(tokens["UnitType"]);
+	w.put(tokens["PseudoVal"]);
+	w.put2(THR30II_REV_TYPES_VALS[reverbtype].key);
+	w.put(tokens["ParCount"]);
+	w.put(tokens["PseudoType"]);
+	//Number and kind of parameters depend on the selected reverb type
+	switch (reverbtype)
+	{
+		case SPRING:
+			w.put4(2u);
+			param(P_SP_REVERB);
+			param(P_SP_TONE);
+			break;
+		case PLATE:
+			w.put4(3u);
+			param(P_PL_DECAY);
+			param(P_PL_PREDELAY);
+			param(P_PL_TONE);
+			break;
+		case HALL:
+			w.put4(3u);
+			param(P_HA_DECAY);
+			param(P_HA_PREDELAY);
+			param(P_HA_TONE);
+			break;
+		case ROOM:
+			w.put4(3u);
+			param(P_RO_DECAY);
+			param(P_RO_PREDELAY);
+			param(P_RO_TONE);
+			break;
+	}
+	w.put(tokens["UnitClose"]);  //close REVERB Unit
+
+	w.put(tokens["UnitClose"]);  //close Unit GuitarProcessor
+	w.put(tokens["StructClose"]);  //close Structure Data
+
+	if(!w.finish(target))
+	{
+		TRACE_THR30IIPEDAL(Serial.println(F("Create_patch(): Upload does not fit in the frame buffer!"));)
+	}
+	TRACE_V_THR30IIPEDAL(Serial.printf("Create_patch(): %lu data bytes in %u frames, %lu cycles, %u bytes stack\n\r",
+	                                   w.length(), pf.count, ARM_DWT_CYCCNT - cycles, (unsigned)(&stack_mark - w.stackLow()));)
+} //End of THR30II_Settings::renderPatch()
+
+byte THR30II_Settings::UseSysExSendCounter() //returns the actual counter value and increments it afterwards
+{
+  return (SysExSendCounter++)%0x80;  //cycles to 0, if more than 0x7f
+}
+
+int8_t THR30II_Settings::getActiveUserSetting() //Getter for number of the active user setting
+{
+	return activeUserSetting;
+}
+
+bool THR30II_Settings::getUserSettingsHaveChanged() //Getter for state of user Settings
+{
+	return userSettingsHaveChanged;
+}
+
+//Tokens to find inside the patch data
+std::map<String, std::vector<byte> > THR30II_Settings::tokens 
+{
+	{{"StructOpen"},  { 0x00, 0x00, 0x00, 0x80, 0x02, 0x00 }},
+	{{"StructClose"}, { 0x02, 0x00, 0x00, 0x80, 0x00, 0x00 }},
+	{{"UnitOpen"},    { 0x03, 0x00, 0x00, 0x80, 0x07, 0x00 }},
+	{{"UnitClose"},   { 0x04, 0x00, 0x00, 0x80, 0x00, 0x00 }},
+	{{"Data"},        { 0x01, 0x00, 0x00, 0x00, 0x01, 0x00 }},
+	{{"Meta"}, 		  { 0x02, 0x00, 0x00, 0x00, 0x01, 0x00 }},
+	{{"TokenMeta"},	  { 0x00, 0x80, 0x02, 0x00, 0x50, 0x53, 0x52, 0x50 }},
+	{{"TokenData"},   { 0x00, 0x80, 0x02, 0x00, 0x54, 0x52, 0x54, 0x47 }},
+	{{"UnitType"},	  { 0x00, 0x00, 0x05, 0x00 }},
+	{{"ParCount"},	  { 0x00, 0x00, 0x06, 0x00 }},
+	{{"PseudoVal"},	  { 0x00, 0x80, 0x07, 0x00 }},   
+	{{"PseudoType"},  { 0x00, 0x80, 0x02, 0x00 }}
+};
+
+static std::map<uint16_t, string_or_ulong> globals;   //global settings from a patch-dump
+std::map<uint16_t, Dumpunit> units;  //ushort value for UnitKey
+uint16_t actualUnitKey = 0, actualSubunitKey = 0;
+static String logg ;   //the log while analyzing dump
+
+//helper for "patchSetAll()"
+//check key and following token, if in state "Structure"
+static THR30II_Settings::States checkKeyStructure(byte key[], byte * buf, int buf_len, uint16_t &pt)
+{
+	if (pt + 6 > buf_len - 8)  //if no following octet fits in the buffer
+	{
+		logg+="Error: Unexpected end of buffer while in Structure context!\n"; 
+		return THR30II_Settings::States::St_error;  //Stay in state Structure
+	}
+
+	byte next_octet[8];
+
+	memcpy(next_octet,buf+pt+6,8);  //Fetch following octet from buffer
+
+	if (memcmp(key, THR30II_Settings::tokens["Data"].data(),6)==0)
+	{
+		logg+="Token Data found. ";
+		if (memcmp(next_octet, THR30II_Settings::tokens["TokenData"].data(),8)==0)
+		{
+			logg+="Token Data complete. Data:\n\r";
+			pt += 8;
+			return THR30II_Settings::States::St_data;
+		}
+	}
+	else if (memcmp(key, THR30II_Settings::tokens["Meta"].data(),6)==0)
+	{
+		logg+="Token Meta found. ";
+		if (memcmp(next_octet, THR30II_Settings::tokens["TokenMeta"].data(),8)==0)
+		{
+			logg+="Token Meta complete. Global:\n\r";
+			pt += 8;
+			return THR30II_Settings::States::St_global;
+		}
+	}
+	logg+="--->Structure:\n";
+	return THR30II_Settings::States::St_structure;
+}
+
+//helper for "patchSetAll()"
+//check key, if in state "Data"
+THR30II_Settings::States checkKeyData(byte key[], byte * buf, int buf_len, uint16_t &pt)
+{
+	if (pt + 6 > buf_len)  //If no token follows (end of buffer)
+	{
+	  	logg+="Error: Unexpected end of buffer while in Data-Context!\n\r";
+		return THR30II_Settings::States::St_error;
+	}
+
+	if (memcmp(key,THR30II_Settings::tokens["UnitOpen"].data(),6)==0)
+	{
+		logg+="token UnitOpen found.  Unit:\n\r";
+		return THR30II_Settings::States::St_unit;
+	}
+	else if (memcmp(key, THR30II_Settings::tokens["StructClose"].data(),6)==0)  //This will perhaps never happen (Empty Data-Section)
+	{
+		logg+="Token StructClose found.  Idle:\n\r";
+		return THR30II_Settings::States::St_idle;
+	}
+	logg+="Data:\n\r";
+	return THR30II_Settings::States::St_data;
+}
+
+//helper for "patchSetAll()"
+//check key and eventually following token, if in state "Unit"
+THR30II_Settings::States checkKeyUnit(byte key[], byte* buf,int buf_len, uint16_t &pt)
+{
+	if (pt + 6 > buf_len)   //if buffer ends after this buffer
+	{
+		logg+="Error: Unexpected end of buffer while in a Unit!\n\r";
+		return THR30II_Settings::States::St_error;
+	}
+
+	if (memcmp(key, THR30II_Settings::tokens["UnitOpen"].data(),6)==0)
+	{
+		logg+="token UnitOpen found. State Subunit:\n\r";
+		return THR30II_Settings::States::St_subunit;
+	}
+	else if (memcmp(key+2, THR30II_Settings::tokens["UnitType"].data(),4)==0)
+	{
+		logg+="token UnitType found. ";
+		uint16_t unitKey = (uint16_t)(key[0] + 256 * key[1]);
+		if (pt + 6 > buf_len - 8)   //if no following octet fits in the buffer
+		{
+			logg+="Error: Unexpected end of buffer while in Unit "+String(unitKey) +" !\n\r";
+			return THR30II_Settings::States::St_error;
+		}
+		pt += 10;
+		uint16_t unitType = (uint16_t)(buf[pt] + 256 * buf[pt + 1]);
+		uint16_t parCount = (uint16_t)(buf[pt + 10] + 256 * buf[pt + 11]);
+
+		std::map<uint16_t, key_longval> emptyvals;
+		std::map<uint16_t, Dumpunit> emptysubUnits;
+
+		Dumpunit actualUnit =
+		{
+			unitType,
+			parCount,
+			emptyvals,      //values
+			emptysubUnits   //subUninits
+		};
+
+		units.emplace(std::pair<uint16_t,Dumpunit>(unitKey, actualUnit));  //store actual unit as a top level unit
+		pt += 8;
+
+		actualUnitKey = unitKey;
+		logg+="State ValuesUnit:\n\r";
+		return THR30II_Settings::States::St_valuesUnit;
+	}
+	else if (memcmp(key, THR30II_Settings::tokens["UnitClose"].data(),6)==0)
+	{
+		logg+="token UnitClose found. State Data:\n\r";
+		return THR30II_Settings::States::St_data;  //Should only happen at the end of last unit
+	}
+	logg+="State Error:\n\r";
+	return THR30II_Settings::States::St_error;
+}
+//helper for "patchSetAll()"
+//check key and eventually following token, if in state "SubUnit"
+THR30II_Settings::States checkKeySubunit(byte key[], byte *buf, int buf_len, uint16_t &pt)
+{
+	if (pt + 6 > buf_len)  //if buffer ends after this unit
+	{
+		logg+="Error: Unexpected end of buffer while in a SubUnit!\n\r";
+		return THR30II_Settings::States::St_error;
+	}
+
+	if (memcmp(key, THR30II_Settings::tokens["UnitOpen"].data(),6)==0)
+	{
+		logg+="token UnitOpen found.  State Error:\n\r";
+		return THR30II_Settings::States::St_error;  //no Sub-SubUnits possible
+	}
+	else if (memcmp(key+2, THR30II_Settings::tokens["UnitType"].data(), 4)==0)
+	{
+		logg+="token UnitType found. ";
+		uint16_t unitKey = (int16_t)(key[0] + 256 * key[1]);
+		if (pt + 6 > buf_len - 8)  //if no following octet fits in buffer
+		{
+			logg+="Error: Unexpected end of buffer while in SubUnit " + String(unitKey) + " !\n\r";
+			return THR30II_Settings::States::St_error;
+		}
+		pt += 10;
+		uint16_t unitType = (uint16_t)(buf[pt] + 256 * buf[pt + 1]);
+		uint16_t parCount = (uint16_t)(buf[pt + 10] + 256 * buf[pt + 11]);
+
+		std::map<uint16_t, key_longval> emptyVals;
+		std::map<uint16_t, Dumpunit> emptysubUnits;
+
+		Dumpunit actualSubunit 
+		{
+			unitType,
+			parCount,
+		    emptyVals,  //values 
+			emptysubUnits  //subUnits
+		};
+
+		units[actualUnitKey].subUnits.emplace(unitKey, actualSubunit);
+
+		pt += 8;
+		actualSubunitKey = unitKey;
+		logg+="State ValuesSubunit:\n\r";
+		return THR30II_Settings::States::St_valuesSubunit;
+	}
+	else if (memcmp(key, THR30II_Settings::tokens["UnitClose"].data(),6)==0)
+	{
+		logg+="token UnitClose found.  Unit:\n\r";
+		actualSubunitKey = 0xFFFF;  //Not in a subunit any more
+		return THR30II_Settings::States::St_unit;  //Should only happen at the end of last unit
+	}
+	logg+="Error: No allowed trigger in State SubUnit:\n\r";
+	return THR30II_Settings::States::St_error;
+}
+
+//get data, when in state "Global"
+//fetch one global setting from the patch dump (called several times, if there are several global values)
+static void getGlobal(byte * buf, int buf_len, uint16_t &pt)  
+{
+	uint16_t lfdNr = (uint16_t)buf[pt + 0] + 256 * (uint16_t)buf[pt + 1];
+
+	byte type = buf[pt + 4];  //get typ code for the global value
+
+	if (type == 0x04)  //string (the patch name)
+	{
+		byte len = buf[pt + 6];  //ignore 3 High Bytes, because string is always shorter than 255 
+		logg.append(String("found string of len ")+String((int)len)+String(" : "));
+
+		String name;
+
+		if (len > 0)
+		{
+			if (len > 64)
+			{
+			    char tmp[len];
+				memcpy(tmp,buf+pt+10,len-1)	;
+				tmp[len-1] = '\0';  //the '\0' of the dump is not copied
+				name = String(tmp).substring(0,64);
+			}
+			else
+			{
+				char tmp[len];
+				memcpy(tmp,buf+pt+10,len-1);
+				tmp[len-1] = '\0';
+				name =  String(tmp);
+			}
+            logg.append(name + String("\n\r") );
+		}
+
+		globals.emplace(std::pair< uint16_t, string_or_ulong> ( lfdNr, (string_or_ulong){true, type, name, 0}) );
+
+		pt += (uint16_t)len + 4;
+	}
+	else if (type == 0x02 || type == 0x03)
+	{
+		globals.emplace(std::pair<uint16_t,string_or_ulong> ( lfdNr, 
+		                                                    (string_or_ulong) {false, type, String(),  //the value is no name
+															(uint32_t)buf[pt + 6] + ((uint32_t)buf[pt + 7] << 8)
+		                                                  + ((uint32_t)buf[pt + 8] << 16) + ((uint32_t)buf[pt + 9] << 24)} ));
+		pt += 4;
+	}
+	else
+	{
+		logg.append("unknown type code " +String(type) + " for global value!\n\r" );
+		pt += 4;
+	}
+	
+}
+
+//get data, when in state "Unit"
+//get one of the units' settings from the patch dump (called several times, if there are several values)
+THR30II_Settings::States getValueUnit(byte key[], byte * buf, int buf_len, uint16_t &pt) 
+{
+	if (memcmp(key, THR30II_Settings::tokens["UnitOpen"].data(),6)==0)
+	{
+		logg+="token UnitOpen found.  SubUnit:\n\r";
+		return THR30II_Settings::States::St_subunit;
+	}
+	else if (memcmp(key, THR30II_Settings::tokens["UnitClose"].data(),6)==0)
+	{
+		logg+="token UnitClose found. Data:\n\r";
+		return THR30II_Settings::States::St_data;
+	}
+	//No Open or Close => should be a value
+	
+	if(pt + 6 > buf_len - 4) //if no following quartet fits in the buffer
+	{
+		logg+="Error: Unexpected end of buffer while in ValueUnit context!\n\r"; 
+		return THR30II_Settings::States::St_error;  //Stay in state Structure
+	}
+	uint16_t parKey = (uint16_t)(key[0] + 256 * key[1]); //get the key for this value
+
+	byte type = buf[pt + 4];  //get the type key for the following 4-Byte-value
+	//get the 4-byte-value itself
+	uint32_t val = (uint32_t)(((uint32_t)buf[pt + 6]) + ((uint32_t)buf[pt + 7] << 8) + ((uint32_t)buf[pt + 8] << 16) + ((uint32_t)buf[pt + 9] << 24));
+	units[actualUnitKey].values.emplace(parKey, (key_longval) {type, val} );
+	pt += 4;
+	//Stay in context ValueUint to read further value(s)
+	logg+="ValuesUnit:\n\r";
+	return THR30II_Settings::States::St_valuesUnit;
+}
+
+//helper for "patchSetAll()" - checks, if there is a value in the current subUnti and extract this value (4-Byte)
+THR30II_Settings::States getValueSubunit(byte key[], byte* buf, int buf_len, uint16_t &pt)
+{
+	if (memcmp(key, THR30II_Settings::tokens["UnitOpen"].data(),6)==0)
+	{
+		logg+="token UnitOpen found.  Unit:\n\r";
+		return THR30II_Settings::States::St_error;  //No Sub-SubUnits possible
+	}
+	else if (memcmp(key, THR30II_Settings::tokens["UnitClose"].data(),6)==0)
+	{
+		logg+="token UnitClose in Subunit found.  Unit:\n\r";
+		actualSubunitKey = 0xFFFF;  // No Subunit any more
+		return THR30II_Settings::States::St_unit;
+	}
+	
+	//No Open or Close => should be a value
+	if(pt + 6 > buf_len - 4) //if no following quartet fits in the buffer
+	{
+		logg+="Error: Unexpected end of buffer while in ValueSubUnit context!\n\r"; 
+		return THR30II_Settings::States::St_error;  
+	}
+
+	uint16_t parKey = (uint16_t)(key[0] + 256 * key[1]); //get the key for this value
+	
+	byte type = buf[pt + 4];//get the type key for the following 4-Byte-value
+	//get the 4-byte-value itself
+	uint32_t val = (uint32_t)(((uint32_t)buf[pt + 6]) + ((uint32_t)buf[pt + 7] << 8) + ((uint32_t)buf[pt + 8] << 16) + ((uint32_t)buf[pt + 9] << 24));
+
+	units[actualUnitKey].subUnits[actualSubunitKey].values.emplace(parKey, (key_longval) {type, val});
+
+	pt += 4;
+	//Stay in context ValueSubUnit to read further value(s)
+	logg+="ValuesSubunit:\n\r";
+	return THR30II_Settings::States::St_valuesSubunit;
+}
+
+//extract all settings from a received dump. returns error code
+int THR30II_Settings::patch_setAll(uint8_t * buf, uint16_t buf_len)  
+{
+	uint16_t pt = 0; //index
+	_state=States::St_idle;
+	globals.clear();
+	units.clear();
+	actualUnitKey=0; actualSubunitKey=0;
+	
+	//Setting up a data structure to keep the retrieved dump data
+	logg=String();
+	//uint16_t patch_size = buf_len;
+	
+	//overwrite locally stored patch values with received buffer's data
+	
+	//Zustand "idle"
+	logg.append("Idle:\n\r");
+
+	while ((pt <= buf_len - 6) && _state!=St_error ) //walk through the patch data and look for token-sextetts
+	{
+		byte sextet[6];
+		memcpy(sextet, buf+pt, 6); //fetch token sextet from buffer
+		char tmp[36];
+		sprintf(tmp, "Byte %d of %d : %02X%02X%02X%02X%02X%02X : ",pt,buf_len, sextet[0],sextet[1],sextet[2],sextet[3],sextet[4],sextet[5]);
+		logg.append(tmp);
+		
+		if(_state == States::St_idle)
+		{
+			//From Idle-state we can reach the Structure-state, 
+			//if we send the corresponding key as a trigger.
+			if(memcmp(sextet, THR30II_Settings::tokens["StructOpen"].data(),6)==0)
+			{ 
+				//Reaches state "Structure"
+				logg.append("Structure:\n\r");					
+				_state=States::St_structure;
+				//_last_state=St_idle;
+			}
+		}
+		else if(_state== States::St_structure)
+		{
+			//Switching options from this state on
+			_state = checkKeyStructure(sextet,buf,buf_len, pt);
+			//_last_state=St_structure;
+		}
+		else if(_state== States::St_data)
+		{
+			//Switching options from this state on
+			_state = checkKeyData(sextet,buf,buf_len,pt);
+			//_last_state=St_data;
+		}
+		else if(_state== States::St_meta)
+		{
+			//Switching options from this state on
+			if(memcmp(sextet, THR30II_Settings::tokens["StructClose"].data(),6)==0)
+			{ 
+				//Reaches state "Idle"
+				logg.append("Idle:\n\r");
+				_state=St_idle;
+			}
+			else
+			{
+				//Reaches state "Global"
+				logg.append("Global:\n\r");
+				_state=St_global;
+			}
+			//_last_state= St_meta;
+		}
+		else if(_state==States::St_global)
+		{
+			//Switching options from this state on
+			if(memcmp(sextet, THR30II_Settings::tokens["StructClose"].data(),6)==0)
+			{
+				//Reaches state"Idle"
+				logg.append("Idle:\n\r");
+					_state=St_idle;
+			}
+			else
+			{ 
+				getGlobal(buf,buf_len, pt);
+				
+				//Reaches state "Global"
+				logg.append("Global:\n\r");
+				_state= St_global;
+			}
+			//_last_state=St_global;
+		}
+		else if(_state==States::St_unit)
+		{
+			//Switching options from this state on
+			_state=checkKeyUnit(sextet,buf,buf_len,pt);
+			//_last_state=St_unit;
+		}
+		else if(_state==States::St_valuesUnit )
+		{
+			//Switching options from this state on
+			_state=getValueUnit(sextet,buf,buf_len,pt);
+			//_last_state=St_valuesUnit;
+		}
+		else if(_state==States::St_subunit)
+		{
+			//Switching options from this state on
+			_state=checkKeySubunit(sextet,buf,buf_len,pt);
+			//_last_state=St_subunit;
+		}
+		else if (_state==States::St_valuesSubunit)
+		{
+			//Switching options from this state on
+			_state=getValueSubunit(sextet,buf,buf_len,pt);
+			//_last_state=St_valuesSubunit;
+		}
+		pt += 6; //advance in buffer
+	}
+
+	TRACE_THR30IIPEDAL(Serial.println("patch_setAll parsing ready - results: ");)
+	TRACE_V_THR30IIPEDAL(Serial.println(logg);)     
+	TRACE_THR30IIPEDAL(Serial.println("Setting the "+ String(globals.size())+" globals: ");)
+
+	//Walk through the globals (Structur Meta)
+	for( std::pair<uint16_t,string_or_ulong> kvp : globals)
+	{
+		if( kvp.first == 0x0000)
+		{
+			if (kvp.second.isString )
+			{
+				SetPatchName(kvp.second.nam,-1);
+			}
+		}
+		else if(kvp.first == 0x0001)
+		{
+			if (!kvp.second.isString) //int
+			{
+				Tnid = kvp.second.val;
+			}
+		}
+		if(kvp.first== 0x0002)
+		{
+			if (!kvp.second.isString)
+			{
+				UnknownGlobal = kvp.second.val;
+			}
+		}
+		if(kvp.first==  0x0003)
+		{
+			if (!kvp.second.isString )
+			{
+				ParTempo = kvp.second.val;
+			}
+		}
+	}
+
+	TRACE_THR30IIPEDAL(Serial.println("... setting unit vals: ");)
+	history.Clear();  //a dump replaces all settings, single changes can not be undone across it
+	history.paused = true;
+	//Recurse through the whole data structure created while parsing the dump
+	
+	for (std::pair<uint16_t, Dumpunit> du : units)    //foreach!
+	{
+		if(du.first == THR30II_UNITS_VALS[GATE].key)  //Unit Gate also hosts MIX and Subunits COMP...REV
+		{
+			TRACE_V_THR30IIPEDAL(Serial.println("In dumpunit GATE/AMP");)
+
+			if (du.second.parCount != 0)
+			{
+				std::map<uint16_t, Dumpunit> &dict2 = du.second.subUnits;  //Get SubUnits of GATE/MIX
+
+				for (std::pair<uint16_t, Dumpunit> kvp : dict2)  //foreach
+				{
+					if(kvp.first== THR30II_UNITS_VALS[ECHO].key)   //If SubUnit "Echo"
+					{
+						TRACE_V_THR30IIPEDAL(Serial.println("In dumpSubUnit ECHO");)
+
+						//Before we set Parameters we have to select the Echo-Type
+						uint16_t t=kvp.second.type;
+
+						size_t result = KeyIndex(THR30II_ECHO_TYPES_VALS, t);
+						if(result < THR30II_ECHO_TYPES_VALS.size())
+						{
+							EchoSelect((THR30II_ECHO_TYPES) result);
+						}
+						else  //Defaults to TAPE_ECHO
+						{
+							EchoSelect(THR30II_ECHO_TYPES::TAPE_ECHO);
+						}
+						SetDumpValues(kvp.first, kvp.second.values);  //Values contained in SubUnit "Echo"
+					}
+					else if(kvp.first== THR30II_UNITS_VALS[EFFECT].key)   //If SubUnit "Effect"
+					{
+						TRACE_V_THR30IIPEDAL(Serial.println("In dumpSubUnit EFFECT");)
+
+						//Before we set Parameters we have to select the Effect-Type
+						uint16_t t=kvp.second.type;
+
+						size_t result = KeyIndex(THR30II_EFF_TYPES_VALS, t);
+						if(result < THR30II_EFF_TYPES_VALS.size())
+						{
+							EffectSelect((THR30II_EFF_TYPES) result);
+						}
+						else  //Defaults to PHASER
+						{
+							EffectSelect(THR30II_EFF_TYPES::PHASER);
+						}
+
+						SetDumpValues(kvp.first, kvp.second.values);  //Values contained in SubUnit "Effect"
+					}
+					else if(kvp.first== THR30II_UNITS_VALS[COMPRESSOR].key)   //If SubUnit "Compressor"
+					{
+						TRACE_V_THR30IIPEDAL(Serial.println("In dumpSubUnit COMPRESSOR");)
+
+						SetDumpValues(kvp.first, kvp.second.values);  //Values contained in SubUnit "Compressor"
+					}
+					else if(kvp.first==THR30II_UNITS_VALS[THR30II_UNITS::REVERB].key)   //If SubUnit "Reverb"
+					{
+						TRACE_V_THR30IIPEDAL(Serial.println("In dumpSubUnit REVERB");)
+
+						//Before we set Parameters we have to select the Reverb-Type
+						uint16_t t=kvp.second.type;
+
+						size_t result = KeyIndex(THR30II_REV_TYPES_VALS, t);
+						if(result < THR30II_REV_TYPES_VALS.size())
+						{
+							ReverbSelect((THR30II_REV_TYPES) result);
+						}
+						else  //Defaults to SPRING
+						{
+							ReverbSelect(SPRING);
+						}
+
+						SetDumpValues(kvp.first, kvp.second.values);  //Values contained in SubUnit "Reverb"
+					}
+					else if(kvp.first== THR30II_UNITS_VALS[THR30II_UNITS::CONTROL].key)          //If SubUnit "Control/Amp"
+					{
+						TRACE_V_THR30IIPEDAL(Serial.println("In dumpSubUnit CTRL/AMP");)
+						setColAmp(kvp.second.type);
+						
+						SetDumpValues(kvp.first, kvp.second.values);  //Values contained in SubUnit "Amp"
+					}
+				} //end of foreach kvp in dict2  (Subunits of GuitarProc (Gate) an their params)
+				
+				//Values -directly- contained in Unit GATE/MIX (unit states, MIX of the subunits, CAB and the gate)
+				//The MIX parameters are found for the subunit types, that were selected above
+				SetDumpValues(du.first, du.second.values);
+
+				auto ampEnable = du.second.values.find(Constants::glo["AmpEnableState"]);  //0x0120: AMP_EnableState (not used in patches to THRII)
+				if(ampEnable != du.second.values.end())                                       //But occurs in dumps from THRII to PC
+				{
+					TRACE_THR30IIPEDAL(Serial.printf("\"AmpEnableState\" %d.\n\r",ampEnable->second.val);)
+				}
+
+			} //end of if count params !=0
+		} //end of if "Unit GATE" (contains COMP...REV as subunits)
+	} //end of foreach dumpunit
+
+	history.paused = false;
+	return 0; //success
+} //end of THR30II_settings::patch_setAll
+
+void THR30II_Settings::SetDumpValues(uint16_t uk, const std::map<uint16_t, key_longval> &values)  //set the values of one unit from a patch dump
+{
+	for(const std::pair<const uint16_t, key_longval> &v : values)
+	{
+		THR30II_PARAM p = FindParam(uk, v.first, true);  //registry lookup by dump key (does not insert)
+		if(p != P_NONE)
+		{
+			TRACE_V_THR30IIPEDAL(Serial.printf("Dump value %s = %.1f\n\r", THR30II_PARAMS[p].label, DecodeParam(p, v.second.val));)
+			SetRaw(p, v.second.val);  //bit-exact
+		}
+		else
+		{
+			TRACE_V_THR30IIPEDAL(Serial.printf("Dump key %04x not in registry\n\r", v.first);)
+		}
+	}
+}
+
+//following all the setters for locally stored THR30II-Settings class
+
+// void THR30II_Settings::SetAmp(uint8_t _amp)   //No separate setter necessary at the moment
+// {
+
+// }
+
+void THR30II_Settings::SetColAmp(THR30II_COL _col, THR30II_AMP _amp)  //Setter for the Simulation Collection / Amp
+{
+	// bool changed = false;
+	if (_col != col)
+	{
+		col = _col;
+		// changed = true;
+	}
+	if (_amp != amp)
+	{
+		amp = _amp;
+		// changed = true;
+	}
+	// if (changed)
+	// {
+	// 	if (sendChangestoTHR)
+	// 	{
+	// 		SendColAmp();
+	// 	}
+	// }
+}
+
+void THR30II_Settings::setColAmp(uint16_t ca)  //Setter by key
+{	
+	for(size_t c = 0; c < THR30IIAmpKeys.size(); c++)  //Lookup Key for this value
+	{
+		size_t a = KeyIndex(THR30IIAmpKeys[c], ca);
+
+		if(a < THR30IIAmpKeys[c].size())  //SET COL/AMP IF FOUND
+		{
+			SetColAmp((THR30II_COL) c, (THR30II_AMP) a);
+			return;
+		}
+	}
+}
+
+void THR30II_Settings::SetCab(THR30II_CAB _cab)  //Setter for the Cabinet Simulation
+{
+	SetParam(P_CAB, _cab);
+}
+
+int8_t THR30II_Settings::SubunitType(THR30II_UNITS u) const  //actual selected type of a unit with subunit types
+{
+	switch(u)
+	{
+		case EFFECT:
+			return effecttype;
+		case ECHO:
+			return echotype;
+		case REVERB:
+			return reverbtype;
+		default:
+			return -1;
+	}
+}
+
+THR30II_PARAM THR30II_Settings::FindParam(uint16_t uk, uint16_t key, bool dump) const  //lookup in the registry's reverse index (never inserts)
+{
+	//only parameters sharing the same key are checked (e.g. "FX2Mix" for all effect types)
+	for(THR30II_PARAM p = ParamByKey(key, dump); p != P_NONE; p = NextParamByKey(p, dump))
+	{
+		const param_def &d = THR30II_PARAMS[p];
+		if(THR30II_PARAM_KEYS[p].uk == uk && (d.type < 0 || d.type == SubunitType(d.unit)))
+		{
+			return p;
+		}
+	}
+	return P_NONE;
+}
+
+const uint32_t *THR30II_Settings::ParamStore(const THR30II_State &s, THR30II_PARAM p)  //Field for the raw value of a slider parameter
+{
+	const param_def &d = THR30II_PARAMS[p];
+	if(d.enc == ENC_ENUM || d.enc == ENC_BOOL)
+	{
+		return nullptr;
+	}
+	switch(d.unit)
+	{
+		case COMPRESSOR:
+			return &s.compressor_setting[d.index];
+		case CONTROL:
+			return &s.control[d.index];
+		case EFFECT:
+			return &s.effect_setting[d.type][d.index];
+		case ECHO:
+			return &s.echo_setting[d.type][d.index];
+		case REVERB:
+			return &s.reverb_setting[d.type][d.index];
+		case GATE:
+			return &s.gate_setting[d.index];
+	}
+	return nullptr;
+}
+
+double THR30II_Settings::GetParam(THR30II_PARAM p) const  //display value (rendering only)
+{
+	if(p >= P_COUNT)
+	{
+		return 0.0;
+	}
+	return DecodeParam(p, GetRaw(p));
+}
+
+uint32_t THR30II_Settings::GetRaw(const THR30II_State &s, THR30II_PARAM p)  //raw value of a parameter in any settings (e.g. the mirror)
+{
+	if(p >= P_COUNT)
+	{
+		return 0;
+	}
+	switch(THR30II_PARAMS[p].enc)
+	{
+		case ENC_BOOL:
+			return s.unit[THR30II_PARAMS[p].index] ? 0x01u : 0x00u;
+		case ENC_ENUM:
+			return (uint32_t) s.cab;  //CAB is the only enum parameter
+		default:
+			return *ParamStore(s, p);
+	}
+}
+
+void THR30II_Settings::StoreRaw(THR30II_State &s, THR30II_PARAM p, uint32_t raw)  //store a raw value in any settings (no sending, no history)
+{
+	const param_def &d = THR30II_PARAMS[p];
+	switch(d.enc)
+	{
+		case ENC_BOOL:
+			s.unit[d.index] = raw != 0;
+			break;
+		case ENC_ENUM:
+			s.cab = (THR30II_CAB) constrain(raw, (uint32_t) d.ll, (uint32_t) d.ul);
+			break;
+		default:
+			*const_cast<uint32_t *>(ParamStore(s, p)) = raw;  //kept bit-exact
+			break;
+	}
+}
+
+void THR30II_Settings::SetParam(THR30II_PARAM p, double value)  //Setter for all parameters of the registry by display value
+{
+	if(p >= P_COUNT)
+	{
+		return;
+	}
+	const param_def &d = THR30II_PARAMS[p];
+	SetRaw(p, EncodeParam(p, constrain(value, (double) d.ll, (double) d.ul)));
+}
+
+void THR30II_Settings::SetRaw(THR30II_PARAM p, uint32_t raw)  //Setter for all parameters of the registry by raw protocol value
+{
+	if(p >= P_COUNT)
+	{
+		return;
+	}
+	uint32_t before = GetRaw(p);
+	StoreRaw(*this, p, raw);
+
+	if(!history.paused && GetRaw(p) != before)
+	{
+		history.Record(p, before, GetRaw(p));
+	}
+
+	if (sendChangestoTHR)  //do not send back, if change results from THR itself
+	{
+		SendParam(p);
+	}
+}
+
+void THR30II_History::Record(THR30II_PARAM p, uint32_t before, uint32_t after)
+{
+	if(!_newGroup && CanUndo() && at(_head - 1).param == p && at(_head - 1).group == _group)
+	{
+		at(_head - 1).after = after;  //same parameter again in this step (e.g. knob move): keep the first "before" only
+		return;
+	}
+
+	if(_newGroup)
+	{
+		_group++;
+		_newGroup = false;
+	}
+
+	_top = _head;  //a new change discards the redoable changes
+
+	if(_head - _tail == HISTORY_SIZE)  //ring is full: drop the oldest group completely
+	{
+		uint16_t oldest = at(_tail).group;
+		while(_tail != _head && at(_tail).group == oldest)
+		{
+			_tail++;
+		}
+	}
+
+	at(_head++) = { before, after, _group, p };
+	_top = _head;
+}
+
+bool THR30II_Settings::Undo()  //revert the last group of changes through the normal setters (sent to THR)
+{
+	if(!history.CanUndo())
+	{
+		return false;
+	}
+	bool send = sendChangestoTHR;
+	sendChangestoTHR = true;
+	history.paused = true;
+
+	uint16_t g = history.at(history._head - 1).group;
+	while(history.CanUndo() && history.at(history._head - 1).group == g)
+	{
+		const param_delta &d = history.at(--history._head);
+		TRACE_THR30IIPEDAL(Serial.printf("Undo: %s %08lx -> %08lx\n\r", THR30II_PARAMS[d.param].label, (unsigned long) d.after, (unsigned long) d.before);)
+		SetRaw(d.param, d.before);
+	}
+
+	history.paused = false;
+	history.BeginGroup();
+	sendChangestoTHR = send;
+	return true;
+}
+
+bool THR30II_Settings::Redo()  //apply the last undone group of changes again (sent to THR)
+{
+	if(!history.CanRedo())
+	{
+		return false;
+	}
+	bool send = sendChangestoTHR;
+	sendChangestoTHR = true;
+	history.paused = true;
+
+	uint16_t g = history.at(history._head).group;
+	while(history.CanRedo() && history.at(history._head).group == g)
+	{
+		const param_delta &d = history.at(history._head++);
+		TRACE_THR30IIPEDAL(Serial.printf("Redo: %s %08lx -> %08lx\n\r", THR30II_PARAMS[d.param].label, (unsigned long) d.before, (unsigned long) d.after);)
+		SetRaw(d.param, d.after);
+	}
+
+	history.paused = false;
+	history.BeginGroup();
+	sendChangestoTHR = send;
+	return true;
+}
+
+void THR30II_Settings::SendParam(THR30II_PARAM p)  //Send the stored value of a parameter to THR
+{
+	if(p >= P_COUNT)
+	{
+		return;
+	}
+	uint32_t before = GetRaw(mirror, p);
+	if(!SendParameterValue(un_cmd {THR30II_PARAM_KEYS[p].uk, THR30II_PARAM_KEYS[p].ck}, THR30II_ENC_CMD_TYPE[THR30II_PARAMS[p].enc], GetRaw(p), ParamAcks::Id(p)))
+	{
+		if(MIDI_Activated)  //out queue full: the mirror keeps THR's value
+		{
+			param_acks.Dropped(p);  //the sync marker shows it (see ParamAcks::Overdue())
+		}
+		return;
+	}
+	param_acks.Queued(p, before, GetRaw(p));
+	StoreRaw(mirror, p, GetRaw(p));  //optimistic, ParamTimeout() corrects it
+}
+
+bool THR30II_Settings::ParamTimeout(uint16_t id)  //Roll back a parameter change, that THR did not acknowledge
+{
+	uint32_t value = 0, rollback = 0;
+	THR30II_PARAM p = param_acks.Timeout(id, value, rollback);
+	if(p == P_NONE)
+	{
+		return id >= PARAM_ACK_ID && id < PARAM_ACK_ID + P_COUNT;  //marked lost (or superseded)
+	}
+	StoreRaw(mirror, p, rollback);  //THR kept the value it acknowledged last
+	if(GetRaw(p) == value)  //not changed again meanwhile
+	{
+		StoreRaw(*this, p, rollback);
+	}
+	TRACE_THR30IIPEDAL(Serial.printf("Parameter %u not acknowledged: rolled back %08lx -> %08lx\n\r", p, value, rollback);)
+	return true;
+}
+
+uint32_t THR30II_Settings::EncodeParam(THR30II_PARAM p, double value)  //convert a display value to the 32Bit MIDI value by the parameter's encoding
+{
+	THR30II_ENC enc = THR30II_PARAMS[p].enc;
+	if(value == floor(value) && value >= 0.0 && value <= 100.0)  //whole display values (buttons, UI) from the lookup table
+	{
+		return ParamDisplayToRaw(enc, (uint8_t) value);
+	}
+	switch(enc)
+	{
+		case ENC_THRESHOLD:
+			return ValToNumber_Threshold(value);
+		case ENC_ENUM:
+			return (uint32_t) value;
+		case ENC_BOOL:
+			return value != 0.0 ? 0x01u : 0x00u;
+		default:
+			return ValToNumber(value);  //fractions (e.g. from the pedals) still need the float conversion
+	}
+}
+
+double THR30II_Settings::DecodeParam(THR30II_PARAM p, uint32_t num)  //convert a 32Bit MIDI value to the display value by the parameter's encoding
+{
+	return ParamRawToDisplay(THR30II_PARAMS[p].enc, num);
+}
+
+uint8_t THR30II_Settings::ParamBars(double bars[5], std::initializer_list<THR30II_PARAM> params) const  //bar chart values (0..100) for the UI
+{
+	uint8_t n = 0;
+	for(THR30II_PARAM p : params)
+	{
+		if(n == 5)
+		{
+			break;
+		}
+		const param_def &d = THR30II_PARAMS[p];
+		bars[n++] = (GetParam(p) - d.ll) * 100.0 / (d.ul - d.ll);  //normalise to the parameter's limits
+	}
+	for(uint8_t i = n; i < 5; i++)
+	{
+		bars[i] = 0;
+	}
+	return n;
+}
+
+void THR30II_Settings::GateSetting(THR30II_GATE ctrl, double value) //Setter for gate effect parameters
+{
+	SetParam((THR30II_PARAM) (P_GA_THRESHOLD + ctrl), value);
+}
+
+void THR30II_Settings::CompressorSetting(THR30II_COMP ctrl, double value)  //Setter for compressor effect parameters
+{
+	SetParam((THR30II_PARAM) (P_CO_SUSTAIN + ctrl), value);
+}
+
+void THR30II_Settings::Switch_On_Off_Gate_Unit(bool state)   //Setter for switching on / off the effect unit
+{
+	SetParam(P_ON_GATE, state);
+}
+
+void THR30II_Settings::Switch_On_Off_Echo_Unit(bool state)   //Setter for switching on / off the Echo unit
+{
+	SetParam(P_ON_ECHO, state);
+}
+
+void THR30II_Settings::Switch_On_Off_Effect_Unit(bool state)   //Setter for switching on / off the effect unit
+{
+	SetParam(P_ON_EFFECT, state);
+}
+
+void THR30II_Settings::Switch_On_Off_Compressor_Unit(bool state)  //Setter for switching on /off the compressor unit
+{
+	SetParam(P_ON_COMPRESSOR, state);
+}
+
+void THR30II_Settings::Switch_On_Off_Reverb_Unit(bool state)   //Setter for switching on / off the reverb unit
+{
+	SetParam(P_ON_REVERB, state);
+}
+
+void THR30II_Settings::SetControl(uint8_t ctrl, double value)
+{
+	SetParam((THR30II_PARAM) (P_CTRL_GAIN + ctrl), value);
+}
+
+double THR30II_Settings::GetControl(uint8_t ctrl)
+{
+	return GetParam((THR30II_PARAM) (P_CTRL_GAIN + ctrl));
+}
+
+void THR30II_Settings::ReverbSelect(THR30II_REV_TYPES type)  //Setter for selection of the reverb type
+{
+	reverbtype = type;
+	
+	if (sendChangestoTHR)
+	{
+		SendTypeSetting(REVERB, THR30II_REV_TYPES_VALS[type].key);  //send reverb type change to THR
+	}
+
+	//Todo: await Acknowledge
+}
+
+void THR30II_Settings::EffectSelect(THR30II_EFF_TYPES type)   //Setter for selection of the Effect type
+{
+	effecttype = type;
+	
+	if (sendChangestoTHR)  //do not send back, if change results from THR itself
+	{
+		SendTypeSetting(EFFECT, THR30II_EFF_TYPES_VALS[type].key);  //send effect type change to THR
+	}
+
+	//Todo: await Acknowledge
+}
+
+void THR30II_Settings::EchoSelect(THR30II_ECHO_TYPES type)   //Setter for selection of the Effect type
+{
+	echotype = type;
+	
+	if (sendChangestoTHR)  //do not send back, if change results from THR itself
+	{
+		SendTypeSetting(ECHO, THR30II_ECHO_TYPES_VALS[type].key);  //send echo type change to THR
+	}
+
+	//Todo: await Acknowledge
+}
+
+THR30II_Settings::THR30II_Settings()  //Constructor
+{
+	dumpFrameNumber = 0; 
+	dumpByteCount = 0;  //received bytes
+	dumplen = 0;  //expected length in bytes
+    Firmware = 0x00000000;
+    ConnectedModel = 0x00000000; //FamilyID (2 Byte) + ModelNr.(2 Byte) , 0x0024_0002=THR30II
+	unit[EFFECT]=false;unit[ECHO]=false;unit[REVERB]=false;unit[COMPRESSOR]=false;unit[GATE]=false;
+}
+
+void THR30II_Settings::SetPatchName(String nam, int nr)  //nr = -1 as default for actual patchname
+{														 //corresponds to field "activeUserSetting"
+	TRACE_THR30IIPEDAL(Serial.println(String("SetPatchName(): Patchnname: ") + nam + String(" nr: ") + String(nr) );)
+	
+	nr = constrain(nr, 0, 5);  //make 0 based index for array patchNames[]
+
+	strncpy(patchNames[nr], nam.c_str(), PATCH_NAME_LEN); //cut, if necessary
+	patchNames[nr][PATCH_NAME_LEN] = '\0';
+
+	if (sendChangestoTHR)
+	{
+		CreateNamePatch();
+	}
+}
+
+//---------METHOD FOR UPLOADING PATCHNAME TO THR30II -----------------
+
+void THR30II_Settings::CreateNamePatch() //fill send buffer with just setting for actual patchname, creating a valid SysEx for sending to THR30II  
+{                             //a memory write like createPatch() - but only the Meta structure with the name (will only be  o n e  frame!)
+	TRACE_V_THR30IIPEDAL(Serial.println(F("Create_Name_Patch(): "));)
+
+	MemFrameWriter w(upload_frames);
+	w.put(tokens["StructOpen"]);
+	//Meta
+	w.put(tokens["Meta"]);
+	w.put(tokens["TokenMeta"]);
+	w.put2(0x0000); w.put4(0x00040000u);  //number 0x0000, type 0x00040000 (String)
+	w.put4(strlen(patchNames[0]) + 1);    //Length of patchname (incl. '\0')
+	w.put((const byte *)patchNames[0], strlen(patchNames[0]) + 1);  //the patchName and its '\0'  //!!ZWEZWE!! mind UTF-8 ?
+	w.put(tokens["StructClose"]);  //close Structure Meta
+
+	if(!w.finish())
+	{
+		TRACE_THR30IIPEDAL(Serial.println(F("Create_Name_patch(): Name does not fit in the frame buffer!"));)
+		return;
+	}
+	queueMemoryWrite(upload_frames, UPLOAD_MSG_ID);  //we have to await acknowledgment for the last frame
+
+	TRACE_THR30IIPEDAL(Serial.println(F("\n\rCreate_Name_patch(): Ready outsending."));)
+}
+
+
+String THR30II_Settings::getPatchName()
+{
+   return String(patchNames[constrain(activeUserSetting,0,5)]);
+}
+
+//Find the correct (col, amp)-struct object for this ampkey
+col_amp THR30IIAmpKey_ToColAmp(uint16_t ampkey)
+{ 
+
+	for(size_t c = 0; c < THR30IIAmpKeys.size(); c++)
+	{
+		size_t a = KeyIndex(THR30IIAmpKeys[c], ampkey);
+
+		if (a < THR30IIAmpKeys[c].size())
+		{
+			return col_amp((THR30II_COL) c, (THR30II_AMP) a);
+		}
+	}
+	return col_amp{CLASSIC,CLEAN};
+}
+
+//---------FUNCTION FOR SENDING COL/AMP SETTING TO THR30II -----------------
+void THR30II_Settings::SendColAmp() //Send COLLLECTION/AMP setting to THR
+{
+		uint16_t ak = THR30IIAmpKeys[col][amp];
+		SendTypeSetting(THR30II_UNITS::CONTROL, ak);
+}
+
+//---------FUNCTION FOR SENDING CAB SETTING TO THR30II -----------------
+void THR30II_Settings::SendCab() //Send cabinet setting to THR
+{
+	SendParam(P_CAB);
+}
+
+//---------FUNCTION FOR SENDING UNIT STATE TO THR30II -----------------
+void THR30II_Settings::SendUnitState(THR30II_UNITS un) //Send unit state setting to THR30II
+{
+	SendParam(THR30II_UNIT_ON_PARAMS[un]);
+}
+
+bool THR30II_Settings::SendParameterValue(un_cmd command, byte type, uint32_t c_val, uint16_t id)  //Send setting to THR (value already encoded)
+{
+	if (!MIDI_Activated)
+		return false;
+	
+	extern ArduinoQueue<Outmessage> outqueue;
+
+	if(outqueue.item_count() + 2 > outqueue.maxQueueSize())  //header and body, or none of them
+	{
+		TRACE_THR30IIPEDAL(Serial.println(F("SendParameterValue(): out queue full"));)
+		return false;
+	}
+
+	std::array<byte,16> raw_msg_body = {}; //4 Ints:  Unit + Setting + Type + Val
+	std::array<byte,8>  raw_msg_head = {};  //2 Ints:  Opcode + Len(Body)
+
+	raw_msg_head[0] = 0x0A;  //0x0A = Opcode for "parameter change"
+	raw_msg_head[4] = (byte) 16; //Length of body  
+
+	raw_msg_body[0] = (byte)(command.unit % 256);
+	raw_msg_body[1] = (byte)(command.unit / 256);
+	raw_msg_body[4] = (byte)(command.command % 256);
+	raw_msg_body[5] = (byte)(command.command / 256);
+	raw_msg_body[8] = type;
+
+	raw_msg_body[12] = (byte)(c_val & 0xFF);
+	raw_msg_body[13] = (byte)((c_val & 0xFF00) >> 8);
+	raw_msg_body[14] = (byte)((c_val & 0xFF0000) >> 16);
+	raw_msg_body[15] = (byte)((c_val & 0xFF000000) >> 24);
+
+	//Prepare Message-Body
+	std::array<byte,100> msg_body = { };
+	byte *mblast = msg_body.begin();
+
+	mblast=Enbucket(msg_body, raw_msg_body, raw_msg_body.end() );
+	
+	//PC_SYSEX_BEGIN.size() =7u
+	//msg_body.size() = 100u
+	std::array<byte,(size_t)(7u + 2u + 3u + 100u + 1u)>  sendbuf_body = {};  //for "00" and frame-counter; 3 for Lenght-Field, 1 for "F7"
+	byte* sbblast=sendbuf_body.begin();
+
+	sbblast=std::copy(PC_SYSEX_BEGIN.begin(), PC_SYSEX_BEGIN.end(), sbblast);
+	
+	sbblast++;
+	*sbblast++ = 0x00; //place holder for SysExSendCounter
+	*sbblast++ = 0x00;  //only one frame in this message
+	*sbblast++ = (byte)((raw_msg_body.size() - 1) / 16);  //Length Field (Hi)
+	*sbblast++ = (byte)((raw_msg_body.size() - 1) % 16); //Length Field (Low)
+
+	sbblast = std::copy(msg_body.begin(),mblast, sbblast);
+	*sbblast++ = SYSEX_STOP;
+	
+	//Prepare Message-Header
+	std::array<byte,16> msg_head = {};  //The 8 Bytes of raw_msg_head result in 2 groups of  (7 bytes+ 1 bitbucket byte)
+	byte * mhlast=msg_head.begin();
+	mhlast = Enbucket(msg_head, raw_msg_head, raw_msg_head.end());
+
+	//PC_SYSEX_BEGIN.size() =7u
+	//msg_body.size() = 100u
+	//msg_head.size() = 16u
+	std::array<byte, 7 + 2 + 3 + 16 + 1> sendbuf_head = {};  //29 Bytes
+	byte *sbhlast = sendbuf_head.begin();
+
+	sbhlast=std::copy(PC_SYSEX_BEGIN.begin(), PC_SYSEX_BEGIN.end(),sbhlast);
+
+	sbhlast++;
+	*sbhlast++ = 0x00;
+	*sbhlast++ = 0x00;  //only one frame in this message
+	*sbhlast++ = (byte)((raw_msg_head.size() - 1) / 16);  //Length Field (Hi)
+	*sbhlast++ = (byte)((raw_msg_head.size() - 1) % 16);  //Length Field (Low)
+	sbhlast=std::copy(msg_head.begin(), mhlast, sbhlast );
+	*sbhlast++ = SYSEX_STOP;
+	
+	sendbuf_head[PC_SYSEX_BEGIN.size() + 1] = UseSysExSendCounter();
+	
+	hexdump(sendbuf_head,sendbuf_head.size());
+	outqueue.enqueue(Outmessage(SysExMessage ( sendbuf_head.data(), sendbuf_head.size()),1000,false,false)); //no ack/answ for the header  
+	
+	sendbuf_body[PC_SYSEX_BEGIN.size() + 1] = UseSysExSendCounter();
+	hexdump(sendbuf_body,sbblast-sendbuf_body.begin());
+	outqueue.enqueue(Outmessage(SysExMessage( sendbuf_body.data(), sbblast-sendbuf_body.begin()),id,true,false)); //needs ack (SendParam() tracks it)
+	return true;
+}	//of SendParameterValue
+
+//---------FUNCTIONS FOR SENDING SETTINGS CHANGES TO THR30II -----------------
+
+void THR30II_Settings::SendTypeSetting(THR30II_UNITS unit, uint16_t val) //Send setting to THR (Col/Amp or Reverbtype or Effecttype)
+{
+	//This method is not really necessary for the THR30II-Pedal
+	//We need it on the PC where we can change settings separately
+	//
+	//Because with the the pedal settings are changed all together with complete MIDI-patches 
+	//Perhaps for future use: If knobs for switching on/off the units are added?
+ /*
+	if (!MIDI_Activated)
+		return;
+
+	byte[] raw_msg_body = new byte[8]; //2 Ints:  Unit + Val
+	byte[] raw_msg_head = new byte[8]; //2 Ints:  Opcode + Len(Body)
+	raw_msg_head[0] = 0x08;   //Opcode for unit type change
+	raw_msg_head[4] = (byte)raw_msg_body.Length;  //Length of the body
+
+	ushort key = THR30II_UNITS_VALS[unit].key;
+
+	raw_msg_body[0] = (byte)(key % 256);
+	raw_msg_body[1] = (byte)(key / 256);
+	raw_msg_body[4] = (byte)(val % 256);
+	raw_msg_body[5] = (byte)(val / 256);
+
+	//Prepare Message-Body
+	byte[] msg_body = Helpers.Enbucket(raw_msg_body);
+	byte[] sendbuf_body = new byte[PC_SYSEX_BEGIN.Length + 2 + 3 + msg_body.Length + 1];  //for "00" and frame-counter; 3 for Length-Field, 1 for "F7"
+
+	Buffer.BlockCopy(PC_SYSEX_BEGIN, 0, sendbuf_body, 0, PC_SYSEX_BEGIN.Length);
+	sendbuf_body[PC_SYSEX_BEGIN.Length] = 0x00;
+	sendbuf_body[PC_SYSEX_BEGIN.Length + 2] = 0x00;  //only one frame in this message
+	sendbuf_body[PC_SYSEX_BEGIN.Length + 3] = (byte)((raw_msg_body.Length - 1) / 16);  //Length Field (Hi)
+	sendbuf_body[PC_SYSEX_BEGIN.Length + 4] = (byte)((raw_msg_body.Length - 1) % 16); //Length Field (Low)
+	Buffer.BlockCopy(msg_body, 0, sendbuf_body, PC_SYSEX_BEGIN.Length + 5, msg_body.Length);
+	sendbuf_body[sendbuf_body.GetUpperBound(0)] = SYSEX_STOP;
+
+	//Prepare Message-Header
+	byte[] msg_head = Helpers.Enbucket(raw_msg_head);
+	byte[] sendbuf_head = new byte[PC_SYSEX_BEGIN.Length + 2 + 3 + msg_head.Length + 1];
+
+	Buffer.BlockCopy(PC_SYSEX_BEGIN, 0, sendbuf_head, 0, PC_SYSEX_BEGIN.Length);
+	sendbuf_head[PC_SYSEX_BEGIN.Length] = 0x00;
+	sendbuf_head[PC_SYSEX_BEGIN.Length + 2] = 0x00;  //only one frame in this message
+	sendbuf_head[PC_SYSEX_BEGIN.Length + 3] = (byte)((raw_msg_head.Length - 1) / 16);  //Length Field (Hi)
+	sendbuf_head[PC_SYSEX_BEGIN.Length + 4] = (byte)((raw_msg_head.Length - 1) % 16); //Length Field (Low)
+	Buffer.BlockCopy(msg_head, 0, sendbuf_head, PC_SYSEX_BEGIN.Length + 5, msg_head.Length);
+	sendbuf_head[sendbuf_head.GetUpperBound(0)] = SYSEX_STOP;
+
+	if (THR10_Editor.THR10_Settings.O_device == null)
+	{
+		return;
+	}
+	if (!THR10_Editor.THR10_Settings.O_device.IsOpen)
+	{
+		THR10_Editor.THR10_Settings.O_device?.Open();
+	}
+	sendbuf_head[PC_SYSEX_BEGIN.Length + 1] = THR30II_Window.SysExSendCounter++;
+	THR10_Editor.THR10_Settings.O_device?.Send(new SysExMessage(sendbuf_head));
+	sendbuf_body[PC_SYSEX_BEGIN.Length + 1] = THR30II_Window.SysExSendCounter++;
+	THR10_Editor.THR10_Settings.O_device?.Send(new SysExMessage(sendbuf_body));
+
+	if (THR10_Editor.THR10_Settings.O_device.IsOpen)
+	{
+		THR10_Editor.THR10_Settings.O_device.Close();
+	}
+
+	//ToDO:  Set Wait for ACK
+ */
+}
+
+String THR30II_Settings::THR30II_MODEL_NAME()
+{ 
+	switch(ConnectedModel) 
+	{
+		case 0x00240002:
+			return String("THR30II");
+			break;
+		
+		case 0x00240001:
+			return String("THR10II");
+			break;
+		default:
+			return String( "None");
+		break;
+	}
+}
+
+//                                             bool cut = true  (preset parameter)
+double THR30II_Settings::NumberToVal(uint32_t num, bool cut ) //convert the 32Bit parameter value to 0..100 Slider value 
+{
+    float val;
+    
+    if (num >= 998277251)  //=0.00392156979069  , cut hard to 0 if too small
+    {
+        memcpy(&val,&num,4);
+        //val = *((float*) &num);
+        val = 100.0*val;
+    }
+    else
+    {
+        val = 0;
+    }
+    return cut ? floor(val) : val;   //cut decimals, if requested (default)
+}
+//                                      bool cut = true  (preset parameter)
+double THR30II_Settings::NumberToVal_Threshold(uint32_t num, bool cut ) //convert the 32Bit parameter value to a 0..100 Slider value 
+{  
+    float val;
+    //0xC2C00000 read as float -> -96
+    //0xBE500000 read as float -> -0.203125
+    if (num >= 0xBE500000 && num < 0xC2C00000)
+    {
+        //val= *((float*) &num);
+        memcpy(&val,&num,4);
+        val = 100.0 + 100.0/96 * val;   //change range from [-96dB ... 0dB] to [0...100]
+    }
+    else if (num >= 0xC2C00000)
+    {
+        val = 0.0;
+    }
+    else
+    {
+        val = 100.0;
+    }
+
+    return cut ? floor(val) : val; //cut decimals, if requested (default)
+}
+
+uint32_t THR30II_Settings::ValToNumber(double val) //convert a 0..100 Slider value to a 32Bit parameter value 
+{
+    uint32_t number;
+    float v= val/(double)100.0;
+
+    memcpy(&number,&v,4);
+    //number= *((uint32_t*) &v);
+            
+    if (number < 999277251)
+    {
+        number = 0u;
+    }
+
+    return number;
+}
+
+uint32_t THR30II_Settings::ValToNumber_Threshold(double val) //convert a 0..100 Slider value to a 32Bit parameter value (for internal -96dB to 0dB range)
+{   
+    uint32_t number;
+    //val 0   -> -96dB
+    //val 100 ->   0dB
+    //-96       float read as uint32_t -> 0xC2C00000  
+    //-0.203125 float read as uint32_t -> 0xBE500000 
+    
+    float v=-(100.0-val) * 96.0 / 100.0 + 0.4; //change range from [0...100] to [-96dB ... 0dB]           
+
+    memcpy(&number,&v,4);
+    //number = *((uint32_t*) &v) ;
+
+    //Limit number to allowed range
+
+    if (number < 0xBE500000)
+    {
+        number = 0u;
+    }
+    if (number > 0xC2C00000)
+    {
+        number = 0xC2C00000;
+    }
+
+    return number;
+}
+
+SysExMessage::SysExMessage():Data(nullptr),Size(0) //standard constructor
+{
+};  
+
+SysExMessage::~SysExMessage() //destructor
+{
+	delete[] Data;
+	Size=0;
+};  
+
+SysExMessage::SysExMessage(const byte * data ,size_t size):Size(size) //Constructor
+{
+	Data=new byte[size];
+	memcpy(Data,data,size);
+};  
+SysExMessage::SysExMessage(const SysExMessage &other ):Size(other.Size)  //Copy Constructor
+{
+	Data=new byte[other.Size];
+	memcpy(Data,other.Data,other.Size);
+}
+SysExMessage::SysExMessage( SysExMessage &&other ) noexcept : Data(other.Data), Size(other.Size) //Move Constructor
+{
+	other.Data=nullptr;
+	other.Size=0;
+}
+SysExMessage & SysExMessage::operator=( const SysExMessage & other ) //Copy-assignment
+{
+	if(&other==this) return *this;
+	delete[] Data;
+	Data=new byte[other.Size];
+	memcpy(Data,other.Data,Size=other.Size);	   
+	return *this;
+} 
+
+SysExMessage & SysExMessage::operator=( SysExMessage && other ) noexcept //Move-assignment
+{
+	if(&other==this) return *this;
+	delete[] Data;
+	Size=other.Size;
+	Data=other.Data;
+	other.Size=0;
+	return *this;	   
+} 
+
+const byte * SysExMessage::getData()  //getter for the const byte-array
+{
+	return (const byte*) Data;
+}
+
+size_t SysExMessage::getSize()  //getter for the const byte-array
+{
+	return Size;
+}
@@ -0,0 +1,67 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* test/host/Arduino.h
+*  The few Arduino/Teensy definitions, the host tests ([env:native]) need from the firmware modules they build
+*/
+
+#ifndef _HOST_ARDUINO_H_
+#define _HOST_ARDUINO_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define F(s) (s)
+#define PROGMEM
+
+using std::min;
+using std::max;
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+//Time is only advanced by the test (replays run in simulated time)
+inline uint32_t host_us = 0;
+inline uint32_t micros() { return host_us; }
+inline uint32_t millis() { return host_us / 1000; }
+#define ARM_DWT_CYCCNT (host_us * 600u)  //cycle counter of the Teensy 4.1 (600 MHz)
+
+class String : public std::string
+{
+	public:
+	  String(const char *s = "") : std::string(s) {}
+	  String(const std::string &s) : std::string(s) {}
+	  String(int v) : std::string(std::to_string(v)) {}
+	  String substring(size_t from, size_t to) const { return substr(from, to - from); }
+};
+
+struct HostSerial
+{
+	bool quiet = false;  //drop the traces of the firmware modules (e.g. in tools/build_patchlib)
+	void print(const char *s) { if(!quiet) fputs(s, stdout); }
+	void println(const char *s = "") { if(!quiet) ::printf("%s\n", s); }
+	void println(const String &s) { println(s.c_str()); }
+	int printf(const char *fmt, ...)
+	{
+		if(quiet)
+		{
+			return 0;
+		}
+		va_list ap;
+		va_start(ap, fmt);
+		int n = vprintf(fmt, ap);
+		va_end(ap);
+		return n;
+	}
+};
+inline HostSerial Serial;
+
+#endif
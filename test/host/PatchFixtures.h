@@ -0,0 +1,141 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* test/host/PatchFixtures.h
+*  What the host tests of the settings model share: a symbol table, the patch files in test/fixtures and applying a decoded patch
+*/
+
+#ifndef _HOST_PATCHFIXTURES_H_
+#define _HOST_PATCHFIXTURES_H_
+
+#include <Arduino.h>
+#include <algorithm>
+#include <dirent.h>
+#include <string>
+#include <vector>
+#include "THR30II.h"
+#include "Globals.h"
+
+//test/fixtures (found from this header, so the tests do not depend on the working directory)
+inline std::string fixture_path(const char *sub)
+{
+	std::string folder = __FILE__;
+	return folder.substr(0, folder.find_last_of("/\\")) + "/../fixtures/" + sub;
+}
+
+//Names of the symbol table, that the model resolves (no table of a real THR is in the tree, so the keys are made up)
+static const char *const FIXTURE_SYMBOLS[] =
+{
+	"-",  //key 0 is no valid key (see PlanSync())
+	"FX1", "Amp", "FX2", "FX3", "FX4", "GuitarProc", "Y2GuitarFlow", "RedComp", "AmpEnableState",
+	"Phaser", "BiasTremolo", "L6Flanger", "StereoSquareChorus", "TapeEcho", "L6DigitalDelay",
+	"StandardSpring", "LargePlate1", "ReallyLargeHall", "SmallRoom1"
+};
+
+//Builds a symbol table dump as received from THR (see SymbolTable::adopt()) and resolves the dictionaries
+inline bool load_fixture_symbols(THR30II_Settings &s)
+{
+	std::vector<std::string> names(std::begin(FIXTURE_SYMBOLS), std::end(FIXTURE_SYMBOLS));
+	auto add = [&names](const char *n)
+	{
+		if(n[0] != '\0' && std::find(names.begin(), names.end(), n) == names.end())
+		{
+			names.push_back(n);
+		}
+	};
+	for(uint8_t c = CLASSIC; c <= MODERN; c++)
+	{
+		for(uint8_t a = CLEAN; a <= FLAT; a++)
+		{
+			add(ColAmp_ToAmpAsset((THR30II_COL) c, (THR30II_AMP) a));
+		}
+	}
+	for(const param_def &d : THR30II_PARAMS)
+	{
+		add(d.dk);
+		add(d.ck);
+	}
+
+	std::vector<byte> dump(12 * names.size() + 8, 0);
+	uint32_t count = names.size();
+	memcpy(dump.data(), &count, 4);
+	for(const std::string &n : names)
+	{
+		dump.insert(dump.end(), n.c_str(), n.c_str() + n.size() + 1);  //with its '\0'
+	}
+	byte *buf = new byte[dump.size()];
+	memcpy(buf, dump.data(), dump.size());
+	if(!Constants::set_all(buf, dump.size()))
+	{
+		return false;
+	}
+	s.Init_Dictionaries();
+	return true;
+}
+
+inline std::vector<std::string> patch_files()  //the .thrl6p files of test/fixtures/patches (sorted)
+{
+	std::string folder = fixture_path("patches/");
+	std::vector<std::string> files;
+	if(DIR *d = opendir(folder.c_str()))
+	{
+		while(dirent *e = readdir(d))
+		{
+			std::string fn = e->d_name;
+			if(fn.size() > 7 && fn.substr(fn.size() - 7) == ".thrl6p")
+			{
+				files.push_back(folder + fn);
+			}
+		}
+		closedir(d);
+	}
+	std::sort(files.begin(), files.end());
+	return files;
+}
+
+inline std::string read_file(const std::string &path)
+{
+	std::string s;
+	if(FILE *f = fopen(path.c_str(), "rb"))
+	{
+		char buf[1024];
+		size_t n;
+		while((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		{
+			s.append(buf, n);
+		}
+		fclose(f);
+	}
+	return s;
+}
+
+inline void apply_patch(THR30II_Settings &s, const THR30II_Patch &pat)  //like ApplyPatch() without MIDI: only the local fields
+{
+	s.sendChangestoTHR = false;
+	s.SetPatchName(pat.name, -1);
+	s.Tnid = pat.Tnid;
+	s.ParTempo = pat.ParTempo;
+	if(pat.col >= 0 && pat.amp >= 0) s.SetColAmp((THR30II_COL) pat.col, (THR30II_AMP) pat.amp);
+	if(pat.effecttype >= 0) s.EffectSelect((THR30II_EFF_TYPES) pat.effecttype);
+	if(pat.echotype >= 0) s.EchoSelect((THR30II_ECHO_TYPES) pat.echotype);
+	if(pat.reverbtype >= 0) s.ReverbSelect((THR30II_REV_TYPES) pat.reverbtype);
+	for(uint8_t i = 0; i < P_COUNT; i++)
+	{
+		if(pat.has.test(i))
+		{
+			s.SetRaw((THR30II_PARAM) i, pat.raw[i]);
+		}
+	}
+}
+
+inline bool same_frames(const PatchFrames &a, const PatchFrames &b)  //byte exact, frame by frame
+{
+	size_t len = 0;
+	for(uint8_t i = 0; i < a.count; i++)
+	{
+		len += a.len[i];
+	}
+	return a.count == b.count && memcmp(a.len, b.len, sizeof(a.len)) == 0 && memcmp(a.data, b.data, len) == 0;
+}
+
+#endif
@@ -0,0 +1,126 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* test/host/SD.h
+*  The SD-card for the host tests ([env:native]): File32 and SD on files below host_sd_root (date and time are always 0)
+*  Power loss is simulated by a budget: bytes written and file operations (create, truncate, rename, remove) reach the card
+*  in the order they are done, until the budget is used up. From then on, everything that changes the card fails.
+*/
+
+#ifndef _HOST_SD_H_
+#define _HOST_SD_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string>
+#include <algorithm>
+
+inline std::string host_sd_root = ".";  //folder of the "card"
+
+inline uint32_t host_sd_budget = UINT32_MAX;  //bytes and operations until power loss (UINT32_MAX: no power loss)
+inline uint32_t host_sd_spent = 0;            //bytes and operations done so far
+
+inline std::string host_sd_path(const char *path) { return host_sd_root + "/" + path; }
+
+inline uint32_t host_sd_spend(uint32_t n)  //part of n, that still reaches the card
+{
+	if(host_sd_budget != UINT32_MAX)
+	{
+		n = std::min(n, host_sd_budget);
+		host_sd_budget -= n;
+	}
+	host_sd_spent += n;
+	return n;
+}
+
+inline bool host_sd_fresh()  //an empty card (new folder below /tmp)
+{
+	char root[] = "/tmp/thr_sd_XXXXXX";
+	if(mkdtemp(root) == nullptr)
+	{
+		return false;
+	}
+	host_sd_root = root;
+	return true;
+}
+
+class File32
+{
+	public:
+	  File32() {}
+	  File32(const File32 &) = delete;
+	  File32 &operator=(const File32 &) = delete;
+	  ~File32() { close(); }
+
+	  bool open(const char *path, int oflag = O_RDONLY)
+	  {
+		close();
+		std::string p = host_sd_path(path);
+		FILE *exists = fopen(p.c_str(), "rb");
+		if(exists != nullptr)
+		{
+			fclose(exists);
+		}
+		if((oflag & O_TRUNC) || (exists == nullptr && (oflag & O_CREAT)))
+		{
+			_f = host_sd_spend(1) == 1 ? fopen(p.c_str(), "w+b") : nullptr;
+		}
+		else if(exists != nullptr)
+		{
+			_f = fopen(p.c_str(), (oflag & O_ACCMODE) == O_RDONLY ? "rb" : "r+b");
+		}
+		return _f != nullptr;
+	  }
+	  bool close()
+	  {
+		bool ok = _f != nullptr && fclose(_f) == 0;
+		_f = nullptr;
+		return ok;
+	  }
+	  bool isOpen() const { return _f != nullptr; }
+	  int read(void *buf, size_t n) { return _f ? (int) fread(buf, 1, n, _f) : -1; }
+	  int read() { return _f ? fgetc(_f) : -1; }
+	  size_t readBytes(char *buf, size_t n) { int r = read(buf, n); return r > 0 ? (size_t) r : 0; }
+	  size_t write(const void *buf, size_t n) { return _f ? fwrite(buf, 1, host_sd_spend(n), _f) : 0; }
+	  bool seekSet(uint32_t pos) { return _f != nullptr && fseek(_f, pos, SEEK_SET) == 0; }
+	  bool rewind() { return seekSet(0); }
+	  uint32_t fileSize() const
+	  {
+		if(_f == nullptr)
+		{
+			return 0;
+		}
+		long pos = ftell(_f);
+		fseek(_f, 0, SEEK_END);
+		long len = ftell(_f);
+		fseek(_f, pos, SEEK_SET);
+		return (uint32_t) len;
+	  }
+	  bool sync() { return _f != nullptr && fflush(_f) == 0 && host_sd_budget > 0; }
+	  bool truncate(uint32_t len) { return sync() && host_sd_spend(1) == 1 && ftruncate(fileno(_f), len) == 0; }
+	  bool getModifyDateTime(uint16_t *date, uint16_t *time) { *date = *time = 0; return _f != nullptr; }
+
+	private:
+	  FILE *_f = nullptr;
+};
+
+struct HostSD
+{
+	bool exists(const char *path)
+	{
+		FILE *f = fopen(host_sd_path(path).c_str(), "rb");
+		if(f != nullptr)
+		{
+			fclose(f);
+		}
+		return f != nullptr;
+	}
+	bool remove(const char *path) { return exists(path) && host_sd_spend(1) == 1 && ::remove(host_sd_path(path).c_str()) == 0; }
+	bool rename(const char *from, const char *to) { return exists(from) && host_sd_spend(1) == 1 && ::rename(host_sd_path(from).c_str(), host_sd_path(to).c_str()) == 0; }
+};
+inline HostSD SD;
+
+#endif
@@ -0,0 +1,238 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* test_journal
+*  Power loss at every byte and file operation of a save, a move and a compaction of the patch library:
+*  after the start sequence of the pedal (PatchJournal::recover(), PatchLibrary::open()) the library must show
+*  the last committed state. Prints the latency of a save and the longest CompactStep().
+*/
+
+#include <unity.h>
+#include <Arduino.h>
+#include <SD.h>
+#include <dirent.h>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include "PatchLibrary.h"
+#include "PatchFixtures.h"   //read_file()
+
+#define SOURCE  "patches.txt"
+#define LIBRARY "patches.thrlib"
+
+typedef std::map<std::string, std::string> Card;  //file name -> contents
+
+static PatchLibrary lib;
+
+void setUp() {}
+void tearDown() {}
+
+static std::string patch_text(const char *name)
+{
+	return std::string("{\"data\":{\"meta\":{\"name\":\"") + name + "\"},\"tone\":{}}}";
+}
+
+static Card card_read()
+{
+	Card c;
+	DIR *d = opendir(host_sd_root.c_str());
+	while(dirent *de = d != nullptr ? readdir(d) : nullptr)
+	{
+		if(de->d_name[0] != '.')
+		{
+			c[de->d_name] = read_file(host_sd_path(de->d_name));
+		}
+	}
+	if(d != nullptr)
+	{
+		closedir(d);
+	}
+	return c;
+}
+
+static void card_write(const Card &c)
+{
+	for(const auto &f : card_read())
+	{
+		::remove(host_sd_path(f.first.c_str()).c_str());
+	}
+	for(const auto &f : c)
+	{
+		FILE *h = fopen(host_sd_path(f.first.c_str()).c_str(), "wb");
+		TEST_ASSERT_NOT_NULL(h);
+		TEST_ASSERT_EQUAL_UINT32(f.second.size(), fwrite(f.second.data(), 1, f.second.size(), h));
+		fclose(h);
+	}
+}
+
+static bool boot()  //as setup() of THR30II_Pedal.cpp
+{
+	lib.close();
+	PatchJournal::recover(SOURCE, LIBRARY);
+
+	uint32_t srcLength = 0;
+	File32 file;
+	if(file.open(SOURCE, O_RDONLY))
+	{
+		srcLength = file.fileSize();
+		file.close();
+	}
+	bool libOk = lib.open(LIBRARY);
+	if(srcLength > 0 && !(libOk && lib.matchesSource(srcLength, 0)))
+	{
+		libOk = PatchLibrary::compile(SOURCE, LIBRARY) && lib.open(LIBRARY);
+	}
+	return libOk;
+}
+
+static std::string state()  //names of the index and of the records, position by position
+{
+	std::string s;
+	for(uint16_t nr = 1; nr <= lib.size(); nr++)
+	{
+		PatchLibEntry e;
+		DynamicJsonDocument doc(PATCH_SUMMARY_SIZE);
+		if(!lib.entry(nr, e) || lib.parse(e, doc, false))
+		{
+			return s + "error at #" + std::to_string(nr);
+		}
+		const char *name = doc["data"]["meta"]["name"].as<const char*>();
+		s += std::string(e.name) + "=" + (name != nullptr ? name : "?") + ";";
+	}
+	return s;
+}
+
+static bool save(uint16_t nr, const char *name)
+{
+	std::string text = patch_text(name);
+	PatchLibEntry e {};
+	strncpy(e.name, name, PATCH_NAME_LEN);
+	e.col = e.amp = e.cab = PATCHLIB_NONE;
+	return lib.Save(nr, text.data(), text.size(), e);
+}
+
+static bool compact()
+{
+	int8_t r;
+	while((r = lib.CompactStep(SOURCE)) == 1)
+	{
+	}
+	return r == 0;
+}
+
+//Runs op on the card before, with power loss after each byte or file operation it does.
+//The state after the next start must be the one before, until op committed, and the one after from then on.
+//commit: bytes and operations of op, after which the new state is mandatory
+static Card cut_everywhere(const Card &before, const std::function<bool()> &op, const char *name, uint32_t commit)
+{
+	card_write(before);
+	TEST_ASSERT_TRUE(boot());
+	std::string old = state();
+	host_sd_spent = 0;
+	TEST_ASSERT_TRUE(op());
+	uint32_t total = host_sd_spent;
+	std::string now = state();
+	Card after = card_read();
+	TEST_ASSERT_TRUE(boot());
+	TEST_ASSERT_EQUAL_STRING(now.c_str(), state().c_str());
+
+	uint32_t first_new = total + 1;
+	for(uint32_t cut = 0; cut < total; cut++)
+	{
+		card_write(before);
+		TEST_ASSERT_TRUE(boot());
+		host_sd_budget = cut;
+		op();
+		lib.close();
+		host_sd_budget = UINT32_MAX;
+
+		TEST_ASSERT_TRUE_MESSAGE(boot(), (std::string(name) + ": no library after power loss at " + std::to_string(cut)).c_str());
+		std::string s = state();
+		if(s == now && first_new > total)
+		{
+			first_new = cut;
+		}
+		std::string msg = std::string(name) + ": power loss at " + std::to_string(cut) + " of " + std::to_string(total);
+		TEST_ASSERT_EQUAL_STRING_MESSAGE((cut < first_new ? old : now).c_str(), s.c_str(), msg.c_str());
+		TEST_ASSERT_TRUE_MESSAGE(cut < total - commit || s == now, msg.c_str());
+		TEST_ASSERT_TRUE_MESSAGE(lib.writable(), msg.c_str());
+	}
+	Serial.printf("%s: %u power losses, new state from %u on\n", name, (unsigned) total, (unsigned) first_new);
+	return after;
+}
+
+static Card base;  //library of 4 patches, compiled on the pedal
+
+void test_build_library()
+{
+	TEST_ASSERT_TRUE(host_sd_fresh());
+	std::string text;
+	for(const char *n : { "One", "Two", "Three", "Four" })
+	{
+		text += patch_text(n) + "\r\n";
+	}
+	File32 f;
+	TEST_ASSERT_TRUE(f.open(SOURCE, O_RDWR | O_CREAT | O_TRUNC));
+	TEST_ASSERT_EQUAL_UINT32(text.size(), f.write(text.data(), text.size()));
+	f.close();
+	TEST_ASSERT_TRUE(boot());
+	TEST_ASSERT_EQUAL_STRING("One=One;Two=Two;Three=Three;Four=Four;", state().c_str());
+	lib.close();
+	base = card_read();
+}
+
+void test_power_loss()  //a save, a new patch, a move, then the compaction of all of them
+{
+	Card c = cut_everywhere(base, [] { return save(2, "Saved"); }, "save", sizeof(JournalIndex));
+	c = cut_everywhere(c, [] { return save(5, "Five"); }, "new patch", sizeof(JournalIndex));
+	c = cut_everywhere(c, [] { return lib.Move(1, 5); }, "move", sizeof(JournalIndex));
+	TEST_ASSERT_TRUE(boot());
+	TEST_ASSERT_EQUAL_STRING("Five=Five;Saved=Saved;Three=Three;Four=Four;One=One;", state().c_str());
+	cut_everywhere(c, compact, "compaction", 0);
+	TEST_ASSERT_EQUAL_STRING("Five=Five;Saved=Saved;Three=Three;Four=Four;One=One;", state().c_str());
+
+	c = cut_everywhere(base, [] { return lib.Move(2, 3); }, "move only", sizeof(JournalIndex));
+	cut_everywhere(c, compact, "compaction of moves", 0);  //the new text file has the length of the old one
+	TEST_ASSERT_EQUAL_STRING("One=One;Three=Three;Two=Two;Four=Four;", state().c_str());
+}
+
+void test_latency()
+{
+	card_write(base);
+	TEST_ASSERT_TRUE(boot());
+	const uint32_t n = 30;
+	double worst = 0, sum = 0;
+	for(uint32_t i = 0; i < n; i++)
+	{
+		auto t0 = std::chrono::steady_clock::now();
+		TEST_ASSERT_TRUE(save(1 + i % 4, ("Saved " + std::to_string(i)).c_str()));
+		double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+		sum += us;
+		worst = std::max(worst, us);
+	}
+	TEST_ASSERT_TRUE(lib.needsCompaction() || n < JOURNAL_SLOTS / 2);
+
+	double copy = 0, last = 0;  //longest step copying a patch, last step (replaces the text file, compiles the library)
+	int r;
+	do
+	{
+		auto t0 = std::chrono::steady_clock::now();
+		r = lib.CompactStep(SOURCE);
+		last = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+		copy = r == 1 ? std::max(copy, last) : copy;
+	}
+	while(r == 1);
+	TEST_ASSERT_EQUAL_INT(0, r);
+	Serial.printf("Save: %.1f us average, %.1f us worst\n", sum / n, worst);
+	Serial.printf("CompactStep: longest %.1f us (copying a patch: %.1f us, finishing: %.1f us)\n", std::max(copy, last), copy, last);
+}
+
+int main()
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_build_library);
+	RUN_TEST(test_power_loss);
+	RUN_TEST(test_latency);
+	return UNITY_END();
+}
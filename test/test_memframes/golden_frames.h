@@ -0,0 +1,143 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* golden_frames.h
+*  Memory write frames as built by the former createPatch()/CreateNamePatch() (slicing, length fields and header
+*  assembled with Enbucket() per frame), for data bytes golden_data(0...len-1)
+*/
+
+#ifndef _GOLDEN_FRAMES_H_
+#define _GOLDEN_FRAMES_H_
+
+#include <Arduino.h>
+#include "MemFrameWriter.h"
+
+inline byte golden_data(uint32_t i) { return (byte)((i * 151u + 17u) ^ (i >> 3)); }  //all bit patterns, MSBs included
+
+struct GoldenWrite
+{
+	uint32_t len;                              //data bytes
+	uint32_t target;                           //user preset 0..4 or 0xFFFFFFFF (actual patch)
+	uint8_t count;                             //frames
+	const char *frames[PATCH_FRAMES_MAX];      //hex, header frame first
+};
+
+static const GoldenWrite GOLDEN_WRITES[] =
+{
+	//single byte
+	{ 1, 0xFFFFFFFFu, 2, {
+	  "f000010c24024d010600010b000d0000001500003c007f7f7f7f0d0000000000000000010000000000000000f7",
+	  "f000010c24024d01070000000011000000000000f7",
+	} },
+	//one full 8/7 group
+	{ 7, 0xFFFFFFFFu, 2, {
+	  "f000010c24024d010600010b000d0000001b00003c007f7f7f7f130000000000000000010000000000000000f7",
+	  "f000010c24024d01070000062911283f566d041bf7",
+	} },
+	//as long as a patch name write (CreateNamePatch())
+	{ 42, 0xFFFFFFFFu, 2, {
+	  "f000010c24024d010600010b000d0000003e00003c007f7f7f7f360000000000000000010000000000000000f7",
+	  "f000010c24024d01070002092911283f566d041b2d324861760f243d35526b031a2d445f157609203a53647d56162f4059750c1b523249607f162c45f7",
+	} },
+	//one byte short of a slice
+	{ 209, 0xFFFFFFFFu, 2, {
+	  "f000010c24024d010600010b040d0000006500003e007f7f7f7f5d0000000000000000010000000000000000f7",
+	  "f000010c24024d0107000d002911283f566d041b2d324861760f243d35526b031a2d445f157609203a53647d56162f4059750c1b523249607f162c454a526b00"
+	  "19364f676b7e09203b526d04291e374059720b242d3d5960771e254c35537a00293e476c14751a234b52650c56173e4168721b2c5a355e6708113d444a537a01"
+	  "28375e642b0d1a2348517e07292f364168731a25254c567f08113a43356c7501382f467d54140b225871661f52342d427b130a3d5a544f6619302a434a746d06"
+	  "3f5049652b1c0b2259706f062d3c55427b100926255f776e19302b42157d140e27504962541b342d4970670e52355c436a10392e5a577c650a335b00f7",
+	} },
+	//exactly one slice
+	{ 210, 0xFFFFFFFFu, 2, {
+	  "f000010c24024d010600010b040d0000006600003e007f7f7f7f5e0000000000000000010000000000000000f7",
+	  "f000010c24024d0107000d012911283f566d041b2d324861760f243d35526b031a2d445f157609203a53647d56162f4059750c1b523249607f162c454a526b00"
+	  "19364f676b7e09203b526d04291e374059720b242d3d5960771e254c35537a00293e476c14751a234b52650c56173e4168721b2c5a355e6708113d444a537a01"
+	  "28375e642b0d1a2348517e07292f364168731a25254c567f08113a43356c7501382f467d54140b225871661f52342d427b130a3d5a544f6619302a434a746d06"
+	  "3f5049652b1c0b2259706f062d3c55427b100926255f776e19302b42157d140e27504962541b342d4970670e52355c436a10392e5a577c650a335b42f7",
+	} },
+	//one byte into the 2nd slice, user preset 3
+	{ 211, 0x00000003u, 3, {
+	  "f000010c24024d010600010b040d0000006700000200030000005f0000000000000000010000000000000000f7",
+	  "f000010c24024d0107000d012911283f566d041b2d324861760f243d35526b031a2d445f157609203a53647d56162f4059750c1b523249607f162c454a526b00"
+	  "19364f676b7e09203b526d04291e374059720b242d3d5960771e254c35537a00293e476c14751a234b52650c56173e4168721b2c5a355e6708113d444a537a01"
+	  "28375e642b0d1a2348517e07292f364168731a25254c567f08113a43356c7501382f467d54140b225871661f52342d427b130a3d5a544f6619302a434a746d06"
+	  "3f5049652b1c0b2259706f062d3c55427b100926255f776e19302b42157d140e27504962541b342d4970670e52355c436a10392e5a577c650a335b42f7",
+	  "f000010c24024d01070100004075000000000000f7",
+	} },
+	//as long as a typical patch upload (createPatch())
+	{ 1337, 0xFFFFFFFFu, 8, {
+	  "f000010c24024d010600010b000d0000004d05003c007f7f7f7f450500000000000000010000000000000000f7",
+	  "f000010c24024d0107000d012911283f566d041b2d324861760f243d35526b031a2d445f157609203a53647d56162f4059750c1b523249607f162c454a526b00"
+	  "19364f676b7e09203b526d04291e374059720b242d3d5960771e254c35537a00293e476c14751a234b52650c56173e4168721b2c5a355e6708113d444a537a01"
+	  "28375e642b0d1a2348517e07292f364168731a25254c567f08113a43356c7501382f467d54140b225871661f52342d427b130a3d5a544f6619302a434a746d06"
+	  "3f5049652b1c0b2259706f062d3c55427b100926255f776e19302b42157d140e27504962541b342d4970670e52355c436a10392e5a577c650a335b42f7",
+	  "f000010c24024d0107010d016a751c072e517862290b3c254e7718012d2d54436a113827354e741d0a335841156e173f26517863560a355c466f1801522a537c"
+	  "6531081f4a764d243b1268416b562f041d724b23293a0d647f5629002d1a73445d360f603579552c3b126940145f360c65724b205639166f475e29005a1b724d"
+	  "243e17604a79522b041d79406b573e056c735a2029091e674c553a03256b72452c371e613548523b0c157e475428311d64735a215208177e442d3a035a68715e"
+	  "270f16614a48533a056c765f2b28311a634c55212d180f665d342b02257851463f140d62155b332a1d746f465439100a63544d26521f7069453c2b02f7",
+	  "f000010c24024d0107020d015a79504f261c75626a5b3029067f574e2939100b625d342e2d077069423b140d256950472e157c63154a30190e775c45562a137b"
+	  "62553c27520e7158422b1c054a6e5738210d74636b4a3118076e543d292a1378614e371f2d067158432a157c35664f38210a735c144551687f162d44565b7208"
+	  "21364f645a7d122b435a6d044a1f3649607a13246b3d566f0019354c295b7209203f566c2505122b4059760f35273e49607b122d54445e770019324b56647d19"
+	  "20375e655a0c133a40697e074a2c355a630b12252b4c577e0128325b2d6c751e2748517d2504133a4168771e15244d5a6308113e54476f760128335af7",
+	  "f000010c24024d0107030d0152650c163f48517a5a032c3541786f066a3d544b62183126295f746d023b534a2d7d140f2659706a2503342d467f100915255c4b"
+	  "6219302f56467c15023b504952661f372e59706b4a023d544e6710096a225b746d093027294e751c032a50792d6e173c254a731b3502355c476e113814224b7c"
+	  "650e375856416d14032a51785a670e345d4a73184a012e577f6611386b234a751c062f5829416a133c257148255f360d647b52283501166f445d320b54637a4d"
+	  "243f166956405a33041d764f5a2039156c7b52294a001f764c25320b2b6079562f071e692d405b320d647e57252039126b445d393500177e452c331af7",
+	  "f000010c24024d0107040d015460495e270c157a52432b32056c775e5a2108127b4c553e6a0768715d24331a296148573e046d7a2d4328311e674f5625210813"
+	  "7a452c36151f68715a230c155661584f261d746b52423811067f544d4a221b736a5d342f6a0679504a23140d29665f3029057c6b2d4239100f665c3535221b70"
+	  "69463f17140e79504b221d74566e473029027b54524d2910076e553c4a230a70594e371c6b056a533b22157c29674e3118026b5c25452e1778614d3435230a71"
+	  "58472e14547d6a5338210e77565f463118036a555a3c260f78614a33551c0511283f566d54041b324861760f52243d526b031a2d5a445f7609203a53f7",
+	  "f000010c24024d0107050d014a647d162f4059752b0c1b3249607f162d2c45526b001936254f677e09203b52156d041e37405972540b243d5960771e52254c53"
+	  "7a00293e5a476c751a234b526a650c173e416872291b2c355e6708112d3d44537a012837355e640d1a234851157e072f36416873561a254c567f0811523a436c"
+	  "7501382f4a467d140b2258716b661f342d427b13290a3d544f6619302d2a43746d063f503549651c0b225970146f063c55427b105609265f776e19305a2b427d"
+	  "140e27504a49621b342d49706b670e355c436a1029392e577c650a33255b42751c072e513578620b3c254e775418012d54436a115238274e741d0a33f7",
+	  "f000010c24024d010706040c5a58416e173f26514a78630a355c466f2b18012a537c65312d081f764d243b12256841562f041d72154b233a0d647f565429001a"
+	  "73445d36520f6079552c3b125a69405f360c65726a4b2039166f475e2929001b724d243ef7",
+	} },
+	//ten full slices, user preset 0
+	{ 2100, 0x00000000u, 11, {
+	  "f000010c24024d010600010b000d000000480800000000000000400800000000000000010000000000000000f7",
+	  "f000010c24024d0107000d012911283f566d041b2d324861760f243d35526b031a2d445f157609203a53647d56162f4059750c1b523249607f162c454a526b00"
+	  "19364f676b7e09203b526d04291e374059720b242d3d5960771e254c35537a00293e476c14751a234b52650c56173e4168721b2c5a355e6708113d444a537a01"
+	  "28375e642b0d1a2348517e07292f364168731a25254c567f08113a43356c7501382f467d54140b225871661f52342d427b130a3d5a544f6619302a434a746d06"
+	  "3f5049652b1c0b2259706f062d3c55427b100926255f776e19302b42157d140e27504962541b342d4970670e52355c436a10392e5a577c650a335b42f7",
+	  "f000010c24024d0107010d016a751c072e517862290b3c254e7718012d2d54436a113827354e741d0a335841156e173f26517863560a355c466f1801522a537c"
+	  "6531081f4a764d243b1268416b562f041d724b23293a0d647f5629002d1a73445d360f603579552c3b126940145f360c65724b205639166f475e29005a1b724d"
+	  "243e17604a79522b041d79406b573e056c735a2029091e674c553a03256b72452c371e613548523b0c157e475428311d64735a215208177e442d3a035a68715e"
+	  "270f16614a48533a056c765f2b28311a634c55212d180f665d342b02257851463f140d62155b332a1d746f465439100a63544d26521f7069453c2b02f7",
+	  "f000010c24024d0107020d015a79504f261c75626a5b3029067f574e2939100b625d342e2d077069423b140d256950472e157c63154a30190e775c45562a137b"
+	  "62553c27520e7158422b1c054a6e5738210d74636b4a3118076e543d292a1378614e371f2d067158432a157c35664f38210a735c144551687f162d44565b7208"
+	  "21364f645a7d122b435a6d044a1f3649607a13246b3d566f0019354c295b7209203f566c2505122b4059760f35273e49607b122d54445e770019324b56647d19"
+	  "20375e655a0c133a40697e074a2c355a630b12252b4c577e0128325b2d6c751e2748517d2504133a4168771e15244d5a6308113e54476f760128335af7",
+	  "f000010c24024d0107030d0152650c163f48517a5a032c3541786f066a3d544b62183126295f746d023b534a2d7d140f2659706a2503342d467f100915255c4b"
+	  "6219302f56467c15023b504952661f372e59706b4a023d544e6710096a225b746d093027294e751c032a50792d6e173c254a731b3502355c476e113814224b7c"
+	  "650e375856416d14032a51785a670e345d4a73184a012e577f6611386b234a751c062f5829416a133c257148255f360d647b52283501166f445d320b54637a4d"
+	  "243f166956405a33041d764f5a2039156c7b52294a001f764c25320b2b6079562f071e692d405b320d647e57252039126b445d393500177e452c331af7",
+	  "f000010c24024d0107040d015460495e270c157a52432b32056c775e5a2108127b4c553e6a0768715d24331a296148573e046d7a2d4328311e674f5625210813"
+	  "7a452c36151f68715a230c155661584f261d746b52423811067f544d4a221b736a5d342f6a0679504a23140d29665f3029057c6b2d4239100f665c3535221b70"
+	  "69463f17140e79504b221d74566e473029027b54524d2910076e553c4a230a70594e371c6b056a533b22157c29674e3118026b5c25452e1778614d3435230a71"
+	  "58472e14547d6a5338210e77565f463118036a555a3c260f78614a33551c0511283f566d54041b324861760f52243d526b031a2d5a445f7609203a53f7",
+	  "f000010c24024d0107050d014a647d162f4059752b0c1b3249607f162d2c45526b001936254f677e09203b52156d041e37405972540b243d5960771e52254c53"
+	  "7a00293e5a476c751a234b526a650c173e416872291b2c355e6708112d3d44537a012837355e640d1a234851157e072f36416873561a254c567f0811523a436c"
+	  "7501382f4a467d140b2258716b661f342d427b13290a3d544f6619302d2a43746d063f503549651c0b225970146f063c55427b105609265f776e19305a2b427d"
+	  "140e27504a49621b342d49706b670e355c436a1029392e577c650a33255b42751c072e513578620b3c254e775418012d54436a115238274e741d0a33f7",
+	  "f000010c24024d0107060d015a58416e173f26514a78630a355c466f2b18012a537c65312d081f764d243b12256841562f041d72154b233a0d647f565429001a"
+	  "73445d36520f6079552c3b125a69405f360c65726a4b2039166f475e2929001b724d243e2d176079522b041d257940573e056c73155a20091e674c55563a036b"
+	  "72452c37521e6148523b0c154a7e4728311d64736b5a2108177e442d293a0368715e270f2d166148533a056c35765f28311a634c145521180f665d34562b0278"
+	  "51463f145a0d625b332a1d744a6f4639100a63546b4d261f7069453c292b0279504f261c2575625b3029067f35574e39100b625d54342e077069423bf7",
+	  "f000010c24024d0107070d0156140d6950472e155a7c634a30190e774a5c452a137b62552b3c270e7158422b2d1c056e5738210d2574634a3118076e15543d2a"
+	  "1378614e54371f067158432a52157c664f38210a5a735c4551687f166a2d445b72082136294f647d122b435a2d6d041f3649607a2513243d566f001915354c5b"
+	  "7209203f56566c05122b405952760f273e49607b4a122d445e7700196a324b647d192037295e650c133a40692d7e072c355a630b3512254c577e012814325b6c"
+	  "751e274856517d04133a41685a771e244d5a63084a113e476f7601286b335a650c163f4829517a032c354178256f063d544b62183531265f746d023bf7",
+	  "f000010c24024d0107080d0154534a7d140f265956706a03342d467f5a1009255c4b62194a302f467c15023b2b5049661f372e592d706b023d544e6725100922"
+	  "5b746d093530274e751c032a5450796e173c254a52731b02355c476e5a1138224b7c650e6a3758416d14032a295178670e345d4a2d7318012e577f6625113823"
+	  "4a751c06152f58416a133c255671485f360d647b52522801166f445d4a320b637a4d243f6a1669405a33041d29764f2039156c7b2d5229001f764c2535320b60"
+	  "79562f07141e69405b320d64567e572039126b44525d3900177e452c4a331a60495e270c6b157a432b32056c29775e2108127b4c25553e0768715d24f7",
+	  "f000010c24024d0107090d0135331a6148573e04546d7a4328311e67564f562108137a455a2c361f68715a234a0c1561584f261d2b746b423811067f2d544d22"
+	  "1b736a5d25342f0679504a2335140d665f302905547c6b4239100f66525c35221b7069465a3f170e79504b226a1d746e473029022b7b544d2910076e2d553c23"
+	  "0a70594e25371c056a533b2215157c674e311802566b5c452e177861524d34230a7158474a2e147d6a5338216a0e775f46311803296a553c260f78612a4a331c"
+	  "0511283f4a566d041b3248616b760f243d526b03291a2d445f7609202d3a53647d162f403559750c1b324960147f162c45526b005619364f677e0920f7",
+	} },
+};
+
+#endif
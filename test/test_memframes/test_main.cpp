@@ -0,0 +1,90 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* test_memframes
+*  MemFrameWriter against the frames of the former createPatch()/CreateNamePatch() (see golden_frames.h)
+*/
+
+#include <unity.h>
+#include <Arduino.h>
+#include <string>
+#include "MemFrameWriter.h"
+#include "golden_frames.h"
+
+static PatchFrames frames;
+
+static std::string hex(const byte *p, size_t n)
+{
+	static const char digits[] = "0123456789abcdef";
+	std::string s;
+	for(size_t i = 0; i < n; i++)
+	{
+		s += digits[p[i] >> 4];
+		s += digits[p[i] & 0x0f];
+	}
+	return s;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_golden_writes()
+{
+	for(const GoldenWrite &g : GOLDEN_WRITES)
+	{
+		MemFrameWriter w(frames);
+		for(uint32_t i = 0; i < g.len; i++)
+		{
+			w.put(golden_data(i));
+		}
+		char what[40];
+		snprintf(what, sizeof(what), "%lu bytes, target %lx", (unsigned long) g.len, (unsigned long) g.target);
+		TEST_ASSERT_TRUE_MESSAGE(w.finish(g.target), what);
+		TEST_ASSERT_EQUAL_UINT32_MESSAGE(g.len, w.length(), what);
+		TEST_ASSERT_EQUAL_UINT8_MESSAGE(g.count, frames.count, what);
+
+		const byte *d = frames.data;
+		for(uint8_t f = 0; f < frames.count; f++)  //byte exact, frame by frame
+		{
+			TEST_ASSERT_EQUAL_STRING_MESSAGE(g.frames[f], hex(d, frames.len[f]).c_str(), what);
+			d += frames.len[f];
+		}
+	}
+}
+
+void test_put_widths()  //put2()/put4() are little endian like the former byte by byte assembly
+{
+	MemFrameWriter a(frames);
+	a.put2(0x0201);
+	a.put4(0x06050403u);
+	a.finish();
+	const std::string wide = hex(frames.data, frames.len[0] + frames.len[1]);
+
+	MemFrameWriter b(frames);
+	for(byte v = 1; v <= 6; v++)
+	{
+		b.put(v);
+	}
+	b.finish();
+	TEST_ASSERT_EQUAL_STRING(wide.c_str(), hex(frames.data, frames.len[0] + frames.len[1]).c_str());
+}
+
+void test_overflow()  //more slices than PATCH_FRAMES_MAX: nothing prepared
+{
+	MemFrameWriter w(frames);
+	for(uint32_t i = 0; i < 210u * PATCH_FRAMES_MAX; i++)
+	{
+		w.put(golden_data(i));
+	}
+	TEST_ASSERT_FALSE(w.finish());
+	TEST_ASSERT_EQUAL_UINT8(0, frames.count);
+}
+
+int main()
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_golden_writes);
+	RUN_TEST(test_put_widths);
+	RUN_TEST(test_overflow);
+	return UNITY_END();
+}
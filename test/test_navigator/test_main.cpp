@@ -0,0 +1,233 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* test_navigator
+*  PatchNavigator on a library of 1000 patches: the name index (sorted on the card) against a sort in RAM,
+*  the worst case presses of MaxPresses() against a search over all buttons, the cost of steps, jumps and index lookups,
+*  and favourites and recently used patches following a move in the library
+*/
+
+#include <unity.h>
+#include <Arduino.h>
+#include <SD.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "PatchLibrary.h"
+#include "PatchNavigator.h"
+
+#define NAV_TEST_PATCHES 1000
+
+static PatchLibrary lib;
+static PatchNavigator nav;
+static std::vector<std::string> names;  //by patch nr - 1
+
+void setUp() {}
+void tearDown() {}
+
+static void make_names()  //mixed case, digits and long common beginnings (the sort compares more than the 8 key characters)
+{
+	static const char *const words[] = { "Clean", "crunch", "Lead", "Hi Gain", "Special", "bass", "Aco", "Flat", "Blues", "Metal",
+	                                     "Jazz", "funk", "Rock", "Ambient", "Twang", "Doom", "80s", "Solo", "Rhythm", "Wah" };
+	static const char *const tails[] = { "Spring", "Tremolo", "Flanger", "Chorus", "Plate", "Hall", "Room", "Echo" };
+	uint32_t r = 1;
+	for(uint32_t i = 0; i < NAV_TEST_PATCHES; i++)
+	{
+		r = r * 1103515245u + 12345u;
+		char name[PATCH_NAME_LEN + 1];
+		snprintf(name, sizeof(name), "%s %s %u", words[(r >> 8) % 20], tails[(r >> 16) % 8], (unsigned)((r >> 20) % 50));
+		names.push_back(name);
+	}
+}
+
+static void select(NavList l, uint8_t bank)
+{
+	while(nav.list() != l)
+	{
+		nav.NextList();
+	}
+	while(nav.bankSize() != bank)
+	{
+		nav.NextBankSize();
+	}
+}
+
+static int name_cmp(const std::string &a, const std::string &b)  //like the navigator: case insensitive
+{
+	for(size_t i = 0; ; i++)
+	{
+		int c = toupper((unsigned char) a.c_str()[i]) - toupper((unsigned char) b.c_str()[i]);
+		if(c != 0 || a.c_str()[i] == '\0')
+		{
+			return c;
+		}
+	}
+}
+
+void test_build_library()
+{
+	TEST_ASSERT_TRUE(host_sd_fresh());
+	make_names();
+	File32 f;
+	TEST_ASSERT_TRUE(f.open("patches.txt", O_RDWR | O_CREAT | O_TRUNC));
+	for(const std::string &n : names)
+	{
+		std::string rec = "{\"data\":{\"meta\":{\"name\":\"" + n + "\"},\"tone\":{}}}\n";
+		TEST_ASSERT_EQUAL_UINT32(rec.size(), f.write(rec.data(), rec.size()));
+	}
+	f.close();
+	TEST_ASSERT_TRUE(PatchLibrary::compile("patches.txt", "patches.thrlib"));
+	TEST_ASSERT_TRUE(lib.open("patches.thrlib"));
+	TEST_ASSERT_EQUAL_UINT16(NAV_TEST_PATCHES, lib.size());
+
+	auto t0 = std::chrono::steady_clock::now();
+	nav.begin(&lib, lib.size());
+	auto t1 = std::chrono::steady_clock::now();
+	Serial.printf("Name index of %d patches built on the card in %.1f ms\n", NAV_TEST_PATCHES, std::chrono::duration<double, std::milli>(t1 - t0).count());
+	TEST_ASSERT_TRUE(SD.exists(NAV_FILE));
+}
+
+void test_name_index()  //the names list is the sort in RAM (ties in patch order)
+{
+	std::vector<uint16_t> expect(NAV_TEST_PATCHES);
+	for(uint16_t i = 0; i < NAV_TEST_PATCHES; i++)
+	{
+		expect[i] = i + 1;
+	}
+	std::stable_sort(expect.begin(), expect.end(), [](uint16_t a, uint16_t b) { return name_cmp(names[a - 1], names[b - 1]) < 0; });
+
+	select(NAV_NAMES, 5);
+	uint16_t nr = nav.Step(0, 0);
+	for(uint16_t i = 0; i < NAV_TEST_PATCHES; i++, nr = nav.Step(nr, 1))
+	{
+		TEST_ASSERT_EQUAL_UINT16(expect[i], nr);
+	}
+	TEST_ASSERT_EQUAL_UINT16(expect[0], nr);  //wraps around
+
+	nav.begin(&lib, lib.size());  //index of the file is taken (not built again)
+	select(NAV_NAMES, 5);
+	TEST_ASSERT_EQUAL_UINT16(expect[1], nav.Step(expect[0], 1));
+}
+
+static uint16_t worst_presses()  //breadth first search over all buttons from every patch
+{
+	std::vector<std::array<uint16_t, 6>> next(NAV_TEST_PATCHES + 1);
+	for(uint16_t nr = 1; nr <= NAV_TEST_PATCHES; nr++)
+	{
+		next[nr] = { nav.Step(nr, 1), nav.Step(nr, -1), nav.Bank(nr, 1), nav.Bank(nr, -1), nav.Jump(nr, 1), nav.Jump(nr, -1) };
+	}
+	uint16_t worst = 0;
+	std::vector<uint16_t> dist(NAV_TEST_PATCHES + 1), queue(NAV_TEST_PATCHES);
+	for(uint16_t from = 1; from <= NAV_TEST_PATCHES; from++)
+	{
+		std::fill(dist.begin(), dist.end(), UINT16_MAX);
+		size_t head = 0, tail = 0;
+		dist[from] = 0;
+		queue[tail++] = from;
+		while(head < tail)
+		{
+			uint16_t nr = queue[head++];
+			for(uint16_t to : next[nr])
+			{
+				if(dist[to] == UINT16_MAX)
+				{
+					dist[to] = dist[nr] + 1;
+					queue[tail++] = to;
+				}
+			}
+		}
+		TEST_ASSERT_EQUAL_UINT32(NAV_TEST_PATCHES, tail);  //every patch is reachable
+		worst = std::max(worst, dist[queue[tail - 1]]);
+	}
+	return worst;
+}
+
+void test_max_presses()  //MaxPresses() is a true bound, any of 1000 patches in 15 presses with banks of 10
+{
+	for(NavList l : { NAV_ALL, NAV_NAMES })
+	{
+		for(uint8_t bank : { 5, 10, 20 })
+		{
+			select(l, bank);
+			uint16_t worst = worst_presses();
+			Serial.printf("List \"%s\", banks of %d: any patch in %d presses (MaxPresses() %d)\n", NAV_LIST_NAMES[l], bank, worst, nav.MaxPresses());
+			TEST_ASSERT_TRUE(worst <= nav.MaxPresses());
+		}
+	}
+	select(NAV_ALL, 10);
+	TEST_ASSERT_TRUE(nav.MaxPresses() <= 15);
+}
+
+void test_lookup_cost()  //each step or jump is a few seeks and reads on the card (here: files of the host)
+{
+	for(NavList l : { NAV_ALL, NAV_NAMES })
+	{
+		select(l, 10);
+		const uint32_t n = 10000;
+		uint16_t nr = nav.Step(0, 0);
+		auto t0 = std::chrono::steady_clock::now();
+		for(uint32_t i = 0; i < n; i++)
+		{
+			nr = nav.Step(nr, 1);
+		}
+		auto t1 = std::chrono::steady_clock::now();
+		for(uint32_t i = 0; i < n; i++)
+		{
+			nr = nav.Jump(nr, 1);
+		}
+		auto t2 = std::chrono::steady_clock::now();
+		Serial.printf("List \"%s\": step %.2f us, jump %.2f us\n", NAV_LIST_NAMES[l],
+		              std::chrono::duration<double, std::micro>(t1 - t0).count() / n, std::chrono::duration<double, std::micro>(t2 - t1).count() / n);
+	}
+
+	const uint32_t n = 10000;
+	PatchLibEntry e;
+	auto t0 = std::chrono::steady_clock::now();
+	for(uint32_t i = 0; i < n; i++)
+	{
+		lib.entry(1 + (i * 7919) % NAV_TEST_PATCHES, e);
+	}
+	auto t1 = std::chrono::steady_clock::now();
+	Serial.printf("Library index: entry lookup %.2f us\n", std::chrono::duration<double, std::micro>(t1 - t0).count() / n);
+}
+
+void test_swapped()  //as save mode does it: move, Swapped(), then begin() again (library_changed())
+{
+	select(NAV_ALL, 5);
+	TEST_ASSERT_TRUE(nav.ToggleFavourite(3));
+	TEST_ASSERT_TRUE(nav.ToggleFavourite(5));
+	TEST_ASSERT_TRUE(nav.ToggleFavourite(700));
+	nav.Used(4);
+	nav.Used(3);
+
+	TEST_ASSERT_TRUE(lib.Move(3, 4));
+	nav.Swapped(3, 4);
+	TEST_ASSERT_TRUE(lib.Move(5, 6));
+	nav.Swapped(5, 6);
+	nav.begin(&lib, lib.size());
+
+	TEST_ASSERT_FALSE(nav.IsFavourite(3));
+	TEST_ASSERT_TRUE(nav.IsFavourite(4));
+	TEST_ASSERT_FALSE(nav.IsFavourite(5));
+	TEST_ASSERT_TRUE(nav.IsFavourite(6));
+	TEST_ASSERT_TRUE(nav.IsFavourite(700));
+	select(NAV_FAVOURITES, 5);
+	TEST_ASSERT_EQUAL_UINT16(4, nav.Step(0, 0));  //still ascending
+	TEST_ASSERT_EQUAL_UINT16(6, nav.Step(4, 1));
+	TEST_ASSERT_EQUAL_UINT16(700, nav.Step(6, 1));
+
+	select(NAV_RECENT, 5);
+	TEST_ASSERT_EQUAL_UINT16(4, nav.Step(0, 0));  //the patch used last
+	TEST_ASSERT_EQUAL_UINT16(3, nav.Step(4, 1));
+}
+
+int main()
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_build_library);
+	RUN_TEST(test_name_index);
+	RUN_TEST(test_max_presses);
+	RUN_TEST(test_lookup_cost);
+	RUN_TEST(test_swapped);
+	return UNITY_END();
+}
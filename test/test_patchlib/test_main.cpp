@@ -0,0 +1,305 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* test_patchlib
+*  The library of tools/build_patchlib (test/fixtures/library, built from test/fixtures/patches) against PatchLibrary::compile()
+*  and the upload frames of its patches against the frames of the original .thrl6p files,
+*  JSON document size and parse time per patch through PatchFilter(), and PatchScanner on files and memory
+*/
+
+#include <unity.h>
+#include <Arduino.h>
+#include <SD.h>
+#include <ArduinoJson.h>
+#include <chrono>
+#include <string>
+#include "THR30II.h"
+#include "PatchLibrary.h"
+#include "PatchFixtures.h"
+
+static THR30II_Settings settings;
+static THR30II_State initial;
+static PatchFrames fromLibrary, fromFile;
+
+void setUp() {}
+void tearDown() {}
+
+void test_compile_matches_tool()  //the pedal compiles the tool's patches.txt into the tool's patches.thrlib (byte exact, stamp 0 on the host)
+{
+	TEST_ASSERT_TRUE(host_sd_fresh());
+
+	std::string text = read_file(fixture_path("library/patches.txt"));
+	std::string tool = read_file(fixture_path("library/patches.thrlib"));
+	TEST_ASSERT_TRUE(text.size() > 0 && tool.size() > sizeof(PatchLibHeader));
+
+	File32 f;
+	TEST_ASSERT_TRUE(f.open("patches.txt", O_RDWR | O_CREAT | O_TRUNC));
+	TEST_ASSERT_EQUAL_UINT32(text.size(), f.write(text.data(), text.size()));
+	f.close();
+
+	TEST_ASSERT_TRUE(PatchLibrary::compile("patches.txt", "patches.thrlib"));
+	std::string pedal = read_file(host_sd_path("patches.thrlib"));
+	TEST_ASSERT_EQUAL_UINT32(tool.size(), pedal.size());
+	TEST_ASSERT_EQUAL_MEMORY(tool.data(), pedal.data(), tool.size());
+}
+
+void test_frames_match_files()  //every library patch gives the upload frames of its .thrl6p file
+{
+	TEST_ASSERT_TRUE(load_fixture_symbols(settings));
+	initial = settings.Snapshot();
+
+	PatchLibrary lib;
+	TEST_ASSERT_TRUE(lib.open("patches.thrlib"));
+
+	//the original files by patch name (a file the tool rejects would be missing in the library)
+	static DynamicJsonDocument djd(16384);
+	std::vector<THR30II_Patch> files;
+	for(const std::string &path : patch_files())
+	{
+		THR30II_Patch pat;
+		TEST_ASSERT_TRUE(deserializeJson(djd, read_file(path).c_str()) == DeserializationError::Ok);
+		TEST_ASSERT_TRUE(settings.DecodePatch(djd, pat));
+		files.push_back(pat);
+	}
+
+	static DynamicJsonDocument doc(16384);  //PATCH_DOC_SIZE is for the 32 bit Teensy
+	uint16_t matched = 0;
+	for(uint16_t nr = 1; nr <= lib.size(); nr++)
+	{
+		PatchLibEntry e;
+		TEST_ASSERT_TRUE(lib.entry(nr, e));
+		TEST_ASSERT_TRUE_MESSAGE(lib.parse(e, doc, true) == DeserializationError::Ok, e.name);  //like fetch_patch() on the pedal
+		THR30II_Patch pat;
+		TEST_ASSERT_TRUE_MESSAGE(settings.DecodePatch(doc, pat), e.name);
+		TEST_ASSERT_EQUAL_INT_MESSAGE(pat.col, e.col, e.name);
+		TEST_ASSERT_EQUAL_INT_MESSAGE(pat.amp, e.amp, e.name);
+		TEST_ASSERT_EQUAL_INT_MESSAGE(pat.raw[P_CAB], e.cab, e.name);
+
+		settings.Restore(initial);
+		apply_patch(settings, pat);
+		settings.renderPatch(fromLibrary);
+		TEST_ASSERT_TRUE_MESSAGE(fromLibrary.count > 1, e.name);
+
+		for(const THR30II_Patch &file : files)
+		{
+			if(strcmp(file.name, pat.name) == 0)
+			{
+				settings.Restore(initial);
+				apply_patch(settings, file);
+				settings.renderPatch(fromFile);
+				TEST_ASSERT_TRUE_MESSAGE(same_frames(fromFile, fromLibrary), e.name);
+				matched++;
+			}
+		}
+	}
+	TEST_ASSERT_EQUAL_UINT16(files.size(), lib.size());  //the tool accepts what the pedal accepts (10_partial misses its cab)
+	TEST_ASSERT_EQUAL_UINT16(lib.size(), matched);
+	lib.close();
+	Serial.printf("%d library patches give the upload frames of their files\n", (int) matched);
+}
+
+//PatchScanner: strings with braces, escapes, text between the patches, an unbalanced '}' and every split at the block boundary
+typedef std::vector<std::pair<uint32_t, uint32_t>> Blocks;
+
+static PatchScanner scanner;  //8 KB block buffer
+
+static Blocks scan_file(const std::string &text, bool &error)
+{
+	Blocks blocks;
+	File32 f;
+	TEST_ASSERT_TRUE(f.open("scan.txt", O_RDWR | O_CREAT | O_TRUNC));
+	TEST_ASSERT_EQUAL_UINT32(text.size(), f.write(text.data(), text.size()));
+	uint32_t beg = 0, end = 0;
+	scanner.begin(f);
+	while(scanner.next(beg, end))
+	{
+		blocks.push_back({ beg, end });
+	}
+	error = scanner.error();
+	f.close();
+	return blocks;
+}
+
+//Braces in strings, an escaped quote, a '\' as the last character of a string
+static const std::string TRICKY = R"({"n":"a\"}{\\","m":"}","o":{"p":"\\\""}})";
+
+void test_scanner_strings()
+{
+	TEST_ASSERT_TRUE(host_sd_fresh());
+	std::vector<std::string> patches = { R"({"n":"}{"})", TRICKY, R"({"a":{"b":"{{"},"c":["}"]})" };
+	std::string text;
+	Blocks expect;
+	for(const std::string &p : patches)
+	{
+		text += "\r\n// between the patches: \"quoted\" text\r\n";
+		expect.push_back({ (uint32_t) text.size(), (uint32_t)(text.size() + p.size()) });
+		text += p;
+	}
+	text += "\r\n";
+
+	bool error = true;
+	Blocks found = scan_file(text, error);
+	TEST_ASSERT_FALSE(error);
+	TEST_ASSERT_EQUAL_UINT32(expect.size(), found.size());
+	static DynamicJsonDocument doc(1024);
+	for(size_t i = 0; i < expect.size(); i++)
+	{
+		TEST_ASSERT_EQUAL_UINT32(expect[i].first, found[i].first);
+		TEST_ASSERT_EQUAL_UINT32(expect[i].second, found[i].second);
+		TEST_ASSERT_TRUE(deserializeJson(doc, text.substr(found[i].first, found[i].second - found[i].first).c_str()) == DeserializationError::Ok);
+	}
+}
+
+void test_scanner_block_boundary()  //TRICKY at every position across the end of the first block
+{
+	for(uint32_t at = PATCHSCAN_BLOCK - TRICKY.size(); at <= PATCHSCAN_BLOCK; at++)
+	{
+		std::string pad = "{\"p\":\"" + std::string(at - 9, 'x') + "\"}";  //at - 1 bytes, then '\n', TRICKY starts at position at
+		std::string text = pad + "\n" + TRICKY + "{}";
+		bool error = true;
+		Blocks found = scan_file(text, error);
+		TEST_ASSERT_FALSE(error);
+		TEST_ASSERT_EQUAL_UINT32(3, found.size());
+		TEST_ASSERT_EQUAL_UINT32(at, found[1].first);
+		TEST_ASSERT_EQUAL_UINT32(at + TRICKY.size(), found[1].second);
+	}
+
+	bool found;  //the tokenizer alone: TRICKY fed in two pieces, split at every position
+	for(size_t cut = 0; cut < TRICKY.size(); cut++)
+	{
+		File32 none;
+		scanner.begin(none);
+		const uint8_t *p = (const uint8_t *) TRICKY.data();
+		size_t used = scanner.feed(p, cut, 100, found);
+		TEST_ASSERT_FALSE(found);
+		TEST_ASSERT_EQUAL_UINT32(cut, used);
+		used = scanner.feed(p + cut, TRICKY.size() - cut, 100 + cut, found);
+		TEST_ASSERT_TRUE(found);
+		TEST_ASSERT_EQUAL_UINT32(TRICKY.size() - cut, used);
+	}
+}
+
+void test_scanner_unbalanced()  //a '}' without '{' stops the scan
+{
+	bool error = false;
+	Blocks found = scan_file(R"({"a":1}}{"b":2})", error);
+	TEST_ASSERT_TRUE(error);
+	TEST_ASSERT_EQUAL_UINT32(1, found.size());
+	TEST_ASSERT_EQUAL_UINT32(7, found[0].second);
+
+	found = scan_file("{\"a\":\"}}", error);  //closing quote missing: the block never ends
+	TEST_ASSERT_FALSE(error);
+	TEST_ASSERT_EQUAL_UINT32(0, found.size());
+}
+
+void test_scanner_throughput()  //a large library file (the fixtures 100 times)
+{
+	std::string patches;
+	for(const std::string &path : patch_files())
+	{
+		patches += read_file(path);
+	}
+	std::string text;
+	for(int i = 0; i < 100; i++)
+	{
+		text += patches;
+	}
+	File32 f;
+	TEST_ASSERT_TRUE(f.open("large.txt", O_RDWR | O_CREAT | O_TRUNC));
+	TEST_ASSERT_EQUAL_UINT32(text.size(), f.write(text.data(), text.size()));
+	uint32_t beg = 0, end = 0, count = 0;
+	auto t0 = std::chrono::steady_clock::now();
+	scanner.begin(f);
+	while(scanner.next(beg, end))
+	{
+		count++;
+	}
+	double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	f.close();
+	TEST_ASSERT_FALSE(scanner.error());
+	TEST_ASSERT_EQUAL_UINT32(100 * patch_files().size(), count);
+	TEST_ASSERT_EQUAL_UINT32(text.size(), scanner.scanned());
+	Serial.printf("Patch scanner: %lu patches in %lu KB, %.0f KB/s\n", (unsigned long) count, (unsigned long)(text.size() / 1024), text.size() / 1024.0 / s);
+}
+
+#define TEENSY_SLOT 16  //bytes per JSON value on the 32 bit Teensy (JSON_OBJECT_SIZE(1) there)
+
+static size_t slots(JsonVariantConst v)  //values in the document (each one a slot of the memory pool)
+{
+	size_t n = 0;
+	if(v.is<JsonObjectConst>())
+	{
+		for(JsonPairConst kv : v.as<JsonObjectConst>())
+		{
+			n += 1 + slots(kv.value());
+		}
+	}
+	else if(v.is<JsonArrayConst>())
+	{
+		for(JsonVariantConst e : v.as<JsonArrayConst>())
+		{
+			n += 1 + slots(e);
+		}
+	}
+	return n;
+}
+
+void test_parse_cost()  //every fixture (the partial one, too) streamed from the library through both filters
+{
+	TEST_ASSERT_TRUE(host_sd_fresh());
+	std::string text;
+	for(const std::string &path : patch_files())
+	{
+		text += read_file(path);
+	}
+	File32 f;
+	TEST_ASSERT_TRUE(f.open("patches.txt", O_RDWR | O_CREAT | O_TRUNC));
+	TEST_ASSERT_EQUAL_UINT32(text.size(), f.write(text.data(), text.size()));
+	f.close();
+	TEST_ASSERT_TRUE(PatchLibrary::compile("patches.txt", "patches.thrlib"));
+
+	PatchLibrary lib;
+	TEST_ASSERT_TRUE(lib.open("patches.thrlib"));
+	TEST_ASSERT_EQUAL_UINT16(patch_files().size(), lib.size());
+
+	//The host's values are bigger (64 bit pointers), so the document is sized for the host and its use converted to the Teensy's
+	static DynamicJsonDocument doc(16384);
+	for(bool full : { false, true })
+	{
+		const size_t limit = full ? PATCH_DOC_SIZE : PATCH_SUMMARY_SIZE;
+		const uint32_t rounds = 100;
+		size_t worst = 0;
+		double us = 0.0;
+		for(uint16_t nr = 1; nr <= lib.size(); nr++)
+		{
+			PatchLibEntry e;
+			TEST_ASSERT_TRUE(lib.entry(nr, e));
+			auto t0 = std::chrono::steady_clock::now();
+			for(uint32_t i = 0; i < rounds; i++)
+			{
+				TEST_ASSERT_TRUE_MESSAGE(lib.parse(e, doc, full) == DeserializationError::Ok, e.name);
+			}
+			us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count() / rounds;
+			size_t teensy = doc.memoryUsage() - slots(doc.as<JsonObjectConst>()) * (JSON_OBJECT_SIZE(1) - TEENSY_SLOT);
+			Serial.printf("%-40.40s %s: %4d bytes (Teensy %4d of %d)\n", e.name, full ? "full   " : "summary", (int) doc.memoryUsage(), (int) teensy, (int) limit);
+			TEST_ASSERT_TRUE_MESSAGE(teensy <= limit, e.name);
+			worst = std::max(worst, teensy);
+		}
+		Serial.printf("%s: %.1f us per patch, largest document %d bytes on the Teensy (%d reserved)\n",
+		              full ? "Full patch" : "Summary", us / lib.size(), (int) worst, (int) limit);
+	}
+	lib.close();
+}
+
+int main()
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_compile_matches_tool);
+	RUN_TEST(test_frames_match_files);
+	RUN_TEST(test_parse_cost);
+	RUN_TEST(test_scanner_strings);
+	RUN_TEST(test_scanner_block_boundary);
+	RUN_TEST(test_scanner_unbalanced);
+	RUN_TEST(test_scanner_throughput);
+	return UNITY_END();
+}
@@ -0,0 +1,81 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* sweeps.h
+*  Pedal 2 readings (0..1023, one every PEDAL_POLL_MS) of typical sweeps, averaged readings with their +-1 noise.
+*  Synthesized in the shape of sweeps on the pedal (no captures of the ADC exist yet).
+*/
+
+#ifndef _SWEEPS_H_
+#define _SWEEPS_H_
+
+#include <Arduino.h>
+
+#define SWEEP_MAX 250
+
+struct Sweep
+{
+	uint16_t count;
+	uint16_t value[SWEEP_MAX];
+};
+
+static const Sweep SWEEPS[] =
+{
+	//heel to toe in 250 ms
+	{ 85, {
+	  0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 4, 16, 37, 62, 97, 139, 185, 238, 293, 352,
+	  416, 479, 545, 608, 671, 729, 786, 838, 883, 925, 961, 986, 1007, 1020, 1022, 1023, 1022, 1023, 1023, 1023,
+	  1023, 1022, 1022, 1023, 1022, 1023, 1023, 1023, 1023, 1023, 1023, 1022, 1022, 1023, 1023, 1023, 1023, 1023, 1023, 1023,
+	  1022, 1023, 1022, 1023, 1023, 1022, 1023, 1023, 1023, 1023, 1023, 1023, 1022, 1022, 1023, 1023, 1023, 1023, 1022, 1022,
+	  1023, 1023, 1023, 1023, 1023,
+	} },
+	//volume swell over 2 s
+	{ 250, {
+	  0, 1, 1, 1, 1, 1, 0, 0, 0, 1, 1, 0, 1, 0, 2, 1, 1, 2, 1, 3,
+	  2, 2, 2, 4, 4, 4, 7, 5, 6, 7, 10, 11, 10, 12, 14, 15, 15, 16, 18, 17,
+	  20, 20, 23, 23, 24, 26, 28, 30, 31, 32, 33, 35, 37, 40, 42, 42, 45, 47, 47, 51,
+	  52, 55, 56, 57, 60, 64, 64, 66, 69, 71, 73, 76, 79, 83, 84, 87, 91, 92, 94, 99,
+	  100, 103, 107, 110, 112, 117, 119, 122, 125, 129, 131, 133, 137, 140, 143, 147, 151, 156, 157, 162,
+	  167, 170, 174, 178, 182, 184, 189, 193, 197, 200, 203, 209, 213, 216, 220, 224, 229, 232, 238, 243,
+	  245, 252, 254, 259, 264, 268, 275, 277, 284, 287, 292, 298, 303, 309, 312, 317, 324, 327, 333, 337,
+	  342, 349, 354, 359, 364, 371, 376, 381, 387, 391, 399, 402, 409, 415, 420, 426, 433, 439, 443, 450,
+	  457, 463, 467, 473, 480, 486, 494, 499, 507, 512, 518, 526, 531, 538, 543, 550, 557, 565, 570, 579,
+	  586, 593, 600, 605, 612, 621, 628, 635, 642, 649, 656, 662, 670, 676, 685, 693, 698, 706, 715, 721,
+	  729, 737, 745, 752, 762, 768, 775, 784, 793, 800, 799, 799, 799, 799, 800, 801, 799, 799, 801, 800,
+	  801, 799, 800, 801, 799, 800, 801, 801, 799, 800, 801, 799, 799, 799, 801, 801, 800, 801, 800, 799,
+	  800, 799, 801, 801, 799, 799, 799, 799, 799, 799,
+	} },
+	//wah-like rocking at 3 Hz for 2 s
+	{ 250, {
+	  549, 549, 551, 550, 551, 550, 550, 549, 549, 551, 616, 680, 737, 790, 834, 868, 889, 900, 897, 883,
+	  856, 821, 772, 718, 657, 595, 528, 462, 401, 344, 296, 254, 224, 206, 201, 206, 226, 253, 294, 343,
+	  401, 463, 527, 593, 658, 719, 774, 820, 857, 884, 898, 898, 888, 866, 833, 789, 739, 679, 615, 550,
+	  485, 420, 363, 309, 267, 234, 211, 200, 204, 217, 244, 281, 328, 381, 443, 506, 572, 636, 700, 757,
+	  805, 846, 875, 893, 899, 893, 875, 846, 804, 756, 700, 636, 571, 507, 442, 381, 327, 280, 243, 217,
+	  203, 200, 210, 234, 266, 310, 361, 420, 483, 550, 617, 679, 738, 790, 833, 868, 888, 898, 897, 883,
+	  856, 821, 772, 719, 658, 595, 528, 462, 400, 344, 295, 255, 225, 207, 200, 207, 226, 255, 295, 345,
+	  400, 463, 527, 593, 659, 718, 774, 820, 858, 884, 896, 899, 889, 867, 833, 789, 738, 680, 615, 550,
+	  485, 421, 362, 309, 268, 232, 210, 200, 204, 218, 244, 281, 327, 380, 441, 507, 573, 638, 699, 755,
+	  805, 846, 874, 893, 900, 895, 874, 847, 805, 757, 698, 636, 571, 506, 441, 382, 326, 279, 244, 218,
+	  202, 202, 211, 234, 268, 310, 361, 421, 483, 550, 549, 551, 551, 551, 551, 551, 550, 551, 551, 551,
+	  550, 551, 550, 551, 549, 551, 549, 551, 549, 549, 551, 551, 549, 549, 551, 549, 550, 551, 550, 550,
+	  551, 550, 549, 550, 550, 549, 551, 550, 551, 550,
+	} },
+	//toe to heel stomp in 50 ms
+	{ 55, {
+	  1023, 1022, 1023, 1022, 1023, 1023, 1023, 1023, 1023, 1023, 817, 615, 409, 206, 1, 0, 0, 0, 0, 1,
+	  0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 1, 1, 0, 0, 0, 1, 1,
+	  0, 1, 1, 0, 1, 0, 0, 1, 0, 1, 1, 1, 0, 0, 0,
+	} },
+	//small corrections
+	{ 120, {
+	  301, 301, 299, 300, 301, 299, 301, 299, 300, 301, 300, 303, 305, 304, 306, 309, 310, 310, 311, 312,
+	  315, 317, 316, 318, 320, 321, 323, 323, 325, 327, 329, 330, 332, 331, 333, 336, 337, 338, 338, 339,
+	  340, 339, 341, 340, 340, 339, 339, 340, 341, 341, 340, 341, 339, 341, 339, 341, 340, 340, 341, 339,
+	  338, 339, 336, 336, 335, 335, 332, 331, 331, 329, 330, 327, 327, 327, 324, 325, 324, 321, 322, 320,
+	  321, 319, 320, 319, 321, 319, 319, 320, 319, 320, 319, 320, 321, 320, 320, 321, 319, 319, 319, 321,
+	  319, 321, 321, 321, 321, 320, 319, 321, 320, 319, 319, 320, 319, 319, 321, 321, 319, 319, 320, 319,
+	} },
+};
+
+#endif
@@ -0,0 +1,121 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* test_pedalstream
+*  Replay of pedal sweeps through PedalStream, acknowledged like THR does (one change in flight, a few ms round trip):
+*  sends, stale values and the latency of the resting value against sending every changed reading
+*/
+
+#include <unity.h>
+#include <Arduino.h>
+#include "PedalStream.h"
+#include "sweeps.h"
+
+#define REPLAY_TAIL_MS   500    //the pedal rests at its last reading after the sweep
+#define ACK_TIMEOUT_MS   250    //OUTQUEUE_TIMEOUT of the firmware
+//Resting value acknowledged at the latest: full travel at the slew limit, two periods of the rate cap and a round trip
+#define END_LATENCY_US   (1023ul * 1000000ul / PEDAL_SLEW + 2 * 1000000ul / PEDAL_STREAM_HZ + 9000)
+
+struct Replay
+{
+	uint32_t sends;
+	uint32_t stale;
+	uint32_t worst_us;            //last move of the pedal until its value was acknowledged
+	uint32_t naive_sends;         //a send for every reading outside the margin
+	uint16_t target;
+	uint16_t output;
+};
+
+static uint32_t rtt_us(uint32_t k)  //3..9 ms round trip to THR
+{
+	return 3000 + (k * 2654435761u >> 8) % 6000;
+}
+
+//The firmware's loop at 1 ms: pedal read every PEDAL_POLL_MS, stream_pedal() every pass, THR's acks as they come in
+static Replay replay(const Sweep &sw, uint32_t drop = UINT32_MAX)  //drop: the ack of this send gets lost
+{
+	PedalStream s;
+	Replay r {};
+	bool waiting = false;
+	bool dropped = false;
+	uint32_t due = 0;
+	uint16_t last = sw.value[0];
+	const uint32_t end_ms = sw.count * PEDAL_POLL_MS + REPLAY_TAIL_MS;
+
+	for(uint32_t ms = 0; ms < end_ms; ms++)
+	{
+		host_us = ms * 1000;
+		if(ms % PEDAL_POLL_MS == 0)
+		{
+			uint16_t v = sw.value[min<uint32_t>(ms / PEDAL_POLL_MS, sw.count - 1)];
+			if(abs((int) v - (int) last) > PEDAL_MARGIN)
+			{
+				r.naive_sends++;
+				last = v;
+			}
+			s.Input(v);
+		}
+		if(waiting && host_us >= due)
+		{
+			waiting = false;
+			if(dropped)
+			{
+				s.Lost();
+			}
+			else
+			{
+				s.Acked();
+			}
+		}
+		if(s.Due(waiting))
+		{
+			s.Next();
+			dropped = s.sends() - 1 == drop;
+			due = host_us + (dropped ? ACK_TIMEOUT_MS * 1000 : rtt_us(s.sends()));
+			waiting = true;
+		}
+	}
+	r.sends = s.sends();
+	r.stale = s.stale();
+	r.worst_us = s.worst();
+	r.target = s.target();
+	r.output = s.output();
+	return r;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_sweeps()
+{
+	for(size_t i = 0; i < sizeof(SWEEPS) / sizeof(SWEEPS[0]); i++)
+	{
+		const Sweep &sw = SWEEPS[i];
+		Replay r = replay(sw);
+		char line[160];
+		snprintf(line, sizeof(line), "sweep %zu: %lu sends (every reading: %lu), %lu stale, resting value after %lu us",
+		         i, (unsigned long) r.sends, (unsigned long) r.naive_sends, (unsigned long) r.stale, (unsigned long) r.worst_us);
+		TEST_MESSAGE(line);
+
+		const uint32_t duration_ms = sw.count * PEDAL_POLL_MS + REPLAY_TAIL_MS;
+		TEST_ASSERT_EQUAL_UINT16_MESSAGE(r.target, r.output, line);  //the resting value is always sent
+		TEST_ASSERT_LESS_OR_EQUAL_UINT32_MESSAGE(duration_ms * PEDAL_STREAM_HZ / 1000 + 1, r.sends, line);  //rate cap
+		TEST_ASSERT_LESS_OR_EQUAL_UINT32_MESSAGE(END_LATENCY_US, r.worst_us, line);
+	}
+}
+
+void test_lost_ack()  //a lost change is sent again and the stream still ends at the resting value
+{
+	const Sweep &sw = SWEEPS[0];
+	Replay r = replay(sw, 3);
+	TEST_ASSERT_EQUAL_UINT16(r.target, r.output);
+	TEST_ASSERT_LESS_OR_EQUAL_UINT32(ACK_TIMEOUT_MS * 1000 + END_LATENCY_US, r.worst_us);
+}
+
+int main()
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_sweeps);
+	RUN_TEST(test_lost_ack);
+	return UNITY_END();
+}
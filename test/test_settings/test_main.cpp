@@ -0,0 +1,205 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* test_settings
+*  Bit-exact round trips of the raw parameter words: .thrl6p patches (test/fixtures/patches) through DecodePatch() -> renderPatch()
+*  -> patch_setAll() -> renderPatch(), display values through the lookup tables, and the cost of the conversions and snapshots
+*/
+
+#include <unity.h>
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "THR30II.h"
+#include "PatchLibrary.h"
+#include "PatchFixtures.h"
+
+static THR30II_Settings settings;  //renders the uploads
+static THR30II_Settings parsed;    //parses them back (like a dump from THR)
+static PatchFrames frames, reframes;
+
+void setUp() {}
+void tearDown() {}
+
+void test_symbol_table()
+{
+	TEST_ASSERT_TRUE(load_fixture_symbols(settings));
+
+	for(uint8_t i = 0; i < P_COUNT; i++)  //every parameter is found by its dump key
+	{
+		TEST_ASSERT_NOT_EQUAL(0, THR30II_PARAM_KEYS[i].dk);
+		TEST_ASSERT_NOT_EQUAL(P_NONE, ParamByKey(THR30II_PARAM_KEYS[i].dk, true));
+	}
+}
+
+static bool in_upload(const THR30II_Settings &s, THR30II_PARAM p)  //see THR30II_Settings::InUpload()
+{
+	const param_def &d = THR30II_PARAMS[p];
+	return d.type < 0 || d.type == s.SubunitType(d.unit);
+}
+
+static std::vector<byte> unbucket(const PatchFrames &pf)  //the data of the slice frames (as ParseSysEx() unpacks them)
+{
+	std::vector<byte> data;
+	const byte *f = pf.data + pf.len[0];
+	for(uint8_t i = 1; i < pf.count; f += pf.len[i++])
+	{
+		uint16_t payload = f[10] * 16 + f[11] + 1;
+		for(uint16_t j = 0; j < payload; j++)
+		{
+			byte bucket = f[12 + 8 * (j / 7)];
+			byte v = f[13 + 8 * (j / 7) + j % 7];
+			data.push_back((bucket & (1 << (6 - j % 7))) ? (byte)(v | 0x80) : v);
+		}
+	}
+	return data;
+}
+
+static void round_trip(const char *what)  //renders the actual settings, parses the upload and compares both bit by bit
+{
+	settings.renderPatch(frames);
+	TEST_ASSERT_TRUE_MESSAGE(frames.count > 1, what);
+
+	std::vector<byte> data = unbucket(frames);
+	parsed.sendChangestoTHR = false;
+	TEST_ASSERT_EQUAL_INT_MESSAGE(0, parsed.patch_setAll(data.data(), (uint16_t) data.size()), what);
+
+	TEST_ASSERT_EQUAL_STRING_MESSAGE(settings.patchNames[0], parsed.patchNames[0], what);
+	TEST_ASSERT_EQUAL_UINT32_MESSAGE(settings.Tnid, parsed.Tnid, what);
+	TEST_ASSERT_EQUAL_UINT32_MESSAGE(settings.ParTempo, parsed.ParTempo, what);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(settings.col, parsed.col, what);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(settings.amp, parsed.amp, what);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(settings.effecttype, parsed.effecttype, what);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(settings.echotype, parsed.echotype, what);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(settings.reverbtype, parsed.reverbtype, what);
+	for(uint8_t i = 0; i < P_COUNT; i++)
+	{
+		THR30II_PARAM p = (THR30II_PARAM) i;
+		if(in_upload(settings, p))
+		{
+			char msg[120];
+			snprintf(msg, sizeof(msg), "%s: %s", what, THR30II_PARAMS[p].label);
+			TEST_ASSERT_EQUAL_HEX32_MESSAGE(settings.GetRaw(p), parsed.GetRaw(p), msg);
+		}
+	}
+
+	parsed.renderPatch(reframes);  //the parsed settings give the same upload again
+	TEST_ASSERT_TRUE_MESSAGE(same_frames(frames, reframes), what);
+}
+
+void test_patch_files()  //.thrl6p -> DecodePatch() -> upload -> patch_setAll(): every value of the file arrives bit-exact
+{
+	std::vector<std::string> files = patch_files();
+	TEST_ASSERT_TRUE(files.size() >= 10);
+
+	static DynamicJsonDocument djd(16384);
+	for(const std::string &path : files)
+	{
+		const char *what = path.c_str() + path.find_last_of("/\\") + 1;
+		std::string text = read_file(path);
+		TEST_ASSERT_TRUE_MESSAGE(deserializeJson(djd, text.c_str()) == DeserializationError::Ok, what);
+
+		THR30II_Patch pat;
+		TEST_ASSERT_TRUE_MESSAGE(settings.DecodePatch(djd, pat), what);
+		apply_patch(settings, pat);
+		round_trip(what);
+
+		for(uint8_t i = 0; i < P_COUNT; i++)  //the values of the file itself
+		{
+			THR30II_PARAM p = (THR30II_PARAM) i;
+			if(pat.has.test(p) && in_upload(settings, p))
+			{
+				char msg[120];
+				snprintf(msg, sizeof(msg), "%s: %s", what, THR30II_PARAMS[p].label);
+				TEST_ASSERT_EQUAL_HEX32_MESSAGE(pat.raw[p], parsed.GetRaw(p), msg);
+			}
+		}
+
+		//and back into a patch file: EncodePatch() -> DecodePatch() gives the same words (all types, not only the selected ones)
+		static DynamicJsonDocument out(16384);
+		TEST_ASSERT_TRUE_MESSAGE(settings.EncodePatch(out, settings.patchNames[0]), what);
+		THR30II_Patch again;
+		TEST_ASSERT_TRUE_MESSAGE(settings.DecodePatch(out, again), what);
+		TEST_ASSERT_TRUE_MESSAGE(THR30II_Settings::IsComplete(again), what);
+		for(uint8_t i = 0; i < P_COUNT; i++)
+		{
+			if(pat.has.test(i))
+			{
+				TEST_ASSERT_EQUAL_HEX32_MESSAGE(pat.raw[i], again.raw[i], what);
+			}
+		}
+	}
+	Serial.printf("%d patch files round trip bit-exact\n", (int) files.size());
+}
+
+void test_all_amps()  //every collection/amp through the amp key of an upload
+{
+	for(uint8_t c = CLASSIC; c <= MODERN; c++)
+	{
+		for(uint8_t a = CLEAN; a <= FLAT; a++)
+		{
+			settings.SetColAmp((THR30II_COL) c, (THR30II_AMP) a);
+			round_trip(ColAmp_ToAmpAsset((THR30II_COL) c, (THR30II_AMP) a));
+		}
+	}
+}
+
+void test_display_values()  //display value -> raw word -> display value for the slider encodings
+{
+	for(uint8_t v = 0; v <= 100; v++)
+	{
+		TEST_ASSERT_EQUAL_UINT8(v, ParamRawToDisplay(ENC_LINEAR, ParamDisplayToRaw(ENC_LINEAR, v)));
+		TEST_ASSERT_EQUAL_UINT8(v, ParamRawToDisplay(ENC_THRESHOLD, ParamDisplayToRaw(ENC_THRESHOLD, v)));
+	}
+}
+
+void test_conversion_cost()  //lookup table against the former float conversion (for information, the host is no Teensy)
+{
+	const uint32_t n = 100000;
+	volatile double sink = 0.0;
+	auto t0 = std::chrono::steady_clock::now();
+	for(uint32_t i = 0; i < n; i++)
+	{
+		sink = THR30II_Settings::NumberToVal(0x3C000000u + (i % 1000) * 0x3000u);
+	}
+	auto t1 = std::chrono::steady_clock::now();
+	for(uint32_t i = 0; i < n; i++)
+	{
+		sink = ParamRawToDisplay(ENC_LINEAR, 0x3C000000u + (i % 1000) * 0x3000u);
+	}
+	auto t2 = std::chrono::steady_clock::now();
+	(void) sink;
+	Serial.printf("Raw values: NumberToVal %.1f ns, lookup table %.1f ns per conversion\n",
+	              std::chrono::duration<double, std::nano>(t1 - t0).count() / n, std::chrono::duration<double, std::nano>(t2 - t1).count() / n);
+}
+
+void test_snapshot_cost()  //RAM per settings instance and time for snapshot + restore (for information)
+{
+	static THR30II_State stored;
+	const uint32_t n = 100000;
+	auto t0 = std::chrono::steady_clock::now();
+	for(uint32_t i = 0; i < n; i++)
+	{
+		stored = settings.Snapshot();
+		settings.Restore(stored);
+	}
+	auto t1 = std::chrono::steady_clock::now();
+	Serial.printf("Settings: %d bytes per snapshot, %d bytes per THR30II_Settings, snapshot + restore %.1f ns\n",
+	              (int) sizeof(THR30II_State), (int) sizeof(THR30II_Settings), std::chrono::duration<double, std::nano>(t1 - t0).count() / n);
+	Serial.printf("Undo history: %d changes in %d bytes\n", HISTORY_SIZE, (int) sizeof(THR30II_History));
+	Serial.printf("Patch cache: %d decoded patches in %d bytes (independent of library size)\n", PATCH_CACHE_SIZE, (int) sizeof(PatchCache));
+}
+
+int main()
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_symbol_table);
+	RUN_TEST(test_patch_files);
+	RUN_TEST(test_all_amps);
+	RUN_TEST(test_display_values);
+	RUN_TEST(test_conversion_cost);
+	RUN_TEST(test_snapshot_cost);
+	return UNITY_END();
+}
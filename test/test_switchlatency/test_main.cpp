@@ -0,0 +1,143 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* test_switchlatency
+*  Replay of a session of patch switches through the stage markers of SwitchLatency (simulated time):
+*  histograms, percentiles and the CSV export, as the patch switch benchmark of the host build
+*/
+
+#include <unity.h>
+#include <Arduino.h>
+#include "SwitchLatency.h"
+#include "MemFrameWriter.h"
+
+#define REPLAY_SWITCHES   360
+#define REPLAY_FRAMES     8      //header and 7 slices (a patch of about 1.3 kB)
+#define SUPERSEDE_EVERY   25     //the next switch comes before THR acknowledged
+#define TIMEOUT_EVERY     80     //the last slice is never acknowledged
+
+static SwitchLatency lat;
+static uint32_t seed = 1;
+
+static uint32_t rnd(uint32_t lo, uint32_t hi)  //lo...hi-1
+{
+	seed = seed * 1103515245u + 12345u;
+	return lo + (seed >> 8) % (hi - lo);
+}
+
+//One switch along the path of the firmware: read_buttons() -> patch_activate() -> send_patch() -> WorkingTimer_Tick()
+//Cached patches have prerendered frames, the others are read from SD-card and rendered.
+static void replaySwitch(uint32_t n)
+{
+	host_us += rnd(200000, 2000000);  //player's pause between switches
+	lat.Begin(host_us);
+	const bool cached = n % 4 != 0;
+	host_us += cached ? rnd(40, 80) : rnd(6000, 12000);
+	lat.Mark(LAT_DECODE);
+	host_us += cached ? rnd(20, 40) : rnd(700, 1100);
+	lat.Mark(LAT_BUILD);
+	for(uint16_t f = 0; f < REPLAY_FRAMES; f++)  //one frame per tick of the out queue
+	{
+		host_us += rnd(800, 1200);
+		lat.Sent(UPLOAD_MSG_ID + f, f == REPLAY_FRAMES - 1);
+	}
+	if(n % SUPERSEDE_EVERY == SUPERSEDE_EVERY - 1)
+	{
+		return;  //Begin() of the next switch
+	}
+	if(n % TIMEOUT_EVERY == TIMEOUT_EVERY - 1)
+	{
+		host_us += 250000;  //OUTQUEUE_TIMEOUT
+		lat.Timeout(UPLOAD_MSG_ID + REPLAY_FRAMES - 1);
+		return;
+	}
+	host_us += rnd(3000, 9000);  //round trip to THR
+	lat.Acked(UPLOAD_MSG_ID + REPLAY_FRAMES - 1);
+}
+
+void setUp()
+{
+	lat.Reset();
+	host_us = 1000;
+	seed = 1;
+}
+void tearDown() {}
+
+void test_replay()
+{
+	uint32_t superseded = 0, timeouts = 0;
+	for(uint32_t n = 0; n < REPLAY_SWITCHES; n++)
+	{
+		replaySwitch(n);
+		if(n % SUPERSEDE_EVERY == SUPERSEDE_EVERY - 1)
+		{
+			superseded++;
+		}
+		else if(n % TIMEOUT_EVERY == TIMEOUT_EVERY - 1)
+		{
+			timeouts++;
+		}
+	}
+	TEST_ASSERT_EQUAL_UINT32(superseded, lat.superseded());
+	TEST_ASSERT_EQUAL_UINT32(timeouts, lat.timeouts());
+	TEST_ASSERT_EQUAL_UINT32(REPLAY_SWITCHES - superseded - timeouts, lat.count());
+
+	uint32_t prev_p95 = 0, prev_mean = 0;
+	for(uint8_t s = LAT_DECODE; s < LAT_STAGES; s++)
+	{
+		LatencyStage st = (LatencyStage) s;
+		uint32_t n = 0;
+		for(uint8_t b = 0; b < LAT_BUCKETS; b++)
+		{
+			n += lat.bucket(st, b);
+		}
+		TEST_ASSERT_EQUAL_UINT32_MESSAGE(lat.count(), n, LAT_STAGE_NAMES[s]);  //every complete switch in every histogram
+		TEST_ASSERT_LESS_OR_EQUAL_UINT32_MESSAGE(lat.percentile(st, 95), lat.percentile(st, 50), LAT_STAGE_NAMES[s]);
+		TEST_ASSERT_LESS_OR_EQUAL_UINT32_MESSAGE(lat.percentile(st, 95), prev_p95, LAT_STAGE_NAMES[s]);  //stages in order
+		TEST_ASSERT_LESS_OR_EQUAL_UINT32_MESSAGE(lat.mean(st), prev_mean, LAT_STAGE_NAMES[s]);
+		prev_p95 = lat.percentile(st, 95);
+		prev_mean = lat.mean(st);
+
+		char line[100];
+		snprintf(line, sizeof(line), "%-6s mean %6lu us, p50 < %6lu us, p95 < %6lu us, worst %6lu us", LAT_STAGE_NAMES[s],
+		         (unsigned long) lat.mean(st), (unsigned long) lat.percentile(st, 50), (unsigned long) lat.percentile(st, 95),
+		         (unsigned long) lat.worst(st));
+		TEST_MESSAGE(line);
+	}
+	//foot switch to ack at the latest: SD-card, rendering, all frames and the round trip
+	TEST_ASSERT_LESS_OR_EQUAL_UINT32(12000 + 1100 + REPLAY_FRAMES * 1200 + 9000, lat.worst(LAT_ACK));
+	lat.Export();
+}
+
+void test_foreign_frames()  //frames of other memory writes and of an older upload do not complete a switch
+{
+	host_us = 5001;  //odd: stage time stamps are odd (0 means "not reached")
+	lat.Sent(UPLOAD_MSG_ID + 3, true);  //no switch measured
+	lat.Begin(host_us);
+	host_us += 100;
+	lat.Sent(UPLOAD_MSG_ID + 7, true);  //older upload still in the queue (before LAT_BUILD)
+	lat.Acked(UPLOAD_MSG_ID + 7);
+	TEST_ASSERT_TRUE(lat.active());
+	lat.Mark(LAT_DECODE);
+	lat.Mark(LAT_BUILD);
+	lat.Sent(UPLOAD_MSG_ID + PATCH_FRAMES_MAX, true);  //not an upload frame
+	lat.Acked(UPLOAD_MSG_ID + PATCH_FRAMES_MAX);
+	TEST_ASSERT_TRUE(lat.active());
+	host_us += 1000;
+	lat.Sent(UPLOAD_MSG_ID, false);
+	host_us += 1000;
+	lat.Sent(UPLOAD_MSG_ID + 1, true);
+	host_us += 4000;
+	lat.Acked(UPLOAD_MSG_ID + 1);
+	TEST_ASSERT_FALSE(lat.active());
+	TEST_ASSERT_EQUAL_UINT32(1, lat.count());
+	TEST_ASSERT_EQUAL_UINT32(6100, lat.worst(LAT_ACK));
+}
+
+int main()
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_replay);
+	RUN_TEST(test_foreign_frames);
+	return UNITY_END();
+}
@@ -0,0 +1,139 @@
+# THR30II Pedal - bake captured symbol tables into flash
+#
+# Turns captured symbol table dumps (symtab/symtab_<firmware>.bin, exactly the
+# cache files the pedal writes to its SD card) into src/BakedSymbols.h.
+# For every firmware the raw dump, the key->offset array and the name-sorted
+# key index are emitted as const tables, so SymbolTable can use them from
+# flash without any heap and without waiting for the dump from the THRII.
+#
+# Used as PlatformIO pre-script (see platformio.ini) or standalone:
+#   python tools/bake_symbols.py
+
+import os
+import struct
+import sys
+
+MAGIC = 0x53524854     # "THRS", see SYMCACHE_MAGIC in THR30II_Pedal.cpp
+VERSION = 1            # see SYMCACHE_VERSION
+HEADER = struct.Struct("<IHHIII")
+
+
+def read_dump(path):
+    """returns (firmware, raw dump) of a cache file or None, if it is not valid"""
+    with open(path, "rb") as f:
+        blob = f.read()
+    if len(blob) < HEADER.size:
+        return None
+    magic, version, _, firmware, length, checksum = HEADER.unpack_from(blob)
+    raw = blob[HEADER.size:HEADER.size + length]
+    if magic != MAGIC or version != VERSION or len(raw) != length or length > 0xFFFF:
+        return None
+    h = 2166136261
+    for b in raw:
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+    if h != checksum:
+        return None
+    return firmware, raw
+
+
+def index_dump(raw):
+    """same layout rules as SymbolTable::adopt(): returns (offsets, sorted keys)"""
+    raw = raw[:-1] + b"\0"
+    count = struct.unpack_from("<I", raw)[0]
+    p = 12 * count + 8
+    offsets = []
+    names = []
+    for _ in range(count):
+        if p >= len(raw):
+            break
+        end = raw.index(b"\0", p)
+        offsets.append(p)
+        names.append(raw[p:end])
+        p = end + 1
+    order = sorted(range(len(names)), key=lambda k: names[k])  # stable, bytewise like strcmp
+    return raw, offsets, order
+
+
+def c_array(ctype, name, values, per_line):
+    lines = ["const %s %s[] PROGMEM = {" % (ctype, name)]
+    for i in range(0, len(values), per_line):
+        lines.append("\t" + ", ".join(values[i:i + per_line]) + ",")
+    lines.append("};")
+    return "\n".join(lines)
+
+
+def bake(project_dir):
+    src_dir = os.path.join(project_dir, "symtab")
+    out_path = os.path.join(project_dir, "src", "BakedSymbols.h")
+
+    tables = {}
+    if os.path.isdir(src_dir):
+        for fn in sorted(os.listdir(src_dir)):
+            if not fn.lower().endswith(".bin"):
+                continue
+            res = read_dump(os.path.join(src_dir, fn))
+            if res is None:
+                print("bake_symbols: skipping invalid dump %s" % fn)
+                continue
+            tables[res[0]] = res[1]
+
+    out = []
+    out.append("/*THR30II Pedal using Teensy 3.6")
+    out.append("* Martin Zwerschke 04/2021")
+    out.append("*")
+    out.append("* BakedSymbols.h")
+    out.append("* GENERATED by tools/bake_symbols.py from the .bin files in symtab/ - do not edit")
+    out.append("*/")
+    out.append("")
+    out.append("#ifndef _BAKEDSYMBOLS_H_")
+    out.append("#define _BAKEDSYMBOLS_H_")
+    out.append("")
+    out.append("#include <Arduino.h>")
+    out.append("")
+    out.append("struct BakedSymbolTable   //symbol table of one firmware version, stored in flash")
+    out.append("{")
+    out.append("\tuint32_t firmware;")
+    out.append("\tconst byte *dump;        //raw symbol table dump")
+    out.append("\tuint16_t len;            //length of the dump")
+    out.append("\tuint16_t count;          //number of symbols")
+    out.append("\tconst uint16_t *offset;  //key -> position of the name in the dump")
+    out.append("\tconst uint16_t *sorted;  //keys in ascending strcmp() order of their names")
+    out.append("};")
+    out.append("")
+
+    entries = []
+    for fw in sorted(tables):
+        raw, offsets, order = index_dump(tables[fw])
+        tag = "%08x" % fw
+        out.append(c_array("byte", "baked_dump_" + tag, ["0x%02x" % b for b in raw], 16))
+        out.append(c_array("uint16_t", "baked_offset_" + tag, [str(o) for o in offsets], 16))
+        out.append(c_array("uint16_t", "baked_sorted_" + tag, [str(k) for k in order], 16))
+        out.append("")
+        entries.append("\t{ 0x%s, baked_dump_%s, %d, %d, baked_offset_%s, baked_sorted_%s }," %
+                       (tag, tag, len(raw), len(offsets), tag, tag))
+
+    entries.append("\t{ 0x00000000, nullptr, 0, 0, nullptr, nullptr }  //end marker")
+    out.append("const BakedSymbolTable baked_symtabs[] =")
+    out.append("{")
+    out.extend(entries)
+    out.append("};")
+    out.append("")
+    out.append("#endif")
+    text = "\r\n".join(out) + "\r\n"
+
+    old = None
+    if os.path.exists(out_path):
+        with open(out_path, "rb") as f:
+            old = f.read().decode("ascii", "replace")
+    if old != text:  # do not touch the file (and trigger a rebuild), if nothing changed
+        with open(out_path, "wb") as f:
+            f.write(text.encode("ascii"))
+    print("bake_symbols: %d firmware symbol table(s) baked" % len(tables))
+
+
+try:
+    Import("env")  # noqa: F821  (PlatformIO / SCons)
+    bake(env.subst("$PROJECT_DIR"))  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        bake(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
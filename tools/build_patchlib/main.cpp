@@ -0,0 +1,291 @@
+/*THR30II Pedal using Teensy 3.6
+* Martin Zwerschke 04/2021
+*
+* tools/build_patchlib/main.cpp
+*  Builds the patch library on the PC from a folder of .thrl6p patches (as exported by THR Remote):
+*    <out>/patches.txt     the valid patches concatenated ({...}{...}...), see PATCH_FILE
+*    <out>/patches.thrlib  the binary library, see PATCHLIB_FILE and PatchLibrary.h
+*  The pedal then does not need to compile the library at boot.
+*
+*  It is built from the firmware's own modules on the host stubs of test/host, so a patch is accepted exactly,
+*  if the pedal accepts it: split like PatchScanner, parsed through PatchFilter(), decoded by DecodePatch() and
+*  rendered into upload frames by renderPatch(). The library is written by PatchLibrary::compile().
+*  The files are checked on a pool of threads, errors and timing are reported per patch.
+*
+*    pio run -e patchlib   (or g++ -std=gnu++17 -pthread -I test/host -I src with the modules of [env:patchlib] and ArduinoJson 6)
+*    .pio/build/patchlib/program <folder with .thrl6p files> [-o <out folder>] [-j <threads>] [-v]
+*/
+
+#include <Arduino.h>
+#include <SD.h>
+#include <ArduinoJson.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "THR30II.h"
+#include "PatchLibrary.h"
+#include "PatchFixtures.h"  //symbol table with all names the model resolves, apply_patch(), read_file()
+
+struct PatchResult
+{
+	std::string file;
+	std::string record;          //the patch's {} block
+	THR30II_Patch pat;
+	uint8_t frames = 0;          //upload frames rendered from it
+	std::vector<std::string> errors;
+	double us = 0;
+};
+
+static std::mutex render_lock;   //renderPatch() looks up the static token map of the model
+
+//Everything the pedal does with a patch from the library, before it is uploaded to THR
+static void check_patch(PatchResult &r)
+{
+	auto t0 = std::chrono::steady_clock::now();
+	std::string text = read_file(r.file);
+
+	PatchScanner scanner;  //same block rules as on SD-card
+	uint32_t blocks = 0, beg = 0;
+	for(size_t pos = 0; pos < text.size(); )
+	{
+		bool found = false;
+		pos += scanner.feed((const uint8_t *) text.data() + pos, text.size() - pos, (uint32_t) pos, found);
+		if(found && blocks++ == 0)
+		{
+			uint32_t end = 0;
+			scanner.block(beg, end);
+			r.record = text.substr(beg, end - beg);
+		}
+	}
+	if(text.empty() || blocks != 1 || scanner.error())
+	{
+		r.errors.push_back(text.empty() ? "not readable or empty" : scanner.error() ? "unbalanced '}'" : std::to_string(blocks) + " top level {} blocks (expected 1)");
+	}
+	else
+	{
+		static thread_local DynamicJsonDocument doc(16384);  //PATCH_DOC_SIZE is for the 32 bit Teensy
+		DeserializationError dse = deserializeJson(doc, r.record.c_str(), DeserializationOption::Filter(PatchFilter(true)));
+		THR30II_Patch &pat = r.pat;
+		if(dse != DeserializationError::Ok)
+		{
+			r.errors.push_back(std::string("JSON: ") + dse.c_str());
+		}
+		else if(!THR30II_Settings().DecodePatch(doc, pat))
+		{
+			r.errors.push_back("not decodable");
+		}
+		else
+		{
+			std::lock_guard<std::mutex> lock(render_lock);
+			static THR30II_Settings settings;
+			static THR30II_State initial = settings.Snapshot();
+			static PatchFrames pf;
+			settings.Restore(initial);
+			apply_patch(settings, pat);
+			settings.renderPatch(pf);
+			r.frames = pf.count;
+			if(pf.count <= 1)
+			{
+				r.errors.push_back("upload does not fit into the frame buffer");
+			}
+		}
+	}
+	r.us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+}
+
+//Hints, that do not reject a patch (the pedal uses it the same way)
+static std::vector<std::string> warnings(const PatchResult &r)
+{
+	std::vector<std::string> w;
+	const THR30II_Patch &pat = r.pat;
+	if(strlen(pat.name) == 0)
+	{
+		w.push_back("no name");
+	}
+	else if(strlen(pat.name) == PATCH_NAME_LEN && r.record.find(std::string("\"") + pat.name + "\"") == std::string::npos)
+	{
+		w.push_back("name is cut to " + std::to_string(PATCH_NAME_LEN) + " bytes");
+	}
+	const char *unknown[] = { pat.col < 0 ? "amp" : nullptr, pat.effecttype < 0 ? "effect" : nullptr,
+	                          pat.echotype < 0 ? "echo" : nullptr, pat.reverbtype < 0 ? "reverb" : nullptr };
+	for(const char *u : unknown)
+	{
+		if(u != nullptr)
+		{
+			w.push_back(std::string("unknown ") + u + " asset (the actual one is kept)");
+		}
+	}
+	if(!THR30II_Settings::IsComplete(pat))
+	{
+		std::string missing;
+		uint8_t n = 0;
+		for(uint8_t i = 0; i < P_COUNT; i++)
+		{
+			const param_def &d = THR30II_PARAMS[i];
+			if((d.json[0] == '\0' && d.enc != ENC_ENUM) || pat.has.test(i))
+			{
+				continue;
+			}
+			std::string where = d.enc == ENC_ENUM ? "THRGroupCab SpkSimType" : std::string(THR30II_JSON_GROUPS[d.unit]);
+			if(d.type >= 0)  //as DecodePatch() looks it up
+			{
+				uint16_t tk = d.unit == EFFECT ? THR30II_EFF_TYPES_VALS[d.type].key : d.unit == ECHO ? THR30II_ECHO_TYPES_VALS[d.type].key : THR30II_REV_TYPES_VALS[d.type].key;
+				const char *asset = Constants::glo.name(tk);
+				where += std::string("/") + (asset != nullptr ? asset : "?");
+			}
+			missing += (n++ > 0 ? ", " : "") + where + (d.enc == ENC_ENUM ? "" : std::string(" ") + d.json);
+		}
+		w.push_back(std::to_string(n) + " settings missing, the pedal keeps their actual values: " + missing);
+	}
+	return w;
+}
+
+static int build(const char *folder, const char *out, unsigned jobs, bool verbose)
+{
+	Serial.quiet = true;  //only the tool's own report
+	THR30II_Settings settings;
+	if(!load_fixture_symbols(settings))
+	{
+		printf("build_patchlib: symbol table could not be built\n");
+		return 1;
+	}
+	PatchFilter(true);  //built once, before the threads share it
+
+	std::vector<PatchResult> results;
+	if(DIR *d = opendir(folder))
+	{
+		while(dirent *e = readdir(d))
+		{
+			std::string fn = e->d_name;
+			if(fn.size() > 7 && strcasecmp(fn.c_str() + fn.size() - 7, ".thrl6p") == 0)
+			{
+				results.emplace_back();
+				results.back().file = std::string(folder) + "/" + fn;
+			}
+		}
+		closedir(d);
+	}
+	if(results.empty())
+	{
+		printf("build_patchlib: no .thrl6p files in %s\n", folder);
+		return 1;
+	}
+	std::sort(results.begin(), results.end(), [](const PatchResult &a, const PatchResult &b) { return a.file < b.file; });
+
+	auto t0 = std::chrono::steady_clock::now();
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> pool;
+	for(unsigned j = 0; j < jobs; j++)
+	{
+		pool.emplace_back([&results, &next]
+		{
+			for(size_t i; (i = next++) < results.size(); )
+			{
+				check_patch(results[i]);
+			}
+		});
+	}
+	for(std::thread &t : pool)
+	{
+		t.join();
+	}
+	double checkMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+	std::string source;
+	uint16_t failed = 0;
+	size_t bytes = 0;
+	double worst = 0, sum = 0;
+	for(const PatchResult &r : results)
+	{
+		const char *fn = r.file.c_str() + r.file.find_last_of('/') + 1;
+		for(const std::string &e : r.errors)
+		{
+			printf("  %s: error: %s\n", fn, e.c_str());
+		}
+		if(verbose && r.errors.empty())
+		{
+			for(const std::string &w : warnings(r))
+			{
+				printf("  %s: warning: %s\n", fn, w.c_str());
+			}
+			printf("  %s: \"%s\", %d bytes, %d upload frames, %.0f us\n", fn, r.pat.name, (int) r.record.size(), r.frames, r.us);
+		}
+		bytes += read_file(r.file).size();
+		sum += r.us;
+		worst = std::max(worst, r.us);
+		if(!r.errors.empty())
+		{
+			failed++;
+			continue;
+		}
+		source += r.record + "\r\n";  //as a compaction on the pedal writes them
+	}
+
+	//the pedal's compile() on the host card (the host gives no file dates, so the library is stamped 0: "built on PC")
+	mkdir(out, 0755);
+	host_sd_root = out;
+	auto t1 = std::chrono::steady_clock::now();
+	File32 f;
+	bool ok = f.open("patches.txt", O_RDWR | O_CREAT | O_TRUNC) && f.write(source.data(), source.size()) == source.size() && f.sync();
+	f.close();
+	ok = ok && PatchLibrary::compile("patches.txt", "patches.thrlib");
+	PatchLibrary lib;
+	ok = ok && lib.open("patches.thrlib") && lib.size() == results.size() - failed;
+	lib.close();
+	SD.remove(JOURNAL_FILE);  //opening made an empty journal and its index, the pedal makes its own
+	SD.remove(JOURNAL_INDEX_FILE);
+	double compileMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t1).count();
+
+	printf("build_patchlib: %d of %d patches ok, %d failed; %.1f KB checked in %.0f ms on %u threads (%.0f KB/s, %.2f ms/patch, slowest %.2f ms)\n",
+	       (int)(results.size() - failed), (int) results.size(), failed, bytes / 1024.0, checkMs, jobs,
+	       bytes / 1024.0 / std::max(checkMs / 1000, 1e-6), sum / 1000 / results.size(), worst / 1000);
+	if(!ok)
+	{
+		printf("build_patchlib: library could not be written to %s\n", out);
+		return 1;
+	}
+	printf("build_patchlib: library compiled in %.0f ms, copy patches.txt and patches.thrlib from %s to the SD card\n", compileMs, out);
+	return failed > 0 ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *folder = nullptr, *out = ".";
+	unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+	bool verbose = false;
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+		{
+			out = argv[++i];
+		}
+		else if(strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+		{
+			jobs = std::max(1, atoi(argv[++i]));
+		}
+		else if(strcmp(argv[i], "-v") == 0)
+		{
+			verbose = true;
+		}
+		else if(folder == nullptr && argv[i][0] != '-')
+		{
+			folder = argv[i];
+		}
+		else
+		{
+			folder = nullptr;
+			break;
+		}
+	}
+	if(folder == nullptr)
+	{
+		printf("Validates .thrl6p patches and builds the pedal's patch library\n"
+		       "usage: build_patchlib <folder with .thrl6p files> [-o <out folder>] [-j <threads>] [-v (warnings and timing of each patch)]\n");
+		return 2;
+	}
+	return build(folder, out, jobs, verbose);
+}